@@ -6,6 +6,7 @@ QT += core qml quick quickcontrols2 widgets
 TARGET = qtglviddemo
 
 SOURCES += \
+	src/base/Settings.cpp \
 	src/base/SystemStats.cpp \
 	src/base/Utility.cpp \
 	src/base/FifoWatch.cpp \
@@ -16,24 +17,37 @@ SOURCES += \
 	src/mesh/SphereMesh.cpp \
 	src/mesh/TorusMesh.cpp \
 	src/mesh/Mesh.cpp \
+	src/scene/FrameArrivalAggregator.cpp \
+	src/scene/FramePrefetcher.cpp \
+	src/scene/FrameUploadThread.cpp \
 	src/scene/GLResources.cpp \
+	src/scene/SharedVideoStream.cpp \
 	src/scene/Transform.cpp \
 	src/scene/Camera.cpp \
 	src/scene/Arcball.cpp \
 	src/scene/VideoObjectModel.cpp \
 	src/scene/VideoObjectItem.cpp \
+	src/scene/VsyncPredictor.cpp \
+	src/player/DecodedFrameCache.cpp \
 	src/player/GStreamerPlayer.cpp \
 	src/player/GStreamerMediaSample.cpp \
 	src/player/GStreamerVideoRenderer.cpp \
 	src/player/GStreamerSignalDispatcher.cpp \
+	src/player/PlayerPipelinePool.cpp \
 	src/main/Application.cpp \
 	src/main/main.cpp \
+	src/videomaterial/MappedPixelBufferPool.cpp \
+	src/videomaterial/ShaderProgramBinaryCache.cpp \
+	src/videomaterial/TexturePool.cpp \
 	src/videomaterial/VideoMaterial.cpp \
+	src/videomaterial/VideoTextureArray.cpp \
 	src/videomaterial/VideoMaterialProviderGeneric.cpp
 
 HEADERS += \
 	src/base/ScopeGuard.hpp \
+	src/base/TripleBuffer.hpp \
 	src/base/VideoInputDevicesModel.hpp \
+	src/base/Settings.hpp \
 	src/base/SystemStats.hpp \
 	src/base/FifoWatch.hpp \
 	src/base/Utility.hpp \
@@ -44,18 +58,29 @@ HEADERS += \
 	src/mesh/CubeMesh.hpp \
 	src/mesh/QuadMesh.hpp \
 	src/scene/Arcball.hpp \
+	src/scene/FrameArrivalAggregator.hpp \
+	src/scene/FramePrefetcher.hpp \
+	src/scene/FrameUploadThread.hpp \
 	src/scene/GLResources.hpp \
+	src/scene/SharedVideoStream.hpp \
 	src/scene/VideoObjectItem.hpp \
+	src/scene/VsyncPredictor.hpp \
 	src/scene/Camera.hpp \
 	src/scene/Transform.hpp \
 	src/scene/VideoObjectModel.hpp \
+	src/player/DecodedFrameCache.hpp \
 	src/player/GStreamerVideoRenderer.hpp \
 	src/player/GStreamerPlayer.hpp \
 	src/player/GStreamerMediaSample.hpp \
 	src/player/GStreamerSignalDispatcher.hpp \
+	src/player/PlayerPipelinePool.hpp \
 	src/player/GStreamerCommon.hpp \
 	src/main/Application.hpp \
+	src/videomaterial/MappedPixelBufferPool.hpp \
+	src/videomaterial/ShaderProgramBinaryCache.hpp \
+	src/videomaterial/TexturePool.hpp \
 	src/videomaterial/VideoMaterial.hpp \
+	src/videomaterial/VideoTextureArray.hpp \
 	src/videomaterial/VideoMaterialProviderGeneric.hpp
 
 
@@ -75,6 +100,24 @@ useImxV4L2 {
 	DEFINES += USE_IMX_V4L2
 }
 
+gstgl {
+	DEFINES += WITH_GST_GL
+	PKGCONFIG += gstreamer-gl-1.0
+	# eglGetCurrentDisplay() is needed for wrapping EGL based Qt contexts.
+	packagesExist(egl) {
+		PKGCONFIG += egl
+	}
+	SOURCES += src/videomaterial/VideoMaterialProviderGLMemory.cpp
+	HEADERS += src/videomaterial/VideoMaterialProviderGLMemory.hpp
+}
+
+dmabuf {
+	DEFINES += WITH_DMABUF
+	PKGCONFIG += gstreamer-allocators-1.0 egl
+	SOURCES += src/videomaterial/VideoMaterialProviderDmaBuf.cpp
+	HEADERS += src/videomaterial/VideoMaterialProviderDmaBuf.hpp
+}
+
 vivante {
 	DEFINES += WITH_VIV_GPU
 	SOURCES += src/videomaterial/GLVIVDirectTextureExtension.cpp src/videomaterial/VideoMaterialProviderVivante.cpp
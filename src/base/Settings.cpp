@@ -0,0 +1,128 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include "Settings.hpp"
+
+
+namespace qtglviddemo
+{
+
+
+Settings::Settings()
+	: m_uploadMode(UploadMode::Direct)
+	, m_videoMaterialProviderType(VideoMaterialProviderType::Auto)
+	, m_renderMode(RenderMode::FramebufferObject)
+	, m_threadedUpload(false)
+	, m_visibilityThrottling(true)
+	, m_framePacing(false)
+	, m_decodedFrameCacheBudget(0)
+	, m_numSparePlayerPipelines(2)
+	, m_playerPipelineIdleTimeout(30)
+	, m_seamlessUrlSwitching(true)
+	, m_lowLatencyCapture(true)
+{
+}
+
+
+Settings & Settings::instance()
+{
+	static Settings settings;
+	return settings;
+}
+
+
+QString toString(Settings::UploadMode const p_uploadMode)
+{
+	switch (p_uploadMode)
+	{
+		case Settings::UploadMode::Direct: return "direct";
+		case Settings::UploadMode::PixelBufferObjects: return "pbo";
+		case Settings::UploadMode::PersistentPixelBuffers: return "persistentpbo";
+		default: assert(false);
+	}
+
+	return "";
+}
+
+
+bool fromString(QString const &p_string, Settings::UploadMode &p_uploadMode)
+{
+	if      (p_string == "direct")        p_uploadMode = Settings::UploadMode::Direct;
+	else if (p_string == "pbo")           p_uploadMode = Settings::UploadMode::PixelBufferObjects;
+	else if (p_string == "persistentpbo") p_uploadMode = Settings::UploadMode::PersistentPixelBuffers;
+	else return false;
+
+	return true;
+}
+
+
+QString toString(Settings::VideoMaterialProviderType const p_type)
+{
+	switch (p_type)
+	{
+		case Settings::VideoMaterialProviderType::Auto: return "auto";
+		case Settings::VideoMaterialProviderType::Generic: return "generic";
+		case Settings::VideoMaterialProviderType::GLMemory: return "glmemory";
+		case Settings::VideoMaterialProviderType::DmaBuf: return "dmabuf";
+		default: assert(false);
+	}
+
+	return "";
+}
+
+
+bool fromString(QString const &p_string, Settings::VideoMaterialProviderType &p_type)
+{
+	if      (p_string == "auto")     p_type = Settings::VideoMaterialProviderType::Auto;
+	else if (p_string == "generic")  p_type = Settings::VideoMaterialProviderType::Generic;
+	else if (p_string == "glmemory") p_type = Settings::VideoMaterialProviderType::GLMemory;
+	else if (p_string == "dmabuf")   p_type = Settings::VideoMaterialProviderType::DmaBuf;
+	else return false;
+
+	return true;
+}
+
+
+QString toString(Settings::RenderMode const p_renderMode)
+{
+	switch (p_renderMode)
+	{
+		case Settings::RenderMode::FramebufferObject: return "fbo";
+		case Settings::RenderMode::SceneGraph: return "scenegraph";
+		case Settings::RenderMode::BatchedSceneGraph: return "batched";
+		default: assert(false);
+	}
+
+	return "";
+}
+
+
+bool fromString(QString const &p_string, Settings::RenderMode &p_renderMode)
+{
+	if      (p_string == "fbo")        p_renderMode = Settings::RenderMode::FramebufferObject;
+	else if (p_string == "scenegraph") p_renderMode = Settings::RenderMode::SceneGraph;
+	else if (p_string == "batched")    p_renderMode = Settings::RenderMode::BatchedSceneGraph;
+	else return false;
+
+	return true;
+}
+
+
+} // namespace qtglviddemo end
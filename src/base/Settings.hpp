@@ -0,0 +1,215 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_SETTINGS_HPP
+#define QTGLVIDDEMO_SETTINGS_HPP
+
+#include <QString>
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Global application settings.
+ *
+ * These settings affect how video frames are transported and rendered.
+ * They are read from the configuration file by the Application class
+ * before the QML user interface is loaded. After that, they must not be
+ * modified anymore, since they are accessed by the render thread without
+ * any synchronization.
+ */
+struct Settings
+{
+	/**
+	 * How video frame pixels are uploaded into textures by providers
+	 * that copy pixels (see VideoMaterialProviderGeneric).
+	 */
+	enum class UploadMode
+	{
+		/// Pixels are passed to glTexSubImage2D() directly.
+		Direct,
+		/**
+		 * Pixels are copied into a ring of pixel buffer objects, and
+		 * glTexSubImage2D() sources the pixels from the PBO. This
+		 * lets the GPU transfer the pixels asynchronously.
+		 */
+		PixelBufferObjects,
+		/**
+		 * Upstream elements write frames directly into persistently
+		 * mapped pixel buffer objects, and glTexSubImage2D() sources
+		 * the pixels from these. The CPU does not copy the pixels.
+		 */
+		PersistentPixelBuffers
+	};
+
+	/**
+	 * Which video material provider to use.
+	 */
+	enum class VideoMaterialProviderType
+	{
+		/**
+		 * Pick the most efficient provider that does not need any
+		 * special configuration. That is, use the Vivante provider
+		 * if Vivante direct textures are supported, and the generic
+		 * provider otherwise.
+		 */
+		Auto,
+		/// Always use the generic provider.
+		Generic,
+		/**
+		 * Use the GstGLMemory based provider (only available
+		 * if built with the gstgl feature). If it cannot be
+		 * set up, the Auto behavior is used instead.
+		 */
+		GLMemory,
+		/**
+		 * Use the DMA-BUF import provider (only available
+		 * if built with the dmabuf feature). If DMA-BUF import
+		 * is not supported, the Auto behavior is used instead.
+		 */
+		DmaBuf
+	};
+
+	/**
+	 * How video objects are integrated into the QtQuick 2 scenegraph.
+	 */
+	enum class RenderMode
+	{
+		/**
+		 * Each video object is rendered into its own framebuffer
+		 * object, which the scenegraph then draws as a textured quad.
+		 */
+		FramebufferObject,
+		/**
+		 * Each video object is drawn directly into the window by
+		 * a QSGRenderNode, without an intermediate framebuffer
+		 * object. This requires Qt 5.8 or newer.
+		 */
+		SceneGraph,
+		/**
+		 * Like SceneGraph, except that all video objects are drawn
+		 * together by the first of their render nodes, sorted by
+		 * shader program and mesh, so the per-object state setup
+		 * is done only once per shader program and mesh. Objects
+		 * with compatible frames are drawn with instanced draw calls
+		 * if the video material provider supports it.
+		 */
+		BatchedSceneGraph
+	};
+
+	/// Constructor. Initializes all settings with their default values.
+	Settings();
+
+	/// Upload mode to use. Default is UploadMode::Direct.
+	UploadMode m_uploadMode;
+	/// Video material provider to use. Default is VideoMaterialProviderType::Auto.
+	VideoMaterialProviderType m_videoMaterialProviderType;
+	/// Render mode to use. Default is RenderMode::FramebufferObject.
+	RenderMode m_renderMode;
+	/**
+	 * If true, frames are uploaded by one FrameUploadThread per video
+	 * object instead of by the render thread, provided that the video
+	 * material provider and the OpenGL implementation support this.
+	 * Default is false.
+	 */
+	bool m_threadedUpload;
+	/**
+	 * If true, players of video objects that are barely visible decode
+	 * fewer frames, or are paused (see GStreamerPlayer::DecodingTier).
+	 * Default is true.
+	 */
+	bool m_visibilityThrottling;
+	/**
+	 * If true, players queue decoded frames, and the renderers pick
+	 * the frame whose display time best matches the next vsync (see
+	 * GStreamerPlayer::setFramePacing()). Not used together with
+	 * threaded uploads. Default is false.
+	 */
+	bool m_framePacing;
+	/**
+	 * Memory budget of the decoded frame cache, in MiB. Looping clips
+	 * whose decoded frames fit into it are decoded only once (see
+	 * DecodedFrameCache). 0 disables the cache. Default is 0.
+	 */
+	unsigned int m_decodedFrameCacheBudget;
+	/**
+	 * Number of idle player pipelines that are kept ready for video
+	 * objects that start playback (see PlayerPipelinePool). Default is 2.
+	 */
+	unsigned int m_numSparePlayerPipelines;
+	/**
+	 * How long player pipelines beyond the spare ones are kept once
+	 * they became idle, in seconds. Default is 30.
+	 */
+	unsigned int m_playerPipelineIdleTimeout;
+	/**
+	 * If true, video objects whose URL changes keep showing the previous
+	 * stream until the first frame of the new one is ready (see
+	 * VideoObjectItem::setUrl()). Not used together with threaded
+	 * uploads. Default is true.
+	 */
+	bool m_seamlessUrlSwitching;
+	/**
+	 * If true, V4L2 capture devices are played in low latency mode
+	 * (see GStreamerPlayer::setLowLatencyCapture()), and video objects
+	 * showing them are redrawn as soon as a frame arrives. Default is
+	 * true.
+	 */
+	bool m_lowLatencyCapture;
+
+	/// Returns the global settings instance.
+	static Settings & instance();
+};
+
+
+/// Returns the configuration file string representation of an upload mode.
+QString toString(Settings::UploadMode const p_uploadMode);
+/**
+ * Parses an upload mode string from the configuration file.
+ *
+ * @return true if the string is valid, false otherwise (in
+ *         which case p_uploadMode is not modified).
+ */
+bool fromString(QString const &p_string, Settings::UploadMode &p_uploadMode);
+/// Returns the configuration file string representation of a provider type.
+QString toString(Settings::VideoMaterialProviderType const p_type);
+/**
+ * Parses a video material provider type string from the configuration file.
+ *
+ * @return true if the string is valid, false otherwise (in
+ *         which case p_type is not modified).
+ */
+bool fromString(QString const &p_string, Settings::VideoMaterialProviderType &p_type);
+/// Returns the configuration file string representation of a render mode.
+QString toString(Settings::RenderMode const p_renderMode);
+/**
+ * Parses a render mode string from the configuration file.
+ *
+ * @return true if the string is valid, false otherwise (in
+ *         which case p_renderMode is not modified).
+ */
+bool fromString(QString const &p_string, Settings::RenderMode &p_renderMode);
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -32,6 +32,7 @@ SystemStats::SystemStats()
 	: m_normCpuUsage(0)
 	, m_normMemoryUsage(0)
 	, m_memoryUsage(0)
+	, m_numThreads(0)
 	, m_lastStatIdle(0)
 	, m_lastStatTotal(0)
 {
@@ -74,6 +75,24 @@ void SystemStats::update()
 		m_memoryUsage = usedMemory;
 		m_normMemoryUsage = double(usedMemory) / double(totalMemory);
 	}
+
+	{
+		// Get the number of threads from the "Threads:" line
+		// in /proc/self/status.
+
+		std::ifstream statusFile("/proc/self/status");
+
+		std::string line;
+		while (std::getline(statusFile, line))
+		{
+			if (line.compare(0, 8, "Threads:") != 0)
+				continue;
+
+			std::istringstream sstr(line.substr(8));
+			sstr >> m_numThreads;
+			break;
+		}
+	}
 }
 
 
@@ -95,4 +114,10 @@ std::uint64_t SystemStats::getMemoryUsageInBytes() const
 }
 
 
+int SystemStats::getNumThreads() const
+{
+	return m_numThreads;
+}
+
+
 } // namespace qtglviddemo end
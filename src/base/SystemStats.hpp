@@ -55,10 +55,13 @@ public:
 	float getNormalizedMemoryUsage() const;
 	/// Returns the current memory usage in bytes.
 	std::uint64_t getMemoryUsageInBytes() const;
+	/// Returns the current number of threads of this process.
+	int getNumThreads() const;
 
 private:
 	float m_normCpuUsage, m_normMemoryUsage;
 	std::uint64_t m_memoryUsage;
+	int m_numThreads;
 	int m_lastStatIdle, m_lastStatTotal;
 };
 
@@ -0,0 +1,148 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_TRIPLE_BUFFER_HPP
+#define QTGLVIDDEMO_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Lock-free single-producer single-consumer triple buffer.
+ *
+ * The buffer consists of three slots. At any time, one slot belongs to
+ * the producer (the "back" slot), one to the consumer (the "front" slot),
+ * and the third one (the "middle" slot) holds the most recently published
+ * value. The producer fills its slot and then publishes it, which swaps
+ * it with the middle slot. The consumer takes the middle slot by swapping
+ * it with its own slot. Both swaps are one atomic exchange each, so
+ * neither side ever blocks the other. If the producer publishes several
+ * times before the consumer takes a value, only the newest value is
+ * kept; the older ones end up in the producer's slot and are overwritten
+ * by the next write.
+ *
+ * Only one thread may act as producer and only one thread may act as
+ * consumer at the same time. The slots are never destroyed or recreated
+ * by the buffer, only swapped, so T must be default constructible, and
+ * values that were replaced linger in their slots until overwritten.
+ */
+template < typename T >
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: m_middle(1)
+		, m_back(0)
+		, m_front(2)
+	{
+	}
+
+	TripleBuffer(TripleBuffer const &) = delete;
+	TripleBuffer& operator = (TripleBuffer const &) = delete;
+
+	/**
+	 * Returns the slot the producer writes into.
+	 *
+	 * Only the producer thread may call this.
+	 */
+	T & getBackSlot()
+	{
+		return m_slots[m_back];
+	}
+
+	/**
+	 * Publishes the back slot.
+	 *
+	 * Afterwards, the back slot is the one that was the middle slot
+	 * previously. If the consumer did not take the middle slot's
+	 * value, that value is therefore now in the back slot.
+	 *
+	 * Only the producer thread may call this.
+	 *
+	 * @return true if the previously published value was not taken
+	 *         by the consumer, and is now in the back slot.
+	 */
+	bool publish()
+	{
+		unsigned int previous = m_middle.exchange(m_back | NewValueFlag, std::memory_order_acq_rel);
+		m_back = previous & IndexMask;
+		return (previous & NewValueFlag) != 0;
+	}
+
+	/**
+	 * Takes the most recently published value, if there is one.
+	 *
+	 * If a value was published since the last call, the front slot
+	 * is swapped with the middle slot, so that the front slot then
+	 * contains that value.
+	 *
+	 * Only the consumer thread may call this.
+	 *
+	 * @return true if the front slot now contains a newly
+	 *         published value.
+	 */
+	bool consume()
+	{
+		// Cheap check first, so that polling without new
+		// values does not need a read-modify-write operation.
+		if ((m_middle.load(std::memory_order_relaxed) & NewValueFlag) == 0)
+			return false;
+
+		unsigned int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = previous & IndexMask;
+		return true;
+	}
+
+	/**
+	 * Returns the slot the consumer reads from.
+	 *
+	 * Only the consumer thread may call this.
+	 */
+	T & getFrontSlot()
+	{
+		return m_slots[m_front];
+	}
+
+
+private:
+	enum : unsigned int
+	{
+		IndexMask = 0x3,
+		NewValueFlag = 0x4
+	};
+
+	T m_slots[3];
+	// Index of the middle slot, plus the NewValueFlag bit that is
+	// set if the middle slot was published but not consumed yet.
+	std::atomic < unsigned int > m_middle;
+	// Only accessed by the producer.
+	unsigned int m_back;
+	// Only accessed by the consumer.
+	unsigned int m_front;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -28,6 +28,10 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QCommandLineParser>
+#include "base/Settings.hpp"
+#include "player/DecodedFrameCache.hpp"
+#include "player/PlayerPipelinePool.hpp"
+#include "scene/FrameArrivalAggregator.hpp"
 #include "scene/GLResources.hpp"
 #include "Application.hpp"
 
@@ -99,6 +103,12 @@ bool Application::prepare()
 {
 	loadConfiguration();
 
+	// Configure the player pipeline pool before the first video object
+	// exists. The spare pipelines are created once the event loop runs.
+	PlayerPipelinePool &pipelinePool = PlayerPipelinePool::instance();
+	pipelinePool.setNumSparePipelines(Settings::instance().m_numSparePlayerPipelines);
+	pipelinePool.setIdleTimeout(int(Settings::instance().m_playerPipelineIdleTimeout) * 1000);
+
 	// Load the QML from our resources.
 	m_engine.load(QUrl("qrc:/UserInterface.qml"));
 	if (m_engine.rootObjects().empty())
@@ -183,14 +193,33 @@ QString Application::getSystemStats() const
 		dur = m_renderingDuration;
 	}
 
+	FrameArrivalAggregator const &aggregator = FrameArrivalAggregator::instance();
+	DecodedFrameCache const &decodedFrameCache = DecodedFrameCache::instance();
+	PlayerPipelinePool const &pipelinePool = PlayerPipelinePool::instance();
+
 	m_systemStats.update();
-	return QString("CPU %1%<br>memory %2% (%3 kB)<br>%4 ms render time (%5 FPS)")
-	       .arg(int(m_systemStats.getNormalizedCpuUsage() * 100.0f))
-	       .arg(int(m_systemStats.getNormalizedMemoryUsage() * 100.0f))
-	       .arg(m_systemStats.getMemoryUsageInBytes() / 1024)
-	       .arg(double(dur) / double(GST_MSECOND), 0, 'f', 2)
-	       .arg(double(GST_SECOND) / double(dur), 0, 'f', 1)
-	       ;
+	QString stats = QString("CPU %1%<br>memory %2% (%3 kB)<br>%4 ms render time (%5 FPS)<br>%6 of %7 frame wakeups saved<br>%8 threads, %9 player pipelines (%10 idle)")
+	                .arg(int(m_systemStats.getNormalizedCpuUsage() * 100.0f))
+	                .arg(int(m_systemStats.getNormalizedMemoryUsage() * 100.0f))
+	                .arg(m_systemStats.getMemoryUsageInBytes() / 1024)
+	                .arg(double(dur) / double(GST_MSECOND), 0, 'f', 2)
+	                .arg(double(GST_SECOND) / double(dur), 0, 'f', 1)
+	                .arg(aggregator.getNumWakeupsSaved())
+	                .arg(aggregator.getNumFrameArrivals())
+	                .arg(m_systemStats.getNumThreads())
+	                .arg(pipelinePool.getNumPipelines())
+	                .arg(pipelinePool.getNumIdlePipelines())
+	                ;
+
+	if (decodedFrameCache.isEnabled())
+	{
+		stats += QString("<br>%1 of %2 kB frame cache used")
+		         .arg(decodedFrameCache.getUsedBytes() / 1024)
+		         .arg(decodedFrameCache.getBudget() / 1024)
+		         ;
+	}
+
+	return stats;
 }
 
 
@@ -429,6 +458,129 @@ void Application::loadConfiguration()
 	else
 		qCDebug(lcQtGLVidDemo) << "FIFO path not found in configuration";
 
+	// Check the frame upload mode.
+	auto uploadModeIter = jsonObject.find("uploadMode");
+	if ((uploadModeIter != jsonObject.end()) && uploadModeIter->isString())
+	{
+		if (fromString(uploadModeIter->toString(), Settings::instance().m_uploadMode))
+			qCDebug(lcQtGLVidDemo) << "Using upload mode" << uploadModeIter->toString();
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid upload mode" << uploadModeIter->toString() << "in configuration";
+	}
+
+	// Check what video material provider to use.
+	auto videoMaterialProviderIter = jsonObject.find("videoMaterialProvider");
+	if ((videoMaterialProviderIter != jsonObject.end()) && videoMaterialProviderIter->isString())
+	{
+		if (fromString(videoMaterialProviderIter->toString(), Settings::instance().m_videoMaterialProviderType))
+			qCDebug(lcQtGLVidDemo) << "Using video material provider type" << videoMaterialProviderIter->toString();
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid video material provider type" << videoMaterialProviderIter->toString() << "in configuration";
+	}
+
+	// Check how video objects are integrated into the scenegraph.
+	auto renderModeIter = jsonObject.find("renderMode");
+	if ((renderModeIter != jsonObject.end()) && renderModeIter->isString())
+	{
+		if (fromString(renderModeIter->toString(), Settings::instance().m_renderMode))
+			qCDebug(lcQtGLVidDemo) << "Using render mode" << renderModeIter->toString();
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid render mode" << renderModeIter->toString() << "in configuration";
+	}
+#if QT_VERSION < QT_VERSION_CHECK(5, 8, 0)
+	// QSGRenderNode, which the scenegraph render modes are based on,
+	// was introduced in Qt 5.8.
+	if (Settings::instance().m_renderMode != Settings::RenderMode::FramebufferObject)
+	{
+		qCWarning(lcQtGLVidDemo) << "Scenegraph render modes require Qt 5.8 or newer; using FBO render mode instead";
+		Settings::instance().m_renderMode = Settings::RenderMode::FramebufferObject;
+	}
+#endif
+
+	// Check if frames shall be uploaded in separate threads.
+	auto threadedUploadIter = jsonObject.find("threadedUpload");
+	if ((threadedUploadIter != jsonObject.end()) && threadedUploadIter->isBool())
+	{
+		Settings::instance().m_threadedUpload = threadedUploadIter->toBool();
+		qCDebug(lcQtGLVidDemo) << "Threaded upload" << (Settings::instance().m_threadedUpload ? "enabled" : "disabled");
+	}
+
+	// Check if players of barely visible items shall decode less.
+	auto visibilityThrottlingIter = jsonObject.find("visibilityThrottling");
+	if ((visibilityThrottlingIter != jsonObject.end()) && visibilityThrottlingIter->isBool())
+	{
+		Settings::instance().m_visibilityThrottling = visibilityThrottlingIter->toBool();
+		qCDebug(lcQtGLVidDemo) << "Visibility throttling" << (Settings::instance().m_visibilityThrottling ? "enabled" : "disabled");
+	}
+
+	// Check if frames shall be paced against the display's vsyncs.
+	auto framePacingIter = jsonObject.find("framePacing");
+	if ((framePacingIter != jsonObject.end()) && framePacingIter->isBool())
+	{
+		Settings::instance().m_framePacing = framePacingIter->toBool();
+		qCDebug(lcQtGLVidDemo) << "Frame pacing" << (Settings::instance().m_framePacing ? "enabled" : "disabled");
+	}
+
+	// Check how much memory the decoded frames of looping clips may use.
+	auto decodedFrameCacheBudgetIter = jsonObject.find("decodedFrameCacheBudget");
+	if ((decodedFrameCacheBudgetIter != jsonObject.end()) && decodedFrameCacheBudgetIter->isDouble())
+	{
+		int budget = decodedFrameCacheBudgetIter->toInt(-1);
+		if (budget >= 0)
+		{
+			Settings::instance().m_decodedFrameCacheBudget = budget;
+			DecodedFrameCache::instance().setBudget(std::size_t(budget) * 1024 * 1024);
+			qCDebug(lcQtGLVidDemo) << "Using decoded frame cache budget of" << budget << "MiB";
+		}
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid decoded frame cache budget" << decodedFrameCacheBudgetIter->toDouble() << "in configuration";
+	}
+
+	// Check how many idle player pipelines shall be kept ready.
+	auto numSparePlayerPipelinesIter = jsonObject.find("numSparePlayerPipelines");
+	if ((numSparePlayerPipelinesIter != jsonObject.end()) && numSparePlayerPipelinesIter->isDouble())
+	{
+		int numSparePipelines = numSparePlayerPipelinesIter->toInt(-1);
+		if (numSparePipelines >= 0)
+		{
+			Settings::instance().m_numSparePlayerPipelines = numSparePipelines;
+			qCDebug(lcQtGLVidDemo) << "Keeping" << numSparePipelines << "spare player pipelines";
+		}
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid number of spare player pipelines" << numSparePlayerPipelinesIter->toDouble() << "in configuration";
+	}
+
+	// Check how long surplus idle player pipelines shall be kept.
+	auto playerPipelineIdleTimeoutIter = jsonObject.find("playerPipelineIdleTimeout");
+	if ((playerPipelineIdleTimeoutIter != jsonObject.end()) && playerPipelineIdleTimeoutIter->isDouble())
+	{
+		int idleTimeout = playerPipelineIdleTimeoutIter->toInt(-1);
+		if (idleTimeout >= 0)
+		{
+			Settings::instance().m_playerPipelineIdleTimeout = idleTimeout;
+			qCDebug(lcQtGLVidDemo) << "Destroying surplus idle player pipelines after" << idleTimeout << "seconds";
+		}
+		else
+			qCWarning(lcQtGLVidDemo) << "Invalid player pipeline idle timeout" << playerPipelineIdleTimeoutIter->toDouble() << "in configuration";
+	}
+
+	// Check if video objects shall keep showing their previous
+	// stream until the stream of their new URL is ready.
+	auto seamlessUrlSwitchingIter = jsonObject.find("seamlessUrlSwitching");
+	if ((seamlessUrlSwitchingIter != jsonObject.end()) && seamlessUrlSwitchingIter->isBool())
+	{
+		Settings::instance().m_seamlessUrlSwitching = seamlessUrlSwitchingIter->toBool();
+		qCDebug(lcQtGLVidDemo) << "Seamless URL switching" << (Settings::instance().m_seamlessUrlSwitching ? "enabled" : "disabled");
+	}
+
+	// Check if capture devices shall be played with low latency.
+	auto lowLatencyCaptureIter = jsonObject.find("lowLatencyCapture");
+	if ((lowLatencyCaptureIter != jsonObject.end()) && lowLatencyCaptureIter->isBool())
+	{
+		Settings::instance().m_lowLatencyCapture = lowLatencyCaptureIter->toBool();
+		qCDebug(lcQtGLVidDemo) << "Low latency capture" << (Settings::instance().m_lowLatencyCapture ? "enabled" : "disabled");
+	}
+
 	// Check splashscreen settings.
 	auto splashscreenIter = jsonObject.find("splashscreen");
 	if ((splashscreenIter != jsonObject.end()) && splashscreenIter->isObject())
@@ -519,6 +671,18 @@ void Application::saveConfiguration()
 		jsonObject["deviceNodeNameMap"] = deviceNodeNameArray;
 	}
 
+	jsonObject["uploadMode"] = toString(Settings::instance().m_uploadMode);
+	jsonObject["videoMaterialProvider"] = toString(Settings::instance().m_videoMaterialProviderType);
+	jsonObject["renderMode"] = toString(Settings::instance().m_renderMode);
+	jsonObject["threadedUpload"] = Settings::instance().m_threadedUpload;
+	jsonObject["visibilityThrottling"] = Settings::instance().m_visibilityThrottling;
+	jsonObject["framePacing"] = Settings::instance().m_framePacing;
+	jsonObject["decodedFrameCacheBudget"] = int(Settings::instance().m_decodedFrameCacheBudget);
+	jsonObject["numSparePlayerPipelines"] = int(Settings::instance().m_numSparePlayerPipelines);
+	jsonObject["playerPipelineIdleTimeout"] = int(Settings::instance().m_playerPipelineIdleTimeout);
+	jsonObject["seamlessUrlSwitching"] = Settings::instance().m_seamlessUrlSwitching;
+	jsonObject["lowLatencyCapture"] = Settings::instance().m_lowLatencyCapture;
+
 	if (!m_splashScreenFilename.isEmpty())
 	{
 		QJsonObject splashscreenObject;
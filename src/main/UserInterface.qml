@@ -171,12 +171,24 @@ Window {
 			opacity: objOpacity * PathView.itemOpacity
 			cropRectangle: objCropRectangle
 			textureRotation: objTextureRotation
+			// Items with the same URL share their player, so the
+			// URL is set on the item instead of on the player.
+			// The player is created once the item can start playback.
+			url: objUrl
 
 			// Set the depth value to the Z value from the path view.
 			// This makes sure that the current item is the one at
 			// the front, and that others are placed behind it.
 			z: PathView.itemZ
 
+			// Items that are cached by the path view but not shown
+			// suspend decoding (see the cacheItemCount below).
+			inView: PathView.onPath
+			// Items that are likely to be shown soon preroll their
+			// player and get their first frame uploaded ahead of time.
+			prefetch: itemView.isPrefetchIndex(index)
+			onFirstFrameLatencyChanged: itemView.lastFirstFrameLatency = firstFrameLatency
+
 			// FBO contents use pixel coordinate (0,0) as the top left
 			// corner, while OpenGL rendering uses (0,0) as the
 			// bottom left corner. Mirror the FBO vertically to reconcile
@@ -211,14 +223,24 @@ Window {
 			onRotationChanged: objRotation = rotation
 
 			onCanStartPlayback: {
-				// If playback ends, restart it.
-				player.onEndOfStream.connect(function() { player.play(); });
+				if (player === null)
+					return;
+
+				// If playback ends, start over. The player loops
+				// with segment seeks, so there is no gap in between.
+				player.loop = true;
 
 				// Autostart playback.
-				player.url = objUrl;
 				player.play();
 			}
 
+			// The playback controls need to follow the current
+			// item's player if the item gets a different one.
+			onPlayerChanged: {
+				if (PathView.isCurrentItem)
+					playerConnections.updateConnections();
+			}
+
 			// Create mouse area so users can click on 3D objects to
 			// select them (= making them the current item).
 			MouseArea {
@@ -693,6 +715,69 @@ Window {
 				// with this functionality.
 				interactive: false
 
+				// Direction of the last navigation (1 towards higher
+				// indices, -1 towards lower ones, 0 if unknown) and the
+				// smoothed navigation speed, in items per second. These
+				// decide which items prefetch (see isPrefetchIndex()).
+				property int navigationDirection: 0
+				property real navigationSpeed: 0
+				property int lastIndex: 0
+				property double lastNavigationTime: 0
+				// While navigating, items that are reached within this many
+				// milliseconds are prefetched as well, but at most this many
+				// items beyond the ones that are always prefetched.
+				property int prefetchLookahead: 500
+				property int maxExtraPrefetchedItems: 4
+				// Time from showing an item until its first frame was drawn,
+				// for the item that was shown last. -1 if unknown.
+				property real lastFirstFrameLatency: -1
+
+				// Returns the distance from the current index to itemIndex,
+				// taking the shorter way around (the path wraps around).
+				function getIndexDistance(itemIndex) {
+					var count = model.count;
+					var distance = (itemIndex - currentIndex + count) % count;
+					return (distance > count / 2) ? (distance - count) : distance;
+				}
+
+				// Returns true if the item at itemIndex shall prefetch. These
+				// are the items on the path and the ones right next to it,
+				// which are shown after one step in either direction. While
+				// navigating, the items that are reached soon in the direction
+				// of travel are prefetched as well.
+				function isPrefetchIndex(itemIndex) {
+					if (model.count === 0)
+						return false;
+
+					var distance = getIndexDistance(itemIndex);
+					var nearDistance = Math.floor(pathItemCount / 2) + 1;
+					var farDistance = nearDistance + Math.min(Math.ceil(navigationSpeed * prefetchLookahead / 1000), maxExtraPrefetchedItems);
+
+					if (navigationDirection > 0)
+						return (distance >= -nearDistance) && (distance <= farDistance);
+					else if (navigationDirection < 0)
+						return (distance <= nearDistance) && (distance >= -farDistance);
+					else
+						return Math.abs(distance) <= nearDistance;
+				}
+
+				onCurrentIndexChanged: {
+					var now = Date.now();
+					var steps = (model.count > 0) ? getIndexDistance(lastIndex) : 0;
+					if (steps !== 0) {
+						// getIndexDistance() measures from the
+						// current index, so the sign is inverted.
+						navigationDirection = (steps < 0) ? 1 : -1;
+						// Smooth the speed, so that a single quick step
+						// does not cause a lot of items to prefetch.
+						var elapsed = Math.max(now - lastNavigationTime, 1) / 1000;
+						navigationSpeed = (navigationSpeed + Math.abs(steps) / elapsed) / 2;
+						navigationIdleTimer.restart();
+					}
+					lastIndex = currentIndex;
+					lastNavigationTime = now;
+				}
+
 				// Define a simple path for 3 elements. This path also has
 				// attributes for scaling and opacity, to make non-current
 				// items look smaller and more translucent. Also, the
@@ -721,6 +806,15 @@ Window {
 				}
 			}
 
+			// Navigation is considered to have stopped
+			// once the current index stays the same.
+			Timer {
+				id: navigationIdleTimer
+				interval: 1000
+				repeat: false
+				onTriggered: itemView.navigationSpeed = 0
+			}
+
 			Text {
 				id: subtitle
 				color: "white"
@@ -871,10 +965,22 @@ Window {
 		repeat: true
 		onTriggered: {
 			var curItem = itemView.currentItem;
-			if (curItem === null)
+			if ((curItem === null) || (curItem.player === null))
 				return;
 
 			var stats = getSystemStats();
+			var player = curItem.player;
+			stats += "<br>" + player.skippedFrameCount + " skipped, " + player.duplicateFrameCount + " duplicate, " + player.judderFrameCount + " judder frames";
+			if (player.loopTransitionLatency >= 0)
+				stats += "<br>" + player.loopTransitionLatency.toFixed(2) + " ms loop transition";
+			if (player.playingFromCache)
+				stats += "<br>playing from frame cache";
+			if (itemView.lastFirstFrameLatency >= 0)
+				stats += "<br>" + itemView.lastFirstFrameLatency.toFixed(2) + " ms from showing an item to its first frame";
+			if (curItem.urlSwitchLatency >= 0)
+				stats += "<br>" + curItem.urlSwitchLatency.toFixed(2) + " ms URL switch, " + curItem.urlSwitchGap.toFixed(2) + " ms without new frames";
+			if (curItem.captureLatency >= 0)
+				stats += "<br>" + curItem.captureLatency.toFixed(2) + " ms from capture to swap";
 
 			if (itemView.currentItem.subtitleSourceValue == VideoObjectModel.SystemStatsSubtitles)
 				playerConnections.playbackSubtitle = stats;
@@ -932,7 +1038,7 @@ Window {
 
 		function updateConnections() {
 			var curItem = itemView.currentItem;
-			if (curItem == null) {
+			if ((curItem == null) || (curItem.player == null)) {
 				playerConnections.playbackPosition = 0;
 				playerConnections.playbackDuration = 1;
 				playerConnections.playbackState = GStreamerPlayer.Stopped;
@@ -0,0 +1,321 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <algorithm>
+#include <QDebug>
+#include <QLoggingCategory>
+#include "DecodedFrameCache.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+
+// Recordings whose first frame is further away from the start of
+// the media than this do not cover the whole clip, so they are not
+// usable for looping.
+constexpr GstClockTime MaxClipStartOffset = 100 * GST_MSECOND;
+
+
+} // unnamed namespace end
+
+
+DecodedClip::DecodedClip()
+	: m_duration(0)
+	, m_sizeInBytes(0)
+{
+}
+
+
+DecodedClip::~DecodedClip()
+{
+	for (Frame const &frame : m_frames)
+		gst_sample_unref(frame.m_sample);
+}
+
+
+std::size_t DecodedClip::findFrame(GstClockTime const p_time) const
+{
+	assert(!m_frames.empty());
+
+	// Find the first frame that is past p_time. The one before
+	// it is the frame that is shown at p_time.
+	auto iter = std::upper_bound(m_frames.begin(), m_frames.end(), p_time, [](GstClockTime const p_t, Frame const &p_frame) {
+		return p_t < p_frame.m_timestamp;
+	});
+
+	return (iter == m_frames.begin()) ? 0 : std::size_t(iter - m_frames.begin() - 1);
+}
+
+
+
+
+DecodedFrameCache::DecodedFrameCache()
+	: m_budget(0)
+	, m_usedBytes(0)
+{
+}
+
+
+void DecodedFrameCache::setBudget(std::size_t const p_budget)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	m_budget = p_budget;
+	evict(p_budget);
+}
+
+
+std::size_t DecodedFrameCache::getBudget() const
+{
+	return m_budget;
+}
+
+
+bool DecodedFrameCache::isEnabled() const
+{
+	return m_budget != 0;
+}
+
+
+std::size_t DecodedFrameCache::getUsedBytes() const
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	return m_usedBytes;
+}
+
+
+DecodedClipSPtr DecodedFrameCache::find(QString const &p_key)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	auto iter = std::find_if(m_clips.begin(), m_clips.end(), [&](std::pair < QString, DecodedClipSPtr > const &p_entry) {
+		return p_entry.first == p_key;
+	});
+	if (iter == m_clips.end())
+		return DecodedClipSPtr();
+
+	// Move the clip to the front, since it is now the most recently used one.
+	m_clips.splice(m_clips.begin(), m_clips, iter);
+	return m_clips.front().second;
+}
+
+
+bool DecodedFrameCache::insert(QString const &p_key, DecodedClipSPtr p_clip)
+{
+	assert(p_clip);
+
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	if (p_clip->m_sizeInBytes > m_budget)
+		return false;
+
+	auto iter = std::find_if(m_clips.begin(), m_clips.end(), [&](std::pair < QString, DecodedClipSPtr > const &p_entry) {
+		return p_entry.first == p_key;
+	});
+	if (iter != m_clips.end())
+	{
+		m_usedBytes -= iter->second->m_sizeInBytes;
+		m_clips.erase(iter);
+	}
+
+	// Make room for the new clip before inserting it,
+	// so it is not evicted itself.
+	evict(m_budget - p_clip->m_sizeInBytes);
+
+	qCDebug(lcQtGLVidDemo) << "Caching" << p_clip->m_frames.size() << "decoded frames (" << p_clip->m_sizeInBytes << "bytes) of" << p_key;
+
+	m_usedBytes += p_clip->m_sizeInBytes;
+	m_clips.emplace_front(p_key, std::move(p_clip));
+
+	return true;
+}
+
+
+DecodedFrameCache & DecodedFrameCache::instance()
+{
+	static DecodedFrameCache decodedFrameCache;
+	return decodedFrameCache;
+}
+
+
+void DecodedFrameCache::evict(std::size_t const p_budget)
+{
+	// The mutex must be locked by the caller.
+	while (!m_clips.empty() && (m_usedBytes > p_budget))
+	{
+		qCDebug(lcQtGLVidDemo) << "Evicting decoded frames of" << m_clips.back().first << "from the cache";
+		m_usedBytes -= m_clips.back().second->m_sizeInBytes;
+		m_clips.pop_back();
+	}
+}
+
+
+
+
+DecodedClipRecorder::DecodedClipRecorder()
+	: m_active(false)
+	, m_maxSizeInBytes(0)
+	, m_lastStreamTime(GST_CLOCK_TIME_NONE)
+	, m_lastStreamTimeEnd(GST_CLOCK_TIME_NONE)
+{
+}
+
+
+void DecodedClipRecorder::start(std::size_t const p_maxSizeInBytes)
+{
+	std::shared_ptr < DecodedClip > oldClip;
+
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	oldClip = std::move(m_clip);
+	m_clip = std::make_shared < DecodedClip > ();
+	m_maxSizeInBytes = p_maxSizeInBytes;
+	m_lastStreamTime = GST_CLOCK_TIME_NONE;
+	m_lastStreamTimeEnd = GST_CLOCK_TIME_NONE;
+	m_active = true;
+}
+
+
+void DecodedClipRecorder::abort()
+{
+	std::shared_ptr < DecodedClip > oldClip;
+
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	oldClip = std::move(m_clip);
+	m_active = false;
+}
+
+
+bool DecodedClipRecorder::isActive() const
+{
+	return m_active;
+}
+
+
+void DecodedClipRecorder::addSample(GstSample *p_sample)
+{
+	if (!m_active)
+		return;
+
+	GstBuffer *buffer = gst_sample_get_buffer(p_sample);
+	GstSegment *segment = gst_sample_get_segment(p_sample);
+	if ((buffer == nullptr) || (segment == nullptr) || (segment->format != GST_FORMAT_TIME) || !GST_BUFFER_PTS_IS_VALID(buffer))
+		return;
+
+	GstClockTime streamTime = gst_segment_to_stream_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	if (!GST_CLOCK_TIME_IS_VALID(streamTime))
+		return;
+
+	// Copy the frame, so that the buffer goes back to its pool
+	// once it was consumed. (Otherwise, the cached frames would
+	// starve decoders with a fixed number of buffers.) This is
+	// done without holding the mutex, since the copy is the
+	// most expensive part.
+	GstBuffer *copy = gst_buffer_copy_deep(buffer);
+	std::size_t size = gst_buffer_get_size(copy);
+	GstSample *cachedSample = gst_sample_new(copy, gst_sample_get_caps(p_sample), nullptr, nullptr);
+	gst_buffer_unref(copy);
+
+	DecodedClip::Frame frame = { cachedSample, streamTime };
+
+	// Discarded clips are destroyed after the mutex is unlocked.
+	std::shared_ptr < DecodedClip > discardedClip;
+
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	if (!m_active)
+	{
+		gst_sample_unref(cachedSample);
+		return;
+	}
+
+	// If the position jumped back, the pipeline was seeked, and
+	// the frames recorded so far are not followed by this one.
+	if (!m_clip->m_frames.empty() && (streamTime <= m_lastStreamTime))
+	{
+		discardedClip = std::move(m_clip);
+		m_clip = std::make_shared < DecodedClip > ();
+	}
+
+	if ((m_clip->m_sizeInBytes + size) > m_maxSizeInBytes)
+	{
+		qCDebug(lcQtGLVidDemo) << "Decoded frames exceed the size limit of" << m_maxSizeInBytes << "bytes; not recording them";
+		gst_sample_unref(cachedSample);
+		discardedClip = std::move(m_clip);
+		m_active = false;
+		return;
+	}
+
+	m_clip->m_frames.push_back(frame);
+	m_clip->m_sizeInBytes += size;
+
+	// If the frame has no duration, the end of the clip is estimated
+	// from the time between the last two frames in finish().
+	m_lastStreamTime = streamTime;
+	m_lastStreamTimeEnd = GST_BUFFER_DURATION_IS_VALID(buffer) ? (streamTime + GST_BUFFER_DURATION(buffer)) : GST_CLOCK_TIME_NONE;
+}
+
+
+DecodedClipSPtr DecodedClipRecorder::finish()
+{
+	std::shared_ptr < DecodedClip > clip;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		if (!m_active)
+			return DecodedClipSPtr();
+
+		clip = std::move(m_clip);
+		m_active = false;
+
+		if (clip->m_frames.empty() || (clip->m_frames.front().m_timestamp > MaxClipStartOffset))
+		{
+			qCDebug(lcQtGLVidDemo) << "Recorded frames do not cover the start of the clip; discarding them";
+			return DecodedClipSPtr();
+		}
+
+		std::vector < DecodedClip::Frame > const &frames = clip->m_frames;
+		if (GST_CLOCK_TIME_IS_VALID(m_lastStreamTimeEnd))
+			clip->m_duration = m_lastStreamTimeEnd;
+		else if (frames.size() >= 2)
+			clip->m_duration = m_lastStreamTime + (m_lastStreamTime - frames[frames.size() - 2].m_timestamp);
+	}
+
+	if (clip->m_duration == 0)
+	{
+		qCDebug(lcQtGLVidDemo) << "Could not determine the duration of the recorded frames; discarding them";
+		return DecodedClipSPtr();
+	}
+
+	return clip;
+}
+
+
+} // namespace qtglviddemo end
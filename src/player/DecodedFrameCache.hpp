@@ -0,0 +1,211 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_DECODED_FRAME_CACHE_HPP
+#define QTGLVIDDEMO_DECODED_FRAME_CACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <QString>
+#include <gst/gst.h>
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * All decoded video frames of one pass through a clip.
+ *
+ * The frames are stored as GstSamples whose buffers are deep copies of
+ * the decoded ones, so they do not hold on to buffers from the pipeline's
+ * buffer pools. Clips are immutable once they are complete, and are shared
+ * between all players that play the same URL.
+ */
+struct DecodedClip
+{
+	struct Frame
+	{
+		/// Sample with the frame's buffer and caps. Owned by the clip.
+		GstSample *m_sample;
+		/// Presentation time of the frame, relative to the clip's start.
+		GstClockTime m_timestamp;
+	};
+
+	DecodedClip();
+	/// Destructor. Unrefs the samples of all frames.
+	~DecodedClip();
+
+	DecodedClip(DecodedClip const &) = delete;
+	DecodedClip& operator = (DecodedClip const &) = delete;
+
+	/**
+	 * Returns the index of the frame that is shown at the given time.
+	 *
+	 * This is the last frame whose timestamp is not past p_time. The
+	 * clip must contain at least one frame.
+	 *
+	 * @param p_time Time relative to the clip's start, in nanoseconds.
+	 */
+	std::size_t findFrame(GstClockTime const p_time) const;
+
+	/// Frames, ordered by their timestamps.
+	std::vector < Frame > m_frames;
+	/// Duration of one pass through the clip.
+	GstClockTime m_duration;
+	/// Sum of the sizes of all frame buffers.
+	std::size_t m_sizeInBytes;
+};
+
+typedef std::shared_ptr < DecodedClip const > DecodedClipSPtr;
+
+
+/**
+ * Process-wide cache for the decoded frames of short clips.
+ *
+ * Looping clips that fit into the cache only have to be decoded once.
+ * After the first pass, players serve the following passes from the
+ * cached frames, and stop their pipelines (see GStreamerPlayer). Clips
+ * are looked up by their URL, so players that show the same URL share
+ * one set of frames.
+ *
+ * All clips share one memory budget. If inserting a clip exceeds it, the
+ * least recently used clips are evicted. Players that still play an
+ * evicted clip keep its frames alive until they stop using it, but new
+ * players have to decode the clip again.
+ *
+ * All functions can be called from any thread.
+ */
+class DecodedFrameCache
+{
+public:
+	/**
+	 * Sets the memory budget for all cached frames, in bytes.
+	 *
+	 * A budget of 0 disables the cache and evicts all clips. The
+	 * cache is disabled by default.
+	 */
+	void setBudget(std::size_t const p_budget);
+	std::size_t getBudget() const;
+	/// Returns true if the budget is nonzero.
+	bool isEnabled() const;
+	/// Returns the total size of all cached frames, in bytes.
+	std::size_t getUsedBytes() const;
+
+	/**
+	 * Looks up the clip with the given key.
+	 *
+	 * A found clip becomes the most recently used one.
+	 *
+	 * @return The clip, or null if it is not in the cache.
+	 */
+	DecodedClipSPtr find(QString const &p_key);
+	/**
+	 * Inserts a complete clip into the cache.
+	 *
+	 * An existing clip with the same key is replaced. Afterwards, least
+	 * recently used clips are evicted until the budget is met again.
+	 *
+	 * @return false if the clip is larger than the whole budget, in
+	 *         which case it is not inserted.
+	 */
+	bool insert(QString const &p_key, DecodedClipSPtr p_clip);
+
+	/// Returns the global cache instance.
+	static DecodedFrameCache & instance();
+
+
+private:
+	DecodedFrameCache();
+
+	void evict(std::size_t const p_budget);
+
+	mutable std::mutex m_mutex;
+	std::atomic < std::size_t > m_budget;
+	std::size_t m_usedBytes;
+	// Most recently used clips come first.
+	std::list < std::pair < QString, DecodedClipSPtr > > m_clips;
+};
+
+
+/**
+ * Records the frames of one pass through a clip during playback.
+ *
+ * The player starts the recorder before playback starts. The video renderer
+ * then passes every decoded frame to addSample() in its streaming thread.
+ * Once the player is notified that the end of the clip was reached, it
+ * calls finish() to get the complete clip.
+ *
+ * Recording restarts whenever the stream position jumps back (after a
+ * flushing seek, for example), and is aborted once the frames exceed the
+ * size limit.
+ */
+class DecodedClipRecorder
+{
+public:
+	DecodedClipRecorder();
+
+	/**
+	 * Starts a new recording, discarding any previous one.
+	 *
+	 * @param p_maxSizeInBytes Size limit for the recorded frames.
+	 */
+	void start(std::size_t const p_maxSizeInBytes);
+	/// Discards the current recording.
+	void abort();
+	/// Returns true if a recording is in progress.
+	bool isActive() const;
+	/**
+	 * Adds a decoded frame to the recording.
+	 *
+	 * This does nothing if no recording is in progress. The sample
+	 * is not modified; its buffer is copied.
+	 */
+	void addSample(GstSample *p_sample);
+	/**
+	 * Ends the recording and returns the recorded clip.
+	 *
+	 * The clip is only returned if it covers the media from the
+	 * start. Otherwise, or if no recording is in progress, this
+	 * returns null.
+	 */
+	DecodedClipSPtr finish();
+
+
+private:
+	std::mutex m_mutex;
+	std::atomic < bool > m_active;
+	std::size_t m_maxSizeInBytes;
+	std::shared_ptr < DecodedClip > m_clip;
+	// Stream time of the frame that was recorded last, and the end
+	// of its display duration.
+	GstClockTime m_lastStreamTime;
+	GstClockTime m_lastStreamTimeEnd;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
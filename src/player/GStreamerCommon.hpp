@@ -21,6 +21,7 @@
 #define QTGLVIDDEMO_GSTREAMER_COMMON_HPP
 
 #include <functional>
+#include <gst/gst.h>
 
 
 namespace qtglviddemo
@@ -28,6 +29,20 @@ namespace qtglviddemo
 
 
 typedef std::function < void() > NewVideoFrameAvailableCB;
+/**
+ * Function object that creates a buffer pool to propose to upstream
+ * elements. It returns null if no pool shall be proposed; otherwise,
+ * the caller owns the returned reference. This is called from a
+ * GStreamer streaming thread.
+ */
+typedef std::function < GstBufferPool*() > BufferPoolFactory;
+/**
+ * Function object that is invoked with every decoded video frame before
+ * it is handed over to the consumer. This is called from a GStreamer
+ * streaming thread. The sample must not be modified, and has to be
+ * ref'd if it is kept.
+ */
+typedef std::function < void(GstSample *) > SampleObserver;
 
 
 } // namespace qtglviddemo end
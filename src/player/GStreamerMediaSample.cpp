@@ -27,6 +27,7 @@ namespace qtglviddemo
 GStreamerMediaSample::GStreamerMediaSample(GstSample *p_sample, bool p_sampleHasNewCaps)
 	: m_sample(p_sample)
 	, m_sampleHasNewCaps(p_sampleHasNewCaps)
+	, m_captureTime(GST_CLOCK_TIME_NONE)
 {
 }
 
@@ -34,6 +35,7 @@ GStreamerMediaSample::GStreamerMediaSample(GstSample *p_sample, bool p_sampleHas
 GStreamerMediaSample::GStreamerMediaSample(GStreamerMediaSample && p_other)
 	: m_sample(p_other.m_sample)
 	, m_sampleHasNewCaps(p_other.m_sampleHasNewCaps)
+	, m_captureTime(p_other.m_captureTime)
 {
 	// Mark the other instance as moved
 	p_other.m_sample = nullptr;
@@ -55,6 +57,7 @@ GStreamerMediaSample& GStreamerMediaSample::operator = (GStreamerMediaSample &&
 
 	m_sample = p_other.m_sample;
 	m_sampleHasNewCaps = p_other.m_sampleHasNewCaps;
+	m_captureTime = p_other.m_captureTime;
 
 	// Mark the other instance as moved
 	p_other.m_sample = nullptr;
@@ -75,4 +78,16 @@ bool GStreamerMediaSample::sampleHasNewCaps() const
 }
 
 
+void GStreamerMediaSample::setCaptureTime(GstClockTime const p_captureTime)
+{
+	m_captureTime = p_captureTime;
+}
+
+
+GstClockTime GStreamerMediaSample::getCaptureTime() const
+{
+	return m_captureTime;
+}
+
+
 } // namespace qtglviddemo end
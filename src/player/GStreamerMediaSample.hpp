@@ -85,9 +85,20 @@ public:
 	 */
 	bool sampleHasNewCaps() const;
 
+	/**
+	 * Sets the time at which the sample's video frame was captured, in
+	 * nanoseconds of the monotonic clock (the one used by
+	 * g_get_monotonic_time()). This is only known for frames of live
+	 * capture devices (see GStreamerPlayer::setLowLatencyCapture()).
+	 */
+	void setCaptureTime(GstClockTime const p_captureTime);
+	/// Returns the capture time, or GST_CLOCK_TIME_NONE if it is unknown.
+	GstClockTime getCaptureTime() const;
+
 private:
 	GstSample *m_sample;
 	bool m_sampleHasNewCaps;
+	GstClockTime m_captureTime;
 };
 
 
@@ -18,7 +18,9 @@
 
 
 #include <assert.h>
+#include <algorithm>
 #include <gst/app/gstappsink.h>
+#include <gst/base/gstbasesrc.h>
 #include <QTextDocumentFragment>
 #include <QDebug>
 #include <QLoggingCategory>
@@ -37,37 +39,284 @@ namespace qtglviddemo
 {
 
 
+namespace
+{
+
+
+// How long the requested frame size limit must remain unchanged
+// before it is applied, in milliseconds.
+constexpr int MaxVideoSizeSettleTime = 500;
+
+// Frame size limits are rounded up to multiples of this value.
+constexpr int MaxVideoSizeGranularity = 64;
+
+
+// Minimum time between frames with the ReducedRate decoding tier.
+constexpr GstClockTime ReducedRateFrameInterval = GST_SECOND / 10;
+
+// Minimum difference between two position updates while frames
+// are served from the decoded frame cache, in milliseconds.
+constexpr int CachedPlaybackPositionInterval = 100;
+
+
+int roundUpMaxVideoSizeExtent(int const p_extent)
+{
+	return (p_extent + MaxVideoSizeGranularity - 1) / MaxVideoSizeGranularity * MaxVideoSizeGranularity;
+}
+
+
+GstClockTime getMonotonicTime()
+{
+	return GstClockTime(g_get_monotonic_time()) * GST_USECOND;
+}
+
+
+bool isLiveCaptureUrl(QUrl const &p_url)
+{
+	// These are the URLs VideoObjectModel::addV4L2DeviceNode() creates.
+	QString scheme = p_url.scheme();
+	return (scheme == "v4l2") || (scheme == "imxv4l2");
+}
+
+
+// Limits of a queue before it was set up for low latency. These are
+// attached to the queue, so they can be restored once the pipeline
+// is used for other media.
+struct QueueLimits
+{
+	gint m_leaky;
+	guint m_maxSizeBuffers;
+	guint m_maxSizeBytes;
+	guint64 m_maxSizeTime;
+};
+
+char const QueueLimitsKey[] = "qtglviddemo-original-queue-limits";
+
+
+bool isQueue(GstElement *p_element)
+{
+	GstElementFactory *factory = gst_element_get_factory(p_element);
+	return (factory != nullptr) && (g_strcmp0(GST_OBJECT_NAME(factory), "queue") == 0);
+}
+
+
+void setLowLatencyQueueLimits(GstElement *p_queue, bool const p_lowLatency)
+{
+	GObject *queue = G_OBJECT(p_queue);
+	QueueLimits *originalLimits = reinterpret_cast < QueueLimits* > (g_object_get_data(queue, QueueLimitsKey));
+
+	if (p_lowLatency && (originalLimits == nullptr))
+	{
+		originalLimits = new QueueLimits;
+		g_object_get(queue, "leaky", &(originalLimits->m_leaky), "max-size-buffers", &(originalLimits->m_maxSizeBuffers), "max-size-bytes", &(originalLimits->m_maxSizeBytes), "max-size-time", &(originalLimits->m_maxSizeTime), nullptr);
+		g_object_set_data_full(queue, QueueLimitsKey, originalLimits, [](gpointer p_data) { delete reinterpret_cast < QueueLimits* > (p_data); });
+
+		// Hold only one frame, and drop the older frame
+		// if a newer one arrives while the queue is full.
+		gst_util_set_object_arg(queue, "leaky", "downstream");
+		g_object_set(queue, "max-size-buffers", guint(1), "max-size-bytes", guint(0), "max-size-time", guint64(0), nullptr);
+
+		qCDebug(lcQtGLVidDemo) << "Set up queue" << GST_ELEMENT_NAME(p_queue) << "for low latency";
+	}
+	else if (!p_lowLatency && (originalLimits != nullptr))
+	{
+		g_object_set(queue, "leaky", originalLimits->m_leaky, "max-size-buffers", originalLimits->m_maxSizeBuffers, "max-size-bytes", originalLimits->m_maxSizeBytes, "max-size-time", originalLimits->m_maxSizeTime, nullptr);
+		// This also deletes the original limits.
+		g_object_set_data(queue, QueueLimitsKey, nullptr);
+	}
+}
+
+
+void setLowLatencyQueueLimitsInBin(GstElement *p_bin, bool const p_lowLatency)
+{
+	GstIterator *iterator = gst_bin_iterate_recurse(GST_BIN(p_bin));
+	GValue item = G_VALUE_INIT;
+	bool done = false;
+
+	while (!done)
+	{
+		switch (gst_iterator_next(iterator, &item))
+		{
+			case GST_ITERATOR_OK:
+			{
+				GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+				if (isQueue(element))
+					setLowLatencyQueueLimits(element, p_lowLatency);
+				g_value_reset(&item);
+				break;
+			}
+
+			case GST_ITERATOR_RESYNC:
+				// Elements that were already visited are
+				// visited again, which is harmless here.
+				gst_iterator_resync(iterator);
+				break;
+
+			default:
+				done = true;
+				break;
+		}
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(iterator);
+}
+
+
+} // unnamed namespace end
+
+
+struct GStreamerPlayer::SegmentDoneTarget
+{
+	std::mutex m_mutex;
+	// Set to null once the player released the pipeline.
+	GStreamerPlayer *m_player;
+};
+
+
 GStreamerPlayer::GStreamerPlayer(NewVideoFrameAvailableCB p_newVideoFrameAvailableCB, QObject *p_parent)
 	: QObject(p_parent)
 	, m_gstplayer(nullptr)
 	, m_gstdispatcher(nullptr)
 	, m_gstvidrenderer(nullptr)
 	, m_subtitleAppsink(nullptr)
+	, m_elementSetupHandlerId(0)
+	, m_queueSetupHandlerId(0)
+	, m_segmentDoneHandlerId(0)
+	, m_sinkCaps(nullptr)
+	, m_numHeldBuffers(0)
+	, m_preferDmaBuf(false)
+	, m_framePacing(false)
+	, m_lowLatencyCapture(false)
+	, m_sinkCapsFeature(nullptr)
 	, m_state(State::Stopped)
-	, m_lastSampleCaps(nullptr)
+	, m_position(-1)
+	, m_decodingTier(DecodingTier::Full)
+	, m_playRequested(false)
+	, m_preroll(false)
+	, m_prerolled(false)
+	, m_keyframeTrickModeActive(false)
+	, m_loop(false)
+	, m_segmentLoopActive(false)
+	, m_loopTransitionLatency(-1.0)
+	, m_newVideoFrameAvailableCB(std::move(p_newVideoFrameAvailableCB))
+	, m_playingFromCache(false)
+	, m_cachedPlaybackStartTime(0)
+	, m_cachedPlaybackPausePosition(GST_CLOCK_TIME_NONE)
+	, m_cachedPlaybackLoop(false)
+	, m_servedFrameIndex(0)
+	, m_consumedCaps(nullptr)
+{
+	// Set up the timers for serving frames from the decoded frame cache.
+	m_cacheSwitchTimer.setSingleShot(true);
+	m_cacheSwitchTimer.setTimerType(Qt::PreciseTimer);
+	connect(&m_cacheSwitchTimer, &QTimer::timeout, this, &GStreamerPlayer::switchToCachedPlayback);
+	m_cachedPlaybackTimer.setSingleShot(true);
+	m_cachedPlaybackTimer.setTimerType(Qt::PreciseTimer);
+	connect(&m_cachedPlaybackTimer, &QTimer::timeout, this, &GStreamerPlayer::onCachedPlaybackTimer);
+
+	// Set up the timer for delayed frame size limit changes.
+	m_maxVideoSizeTimer.setSingleShot(true);
+	m_maxVideoSizeTimer.setInterval(MaxVideoSizeSettleTime);
+	connect(&m_maxVideoSizeTimer, &QTimer::timeout, this, &GStreamerPlayer::applyMaxVideoSize);
+
+	// The GstPlayer pipeline is acquired once playback starts.
+}
+
+
+GStreamerPlayer::~GStreamerPlayer()
+{
+	// Stop the pipeline and hand it back to the pool. This also
+	// disconnects all of its signals to make sure they don't try
+	// to invoke callbacks related to this GStreamerPlayer instance.
+	releasePipeline();
+
+	if (m_sinkCaps != nullptr)
+		gst_caps_unref(m_sinkCaps);
+	for (GstContext *context : m_videoSinkContexts)
+		gst_context_unref(context);
+
+	if (m_consumedCaps != nullptr)
+		gst_caps_unref(m_consumedCaps);
+}
+
+
+void GStreamerPlayer::acquirePipeline()
 {
-	// Set up the core GstPlayer instance. Create the associated signal
-	// dispatcher and video renderer and pass them to the GstPlayer.
-	m_gstdispatcher = createGStreamerSignalDispatcher(this);
-	m_gstvidrenderer = createGStreamerVideoRenderer(std::move(p_newVideoFrameAvailableCB));
-	m_gstplayer = gst_player_new(m_gstvidrenderer, m_gstdispatcher);
+	if (m_pipeline)
+		return;
+
+	PlayerPipelineUPtr pipeline = PlayerPipelinePool::instance().acquire();
+	GstPlayerVideoRenderer *vidrenderer = pipeline->m_gstvidrenderer;
+
+	// The pipeline may have been used by another player before, so
+	// apply this player's video output configuration. This is done
+	// before the pipeline is made visible to other threads. (Contexts
+	// cannot be removed from the renderer, but all players use the
+	// same ones anyway.)
+	setGStreamerVideoRendererSinkCaps(vidrenderer, m_sinkCaps);
+	for (GstContext *context : m_videoSinkContexts)
+		setGStreamerVideoRendererContext(vidrenderer, context);
+	setGStreamerVideoRendererBufferPoolFactory(vidrenderer, m_bufferPoolFactory, m_numHeldBuffers);
+	setGStreamerVideoRendererFramePacing(vidrenderer, m_framePacing && !isLiveCapture());
+	setGStreamerVideoRendererLowLatency(vidrenderer, isLiveCapture());
+	setGStreamerVideoRendererNewVideoFrameAvailableCB(vidrenderer, m_newVideoFrameAvailableCB);
+
+	// Let the recorder see all decoded frames, so it can record
+	// the first pass of looping media for the decoded frame cache.
+	setGStreamerVideoRendererSampleObserver(vidrenderer, [this](GstSample *p_sample) {
+		m_clipRecorder.addSample(p_sample);
+	});
+
+	// Signals that the previous user of the pipeline did not get
+	// yet are not meant for this player.
+	discardPendingGStreamerSignals(pipeline->m_gstdispatcher);
+
+	{
+		std::lock_guard < std::mutex > lock(m_pipelineMutex);
+		m_pipeline = std::move(pipeline);
+		m_gstplayer = m_pipeline->m_gstplayer;
+		m_gstdispatcher = m_pipeline->m_gstdispatcher;
+		m_gstvidrenderer = m_pipeline->m_gstvidrenderer;
+		m_subtitleAppsink = m_pipeline->m_subtitleAppsink;
+	}
+
+	qCDebug(lcQtGLVidDemo) << "Player" << this << "acquired a pipeline";
 
-	// Set up the subtitle appsink.
-	m_subtitleAppsink = gst_element_factory_make("appsink", "subtitleAppsink");
 	// Create and connect the GLib signal callback for new subtitles.
 	GstFlowReturn (*newSubtitleSampleCB)(GstElement *, gpointer) = [](GstElement *, gpointer p_userData) -> GstFlowReturn {
 		return reinterpret_cast < GStreamerPlayer* > (p_userData)->onNewSubtitleSample();
 	};
 	g_signal_connect(G_OBJECT(m_subtitleAppsink), "new-sample", G_CALLBACK(newSubtitleSampleCB), this);
-	// appsink does not emit signals by default, so we need to enable it.
-	gst_app_sink_set_emit_signals(GST_APP_SINK(m_subtitleAppsink), TRUE);
 
-	// There is currently no GstPlayer API to set the subtitle sink, so we
-	// have to manually do that by acquiring a reference to the GstPlayer's
-	// playbin and setting its text-sink property. playbin takes ownership
-	// over the subtitle appsink; we don't have to worry about unref'ing it.
+	// Segment seek based looping needs to know when the end of the
+	// segment is reached. GstPlayer does not forward segment-done
+	// messages, so listen for them on the pipeline's bus. Sync messages
+	// are emitted in the thread that posted them, so the rest of the
+	// handling is done in the main Qt thread with a queued invocation.
+	// The invocation is posted with the target's mutex locked, so once
+	// releasePipeline() detached the target, no invocation is being
+	// posted anymore, and the ones that were posted are discarded by
+	// Qt if the player is destroyed.
+	m_segmentDoneTarget = std::make_shared < SegmentDoneTarget > ();
+	m_segmentDoneTarget->m_player = this;
+
 	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
-	g_object_set(G_OBJECT(playbin), "text-sink", m_subtitleAppsink, "flags", gint(0x55), nullptr);
+	GstBus *bus = gst_element_get_bus(playbin);
+	gst_bus_enable_sync_message_emission(bus);
+	void (*segmentDoneCB)(GstBus *, GstMessage *, gpointer) = [](GstBus *, GstMessage *, gpointer p_userData) {
+		SegmentDoneTarget &target = **reinterpret_cast < std::shared_ptr < SegmentDoneTarget > * > (p_userData);
+		std::lock_guard < std::mutex > lock(target.m_mutex);
+		if (target.m_player != nullptr)
+			QMetaObject::invokeMethod(target.m_player, "onSegmentDone", Qt::QueuedConnection, Q_ARG(qint64, g_get_monotonic_time()));
+	};
+	// The handler holds its own reference to the target, which
+	// is released once the handler is disconnected.
+	void (*destroyTargetCB)(gpointer, GClosure *) = [](gpointer p_userData, GClosure *) {
+		delete reinterpret_cast < std::shared_ptr < SegmentDoneTarget > * > (p_userData);
+	};
+	m_segmentDoneHandlerId = g_signal_connect_data(G_OBJECT(bus), "sync-message::segment-done", G_CALLBACK(segmentDoneCB), new std::shared_ptr < SegmentDoneTarget > (m_segmentDoneTarget), destroyTargetCB, GConnectFlags(0));
+	gst_object_unref(GST_OBJECT(bus));
 	gst_object_unref(GST_OBJECT(playbin));
 
 	// Connect the GstPlayer signals. These are emitted from the main Qt
@@ -83,47 +332,92 @@ GStreamerPlayer::GStreamerPlayer(NewVideoFrameAvailableCB p_newVideoFrameAvailab
 		nullptr
 	);
 
-	// Enable video and subtitle tracks, but disable audio, since at this
-	// moment we do not care for audio output.
-	gst_player_set_video_track_enabled(m_gstplayer, true);
-	gst_player_set_audio_track_enabled(m_gstplayer, false);
-	gst_player_set_subtitle_track_enabled(m_gstplayer, true);
+	updateElementSetupHandler();
+
+	// The pipeline may still have queues that were set up for low
+	// latency by its previous user, or may need them for this player.
+	GstElement *pipelineBin = gst_player_get_pipeline(m_gstplayer);
+	setLowLatencyQueueLimitsInBin(pipelineBin, isLiveCapture());
+	gst_object_unref(GST_OBJECT(pipelineBin));
+
+	// A new pipeline starts with a regular segment, so only frame
+	// throttling applies until the state change handler requests
+	// keyframe-only decoding.
+	setFrameThrottling((m_decodingTier == DecodingTier::ReducedRate) || (m_decodingTier == DecodingTier::KeyframesOnly));
+
+	QByteArray urlCStr = m_url.toString().toUtf8();
+	gst_player_set_uri(m_gstplayer, m_url.isEmpty() ? nullptr : urlCStr.data());
 }
 
 
-GStreamerPlayer::~GStreamerPlayer()
+void GStreamerPlayer::releasePipeline()
 {
-	// Stop the GstPlayer to make sure no new GLib signal emissions
-	// are dispatched. Also disconnect all of its signals to make sure
-	// they don't try to invoke callbacks related to this GStreamerPlayer
-	// instance.
-	// Stopping the GstPlayer also sets an internal flag that makes sure
-	// any signals that were queued by the dispatcher and might still be
-	// in the Qt event loop won't do anything.
-	if (m_gstplayer != nullptr)
+	if (!m_pipeline)
+		return;
+
+	qCDebug(lcQtGLVidDemo) << "Player" << this << "releases its pipeline";
+
+	gst_player_stop(m_gstplayer);
+	g_signal_handlers_disconnect_by_data(m_gstplayer, this);
+	g_signal_handlers_disconnect_by_data(m_subtitleAppsink, this);
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+
+	if (m_elementSetupHandlerId != 0)
+	{
+		g_signal_handler_disconnect(G_OBJECT(playbin), m_elementSetupHandlerId);
+		m_elementSetupHandlerId = 0;
+	}
+
+	if (m_queueSetupHandlerId != 0)
 	{
-		qCDebug(lcQtGLVidDemo) << "Stopping gstplayer and disconnecting GLib signals";
-		gst_player_stop(m_gstplayer);
-		g_signal_handlers_disconnect_by_data(m_gstplayer, this);
+		g_signal_handler_disconnect(G_OBJECT(playbin), m_queueSetupHandlerId);
+		m_queueSetupHandlerId = 0;
 	}
 
-	// Unref the GstPlayer.
-	// Note that this may not always destroy the gstplayer instance right
-	// away. If there is an unemitted signal in the event loop remaining,
-	// then the gstplayer is destroyed once this signal is torn down,
-	// because these signals hold references to the gstplayer. (The signals
-	// are marshaled into the event loop by GStreamerSignalDispatcher.)
-	// But this is okay, since there are no adverse effects of a lingering
-	// gstplayer instance.
-	if (m_gstplayer != nullptr)
+	GstBus *bus = gst_element_get_bus(playbin);
+	g_signal_handler_disconnect(G_OBJECT(bus), m_segmentDoneHandlerId);
+	m_segmentDoneHandlerId = 0;
+	gst_bus_disable_sync_message_emission(bus);
+	gst_object_unref(GST_OBJECT(bus));
+
+	// Disconnecting does not wait for handler invocations that are
+	// running in streaming threads, so detach the target as well.
 	{
-		qCDebug(lcQtGLVidDemo) << "Unref'ing gstplayer";
-		gst_object_unref(GST_OBJECT(m_gstplayer));
+		std::lock_guard < std::mutex > lock(m_segmentDoneTarget->m_mutex);
+		m_segmentDoneTarget->m_player = nullptr;
 	}
+	m_segmentDoneTarget.reset();
+
+	gst_object_unref(GST_OBJECT(playbin));
+
+	// Once these calls return, the streaming threads do not invoke
+	// this player's callbacks anymore, even though the pipeline may
+	// still be running. Setting the pipeline to the NULL state waits
+	// for the streaming threads, so it is left to the pool, which does
+	// that in its teardown thread instead of blocking the caller.
+	setGStreamerVideoRendererSampleObserver(m_gstvidrenderer, SampleObserver());
+	setGStreamerVideoRendererNewVideoFrameAvailableCB(m_gstvidrenderer, NewVideoFrameAvailableCB());
+	setGStreamerVideoRendererBufferPoolFactory(m_gstvidrenderer, BufferPoolFactory(), 0);
 
-	// Unref any lingering last sample caps.
-	if (m_lastSampleCaps != nullptr)
-		gst_caps_unref(m_lastSampleCaps);
+	PlayerPipelineUPtr pipeline;
+
+	{
+		std::lock_guard < std::mutex > lock(m_pipelineMutex);
+		pipeline = std::move(m_pipeline);
+		m_gstplayer = nullptr;
+		m_gstdispatcher = nullptr;
+		m_gstvidrenderer = nullptr;
+		m_subtitleAppsink = nullptr;
+	}
+
+	// GstPlayer does not report the pipeline's state changes to this
+	// player anymore, so reset what its Stopped state would reset.
+	m_keyframeTrickModeActive = false;
+	m_segmentLoopActive = false;
+	m_prerolled = false;
+
+	PlayerPipelinePool::instance().release(std::move(pipeline));
 }
 
 
@@ -132,9 +426,27 @@ void GStreamerPlayer::setUrl(QUrl p_url)
 	if (m_url != p_url)
 	{
 		m_url = std::move(p_url);
+		m_position = -1;
+
+		// GstPlayer stops the pipeline when the URL changes.
+		cancelCacheSwitch();
+		m_clipRecorder.abort();
+
+		// Without a pipeline, the URL is passed on once one is acquired.
+		if (m_gstplayer != nullptr)
+		{
+			QByteArray urlCStr = m_url.toString().toUtf8();
+			gst_player_set_uri(m_gstplayer, urlCStr.data());
 
-		QByteArray urlCStr = m_url.toString().toUtf8();
-		gst_player_set_uri(m_gstplayer, urlCStr.data());
+			// The new media may or may not be a capture device.
+			applyLowLatencyCapture();
+
+			// Preroll the new media as well.
+			if (m_prerolled)
+				gst_player_pause(m_gstplayer);
+		}
+		else if (m_preroll)
+			preroll();
 
 		emit urlChanged();
 	}
@@ -155,13 +467,24 @@ GStreamerPlayer::State GStreamerPlayer::getState() const
 
 int GStreamerPlayer::getPosition() const
 {
-	GstClockTime pos = gst_player_get_position(m_gstplayer);
-	return GST_CLOCK_TIME_IS_VALID(pos) ? int(pos / GST_MSECOND) : int(-1);
+	// Don't call gst_player_get_position() here, since it queries
+	// the pipeline synchronously, and this is called often by QML
+	// bindings. Use the position that GstPlayer reported instead.
+	return m_position;
 }
 
 
 int GStreamerPlayer::getDuration() const
 {
+	if (m_playingFromCache)
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		return std::max(int(m_cachedClip->m_duration / GST_MSECOND), 1);
+	}
+
+	if (m_gstplayer == nullptr)
+		return -1;
+
 	GstClockTime dur = gst_player_get_duration(m_gstplayer);
 	// Use std::max() to avoid fringe cases where a duration of than 1 ms length is reported.
 	return GST_CLOCK_TIME_IS_VALID(dur) ? std::max(int(dur / GST_MSECOND), 1) : int(-1);
@@ -170,6 +493,11 @@ int GStreamerPlayer::getDuration() const
 
 bool GStreamerPlayer::isSeekable() const
 {
+	// Cached frames can be served from any position. (The pipeline
+	// is released during cached playback, so check this first.)
+	if (m_playingFromCache)
+		return true;
+
 	if (m_gstplayer == nullptr)
 		return false;
 
@@ -190,91 +518,1021 @@ QString GStreamerPlayer::getSubtitle() const
 }
 
 
-void GStreamerPlayer::setSinkCaps(GstCaps *p_sinkCaps)
+void GStreamerPlayer::setLoop(bool const p_loop)
+{
+	if (m_loop == p_loop)
+		return;
+
+	m_loop = p_loop;
+
+	if (!m_loop)
+	{
+		cancelCacheSwitch();
+		m_clipRecorder.abort();
+	}
+
+	// Cached playback ends after the current pass if looping is disabled.
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		m_cachedPlaybackLoop = m_loop;
+	}
+
+	updateSegmentLoop();
+
+	emit loopChanged();
+}
+
+
+bool GStreamerPlayer::getLoop() const
 {
-	setGStreamerVideoRendererSinkCaps(m_gstvidrenderer, p_sinkCaps);
+	return m_loop;
 }
 
 
-void GStreamerPlayer::setSinkCapsFromVideoFormats(std::vector < GstVideoFormat > const &p_videoFormats)
+double GStreamerPlayer::getLoopTransitionLatency() const
 {
-	// Produce caps with unrestricted width/height/framerate and a list of format strings.
-	// Example: if p_videoFormats contains GST_VIDEO_FORMAT_RGBA and GST_VIDEO_FORMAT_I420,
-	// this produces: "video/x-raw; width: [ 1, 2147483647 ], height: [ 1, 2147483647 ],
-	// framerate: [ 0/1, 2147483647/1 ], format: { RGBA, I420 }".
+	return m_loopTransitionLatency;
+}
+
+
+bool GStreamerPlayer::isPlayingFromCache() const
+{
+	return m_playingFromCache;
+}
+
+
+int GStreamerPlayer::getSkippedFrameCount() const
+{
+	std::lock_guard < std::mutex > lock(m_pipelineMutex);
+	return (m_gstvidrenderer != nullptr) ? getGStreamerVideoRendererFramePacingStats(m_gstvidrenderer).m_numSkippedFrames : 0;
+}
+
+
+int GStreamerPlayer::getDuplicateFrameCount() const
+{
+	std::lock_guard < std::mutex > lock(m_pipelineMutex);
+	return (m_gstvidrenderer != nullptr) ? getGStreamerVideoRendererFramePacingStats(m_gstvidrenderer).m_numDuplicateFrames : 0;
+}
+
+
+int GStreamerPlayer::getJudderFrameCount() const
+{
+	std::lock_guard < std::mutex > lock(m_pipelineMutex);
+	return (m_gstvidrenderer != nullptr) ? getGStreamerVideoRendererFramePacingStats(m_gstvidrenderer).m_numJudderFrames : 0;
+}
+
+
+void GStreamerPlayer::setSinkCaps(GstCaps *p_sinkCaps)
+{
+	gst_caps_replace(&m_sinkCaps, p_sinkCaps);
+
+	if (m_gstvidrenderer != nullptr)
+		setGStreamerVideoRendererSinkCaps(m_gstvidrenderer, m_sinkCaps);
+}
+
 
+void GStreamerPlayer::setSinkCapsFromVideoFormats(std::vector < GstVideoFormat > const &p_videoFormats, char const *p_capsFeature)
+{
 	assert(!p_videoFormats.empty());
 
-	GstCaps *caps = gst_caps_new_simple(
-		"video/x-raw",
-		"width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
-		"height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
-		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1,
-		nullptr
-	);
+	// Store the formats and the feature, since the caps have to be
+	// recreated whenever the frame size limit changes.
+	m_sinkVideoFormats = p_videoFormats;
+	m_sinkCapsFeature = p_capsFeature;
 
-	GValue format = G_VALUE_INIT;
-	GValue formats = G_VALUE_INIT;
-	g_value_init(&format, G_TYPE_STRING);
-	g_value_init(&formats, GST_TYPE_LIST);
-	for (GstVideoFormat fmt : p_videoFormats)
+	updateSinkCapsFromVideoFormats();
+}
+
+
+void GStreamerPlayer::setVideoSinkContext(GstContext *p_context)
+{
+	// Like GstElement, keep only one context per type.
+	char const *contextType = gst_context_get_context_type(p_context);
+	auto contextIter = std::find_if(m_videoSinkContexts.begin(), m_videoSinkContexts.end(), [&](GstContext *p_existingContext) {
+		return g_strcmp0(gst_context_get_context_type(p_existingContext), contextType) == 0;
+	});
+
+	gst_context_ref(p_context);
+	if (contextIter != m_videoSinkContexts.end())
 	{
-		g_value_set_static_string(&format, gst_video_format_to_string(fmt));
-		gst_value_list_append_value(&formats, &format);
+		gst_context_unref(*contextIter);
+		*contextIter = p_context;
 	}
-	gst_caps_set_value(caps, "format", &formats);
-	g_value_unset(&format);
-	g_value_unset(&formats);
+	else
+		m_videoSinkContexts.push_back(p_context);
 
-	setSinkCaps(caps);
+	if (m_gstvidrenderer != nullptr)
+		setGStreamerVideoRendererContext(m_gstvidrenderer, p_context);
+}
 
-	gst_caps_unref(caps);
+
+void GStreamerPlayer::setVideoSinkBufferPoolFactory(BufferPoolFactory p_factory, unsigned int const p_numHeldBuffers)
+{
+	m_bufferPoolFactory = std::move(p_factory);
+	m_numHeldBuffers = p_numHeldBuffers;
+
+	if (m_gstvidrenderer != nullptr)
+		setGStreamerVideoRendererBufferPoolFactory(m_gstvidrenderer, m_bufferPoolFactory, m_numHeldBuffers);
+}
+
+
+void GStreamerPlayer::setFramePacing(bool const p_framePacing)
+{
+	m_framePacing = p_framePacing;
+
+	if (m_gstvidrenderer != nullptr)
+		setGStreamerVideoRendererFramePacing(m_gstvidrenderer, m_framePacing && !isLiveCapture());
+}
+
+
+void GStreamerPlayer::setLowLatencyCapture(bool const p_lowLatencyCapture)
+{
+	if (m_lowLatencyCapture == p_lowLatencyCapture)
+		return;
+
+	m_lowLatencyCapture = p_lowLatencyCapture;
+	applyLowLatencyCapture();
+}
+
+
+bool GStreamerPlayer::getLowLatencyCapture() const
+{
+	return m_lowLatencyCapture;
+}
+
+
+bool GStreamerPlayer::isLiveCapture() const
+{
+	return m_lowLatencyCapture && isLiveCaptureUrl(m_url);
+}
+
+
+void GStreamerPlayer::setPreferDmaBufMemory(bool const p_preferDmaBuf)
+{
+	m_preferDmaBuf = p_preferDmaBuf;
+	updateElementSetupHandler();
+}
+
+
+void GStreamerPlayer::preroll()
+{
+	// Nothing needs to be prerolled if there already is a pipeline
+	// (it is either prerolled or playing), or if there is no media.
+	if (m_pipeline || m_playingFromCache || m_url.isEmpty())
+		return;
+
+	// Looping media that is in the decoded frame
+	// cache is played without a pipeline.
+	DecodedFrameCache &cache = DecodedFrameCache::instance();
+	if (m_loop && cache.isEnabled() && cache.find(m_url.toString()))
+		return;
+
+	qCDebug(lcQtGLVidDemo) << "Player" << this << "prerolls" << m_url;
+
+	// Pausing a stopped pipeline prerolls it. This is done even in
+	// the Suspended decoding tier, since the point is to have the
+	// first frame ready before the player's output is shown.
+	acquirePipeline();
+	gst_player_pause(m_gstplayer);
+	m_prerolled = true;
+}
+
+
+void GStreamerPlayer::updateElementSetupHandler()
+{
+	if (m_gstplayer == nullptr)
+		return;
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+
+	if (isLiveCapture() && (m_queueSetupHandlerId == 0))
+	{
+		// Queues that the playbin creates later (for example, the one
+		// in front of the video sink is created once the video stream
+		// is linked) are set up for low latency right away.
+		void (*queueSetupCB)(GstElement *, GstElement *, gpointer) = [](GstElement *, GstElement *p_element, gpointer) {
+			if (isQueue(p_element))
+				setLowLatencyQueueLimits(p_element, true);
+		};
+		m_queueSetupHandlerId = g_signal_connect(G_OBJECT(playbin), "element-setup", G_CALLBACK(queueSetupCB), nullptr);
+	}
+	else if (!isLiveCapture() && (m_queueSetupHandlerId != 0))
+	{
+		g_signal_handler_disconnect(G_OBJECT(playbin), m_queueSetupHandlerId);
+		m_queueSetupHandlerId = 0;
+	}
+
+	if (m_preferDmaBuf && (m_elementSetupHandlerId == 0))
+	{
+		// playbin emits element-setup for every element it creates,
+		// including the ones inside decodebin and the source element.
+		// This is emitted from a streaming thread, but since the
+		// callback only touches the new element, this is not a problem.
+		// V4L2 capture devices use the io-mode property, V4L2 mem2mem
+		// decoders use capture-io-mode for their output frames.
+		void (*elementSetupCB)(GstElement *, GstElement *, gpointer) = [](GstElement *, GstElement *p_element, gpointer) {
+			GObjectClass *klass = G_OBJECT_GET_CLASS(p_element);
+			char const *propertyName = nullptr;
+
+			if (g_object_class_find_property(klass, "capture-io-mode") != nullptr)
+				propertyName = "capture-io-mode";
+			else if ((g_object_class_find_property(klass, "io-mode") != nullptr) && GST_IS_BASE_SRC(p_element))
+				propertyName = "io-mode";
+
+			if (propertyName != nullptr)
+			{
+				qCDebug(lcQtGLVidDemo) << "Setting" << propertyName << "of element" << GST_ELEMENT_NAME(p_element) << "to dmabuf";
+				gst_util_set_object_arg(G_OBJECT(p_element), propertyName, "dmabuf");
+			}
+		};
+		m_elementSetupHandlerId = g_signal_connect(G_OBJECT(playbin), "element-setup", G_CALLBACK(elementSetupCB), nullptr);
+	}
+	else if (!m_preferDmaBuf && (m_elementSetupHandlerId != 0))
+	{
+		g_signal_handler_disconnect(G_OBJECT(playbin), m_elementSetupHandlerId);
+		m_elementSetupHandlerId = 0;
+	}
+
+	gst_object_unref(GST_OBJECT(playbin));
 }
 
 
 void GStreamerPlayer::play()
 {
+	m_playRequested = true;
+
+	// Playback is started once the Suspended tier is left.
+	if (m_decodingTier == DecodingTier::Suspended)
+	{
+		qCDebug(lcQtGLVidDemo) << "Decoding is suspended; deferring playback start";
+		return;
+	}
+
+	if (m_playingFromCache)
+	{
+		resumeCachedPlayback();
+		return;
+	}
+
+	// A prerolled pipeline did not play anything yet, so the
+	// first pass can be recorded just like after a stop.
+	DecodedFrameCache &cache = DecodedFrameCache::instance();
+	if (((m_state == State::Stopped) || m_prerolled) && m_loop && cache.isEnabled())
+	{
+		// If another player (or an earlier playback) already decoded
+		// the media, serve its frames right away without a pipeline.
+		QString key = m_url.toString();
+		DecodedClipSPtr clip = cache.find(key);
+		if (clip)
+		{
+			startCachedPlayback(std::move(clip));
+			return;
+		}
+
+		// Otherwise, record the first pass. Frames are missing with
+		// the lower decoding tiers, so only record with all frames.
+		if (m_decodingTier == DecodingTier::Full)
+		{
+			m_recordingKey = std::move(key);
+			m_clipRecorder.start(cache.getBudget());
+		}
+	}
+
+	acquirePipeline();
 	gst_player_play(m_gstplayer);
+	m_prerolled = false;
 }
 
 
 void GStreamerPlayer::pause()
 {
+	m_playRequested = false;
+	m_prerolled = false;
+	cancelCacheSwitch();
+
+	if (m_playingFromCache)
+	{
+		pauseCachedPlayback();
+		return;
+	}
+
+	// Pausing prerolls the pipeline, which is not worth
+	// acquiring a pipeline for while decoding is suspended.
+	if ((m_gstplayer == nullptr) && (m_decodingTier == DecodingTier::Suspended))
+		return;
+
+	acquirePipeline();
 	gst_player_pause(m_gstplayer);
 }
 
 
 void GStreamerPlayer::stop()
 {
-	gst_player_stop(m_gstplayer);
+	m_playRequested = false;
+	cancelCacheSwitch();
+	m_clipRecorder.abort();
+
+	if (m_playingFromCache)
+		stopCachedPlayback();
+
+	// The pipeline's Stopped state is not reported to this player
+	// anymore once the pipeline is released, so switch it here.
+	releasePipeline();
+
+	if (m_state != State::Stopped)
+	{
+		m_state = State::Stopped;
+		m_position = -1;
+		emit stateChanged();
+	}
 }
 
 
 void GStreamerPlayer::seek(int p_position)
 {
-	gst_player_seek(m_gstplayer, GstClockTime(p_position) * GST_MSECOND);
+	GstClockTime position = GstClockTime(p_position) * GST_MSECOND;
+
+	// Report the new position right away instead of
+	// waiting for the next position update.
+	m_position = p_position;
+
+	if (m_playingFromCache)
+	{
+		{
+			std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+			position = std::min(position, m_cachedClip->m_duration - 1);
+			if (GST_CLOCK_TIME_IS_VALID(m_cachedPlaybackPausePosition))
+				m_cachedPlaybackPausePosition = position;
+			else
+				m_cachedPlaybackStartTime = getMonotonicTime() - position;
+		}
+
+		// Notify about the frame at the new position. If playback
+		// runs, also reschedule the timer for the frame after it.
+		if (m_cachedPlaybackTimer.isActive())
+			onCachedPlaybackTimer();
+		else if (m_newVideoFrameAvailableCB)
+			m_newVideoFrameAvailableCB();
+		return;
+	}
+
+	// The recording would have a gap (or restart if the
+	// position jumps back), so it cannot be used anymore.
+	cancelCacheSwitch();
+	m_clipRecorder.abort();
+
+	// gst_player_seek() would replace the key unit trick mode
+	// segment or the looping segment with a regular one, so
+	// seek directly instead.
+	if ((m_keyframeTrickModeActive || m_segmentLoopActive) && seekPipeline(position, m_keyframeTrickModeActive))
+		return;
+
+	if (m_gstplayer == nullptr)
+		return;
+
+	gst_player_seek(m_gstplayer, position);
+	m_segmentLoopActive = false;
+}
+
+
+GStreamerMediaSample GStreamerPlayer::pullVideoSample(GstClockTime const p_vsyncTime, GstClockTime const p_vsyncInterval)
+{
+	DecodedClipSPtr clip;
+	GstClockTime clipTime = 0;
+
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		clip = m_cachedClip;
+		if (clip)
+			clipTime = getCachedClipTime(GST_CLOCK_TIME_IS_VALID(p_vsyncTime) ? p_vsyncTime : getMonotonicTime());
+	}
+
+	if (clip)
+	{
+		// Pick the cached frame that is due at the vsync.
+		// Each frame is returned only once in a row.
+		std::size_t frameIndex = clip->findFrame(clipTime);
+		if ((clip == m_servedClip) && (frameIndex == m_servedFrameIndex))
+			return GStreamerMediaSample(nullptr, false);
+
+		m_servedClip = std::move(clip);
+		m_servedFrameIndex = frameIndex;
+
+		return makeConsumedSample(gst_sample_ref(m_servedClip->m_frames[frameIndex].m_sample), false);
+	}
+
+	m_servedClip.reset();
+
+	// The sample was already pulled from the appsink by the streaming
+	// thread, which also checked for caps changes. Here, we just take
+	// it out of the renderer's triple buffer (or its frame pacing queue).
+	// The lock keeps the main Qt thread from releasing the pipeline
+	// in the meantime; the renderer never blocks, so this is short.
+	GStreamerMediaSample videoSample(nullptr, false);
+	{
+		std::lock_guard < std::mutex > lock(m_pipelineMutex);
+		if (m_gstvidrenderer != nullptr)
+			videoSample = pullGStreamerVideoRendererSample(m_gstvidrenderer, p_vsyncTime, p_vsyncInterval);
+	}
+	if (videoSample.getSample() == nullptr)
+		return videoSample;
+
+	GStreamerMediaSample consumedSample = makeConsumedSample(gst_sample_ref(videoSample.getSample()), videoSample.sampleHasNewCaps());
+	consumedSample.setCaptureTime(videoSample.getCaptureTime());
+	return consumedSample;
+}
+
+
+bool GStreamerPlayer::hasQueuedVideoSamples() const
+{
+	// Cached frames are not queued; the cached playback
+	// timer notifies about each one when it is due.
+	if (m_playingFromCache)
+		return false;
+
+	std::lock_guard < std::mutex > lock(m_pipelineMutex);
+	return (m_gstvidrenderer != nullptr) && hasGStreamerVideoRendererQueuedSamples(m_gstvidrenderer);
+}
+
+
+void GStreamerPlayer::setMaxVideoSize(QSize p_maxVideoSize)
+{
+	// Round up the size, so that small changes do not lead to
+	// different limits. An empty size means "no limit".
+	QSize newMaxVideoSize;
+	if (!p_maxVideoSize.isEmpty())
+		newMaxVideoSize = QSize(roundUpMaxVideoSizeExtent(p_maxVideoSize.width()), roundUpMaxVideoSizeExtent(p_maxVideoSize.height()));
+
+	// Hysteresis: Growing the limit is always done, since otherwise,
+	// frames would be visibly upscaled. Shrinking it is only done if
+	// the new limit is considerably smaller than the current one. This
+	// avoids renegotiations back and forth if the size oscillates around
+	// a rounding boundary.
+	bool changeLimit;
+	if (newMaxVideoSize.isEmpty() || m_maxVideoSize.isEmpty())
+		changeLimit = (newMaxVideoSize != m_maxVideoSize);
+	else if ((newMaxVideoSize.width() > m_maxVideoSize.width()) || (newMaxVideoSize.height() > m_maxVideoSize.height()))
+		changeLimit = true;
+	else
+		changeLimit = (newMaxVideoSize.width() * 4 < m_maxVideoSize.width() * 3) || (newMaxVideoSize.height() * 4 < m_maxVideoSize.height() * 3);
+
+	if (!changeLimit)
+	{
+		// The current limit is good enough; discard any pending change.
+		m_maxVideoSizeTimer.stop();
+		return;
+	}
+
+	// (Re)start the timer. The limit is applied once no new
+	// size was requested for MaxVideoSizeSettleTime milliseconds.
+	m_pendingMaxVideoSize = newMaxVideoSize;
+	m_maxVideoSizeTimer.start();
+}
+
+
+void GStreamerPlayer::setDecodingTier(DecodingTier const p_decodingTier)
+{
+	if (m_decodingTier == p_decodingTier)
+		return;
+
+	qCDebug(lcQtGLVidDemo) << "Changing decoding tier from" << m_decodingTier << "to" << p_decodingTier;
+
+	DecodingTier oldDecodingTier = m_decodingTier;
+	m_decodingTier = p_decodingTier;
+
+	// Cached frames are not decoded, so only suspending
+	// matters while frames are served from the cache.
+	if (m_playingFromCache)
+	{
+		if (m_decodingTier == DecodingTier::Suspended)
+			pauseCachedPlayback();
+		else if ((oldDecodingTier == DecodingTier::Suspended) && m_playRequested)
+			resumeCachedPlayback();
+		return;
+	}
+
+	// The lower tiers skip frames, so a recording of
+	// the first pass would be incomplete.
+	if (m_decodingTier != DecodingTier::Full)
+	{
+		cancelCacheSwitch();
+		m_clipRecorder.abort();
+	}
+
+	// Resume playback first when leaving the Suspended tier, since
+	// the trick mode seek below needs a running pipeline. If playback
+	// was deferred before a pipeline was acquired, start it like any
+	// other playback; the tier is then applied to the new pipeline.
+	if ((oldDecodingTier == DecodingTier::Suspended) && m_playRequested)
+	{
+		if (m_gstplayer == nullptr)
+		{
+			play();
+			return;
+		}
+
+		// A prerolled pipeline did not start playback yet, so
+		// start it like any other playback as well. This may
+		// switch to serving frames from the decoded frame cache.
+		if (m_prerolled)
+		{
+			play();
+			if (m_playingFromCache)
+				return;
+		}
+		else
+			gst_player_play(m_gstplayer);
+	}
+
+	// Keyframe-only decoding is attempted with the KeyframesOnly tier.
+	// If the media is not seekable, frame throttling is used instead.
+	// Suspended players keep their current segment, so that they can
+	// resume in the same tier without another seek.
+	if (m_decodingTier != DecodingTier::Suspended)
+		setKeyframeTrickMode(m_decodingTier == DecodingTier::KeyframesOnly);
+
+	bool throttle = (m_decodingTier == DecodingTier::ReducedRate) || ((m_decodingTier == DecodingTier::KeyframesOnly) && !m_keyframeTrickModeActive);
+	setFrameThrottling(throttle);
+
+	if ((m_decodingTier == DecodingTier::Suspended) && m_playRequested && (m_gstplayer != nullptr))
+		gst_player_pause(m_gstplayer);
+}
+
+
+GStreamerPlayer::DecodingTier GStreamerPlayer::getDecodingTier() const
+{
+	return m_decodingTier;
+}
+
+
+void GStreamerPlayer::setPreroll(bool const p_preroll)
+{
+	if (m_preroll == p_preroll)
+		return;
+
+	m_preroll = p_preroll;
+
+	if (m_preroll)
+		preroll();
+	else if (m_prerolled && !m_playRequested)
+	{
+		// Nobody requested playback with the prerolled
+		// pipeline, so it is not needed anymore.
+		qCDebug(lcQtGLVidDemo) << "Player" << this << "no longer prerolls; releasing its pipeline";
+		stop();
+	}
+}
+
+
+bool GStreamerPlayer::getPreroll() const
+{
+	return m_preroll;
+}
+
+
+bool GStreamerPlayer::isPlaybackRequested() const
+{
+	return m_playRequested;
+}
+
+
+void GStreamerPlayer::setFrameThrottling(bool const p_enabled)
+{
+	// With a throttle time, the appsink drops frames that arrive less
+	// than ReducedRateFrameInterval after the previous one. QoS makes
+	// it send throttle QoS events upstream, which tell decoders that
+	// they can skip these frames. (The appsink is synchronized to the
+	// clock, otherwise this would not work.)
+	if (m_gstvidrenderer == nullptr)
+		return;
+
+	GstElement *appsink = getGStreamerVideoRendererVideoAppsink(m_gstvidrenderer);
+	g_object_set(
+		G_OBJECT(appsink),
+		"throttle-time", guint64(p_enabled ? ReducedRateFrameInterval : 0),
+		"qos", gboolean(p_enabled),
+		nullptr
+	);
+}
+
+
+void GStreamerPlayer::setKeyframeTrickMode(bool const p_enabled)
+{
+	if (m_keyframeTrickModeActive == p_enabled)
+		return;
+
+	// A seek to the current position is needed for switching between
+	// regular and key unit trick mode segments. Demuxers and decoders
+	// then skip everything except keyframes. This is only possible if
+	// playback is running, and if the media is seekable. (If playback
+	// is stopped, the trick mode is requested again by the state
+	// change handler once playback is running.)
+	if ((m_gstplayer == nullptr) || (p_enabled && (((m_state != State::Playing) && (m_state != State::Paused)) || !isSeekable())))
+		return;
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+
+	gint64 position;
+	if (!gst_element_query_position(playbin, GST_FORMAT_TIME, &position))
+		position = 0;
+
+	gst_object_unref(GST_OBJECT(playbin));
+
+	if (seekPipeline(position, p_enabled))
+	{
+		qCDebug(lcQtGLVidDemo) << (p_enabled ? "Enabled" : "Disabled") << "keyframe-only decoding";
+		m_keyframeTrickModeActive = p_enabled;
+	}
+	else
+		qCWarning(lcQtGLVidDemo) << "Could not" << (p_enabled ? "enable" : "disable") << "keyframe-only decoding";
+}
+
+
+bool GStreamerPlayer::seekPipeline(gint64 const p_position, bool const p_keyframesOnly, bool const p_flush)
+{
+	GstSeekFlags seekFlags = GST_SEEK_FLAG_KEY_UNIT;
+	if (p_flush)
+		seekFlags = GstSeekFlags(seekFlags | GST_SEEK_FLAG_FLUSH);
+	if (p_keyframesOnly)
+		seekFlags = GstSeekFlags(seekFlags | GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS);
+	// With the segment flag, the pipeline posts a segment-done
+	// message at the end instead of ending the stream.
+	if (m_loop)
+		seekFlags = GstSeekFlags(seekFlags | GST_SEEK_FLAG_SEGMENT);
+
+	if (m_gstplayer == nullptr)
+		return false;
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+	bool ret = gst_element_seek(playbin, 1.0, GST_FORMAT_TIME, seekFlags, GST_SEEK_TYPE_SET, p_position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+	gst_object_unref(GST_OBJECT(playbin));
+
+	if (ret)
+		m_segmentLoopActive = m_loop;
+
+	return ret;
+}
+
+
+void GStreamerPlayer::updateSegmentLoop()
+{
+	if (m_loop == m_segmentLoopActive)
+		return;
+
+	// Like the key unit trick mode, the looping segment can only be
+	// set up while playback is running, and if the media is seekable.
+	// (Otherwise, this is called again once playback runs or the
+	// media info is updated. Media that is not seekable is restarted
+	// in the end-of-stream handler instead.) During cached playback,
+	// there is no pipeline, and the cached clip loops on its own.
+	if ((m_gstplayer == nullptr) || ((m_state != State::Playing) && (m_state != State::Paused)) || !isSeekable())
+		return;
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+
+	gint64 position;
+	if (!gst_element_query_position(playbin, GST_FORMAT_TIME, &position))
+		position = 0;
+
+	gst_object_unref(GST_OBJECT(playbin));
+
+	if (seekPipeline(position, m_keyframeTrickModeActive))
+		qCDebug(lcQtGLVidDemo) << (m_loop ? "Enabled" : "Disabled") << "segment seek based looping";
+	else
+		qCWarning(lcQtGLVidDemo) << "Could not" << (m_loop ? "enable" : "disable") << "segment seek based looping";
+}
+
+
+void GStreamerPlayer::onSegmentDone(qint64 p_segmentDoneTime)
+{
+	// If looping was disabled in the meantime, the segment
+	// was already replaced by a regular one.
+	if (!m_segmentLoopActive)
+		return;
+
+	// If the first pass is being recorded for the decoded frame cache,
+	// do not loop the pipeline. Instead, switch to the cached frames
+	// once the frames that are still queued downstream were shown.
+	if (m_clipRecorder.isActive())
+	{
+		GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+
+		gint64 position, duration;
+		GstClockTime remainingTime = 0;
+		if (gst_element_query_position(playbin, GST_FORMAT_TIME, &position) && gst_element_query_duration(playbin, GST_FORMAT_TIME, &duration) && (duration > position))
+			remainingTime = GstClockTime(duration - position);
+
+		gst_object_unref(GST_OBJECT(playbin));
+
+		m_cacheSwitchTimer.start(int(remainingTime / GST_MSECOND));
+		return;
+	}
+
+	// Seek back to the start without flushing. The data that is still
+	// queued downstream keeps playing while the demuxer starts over, and
+	// the new segment's running times continue where the old one ended,
+	// so there is no gap. Decoders are not reset, so the caps stay the
+	// same, and the video material does not have to be reconfigured.
+	if (!seekPipeline(0, m_keyframeTrickModeActive, false))
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not seek back to the start for looping";
+		return;
+	}
+
+	m_loopTransitionLatency = double(g_get_monotonic_time() - p_segmentDoneTime) / 1000.0;
+	qCDebug(lcQtGLVidDemo) << "Looped playback; transition latency:" << m_loopTransitionLatency << "ms";
+	emit loopTransitionLatencyChanged();
+}
+
+
+void GStreamerPlayer::switchToCachedPlayback()
+{
+	// All frames of the first pass were shown by now, so the
+	// recording is complete. Continue with the cached frames.
+	DecodedClipSPtr clip = m_clipRecorder.finish();
+	if (clip && DecodedFrameCache::instance().insert(m_recordingKey, clip))
+	{
+		startCachedPlayback(std::move(clip));
+		return;
+	}
+
+	// The frames could not be cached, so loop the pipeline after all.
+	// (There is a gap this time, since the queued frames were shown
+	// already. Later transitions do not have it.)
+	qCDebug(lcQtGLVidDemo) << "Could not cache the decoded frames of" << m_recordingKey << "; looping the pipeline instead";
+	if (m_segmentLoopActive && !seekPipeline(0, m_keyframeTrickModeActive, false))
+		qCWarning(lcQtGLVidDemo) << "Could not seek back to the start for looping";
+}
+
+
+void GStreamerPlayer::cancelCacheSwitch()
+{
+	if (!m_cacheSwitchTimer.isActive())
+		return;
+
+	m_cacheSwitchTimer.stop();
+	m_clipRecorder.abort();
+
+	// The pipeline waits at the end of the segment,
+	// so seek back to the start like onSegmentDone() does.
+	if (m_segmentLoopActive && !seekPipeline(0, m_keyframeTrickModeActive, false))
+		qCWarning(lcQtGLVidDemo) << "Could not seek back to the start for looping";
+}
+
+
+void GStreamerPlayer::startCachedPlayback(DecodedClipSPtr p_clip)
+{
+	qCDebug(lcQtGLVidDemo) << "Serving" << p_clip->m_frames.size() << "cached frames of" << m_url << "; stopping the pipeline";
+
+	m_cacheSwitchTimer.stop();
+	m_clipRecorder.abort();
+
+	// Set this before stopping the pipeline, so that the state
+	// changes that GstPlayer reports afterwards are ignored. The
+	// pipeline is not needed anymore, so another player can use it.
+	m_playingFromCache = true;
+	releasePipeline();
+
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		m_cachedClip = std::move(p_clip);
+		m_cachedPlaybackStartTime = getMonotonicTime();
+		m_cachedPlaybackPausePosition = GST_CLOCK_TIME_NONE;
+		m_cachedPlaybackLoop = m_loop;
+	}
+
+	// If no pipeline ran before, the duration was not reported yet.
+	m_position = 0;
+	emit playingFromCacheChanged();
+	emit isSeekableChanged();
+	emit durationChanged(getDuration());
+	emit positionUpdated(m_position);
+
+	if (m_state != State::Playing)
+	{
+		m_state = State::Playing;
+		emit stateChanged();
+	}
+
+	// Notify about the first frame and schedule the next one.
+	onCachedPlaybackTimer();
+}
+
+
+void GStreamerPlayer::stopCachedPlayback()
+{
+	if (!m_playingFromCache)
+		return;
+
+	m_cachedPlaybackTimer.stop();
+
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		m_cachedClip.reset();
+	}
+
+	m_playingFromCache = false;
+	emit playingFromCacheChanged();
+	emit isSeekableChanged();
+}
+
+
+void GStreamerPlayer::pauseCachedPlayback()
+{
+	m_cachedPlaybackTimer.stop();
+
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		if (!GST_CLOCK_TIME_IS_VALID(m_cachedPlaybackPausePosition))
+			m_cachedPlaybackPausePosition = getCachedClipTime(getMonotonicTime());
+	}
+
+	if (m_state != State::Paused)
+	{
+		m_state = State::Paused;
+		emit stateChanged();
+	}
 }
 
 
-GStreamerMediaSample GStreamerPlayer::pullVideoSample()
+void GStreamerPlayer::resumeCachedPlayback()
 {
-	GstSample *sample;
-	bool hasNewCaps = false;
+	{
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		if (GST_CLOCK_TIME_IS_VALID(m_cachedPlaybackPausePosition))
+		{
+			m_cachedPlaybackStartTime = getMonotonicTime() - m_cachedPlaybackPausePosition;
+			m_cachedPlaybackPausePosition = GST_CLOCK_TIME_NONE;
+		}
+	}
+
+	if (m_state != State::Playing)
+	{
+		m_state = State::Playing;
+		emit stateChanged();
+	}
 
-	sample = gst_app_sink_try_pull_sample(GST_APP_SINK_CAST(getGStreamerVideoRendererVideoAppsink(m_gstvidrenderer)), 0);
+	onCachedPlaybackTimer();
+}
+
+
+void GStreamerPlayer::onCachedPlaybackTimer()
+{
+	GstClockTime now = getMonotonicTime();
+	DecodedClipSPtr clip;
+	GstClockTime clipTime;
+	bool ended;
 
-	if (sample != nullptr)
 	{
-		// Check if the caps changed, and if so, record it. This
-		// information is then passed to the new media sample below.
-		GstCaps *caps = gst_sample_get_caps(sample);
-		hasNewCaps = (m_lastSampleCaps == nullptr) || !gst_caps_is_equal(m_lastSampleCaps, caps);
-		// Remember the current caps so we can compare them against
-		// future caps to detect caps changes.
-		gst_caps_replace(&m_lastSampleCaps, caps);
+		std::lock_guard < std::mutex > lock(m_cachedPlaybackMutex);
+		clip = m_cachedClip;
+		if (!clip || GST_CLOCK_TIME_IS_VALID(m_cachedPlaybackPausePosition))
+			return;
+
+		clipTime = getCachedClipTime(now);
+		ended = !m_cachedPlaybackLoop && (now > m_cachedPlaybackStartTime) && ((now - m_cachedPlaybackStartTime) >= clip->m_duration);
+	}
+
+	if (ended)
+	{
+		stopCachedPlayback();
+		m_playRequested = false;
+		m_state = State::Stopped;
+		m_position = -1;
+		emit stateChanged();
+		emit endOfStream();
+		return;
+	}
+
+	// Let the consumer pull the frame that is due now.
+	if (m_newVideoFrameAvailableCB)
+		m_newVideoFrameAvailableCB();
+
+	// Position updates are limited like GstPlayer's are.
+	int position = int(clipTime / GST_MSECOND);
+	if ((position < m_position) || (position >= (m_position + CachedPlaybackPositionInterval)))
+	{
+		m_position = position;
+		emit positionUpdated(m_position);
 	}
 
-	return GStreamerMediaSample(sample, hasNewCaps);
+	// Wake up again once the next frame is due. After the last frame,
+	// this is the end of the clip, where the first frame is due again.
+	std::size_t frameIndex = clip->findFrame(clipTime);
+	GstClockTime nextTimestamp = ((frameIndex + 1) < clip->m_frames.size()) ? clip->m_frames[frameIndex + 1].m_timestamp : clip->m_duration;
+	m_cachedPlaybackTimer.start(int((nextTimestamp - clipTime + GST_MSECOND - 1) / GST_MSECOND));
+}
+
+
+GstClockTime GStreamerPlayer::getCachedClipTime(GstClockTime const p_time) const
+{
+	// m_cachedPlaybackMutex must be locked by the caller.
+
+	if (GST_CLOCK_TIME_IS_VALID(m_cachedPlaybackPausePosition))
+		return m_cachedPlaybackPausePosition;
+
+	// The vsync time may be slightly before the start.
+	if (p_time <= m_cachedPlaybackStartTime)
+		return 0;
+
+	GstClockTime elapsed = p_time - m_cachedPlaybackStartTime;
+	if (m_cachedPlaybackLoop)
+		return elapsed % m_cachedClip->m_duration;
+	else
+		return std::min(elapsed, m_cachedClip->m_duration - 1);
+}
+
+
+void GStreamerPlayer::applyLowLatencyCapture()
+{
+	if (m_gstvidrenderer == nullptr)
+		return;
+
+	bool liveCapture = isLiveCapture();
+	qCDebug(lcQtGLVidDemo) << "Player" << this << (liveCapture ? "enables" : "disables") << "low latency capture";
+
+	setGStreamerVideoRendererFramePacing(m_gstvidrenderer, m_framePacing && !liveCapture);
+	setGStreamerVideoRendererLowLatency(m_gstvidrenderer, liveCapture);
+	updateElementSetupHandler();
+
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+	setLowLatencyQueueLimitsInBin(playbin, liveCapture);
+	gst_object_unref(GST_OBJECT(playbin));
+}
+
+
+GStreamerMediaSample GStreamerPlayer::makeConsumedSample(GstSample *p_sample, bool p_sampleHasNewCaps)
+{
+	// Cached frames and pipeline frames alternate when switching to
+	// and from the cache, and players can serve clips that another
+	// player recorded, so the renderer's caps change detection does
+	// not cover all cases. Compare with the caps the consumer got last.
+	// (This is a pointer comparison most of the time.)
+	GstCaps *caps = gst_sample_get_caps(p_sample);
+	if (caps != m_consumedCaps)
+	{
+		if ((caps == nullptr) || (m_consumedCaps == nullptr) || !gst_caps_is_equal(caps, m_consumedCaps))
+			p_sampleHasNewCaps = true;
+		gst_caps_replace(&m_consumedCaps, caps);
+	}
+
+	return GStreamerMediaSample(p_sample, p_sampleHasNewCaps);
+}
+
+
+void GStreamerPlayer::applyMaxVideoSize()
+{
+	qCDebug(lcQtGLVidDemo) << "Changing maximum video frame size from" << m_maxVideoSize << "to" << m_pendingMaxVideoSize;
+	m_maxVideoSize = m_pendingMaxVideoSize;
+
+	if (!m_sinkVideoFormats.empty())
+		updateSinkCapsFromVideoFormats();
+}
+
+
+void GStreamerPlayer::updateSinkCapsFromVideoFormats()
+{
+	// Produce caps with a list of format strings, and with width and height
+	// limited by the maximum video size (or unrestricted if there is none).
+	// The framerate remains unrestricted. Example: if m_sinkVideoFormats
+	// contains GST_VIDEO_FORMAT_RGBA and GST_VIDEO_FORMAT_I420, and there
+	// is no maximum video size, this produces: "video/x-raw;
+	// width: [ 1, 2147483647 ], height: [ 1, 2147483647 ],
+	// framerate: [ 0/1, 2147483647/1 ], format: { RGBA, I420 }".
+
+	int maxWidth = m_maxVideoSize.isEmpty() ? G_MAXINT : m_maxVideoSize.width();
+	int maxHeight = m_maxVideoSize.isEmpty() ? G_MAXINT : m_maxVideoSize.height();
+
+	GstCaps *caps = gst_caps_new_simple(
+		"video/x-raw",
+		"width", GST_TYPE_INT_RANGE, 1, maxWidth,
+		"height", GST_TYPE_INT_RANGE, 1, maxHeight,
+		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1,
+		nullptr
+	);
+
+	GValue format = G_VALUE_INIT;
+	GValue formats = G_VALUE_INIT;
+	g_value_init(&format, G_TYPE_STRING);
+	g_value_init(&formats, GST_TYPE_LIST);
+	for (GstVideoFormat fmt : m_sinkVideoFormats)
+	{
+		g_value_set_static_string(&format, gst_video_format_to_string(fmt));
+		gst_value_list_append_value(&formats, &format);
+	}
+	gst_caps_set_value(caps, "format", &formats);
+	g_value_unset(&format);
+	g_value_unset(&formats);
+
+	// Caps without features implicitely have the
+	// "memory:SystemMemory" feature, so only set
+	// features if some other one is requested.
+	if (m_sinkCapsFeature != nullptr)
+		gst_caps_set_features(caps, 0, gst_caps_features_new(m_sinkCapsFeature, nullptr));
+
+	setSinkCaps(caps);
+
+	gst_caps_unref(caps);
 }
 
 
@@ -335,21 +1593,63 @@ GstFlowReturn GStreamerPlayer::onNewSubtitleSample()
 
 void GStreamerPlayer::staticOnGstPlayerEndOfStream(GStreamerPlayer *self)
 {
+	// Signals of the stopped pipeline may still arrive after
+	// switching to the decoded frame cache. Ignore them.
+	if (self->m_playingFromCache)
+		return;
+
+	// With segment seek based looping, the stream does not end, so
+	// this is only reached if that was not possible (for example
+	// because the media is not seekable). Restart playback then.
+	if (self->m_loop)
+		self->play();
+
 	emit self->endOfStream();
 }
 
 
 void GStreamerPlayer::staticOnGstPlayerStateChanged(GStreamerPlayer *self, GstPlayerState p_state)
 {
+	// The state is managed by the player itself while frames are
+	// served from the decoded frame cache. This also ignores the
+	// state changes caused by stopping the pipeline for the switch.
+	if (self->m_playingFromCache)
+		return;
+
 	State newState = static_cast < State > (p_state);
 	self->m_state = newState;
 
+	// A stopped pipeline starts with a regular segment again. If
+	// keyframe-only decoding is wanted, request it once playback
+	// is running. (The seek cannot be done in the Stopped state.)
+	if (newState == State::Stopped)
+	{
+		self->m_keyframeTrickModeActive = false;
+		self->m_segmentLoopActive = false;
+		self->m_position = -1;
+	}
+	else if (newState == State::Playing)
+	{
+		if ((self->m_decodingTier == DecodingTier::KeyframesOnly) && !self->m_keyframeTrickModeActive)
+		{
+			self->setKeyframeTrickMode(true);
+			self->setFrameThrottling(!self->m_keyframeTrickModeActive);
+		}
+
+		// The same applies to the looping segment. (If the trick
+		// mode seek above was done, it set up the loop as well.)
+		self->updateSegmentLoop();
+	}
+
 	emit self->stateChanged();
 }
 
 
 void GStreamerPlayer::staticOnGstPlayerDurationChanged(GStreamerPlayer *self, guint64 p_duration)
 {
+	if (self->m_playingFromCache)
+		return;
+
 	// Use std::max() to avoid fringe cases where a duration of than 1 ms length is reported.
 	emit self->durationChanged(std::max(int(p_duration / GST_MSECOND), 1));
 }
@@ -357,7 +1657,11 @@ void GStreamerPlayer::staticOnGstPlayerDurationChanged(GStreamerPlayer *self, gu
 
 void GStreamerPlayer::staticOnGstPlayerPositionUpdated(GStreamerPlayer *self, guint64 p_position)
 {
-	emit self->positionUpdated(p_position / GST_MSECOND);
+	if (self->m_playingFromCache)
+		return;
+
+	self->m_position = GST_CLOCK_TIME_IS_VALID(p_position) ? int(p_position / GST_MSECOND) : int(-1);
+	emit self->positionUpdated(self->m_position);
 }
 
 
@@ -369,6 +1673,9 @@ void GStreamerPlayer::staticOnGstPlayerBufferingChanged(GStreamerPlayer *self, g
 
 void GStreamerPlayer::staticOnGstPlayerMediaInfoUpdated(GStreamerPlayer *self, GstPlayerMediaInfo *)
 {
+	// The media may have become known to be seekable.
+	self->updateSegmentLoop();
+
 	emit self->isSeekableChanged();
 }
 
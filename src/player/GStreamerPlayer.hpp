@@ -21,14 +21,19 @@
 #define QTGLVIDDEMO_GSTREAMER_PLAYER_HPP
 
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <QUrl>
 #include <QObject>
+#include <QSize>
+#include <QTimer>
 #include <gst/gst.h>
 #include <gst/player/player.h>
 #include <gst/video/video.h>
+#include "DecodedFrameCache.hpp"
 #include "GStreamerCommon.hpp"
 #include "GStreamerMediaSample.hpp"
+#include "PlayerPipelinePool.hpp"
 
 
 namespace qtglviddemo
@@ -66,6 +71,15 @@ namespace qtglviddemo
  * GstPlayer requires two other components to be implemented and instantiated:
  * a signal dispatcher and a video renderer. See the corresponding source
  * files for details.
+ *
+ * The GstPlayer pipeline is not created by the constructor. Instead, it is
+ * acquired from the PlayerPipelinePool once playback actually starts (that
+ * is, once play() is called while the decoding tier is not Suspended), and
+ * released back to the pool by stop(), by the destructor, and once frames
+ * are served from the decoded frame cache. Until then, setters like
+ * setSinkCaps() just store their values, and these are applied to the
+ * pipeline when it is acquired. This keeps players of video objects that
+ * were never visible cheap.
  */
 class GStreamerPlayer
 	: public QObject
@@ -84,8 +98,11 @@ class GStreamerPlayer
 	 * Current playback position, in milliseconds.
 	 *
 	 * If the position cannot be currently determined, the position is -1.
+	 *
+	 * This is the position that was last reported by GstPlayer, so
+	 * reading it does not query the pipeline.
 	 */
-	Q_PROPERTY(int position READ getPosition)
+	Q_PROPERTY(int position READ getPosition NOTIFY positionUpdated)
 	/**
 	 * Current playback duration, in milliseconds.
 	 *
@@ -101,6 +118,30 @@ class GStreamerPlayer
 	Q_PROPERTY(bool isSeekable READ isSeekable NOTIFY isSeekableChanged)
 	/// The current subtitle.
 	Q_PROPERTY(QString subtitle READ getSubtitle NOTIFY subtitleChanged)
+	/**
+	 * If this is true, playback starts over once the end is reached.
+	 *
+	 * For seekable media, this uses segment seeks, so playback loops
+	 * without stopping the pipeline (see setLoop()). Default is false.
+	 */
+	Q_PROPERTY(bool loop READ getLoop WRITE setLoop NOTIFY loopChanged)
+	/**
+	 * Time between the end of the media and the seek back to its start
+	 * in the most recent loop transition, in milliseconds. This is -1
+	 * if no segment seek based loop transition happened yet.
+	 */
+	Q_PROPERTY(double loopTransitionLatency READ getLoopTransitionLatency NOTIFY loopTransitionLatencyChanged)
+	/**
+	 * If this is true, frames are currently served from the decoded
+	 * frame cache, and the pipeline is not running (see setLoop()).
+	 */
+	Q_PROPERTY(bool playingFromCache READ isPlayingFromCache NOTIFY playingFromCacheChanged)
+	/// Number of decoded frames that were dropped without being shown.
+	Q_PROPERTY(int skippedFrameCount READ getSkippedFrameCount)
+	/// Number of frames that were uploaded for a vsync that already had one.
+	Q_PROPERTY(int duplicateFrameCount READ getDuplicateFrameCount)
+	/// Number of frames that were shown at a different vsync than the one closest to their display time.
+	Q_PROPERTY(int judderFrameCount READ getJudderFrameCount)
 
 
 public:
@@ -117,16 +158,49 @@ public:
 	};
 	Q_ENUM(State)
 
+	/**
+	 * How much decoding work the player does.
+	 *
+	 * Video objects that are barely visible on screen do not need all
+	 * of their frames. The lower tiers reduce the CPU load of such
+	 * players. The tiers are ordered from most to least work.
+	 */
+	enum class DecodingTier
+	{
+		/// All frames are decoded and delivered.
+		Full,
+		/**
+		 * Frames are delivered at a reduced rate. The video appsink
+		 * drops frames that arrive too early, and sends QoS events
+		 * upstream, so decoders can skip decoding them.
+		 */
+		ReducedRate,
+		/**
+		 * Only keyframes are decoded. This uses a key unit trick mode
+		 * seek, so it requires seekable media. With other media,
+		 * this behaves like ReducedRate.
+		 */
+		KeyframesOnly,
+		/**
+		 * Playback is paused. Calls to play() are deferred until
+		 * the tier is changed again.
+		 */
+		Suspended
+	};
+	Q_ENUM(DecodingTier)
+
 	/**
 	 * Constructor.
 	 *
-	 * This sets up the GstPlayer, the appsinks, etc. but does not start
-	 * playback. Use the url property and play() for this purpose.
+	 * This does not set up the GstPlayer pipeline yet, and does not
+	 * start playback. Use the url property and play() for this purpose.
 	 *
 	 * @param newVideoFrameAvailableCB Callback function object that shall
 	 *        be invoked whenever a new video frame is available. If this
 	 *        is not a valid function object, no notification is done.
-	 *        Note that this is called from a GStreamer streaming thread.
+	 *        Note that this is called from a GStreamer streaming thread,
+	 *        or from the main Qt thread while frames are served from the
+	 *        decoded frame cache.
 	 * @param p_parent Parent QObject
 	 */
 	explicit GStreamerPlayer(NewVideoFrameAvailableCB p_newVideoFrameAvailableCB = NewVideoFrameAvailableCB(), QObject *p_parent = nullptr);
@@ -147,6 +221,40 @@ public:
 
 	QString getSubtitle() const;
 
+	/**
+	 * Enables or disables looping.
+	 *
+	 * For seekable media, looping is done by segment seeks: the pipeline
+	 * is seeked with the segment flag once playback runs, so that instead
+	 * of ending the stream, the demuxer posts a segment-done message at
+	 * the end. The player then seeks back to the start without flushing.
+	 * Data that is already queued downstream keeps playing in the meantime,
+	 * and decoders are not reset, so there is no gap and no caps change
+	 * between two iterations. Media that is not seekable is restarted
+	 * once the end is reached instead.
+	 *
+	 * If the DecodedFrameCache is enabled, looping media is decoded only
+	 * once: the frames of the first pass are recorded, and if they fit
+	 * into the cache, the pipeline is stopped once the first pass ends,
+	 * and later passes are served from the cached frames, timed by their
+	 * original timestamps. If the URL is already in the cache when
+	 * playback starts, no pipeline is run at all. This requires the Full
+	 * decoding tier during the first pass.
+	 *
+	 * This can be changed at any time. Changing it during playback
+	 * performs a flushing seek to the current position.
+	 */
+	void setLoop(bool const p_loop);
+	bool getLoop() const;
+	double getLoopTransitionLatency() const;
+	bool isPlayingFromCache() const;
+
+	// The frame pacing statistics are those of the current pipeline,
+	// so they start over whenever a pipeline is acquired.
+	int getSkippedFrameCount() const;
+	int getDuplicateFrameCount() const;
+	int getJudderFrameCount() const;
+
 
 	/**
 	 * Sets the allowed video caps.
@@ -158,8 +266,8 @@ public:
 	 * Make sure this is called before playback is started, otherwise
 	 * frames are produced with incorrect formats.
 	 *
-	 * @param p_sinkCaps Sink caps to use. This does not take
-	 *        ownership over the caps.
+	 * @param p_sinkCaps Sink caps to use. The player keeps its
+	 *        own reference to the caps.
 	 */
 	void setSinkCaps(GstCaps *p_sinkCaps);
 	/**
@@ -167,12 +275,153 @@ public:
 	 *
 	 * This is a variant of setSinkCaps() that limits only the
 	 * set of pixel formats frames can use. Other capabilities such
-	 * as width, height, framerate remain unrestricted.
+	 * as width, height, framerate remain unrestricted, except for
+	 * the frame size limit set by setMaxVideoSize().
 	 *
 	 * @param p_videoFormats The set of allowed video formats.
 	 *        Must not be empty.
+	 * @param p_capsFeature Caps feature the frames must have, for
+	 *        example "memory:GLMemory". If this is null, frames
+	 *        are produced in system memory. The string must remain
+	 *        valid for as long as the player exists.
+	 */
+	void setSinkCapsFromVideoFormats(std::vector < GstVideoFormat > const &p_videoFormats, char const *p_capsFeature = nullptr);
+	/**
+	 * Sets a GStreamer context on the video output elements.
+	 *
+	 * This is used for sharing resources such as an OpenGL context
+	 * with the elements that produce the video frames. Like the sink
+	 * caps, contexts must be set before playback is started.
+	 *
+	 * @param p_context GStreamer context to set. The player keeps
+	 *        its own reference to the context. Contexts of the same
+	 *        type replace each other.
+	 */
+	void setVideoSinkContext(GstContext *p_context);
+	/**
+	 * Sets the factory for buffer pools that are proposed to upstream elements.
+	 *
+	 * Decoders and converters then write the frames directly into buffers
+	 * from these pools (if they support it). See
+	 * setGStreamerVideoRendererBufferPoolFactory() for details. This can
+	 * be called at any time; pass an invalid function object to stop
+	 * proposing pools.
+	 *
+	 * @param p_factory Buffer pool factory.
+	 * @param p_numHeldBuffers How many frames the caller holds at most
+	 *        at the same time.
+	 */
+	void setVideoSinkBufferPoolFactory(BufferPoolFactory p_factory, unsigned int const p_numHeldBuffers);
+	/**
+	 * Configures sources and decoders to export DMA-BUFs if possible.
+	 *
+	 * If enabled, V4L2 based capture devices and decoders that are
+	 * created by the playbin get their IO mode set to "dmabuf", which
+	 * makes them produce frames in DMA-BUF memory. Other elements are
+	 * unaffected. Like the sink caps, this must be set before playback
+	 * is started. It is disabled by default.
+	 *
+	 * @param p_preferDmaBuf true if DMA-BUFs shall be exported.
 	 */
-	void setSinkCapsFromVideoFormats(std::vector < GstVideoFormat > const &p_videoFormats);
+	void setPreferDmaBufMemory(bool const p_preferDmaBuf);
+	/**
+	 * Enables or disables frame pacing.
+	 *
+	 * With frame pacing, decoded frames are queued together with their
+	 * display times, and pullVideoSample() picks the frame that best
+	 * matches the vsync it is given. Like the sink caps, this must be
+	 * set before playback is started. It is disabled by default.
+	 *
+	 * @param p_framePacing true if frames shall be paced.
+	 */
+	void setFramePacing(bool const p_framePacing);
+	/**
+	 * Enables or disables low latency mode for live capture devices.
+	 *
+	 * If enabled, and the URL refers to a V4L2 capture device (v4l2:// or
+	 * imxv4l2://), the pipeline is set up for showing frames as early
+	 * as possible: the video appsink does not synchronize against the
+	 * clock, so frames are handed over as soon as they arrive, and the
+	 * queues inside the playbin are made leaky and hold at most one frame,
+	 * so that older frames are dropped instead of delaying newer ones.
+	 * Frame pacing is not used in this mode. Frames are stamped with
+	 * their capture time (see GStreamerMediaSample::getCaptureTime()).
+	 * Other URLs are unaffected. This can be changed at any time. It is
+	 * disabled by default.
+	 *
+	 * @param p_lowLatencyCapture true if capture devices shall be
+	 *        played with low latency.
+	 */
+	void setLowLatencyCapture(bool const p_lowLatencyCapture);
+	bool getLowLatencyCapture() const;
+	/**
+	 * Returns true if low latency capture is enabled, and the
+	 * current URL refers to a live capture device.
+	 */
+	bool isLiveCapture() const;
+	/**
+	 * Limits the size of the frames the player produces.
+	 *
+	 * Frames that are larger than the given size are downscaled by the
+	 * player (preserving the aspect ratio), so that decoded frames that
+	 * are much larger than what is visible on screen do not have to be
+	 * converted and uploaded at full size. Frames that are smaller are
+	 * left unchanged. An empty size removes the limit.
+	 *
+	 * The limit is only applied after it stopped changing for a short
+	 * while, and is rounded and subject to hysteresis, so that continuous
+	 * size changes (for example during animations) do not cause constant
+	 * renegotiations in the pipeline. This only has an effect if the sink
+	 * caps were set with setSinkCapsFromVideoFormats(). It can be called
+	 * during playback.
+	 *
+	 * This function can be called from QML.
+	 *
+	 * @param p_maxVideoSize Maximum size of video frames, in pixels.
+	 */
+	Q_INVOKABLE void setMaxVideoSize(QSize p_maxVideoSize);
+	/**
+	 * Sets how much decoding work the player does.
+	 *
+	 * This is meant for reducing the work for players whose output is
+	 * barely visible. The tier is independent of the playback state; for
+	 * example, if play() is called while the tier is Suspended, playback
+	 * starts once the tier changes. The default tier is Full.
+	 *
+	 * @param p_decodingTier New decoding tier.
+	 */
+	void setDecodingTier(DecodingTier const p_decodingTier);
+	/// Returns the current decoding tier.
+	DecodingTier getDecodingTier() const;
+	/**
+	 * Enables or disables prerolling ahead of playback.
+	 *
+	 * If enabled while the player has no pipeline, a pipeline is acquired
+	 * and prerolled to the paused state, regardless of the decoding tier.
+	 * The first frame is then decoded and can be pulled right away, and
+	 * play() only needs to start the prerolled pipeline. This is meant
+	 * for players whose output is likely to be shown soon. Looping media
+	 * that is in the decoded frame cache is not prerolled, since it is
+	 * played without a pipeline anyway.
+	 *
+	 * If disabled while the pipeline is still prerolled (that is, neither
+	 * play() nor pause() were called since), the player is stopped, and
+	 * the pipeline is released. A play() call that is deferred by the
+	 * Suspended tier keeps the pipeline. Disabled by default.
+	 *
+	 * @param p_preroll true if the player shall preroll.
+	 */
+	void setPreroll(bool const p_preroll);
+	/// Returns true if the player prerolls ahead of playback.
+	bool getPreroll() const;
+	/**
+	 * Returns true if play() was called, and neither pause() nor stop()
+	 * were called since.
+	 *
+	 * Unlike the state, this is also true while playback is deferred
+	 * by the Suspended tier, or while the pipeline is still prerolling.
+	 */
+	bool isPlaybackRequested() const;
 
 	/**
 	 * Starts playback if not playing yet, or resumes if paused.
@@ -214,7 +463,8 @@ public:
 	 * state is already Stopped, this does nothing.
 	 *
 	 * Unlike other calls, this blocks until the Stopped
-	 * state is reached.
+	 * state is reached. The pipeline is then released
+	 * to the PlayerPipelinePool.
 	 *
 	 * This function can be called from QML.
 	 */
@@ -226,16 +476,39 @@ public:
 	Q_INVOKABLE void seek(int p_position);
 
 	/**
-	 * Pulls the current video sample from the video appsink.
+	 * Pulls the newest video sample that arrived since the last call.
+	 *
+	 * This does not block; samples are handed over from the streaming
+	 * thread through a lock-free triple buffer. If no new sample arrived,
+	 * the media sample's getSample() function will return a null pointer.
+	 * Only one thread may call this at the same time.
 	 *
-	 * If the appsink currently has no sample, the media sample's
-	 * getSample() function will return a null pointer.
+	 * If frame pacing is enabled, the frame whose display time best
+	 * matches p_vsyncTime is returned, and at most one frame is returned
+	 * per vsync. The frame pacing statistics are counted for calls that
+	 * pass a vsync time.
+	 *
+	 * While frames are served from the decoded frame cache, the cached
+	 * frame whose timestamp is due at p_vsyncTime (or now, if that is
+	 * invalid) is returned instead, unless it was returned already.
 	 *
 	 * Note that the returned media sample holds a reference to
 	 * the underlying GstSample, so make sure the media sample
 	 * is discarded once it is no longer needed.
+	 *
+	 * @param p_vsyncTime Predicted time of the vsync the frame will
+	 *        be shown at, in nanoseconds of the monotonic clock (the one
+	 *        used by g_get_monotonic_time()), or GST_CLOCK_TIME_NONE
+	 *        if it is unknown.
+	 * @param p_vsyncInterval Time between two vsyncs, in nanoseconds.
+	 */
+	GStreamerMediaSample pullVideoSample(GstClockTime const p_vsyncTime = GST_CLOCK_TIME_NONE, GstClockTime const p_vsyncInterval = GST_CLOCK_TIME_NONE);
+	/**
+	 * Returns true if frame pacing is enabled, and frames are
+	 * queued for later vsyncs. The caller should then call
+	 * pullVideoSample() again at the next vsync.
 	 */
-	GStreamerMediaSample pullVideoSample();
+	bool hasQueuedVideoSamples() const;
 
 
 signals:
@@ -288,10 +561,12 @@ signals:
 	/**
 	 * This signal is emitted when the current playback position changed.
 	 *
-	 * The current position is passed as an argument here, because
-	 * it is supplied by GstPlayer, and calling getPosition() would
-	 * be an alternative with slightly more overhead (because it calls
-	 * gst_player_get_position()).
+	 * The current position is passed as an argument here for
+	 * convenience; getPosition() returns the same value.
+	 *
+	 * Position updates are coalesced by the signal dispatcher, so
+	 * this is emitted at most once per window frame, with the
+	 * latest position.
 	 *
 	 * @param newPosition New playback position, in milliseconds
 	 *        If no position is known, this is set to -1.
@@ -307,10 +582,37 @@ signals:
 	 * new subtitles are available, then these subtitles will be dropped.
 	 */
 	void subtitleChanged();
+	/// This signal is emitted when the loop property changes.
+	void loopChanged();
+	/// This signal is emitted after each segment seek based loop transition.
+	void loopTransitionLatencyChanged();
+	/// This signal is emitted when the playingFromCache property changes.
+	void playingFromCacheChanged();
 
 
 private:
+	void acquirePipeline();
+	void releasePipeline();
+	void preroll();
+	void updateElementSetupHandler();
+	void applyLowLatencyCapture();
 	GstFlowReturn onNewSubtitleSample();
+	void applyMaxVideoSize();
+	void updateSinkCapsFromVideoFormats();
+	void setFrameThrottling(bool const p_enabled);
+	void setKeyframeTrickMode(bool const p_enabled);
+	bool seekPipeline(gint64 const p_position, bool const p_keyframesOnly, bool const p_flush = true);
+	void updateSegmentLoop();
+	Q_INVOKABLE void onSegmentDone(qint64 p_segmentDoneTime);
+	void switchToCachedPlayback();
+	void cancelCacheSwitch();
+	void startCachedPlayback(DecodedClipSPtr p_clip);
+	void stopCachedPlayback();
+	void pauseCachedPlayback();
+	void resumeCachedPlayback();
+	void onCachedPlaybackTimer();
+	GstClockTime getCachedClipTime(GstClockTime const p_time) const;
+	GStreamerMediaSample makeConsumedSample(GstSample *p_sample, bool p_sampleHasNewCaps);
 
 	static void staticOnGstPlayerEndOfStream(GStreamerPlayer *self);
 	static void staticOnGstPlayerStateChanged(GStreamerPlayer *self, GstPlayerState p_state);
@@ -319,17 +621,103 @@ private:
 	static void staticOnGstPlayerBufferingChanged(GStreamerPlayer *self, gint p_percentage);
 	static void staticOnGstPlayerMediaInfoUpdated(GStreamerPlayer *self, GstPlayerMediaInfo *p_mediaInfo);
 
+	// The pipeline is only present while it is needed (see
+	// acquirePipeline()). The other pointers are shortcuts to its
+	// elements, and are null while there is no pipeline. Other threads
+	// call pullVideoSample(), so pipeline changes are protected by
+	// a mutex. The main Qt thread reads them without locking, since
+	// it is the only thread that changes them.
+	PlayerPipelineUPtr m_pipeline;
+	mutable std::mutex m_pipelineMutex;
 	GstPlayer *m_gstplayer;
 	GstPlayerSignalDispatcher *m_gstdispatcher;
 	GstPlayerVideoRenderer *m_gstvidrenderer;
 	GstElement *m_subtitleAppsink;
+	gulong m_elementSetupHandlerId;
+	gulong m_queueSetupHandlerId;
+
+	// Receiver of the pipeline bus' segment-done messages. These are
+	// handled in streaming threads, which may still be running the
+	// handler while the pipeline is released, so the handler refers
+	// to this player only through this object, which is detached from
+	// the player once the pipeline is released (see acquirePipeline()).
+	struct SegmentDoneTarget;
+	std::shared_ptr < SegmentDoneTarget > m_segmentDoneTarget;
+	gulong m_segmentDoneHandlerId;
+
+	// Video output configuration. This is applied to the
+	// pipeline whenever one is acquired.
+	GstCaps *m_sinkCaps;
+	std::vector < GstContext* > m_videoSinkContexts;
+	BufferPoolFactory m_bufferPoolFactory;
+	unsigned int m_numHeldBuffers;
+	bool m_preferDmaBuf;
+	bool m_framePacing;
+	bool m_lowLatencyCapture;
+
+	std::vector < GstVideoFormat > m_sinkVideoFormats;
+	char const *m_sinkCapsFeature;
+	// The currently applied frame size limit, and the one that
+	// is applied once m_maxVideoSizeTimer times out.
+	QSize m_maxVideoSize;
+	QSize m_pendingMaxVideoSize;
+	QTimer m_maxVideoSizeTimer;
 
 	QUrl m_url;
 	State m_state;
+	// Position in milliseconds as last reported by GstPlayer,
+	// or -1 if unknown. Returned by getPosition().
+	int m_position;
+
+	DecodingTier m_decodingTier;
+	// True if play() was called, and neither pause() nor stop()
+	// were called since. Used for resuming playback once the
+	// Suspended decoding tier is left.
+	bool m_playRequested;
+	// m_preroll is set by setPreroll(). m_prerolled is true while the
+	// pipeline was only acquired for prerolling, and playback was
+	// neither started nor explicitly paused since. (A play() call
+	// that is deferred by the Suspended tier does not start it.)
+	bool m_preroll;
+	bool m_prerolled;
+	// True if the current segment is a key unit trick mode one.
+	bool m_keyframeTrickModeActive;
+
+	bool m_loop;
+	// True if the current segment was set up with a segment seek,
+	// so the pipeline posts segment-done instead of ending the stream.
+	bool m_segmentLoopActive;
+	double m_loopTransitionLatency;
+
+	// Decoded frame cache state. The frame notification callback is
+	// also invoked by m_cachedPlaybackTimer for cached frames.
+	NewVideoFrameAvailableCB m_newVideoFrameAvailableCB;
+	DecodedClipRecorder m_clipRecorder;
+	// Cache key of the media the recorder records.
+	QString m_recordingKey;
+	// Runs from the segment-done message of the first pass until
+	// the last frames of that pass were shown.
+	QTimer m_cacheSwitchTimer;
+	// Fires whenever the next cached frame is due.
+	QTimer m_cachedPlaybackTimer;
+	bool m_playingFromCache;
+	// The cached playback state is read by pullVideoSample(),
+	// so it is protected by a mutex. m_cachedClip is null unless
+	// frames are served from the cache. The clip's time 0 is (or was)
+	// shown at m_cachedPlaybackStartTime, in nanoseconds of the
+	// monotonic clock. While paused, the clip time is frozen at
+	// m_cachedPlaybackPausePosition; otherwise, that is invalid.
+	mutable std::mutex m_cachedPlaybackMutex;
+	DecodedClipSPtr m_cachedClip;
+	GstClockTime m_cachedPlaybackStartTime;
+	GstClockTime m_cachedPlaybackPausePosition;
+	bool m_cachedPlaybackLoop;
+	// Only accessed by the thread that calls pullVideoSample().
+	DecodedClipSPtr m_servedClip;
+	std::size_t m_servedFrameIndex;
+	GstCaps *m_consumedCaps;
 
 	QString m_subtitle;
-
-	GstCaps *m_lastSampleCaps;
 };
 
 typedef std::unique_ptr < GStreamerPlayer > GStreamerPlayerUPtr;
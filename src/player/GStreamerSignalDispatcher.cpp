@@ -17,14 +17,20 @@
  */
 
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <utility>
+#include <vector>
 #include <gst/gst.h>
 #include <QDebug>
 #include <QLoggingCategory>
 #include <QCoreApplication>
 #include <QEvent>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QTimer>
 #include "GStreamerSignalDispatcher.hpp"
-#include "GStreamerPlayer.hpp"
 
 
 Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
@@ -81,6 +87,104 @@ void postFunctionToThread(QObject *p_receiver, F && p_function)
 }
 
 
+typedef void (*EmitterFunc)(gpointer data);
+
+
+// A signal emission that was dispatched by the GstPlayer thread,
+// but was not yet handled in the main Qt thread.
+struct PendingEmission
+{
+	EmitterFunc emitter;
+	gpointer emitterData;
+	GDestroyNotify emitterDestroy;
+};
+
+typedef std::vector < PendingEmission > PendingEmissions;
+
+
+// Room for this many pending emissions is allocated up front,
+// so that dispatching normally does not allocate any memory.
+std::size_t const PendingEmissionsPoolSize = 16;
+
+// Used if the refresh rate of the primary screen is unknown.
+qreal const DefaultRefreshRate = 60.0;
+
+
+// GstPlayer signals that just carry their latest value. Each of them
+// is emitted by one emitter function of the GstPlayer library, which
+// is the same for all GstPlayer instances. The dispatcher interface
+// does not reveal which signal an emitter emits, so the emitters are
+// recorded by signal handlers the first time the signals are emitted
+// (see watchCoalescableGStreamerSignals()). GstPlayer signals do not
+// support emission hooks, so these cannot be used instead.
+struct CoalescableSignal
+{
+	char const *name;
+	std::atomic < EmitterFunc > emitter;
+};
+
+CoalescableSignal coalescableSignals[] = {
+	{ "position-updated", { nullptr } },
+	{ "duration-changed", { nullptr } },
+	{ "buffering", { nullptr } }
+};
+
+// Emitter that is currently being invoked, or null if none is.
+// Only accessed by the main Qt thread.
+EmitterFunc currentEmitter = nullptr;
+
+
+void destroyEmission(PendingEmission const &p_emission)
+{
+	if (p_emission.emitterDestroy != nullptr)
+		p_emission.emitterDestroy(p_emission.emitterData);
+}
+
+
+bool isCoalescable(EmitterFunc const p_emitter)
+{
+	for (CoalescableSignal const &coalescableSignal : coalescableSignals)
+	{
+		if (coalescableSignal.emitter.load(std::memory_order_acquire) == p_emitter)
+			return true;
+	}
+
+	return false;
+}
+
+
+void recordCoalescableEmitter(std::size_t const p_index)
+{
+	CoalescableSignal &coalescableSignal = coalescableSignals[p_index];
+
+	// Nothing to do if the emitter is known already, or if the
+	// signal was not emitted by a dispatched emission.
+	if ((coalescableSignal.emitter.load(std::memory_order_relaxed) != nullptr) || (currentEmitter == nullptr))
+		return;
+
+	coalescableSignal.emitter.store(currentEmitter, std::memory_order_release);
+	qCDebug(lcQtGLVidDemo) << "Coalescing emissions of GstPlayer signal" << coalescableSignal.name;
+}
+
+
+template < typename T, std::size_t Index >
+void onCoalescableSignal(GstPlayer *, T, gpointer)
+{
+	recordCoalescableEmitter(Index);
+}
+
+
+int getFrameInterval()
+{
+	QScreen *screen = QGuiApplication::primaryScreen();
+	qreal refreshRate = (screen != nullptr) ? screen->refreshRate() : 0.0;
+	if (refreshRate < 1.0)
+		refreshRate = DefaultRefreshRate;
+
+	return int(std::ceil(1000.0 / refreshRate));
+}
+
+
 } // unnamed namespace end
 
 
@@ -89,7 +193,24 @@ void postFunctionToThread(QObject *p_receiver, F && p_function)
 struct GStreamerSignalDispatcher
 {
 	GObject parent;
-	qtglviddemo::GStreamerPlayer *player;
+	QObject *receiver;
+
+	// Protects pendingEmissions and wakeupScheduled, which are
+	// accessed by both the GstPlayer thread and the main Qt thread.
+	GMutex mutex;
+	PendingEmissions *pendingEmissions;
+	// True if an event that handles the pending emissions is in the
+	// Qt event queue, or if the frame timer is active. Further
+	// emissions do not post another event.
+	gboolean wakeupScheduled;
+
+	// Only accessed by the main Qt thread. The spare vector is swapped
+	// with pendingEmissions when the emissions are handled, so neither
+	// vector is reallocated in the steady state.
+	PendingEmissions *spareEmissions;
+	// Handles the emissions that arrived during the last window frame.
+	// While it is active, it holds a reference to the dispatcher.
+	QTimer *frameTimer;
 };
 
 
@@ -105,6 +226,7 @@ namespace
 
 void dispatch(GstPlayerSignalDispatcher *p_iface, GstPlayer *p_gstplayer, void (*p_emitter)(gpointer data), gpointer p_emitter_data, GDestroyNotify p_emitter_destroy);
 void initDispatcherInterface(GstPlayerSignalDispatcherInterface *p_iface);
+void finalizeDispatcher(GObject *p_object);
 
 
 } // unnamed namespace end
@@ -120,16 +242,24 @@ G_DEFINE_TYPE_WITH_CODE(
 )
 
 
-// Init function definitions necessary for the GObject boilerplate. We do not
-// need to initialize anything, so they are empty, but they must still exist.
-// (See G_DEFINE_TYPE_WITH_CODE documentation for details.)
+// These _class_init and _init functions are declared by the
+// G_DEFINE_TYPE_WITH_CODE() boilerplate.
 
-static void gstreamer_signal_dispatcher_class_init(GStreamerSignalDispatcherClass *)
+static void gstreamer_signal_dispatcher_class_init(GStreamerSignalDispatcherClass *klass)
 {
+	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+	gobject_class->finalize = GST_DEBUG_FUNCPTR(finalizeDispatcher);
 }
 
-static void gstreamer_signal_dispatcher_init(GStreamerSignalDispatcher *)
+static void gstreamer_signal_dispatcher_init(GStreamerSignalDispatcher *dispatcher)
 {
+	g_mutex_init(&(dispatcher->mutex));
+	dispatcher->pendingEmissions = new PendingEmissions;
+	dispatcher->pendingEmissions->reserve(PendingEmissionsPoolSize);
+	dispatcher->wakeupScheduled = FALSE;
+	dispatcher->spareEmissions = new PendingEmissions;
+	dispatcher->spareEmissions->reserve(PendingEmissionsPoolSize);
+	dispatcher->frameTimer = nullptr;
 }
 
 
@@ -137,20 +267,121 @@ namespace
 {
 
 
+bool handlePendingEmissions(GStreamerSignalDispatcher *p_dispatcher)
+{
+	// Normally, the spare vector is available here. It is only missing
+	// if an emission handler ran a nested event loop which handled more
+	// emissions; in that rare case, a new vector is allocated.
+	PendingEmissions *emissions = p_dispatcher->spareEmissions;
+	p_dispatcher->spareEmissions = nullptr;
+	if (emissions == nullptr)
+		emissions = new PendingEmissions;
+
+	// Take all pending emissions. If there were none, no signals were
+	// dispatched during the last window frame, so go idle, and let the
+	// next emission post a new event. Otherwise, keep the wakeup
+	// scheduled; emissions that arrive in the meantime are then
+	// handled in the next window frame.
+	g_mutex_lock(&(p_dispatcher->mutex));
+	std::swap(p_dispatcher->pendingEmissions, emissions);
+	bool handledEmissions = !emissions->empty();
+	if (!handledEmissions)
+		p_dispatcher->wakeupScheduled = FALSE;
+	g_mutex_unlock(&(p_dispatcher->mutex));
+
+	// Restore the previous emitter afterwards in case
+	// this is run by a nested event loop of a handler.
+	EmitterFunc previousEmitter = currentEmitter;
+	for (PendingEmission const &emission : *emissions)
+	{
+		currentEmitter = emission.emitter;
+		emission.emitter(emission.emitterData);
+		destroyEmission(emission);
+	}
+	currentEmitter = previousEmitter;
+
+	// clear() keeps the capacity, so the vector can be reused.
+	emissions->clear();
+	if (p_dispatcher->spareEmissions == nullptr)
+		p_dispatcher->spareEmissions = emissions;
+	else
+		delete emissions;
+
+	return handledEmissions;
+}
+
+
+void wakeUp(GStreamerSignalDispatcher *p_dispatcher)
+{
+	// Check again in the next window frame for as long as signals
+	// keep being dispatched. Like FrameArrivalAggregator, this way,
+	// a burst of emissions wakes up the main Qt thread at most once
+	// per window frame, no matter how fast it could handle them.
+	if (handlePendingEmissions(p_dispatcher))
+	{
+		g_object_ref(G_OBJECT(p_dispatcher));
+		p_dispatcher->frameTimer->start();
+	}
+}
+
+
 void dispatch(GstPlayerSignalDispatcher *p_iface, GstPlayer *, void (*p_emitter)(gpointer data), gpointer p_emitter_data, GDestroyNotify p_emitter_destroy)
 {
 	GStreamerSignalDispatcher *self = (GStreamerSignalDispatcher *)p_iface;
 
-	QObject *receiver = static_cast < QObject* > (self->player);
+	PendingEmission newEmission = { p_emitter, p_emitter_data, p_emitter_destroy };
+	PendingEmission replacedEmission = { nullptr, nullptr, nullptr };
+	bool postWakeup;
 
-	qCDebug(lcQtGLVidDemo) << "Dispatching GstPlayer signal; emitter data" << p_emitter_data;
+	bool coalescable = isCoalescable(p_emitter);
 
-	// Make sure the signal emission is handled in the main Qt thread.
-	postFunctionToThread(receiver, [=]() {
-		qCDebug(lcQtGLVidDemo) << "Handling dispatched GstPlayer signal; emitter data" << p_emitter_data;
-		p_emitter(p_emitter_data);
-		if (p_emitter_destroy != nullptr)
-			p_emitter_destroy(p_emitter_data);
+	g_mutex_lock(&(self->mutex));
+
+	// If the signal only carries its latest value, and an emission of
+	// that signal is still pending, replace the pending emission's data
+	// instead of adding another emission. This way, a burst of position
+	// or buffering updates ends up as only one emission with the latest
+	// value, while the order of the other signals is preserved.
+	auto pendingIter = self->pendingEmissions->end();
+	if (coalescable)
+	{
+		pendingIter = std::find_if(self->pendingEmissions->begin(), self->pendingEmissions->end(), [&](PendingEmission const &p_emission) {
+			return p_emission.emitter == p_emitter;
+		});
+	}
+
+	if (pendingIter != self->pendingEmissions->end())
+	{
+		replacedEmission = *pendingIter;
+		*pendingIter = newEmission;
+	}
+	else
+		self->pendingEmissions->push_back(newEmission);
+
+	postWakeup = !(self->wakeupScheduled);
+	self->wakeupScheduled = TRUE;
+
+	g_mutex_unlock(&(self->mutex));
+
+	// Destroy the replaced emission's data outside of the lock,
+	// since this releases a reference to the gstplayer.
+	destroyEmission(replacedEmission);
+
+	if (!postWakeup)
+		return;
+
+	// Make sure the signal emissions are handled in the main Qt thread.
+	// Only the first emission after an idle period posts an event; the
+	// ones that follow are picked up by the frame timer (see wakeUp()).
+	// The event holds a reference to the dispatcher, since it might
+	// otherwise be destroyed before the event is handled. (Like the
+	// gstplayer, the event's function is run even if the receiver is
+	// destroyed before the event is handled. The emissions do nothing
+	// then, see the description in GStreamerSignalDispatcher.hpp.)
+	g_object_ref(G_OBJECT(self));
+	postFunctionToThread(self->receiver, [self]() {
+		wakeUp(self);
+		g_object_unref(G_OBJECT(self));
 	});
 }
 
@@ -161,6 +392,30 @@ void initDispatcherInterface(GstPlayerSignalDispatcherInterface *p_iface)
 }
 
 
+void finalizeDispatcher(GObject *p_object)
+{
+	GStreamerSignalDispatcher *self = reinterpret_cast < GStreamerSignalDispatcher* > (p_object);
+
+	// Emissions hold a reference to the gstplayer, which in turn
+	// holds the dispatcher, so there should not be any pending
+	// emissions here. Release them anyway to be on the safe side.
+	for (PendingEmission const &emission : *(self->pendingEmissions))
+		destroyEmission(emission);
+
+	// The last reference may be released by the frame timer's own
+	// timeout handler, or in another thread, so the timer cannot
+	// be deleted right away.
+	if (self->frameTimer != nullptr)
+		self->frameTimer->deleteLater();
+
+	delete self->pendingEmissions;
+	delete self->spareEmissions;
+	g_mutex_clear(&(self->mutex));
+
+	G_OBJECT_CLASS(gstreamer_signal_dispatcher_parent_class)->finalize(p_object);
+}
+
+
 } // unnamed namespace end
 
 
@@ -168,12 +423,60 @@ namespace qtglviddemo
 {
 
 
-GstPlayerSignalDispatcher* createGStreamerSignalDispatcher(GStreamerPlayer *player)
+GstPlayerSignalDispatcher* createGStreamerSignalDispatcher(QObject *receiver)
 {
 	gpointer dispatcher = g_object_new(gstreamer_signal_dispatcher_get_type(), nullptr);
-	static_cast < GStreamerSignalDispatcher* > (dispatcher)->player = player;
+	GStreamerSignalDispatcher *self = static_cast < GStreamerSignalDispatcher* > (dispatcher);
+
+	self->receiver = receiver;
+
+	// The frame timer is started and stopped in the receiver's thread,
+	// so it has to live there. It is only started by wakeUp(), which
+	// already holds a reference for it.
+	self->frameTimer = new QTimer;
+	self->frameTimer->moveToThread(receiver->thread());
+	self->frameTimer->setSingleShot(true);
+	self->frameTimer->setTimerType(Qt::PreciseTimer);
+	self->frameTimer->setInterval(getFrameInterval());
+	QObject::connect(self->frameTimer, &QTimer::timeout, [self]() {
+		wakeUp(self);
+		g_object_unref(G_OBJECT(self));
+	});
+
 	return static_cast < GstPlayerSignalDispatcher* > (dispatcher);
 }
 
 
+void watchCoalescableGStreamerSignals(GstPlayer *gstplayer)
+{
+	// The order of the signals must match coalescableSignals.
+	g_signal_connect(G_OBJECT(gstplayer), "position-updated", G_CALLBACK((onCoalescableSignal < guint64, 0 >)), nullptr);
+	g_signal_connect(G_OBJECT(gstplayer), "duration-changed", G_CALLBACK((onCoalescableSignal < guint64, 1 >)), nullptr);
+	g_signal_connect(G_OBJECT(gstplayer), "buffering", G_CALLBACK((onCoalescableSignal < gint, 2 >)), nullptr);
+}
+
+
+void discardPendingGStreamerSignals(GstPlayerSignalDispatcher *dispatcher)
+{
+	GStreamerSignalDispatcher *self = (GStreamerSignalDispatcher *)dispatcher;
+
+	// Copy the emissions and clear the vector instead of swapping
+	// it, so it keeps its capacity. An event or frame timer that is
+	// already scheduled for these emissions then just finds an empty
+	// vector. The coalescable signals are registered process-wide,
+	// so they stay coalesced for the new user of the gstplayer.
+	PendingEmissions droppedEmissions;
+
+	g_mutex_lock(&(self->mutex));
+	droppedEmissions = *(self->pendingEmissions);
+	self->pendingEmissions->clear();
+	g_mutex_unlock(&(self->mutex));
+
+	// Destroy the emissions' data outside of the lock,
+	// since this releases references to the gstplayer.
+	for (PendingEmission const &emission : droppedEmissions)
+		destroyEmission(emission);
+}
+
+
 } // namespace qtglviddemo end
@@ -23,11 +23,11 @@
 #include <gst/player/player.h>
 
 
-namespace qtglviddemo
-{
+class QObject;
 
 
-class GStreamerPlayer;
+namespace qtglviddemo
+{
 
 
 /**
@@ -57,8 +57,57 @@ class GStreamerPlayer;
  * gst_player_stop() is called, which raises this flag. If the lingering emissions
  * are dispatched later when the Qt event loop processes them, this dispatch only
  * releases the gstplayer reference and does nothing else.
+ *
+ * To avoid flooding the Qt event loop, emissions are not posted one by one.
+ * Instead, they are collected in a preallocated list. The first emission
+ * after an idle period posts an event, which handles all emissions that
+ * are pending by then. For as long as signals keep being dispatched, the
+ * pending emissions are then handled once per window frame (based on the
+ * refresh rate of the primary screen), like FrameArrivalAggregator does
+ * with frame arrivals, so a burst of emissions wakes up the main Qt thread
+ * at most once per window frame. Signals that just carry their latest
+ * value (position updates, duration changes, and buffering percentages)
+ * are coalesced: if such a signal is emitted again while an older emission
+ * of it is still pending, the older one is replaced, so only the latest
+ * value is delivered per window frame. See watchCoalescableGStreamerSignals().
+ *
+ * @param receiver QObject that receives the events which carry the
+ *        emissions. The emissions are handled in its thread. It must
+ *        outlive the dispatcher. Since the gstplayer that owns the
+ *        dispatcher may be passed on between GStreamerPlayer instances
+ *        (see PlayerPipelinePool), this is typically not a player.
+ */
+GstPlayerSignalDispatcher* createGStreamerSignalDispatcher(QObject *receiver);
+/**
+ * Lets the dispatchers recognize the signals of the given gstplayer
+ * that only carry their latest value.
+ *
+ * The GstPlayer signal dispatcher interface does not reveal which signal
+ * is emitted. The emissions of each signal are however always done by the
+ * same emitter function of the GstPlayer library, which is shared by all
+ * GstPlayer instances. This connects handlers to the position-updated,
+ * duration-changed, and buffering signals, which record the emitter
+ * functions the first time these signals are emitted. From then on, all
+ * dispatchers coalesce emissions of these signals, including the ones of
+ * gstplayers that are handed over to another user.
+ *
+ * This must be called right after the gstplayer is created, before
+ * anything else connects to its signals.
+ *
+ * @param gstplayer Newly created gstplayer that uses a dispatcher
+ *        created by createGStreamerSignalDispatcher().
+ */
+void watchCoalescableGStreamerSignals(GstPlayer *gstplayer);
+/**
+ * Drops all emissions that are pending.
+ *
+ * This is used when the gstplayer that owns the dispatcher is handed over
+ * to another user, so that signals that were meant for the previous user
+ * are not delivered to the new one. Must be called from the main Qt thread.
+ *
+ * @param dispatcher Dispatcher whose pending emissions shall be dropped.
  */
-GstPlayerSignalDispatcher* createGStreamerSignalDispatcher(GStreamerPlayer *player);
+void discardPendingGStreamerSignals(GstPlayerSignalDispatcher *dispatcher);
 
 
 } // namespace qtglviddemo end
@@ -17,19 +17,137 @@
  */
 
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <utility>
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/video/video.h>
+#include "base/TripleBuffer.hpp"
 #include "GStreamerVideoRenderer.hpp"
 
 
+namespace
+{
+
+
+// Slot of the triple buffer that hands over frames from the
+// streaming thread to the consumer. The caps generation is
+// incremented by the streaming thread whenever the caps change,
+// so the consumer can detect caps changes by comparing integers,
+// even if samples with new caps were dropped in between.
+struct VideoSampleSlot
+{
+	VideoSampleSlot()
+		: sample(nullptr)
+		, capsGeneration(0)
+		, displayTime(GST_CLOCK_TIME_NONE)
+		, captureTime(GST_CLOCK_TIME_NONE)
+	{
+	}
+
+	~VideoSampleSlot()
+	{
+		if (sample != nullptr)
+			gst_sample_unref(sample);
+	}
+
+	GstSample *sample;
+	guint capsGeneration;
+	// Pipeline clock time at which the frame is meant to be shown.
+	GstClockTime displayTime;
+	// Monotonic time at which the frame was captured, if known.
+	GstClockTime captureTime;
+};
+
+typedef qtglviddemo::TripleBuffer < VideoSampleSlot > VideoSampleTripleBuffer;
+
+
+// Entry in the frame pacing queue. Unlike VideoSampleSlot, this does
+// not unref the sample by itself, since entries are copied around.
+struct PacedSample
+{
+	GstSample *sample;
+	guint capsGeneration;
+	GstClockTime displayTime;
+	GstClockTime captureTime;
+};
+
+typedef std::deque < PacedSample > PacedSamples;
+
+
+// With frame pacing, the appsink hands over frames this long before
+// their display time, so that a few of them are queued at a time.
+GstClockTimeDiff const FramePacingLead = 40 * GST_MSECOND;
+// Maximum number of frames in the frame pacing queue. If it is full,
+// the oldest frame is dropped.
+std::size_t const MaxPacedSamples = 4;
+
+
+} // unnamed namespace end
+
+
 struct GStreamerVideoRenderer
 {
 	GObject parent;
 	GstElement *videoBin;
 	GstElement *videoAppsink;
+	GstPad *videoBinSinkPad;
+	// Elements in front of the appsink. Which ones are present
+	// depends on whether or not frames are in GL memory.
+	GList *converterElements;
+	gboolean usesGLMemory;
+	// Invoked by streaming threads, but can be replaced at any
+	// time, so these are protected by a mutex.
+	GMutex callbacksMutex;
 	qtglviddemo::NewVideoFrameAvailableCB newVideoFrameAvailableCB;
+	qtglviddemo::SampleObserver *sampleObserver;
+	// Set by the application thread, used by streaming threads,
+	// so it is protected by a mutex.
+	GMutex bufferPoolFactoryMutex;
+	qtglviddemo::BufferPoolFactory *bufferPoolFactory;
+	guint numHeldBuffers;
+	// Frames are pulled from the appsink by the streaming thread as
+	// soon as they arrive, and are handed over to the consumer through
+	// this triple buffer (see installSampleCallbacks()).
+	VideoSampleTripleBuffer *sampleBuffer;
+	// Only accessed by the streaming thread.
+	GstCaps *lastProducedCaps;
+	guint producedCapsGeneration;
+	// Buffer of the last preroll sample. Only used for recognizing
+	// it when it is rendered once playback starts. It is ref'd, so
+	// its buffer pool cannot recycle it for a different frame while
+	// it is stored here. Cleared on flushes and when samples are
+	// discarded, since the pipeline may be reused for other media.
+	GstBuffer *prerollBuffer;
+	// Only accessed by the consumer.
+	guint consumedCapsGeneration;
+
+	// With frame pacing, samples are queued here instead of being
+	// published in the triple buffer. Can be changed by the application
+	// thread during playback, so it is accessed with atomic operations.
+	gint framePacingEnabled;
+	// Frame pacing mode the last sample was produced with. Only
+	// accessed by the streaming thread.
+	gint producedFramePacing;
+	GMutex pacedSamplesMutex;
+	PacedSamples *pacedSamples;
+	// Vsync time the consumer last got a sample for. Only
+	// accessed by the consumer.
+	GstClockTime lastVsyncTime;
+	// Frame pacing statistics. Accessed with atomic operations.
+	gint numSkippedFrames;
+	gint numDuplicateFrames;
+	gint numJudderFrames;
+
+	// In low latency mode, the appsink does not synchronize against
+	// the clock, and frames are stamped with their capture time. Set
+	// by the application thread, read by streaming threads, so it is
+	// accessed with atomic operations.
+	gint lowLatencyEnabled;
 };
 
 
@@ -45,6 +163,10 @@ namespace
 GstElement* createVideoSink(GstPlayerVideoRenderer *p_iface, GstPlayer *p_gstplayer);
 void initVideoRenderInterface(GstPlayerVideoRendererInterface *p_iface);
 void disposeVideoRenderer(GObject *p_object);
+void finalizeVideoRenderer(GObject *p_object);
+GstPadProbeReturn allocationQueryProbe(GstPad *, GstPadProbeInfo *p_info, gpointer p_user_data);
+GstPadProbeReturn flushEventProbe(GstPad *, GstPadProbeInfo *p_info, gpointer p_user_data);
+void setupConverterElements(GStreamerVideoRenderer *p_renderer, bool const p_useGLMemory);
 
 } // unnamed namespace end
 
@@ -65,6 +187,7 @@ static void gstreamer_video_renderer_class_init(GStreamerVideoRendererClass *kla
 {
 	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
 	gobject_class->dispose = GST_DEBUG_FUNCPTR(disposeVideoRenderer);
+	gobject_class->finalize = GST_DEBUG_FUNCPTR(finalizeVideoRenderer);
 }
 
 
@@ -77,8 +200,28 @@ static void gstreamer_video_renderer_init(GStreamerVideoRenderer *renderer)
 	// one element, we put all of these converter elements and the appsink
 	// into one bin, so that from the outside, they look like one element.
 	renderer->videoBin = gst_bin_new("videoBin");
-	GstElement *videoconvert = gst_element_factory_make("videoconvert", nullptr);
 	renderer->videoAppsink = gst_element_factory_make("appsink", "videoAppsink");
+	renderer->converterElements = nullptr;
+	renderer->usesGLMemory = FALSE;
+	g_mutex_init(&(renderer->callbacksMutex));
+	renderer->sampleObserver = nullptr;
+	g_mutex_init(&(renderer->bufferPoolFactoryMutex));
+	renderer->bufferPoolFactory = nullptr;
+	renderer->numHeldBuffers = 0;
+	renderer->sampleBuffer = new VideoSampleTripleBuffer;
+	renderer->lastProducedCaps = nullptr;
+	renderer->producedCapsGeneration = 0;
+	renderer->prerollBuffer = nullptr;
+	renderer->consumedCapsGeneration = 0;
+	renderer->framePacingEnabled = 0;
+	renderer->producedFramePacing = 0;
+	g_mutex_init(&(renderer->pacedSamplesMutex));
+	renderer->pacedSamples = new PacedSamples;
+	renderer->lastVsyncTime = GST_CLOCK_TIME_NONE;
+	renderer->numSkippedFrames = 0;
+	renderer->numDuplicateFrames = 0;
+	renderer->numJudderFrames = 0;
+	renderer->lowLatencyEnabled = 0;
 
 	// Configure the video appsink to drop the current frame is a new frame
 	// is produced and the application didn't pull the current frame yet.
@@ -87,15 +230,26 @@ static void gstreamer_video_renderer_init(GStreamerVideoRenderer *renderer)
 	g_object_set(G_OBJECT(renderer->videoAppsink), "sync", gboolean(TRUE), "max-buffers", guint(1), nullptr);
 	gst_app_sink_set_drop(GST_APP_SINK(renderer->videoAppsink), TRUE);
 
-	// Add the converter and appsink elements to the bin and link them.
-	gst_bin_add_many(GST_BIN(renderer->videoBin), videoconvert, renderer->videoAppsink, nullptr);
-	gst_element_link(videoconvert, renderer->videoAppsink);
+	gst_bin_add(GST_BIN(renderer->videoBin), renderer->videoAppsink);
 
 	// Set up a ghost pad. This ghost pad is added to the bin. Its job is
-	// to forward incoming data to the inner elements.
-	GstPad *pad = gst_element_get_static_pad(videoconvert, "sink");
-	gst_element_add_pad(renderer->videoBin, gst_ghost_pad_new("sink", pad));
-	gst_object_unref(GST_OBJECT(pad));
+	// to forward incoming data to the inner elements. Its target is set
+	// by setupConverterElements(), since the first inner element depends
+	// on the sink caps.
+	renderer->videoBinSinkPad = gst_ghost_pad_new_no_target("sink", GST_PAD_SINK);
+	gst_element_add_pad(renderer->videoBin, renderer->videoBinSinkPad);
+
+	// Answer allocation queries from upstream (see allocationQueryProbe()).
+	GstPad *appsinkPad = gst_element_get_static_pad(renderer->videoAppsink, "sink");
+	gst_pad_add_probe(appsinkPad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM, allocationQueryProbe, renderer, nullptr);
+	// Discard frames that were not consumed yet when the
+	// pipeline is flushed (see flushEventProbe()).
+	gst_pad_add_probe(appsinkPad, GST_PAD_PROBE_TYPE_EVENT_FLUSH, flushEventProbe, renderer, nullptr);
+	gst_object_unref(GST_OBJECT(appsinkPad));
+
+	// Add the converter elements to the bin and link them. By default,
+	// frames are expected to be in system memory.
+	setupConverterElements(renderer, false);
 
 	// Sink-ref the element. The video renderer's create_video_sink function
 	// is used by GstPlayer to get the video renderer element and pass it
@@ -143,31 +297,423 @@ void initVideoRenderInterface(GstPlayerVideoRendererInterface *p_iface)
 void disposeVideoRenderer(GObject *p_object)
 {
 	GStreamerVideoRenderer *self = reinterpret_cast < GStreamerVideoRenderer* > (p_object);
-	gst_object_unref(GST_OBJECT(self->videoBin));
+	if (self->videoBin != nullptr)
+	{
+		g_list_free(self->converterElements);
+		self->converterElements = nullptr;
+		gst_object_unref(GST_OBJECT(self->videoBin));
+		self->videoBin = nullptr;
+	}
 	G_OBJECT_CLASS(gstreamer_video_renderer_parent_class)->dispose(p_object);
 }
 
 
-void setNewVideoFrameAvailableCB(GStreamerVideoRenderer &p_videoRenderer, qtglviddemo::NewVideoFrameAvailableCB p_newVideoFrameAvailableCB)
+void finalizeVideoRenderer(GObject *p_object)
 {
-	p_videoRenderer.newVideoFrameAvailableCB = std::move(p_newVideoFrameAvailableCB);
+	GStreamerVideoRenderer *self = reinterpret_cast < GStreamerVideoRenderer* > (p_object);
+	delete self->bufferPoolFactory;
+	delete self->sampleObserver;
+	// This also unrefs any samples that are still in the slots.
+	delete self->sampleBuffer;
+	if (self->lastProducedCaps != nullptr)
+		gst_caps_unref(self->lastProducedCaps);
+	for (PacedSample const &pacedSample : *(self->pacedSamples))
+		gst_sample_unref(pacedSample.sample);
+	delete self->pacedSamples;
+	gst_buffer_replace(&(self->prerollBuffer), nullptr);
+	g_mutex_clear(&(self->pacedSamplesMutex));
+	g_mutex_clear(&(self->bufferPoolFactoryMutex));
+	g_mutex_clear(&(self->callbacksMutex));
+	G_OBJECT_CLASS(gstreamer_video_renderer_parent_class)->finalize(p_object);
+}
+
+
+void proposeBufferPool(GStreamerVideoRenderer *p_renderer, GstQuery *p_query)
+{
+	GstCaps *caps;
+	gboolean needPool;
+	gst_query_parse_allocation(p_query, &caps, &needPool);
+	if ((caps == nullptr) || !needPool)
+		return;
+
+	GstVideoInfo videoInfo;
+	if (!gst_video_info_from_caps(&videoInfo, caps))
+		return;
+
+	// The factory is invoked while the mutex is locked. This way,
+	// once setGStreamerVideoRendererBufferPoolFactory() returns,
+	// the old factory is guaranteed to not be in use anymore.
+	GstBufferPool *pool = nullptr;
+	guint numHeldBuffers;
+	g_mutex_lock(&(p_renderer->bufferPoolFactoryMutex));
+	if (p_renderer->bufferPoolFactory != nullptr)
+		pool = (*(p_renderer->bufferPoolFactory))();
+	numHeldBuffers = p_renderer->numHeldBuffers;
+	g_mutex_unlock(&(p_renderer->bufferPoolFactoryMutex));
+
+	if (pool == nullptr)
+		return;
+
+	// Buffers are held by the consumer of the frames, by the middle
+	// slot of the sample triple buffer (samples in the back slot are
+	// unref'd right away, see publishSample()), by the appsink's
+	// last-sample property, and by upstream, which fills
+	// one buffer while the others are held. There is no maximum; if the
+	// pool runs out of buffers, it allocates new ones instead of
+	// blocking upstream.
+	guint minBuffers = numHeldBuffers + 3;
+	// The frame pacing queue holds buffers as well.
+	if (g_atomic_int_get(&(p_renderer->framePacingEnabled)))
+		minBuffers += MaxPacedSamples;
+	gst_query_add_allocation_pool(p_query, pool, GST_VIDEO_INFO_SIZE(&videoInfo), minBuffers, 0);
+	gst_object_unref(GST_OBJECT(pool));
+
+	// Let upstream use its own strides and plane offsets.
+	gst_query_add_allocation_meta(p_query, GST_VIDEO_META_API_TYPE, nullptr);
+}
+
+
+GstPadProbeReturn allocationQueryProbe(GstPad *, GstPadProbeInfo *p_info, gpointer p_user_data)
+{
+	GStreamerVideoRenderer *self = reinterpret_cast < GStreamerVideoRenderer* > (p_user_data);
+	GstQuery *query = GST_PAD_PROBE_INFO_QUERY(p_info);
+
+	if (GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION)
+		return GST_PAD_PROBE_OK;
 
-	if (p_videoRenderer.newVideoFrameAvailableCB)
+	if (self->usesGLMemory)
 	{
-		// Install new_sample callback function that invokes the
-		// newVideoFrameAvailableCB function object when a new
-		// frame is available.
-		GstFlowReturn (*newSampleCB)(GstAppSink *, gpointer) = [](GstAppSink *, gpointer p_user_data) -> GstFlowReturn {
-			GStreamerVideoRenderer *renderer = reinterpret_cast < GStreamerVideoRenderer* > (p_user_data);
-			renderer->newVideoFrameAvailableCB();
-			return GST_FLOW_OK;
-		};
+		// Request GstGLSyncMeta from upstream. This makes glcolorconvert
+		// attach a sync point to each frame, which the consumer of the
+		// frames can wait on before using the frame's texture, since it
+		// uses a different OpenGL context. The meta API type is looked
+		// up by name to avoid a hard dependency on the GStreamer OpenGL
+		// library (which is loaded by then, since glupload exists).
+		GType syncMetaApi = g_type_from_name("GstGLSyncMetaAPI");
+		if (syncMetaApi != 0)
+			gst_query_add_allocation_meta(query, syncMetaApi, nullptr);
+	}
+	else
+	{
+		// Frames are in system memory, so upstream can write
+		// them into memory from a pool the consumer provides.
+		proposeBufferPool(self, query);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+GstClockTime getDisplayTime(GStreamerVideoRenderer *p_renderer, GstSample *p_sample)
+{
+	// The appsink renders a buffer once the pipeline clock reaches the
+	// buffer's running time plus the base time and the latency (plus
+	// the ts-offset, which is not included here, since it just makes
+	// the appsink hand over frames earlier with frame pacing).
+	GstBuffer *buffer = gst_sample_get_buffer(p_sample);
+	GstSegment *segment = gst_sample_get_segment(p_sample);
+	if ((buffer == nullptr) || (segment == nullptr) || !GST_BUFFER_PTS_IS_VALID(buffer))
+		return GST_CLOCK_TIME_NONE;
+
+	guint64 runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	if (!GST_CLOCK_TIME_IS_VALID(runningTime))
+		return GST_CLOCK_TIME_NONE;
+
+	return runningTime + gst_element_get_base_time(p_renderer->videoAppsink) + gst_base_sink_get_latency(GST_BASE_SINK(p_renderer->videoAppsink));
+}
+
+
+GstClockTime getCaptureTime(GStreamerVideoRenderer *p_renderer, GstSample *p_sample)
+{
+	// Live sources timestamp their buffers with the running time at
+	// which they were captured. (v4l2src uses the driver's capture
+	// timestamp if it is based on the monotonic clock, otherwise the
+	// time at which it dequeued the buffer.) Convert that from the
+	// pipeline clock to the monotonic clock by comparing both clocks'
+	// current times, since the pipeline clock may be a different one.
+	GstBuffer *buffer = gst_sample_get_buffer(p_sample);
+	GstSegment *segment = gst_sample_get_segment(p_sample);
+	if ((buffer == nullptr) || (segment == nullptr) || !GST_BUFFER_PTS_IS_VALID(buffer))
+		return GST_CLOCK_TIME_NONE;
+
+	guint64 runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	if (!GST_CLOCK_TIME_IS_VALID(runningTime))
+		return GST_CLOCK_TIME_NONE;
+
+	GstClock *clock = gst_element_get_clock(p_renderer->videoAppsink);
+	if (clock == nullptr)
+		return GST_CLOCK_TIME_NONE;
+
+	GstClockTimeDiff sinceCapture = GST_CLOCK_DIFF(runningTime + gst_element_get_base_time(p_renderer->videoAppsink), gst_clock_get_time(clock));
+	gst_object_unref(GST_OBJECT(clock));
+
+	return GstClockTime(std::max(GstClockTimeDiff(g_get_monotonic_time() * GST_USECOND) - sinceCapture, GstClockTimeDiff(0)));
+}
+
+
+void queuePacedSample(GStreamerVideoRenderer *p_renderer, PacedSample const &p_pacedSample)
+{
+	GstSample *droppedSample = nullptr;
+
+	g_mutex_lock(&(p_renderer->pacedSamplesMutex));
+	if (p_renderer->pacedSamples->size() >= MaxPacedSamples)
+	{
+		droppedSample = p_renderer->pacedSamples->front().sample;
+		p_renderer->pacedSamples->pop_front();
+	}
+	p_renderer->pacedSamples->push_back(p_pacedSample);
+	g_mutex_unlock(&(p_renderer->pacedSamplesMutex));
+
+	if (droppedSample != nullptr)
+	{
+		g_atomic_int_inc(&(p_renderer->numSkippedFrames));
+		gst_sample_unref(droppedSample);
+	}
+}
+
+
+void clearPacedSamples(GStreamerVideoRenderer *p_renderer)
+{
+	PacedSamples droppedSamples;
+
+	g_mutex_lock(&(p_renderer->pacedSamplesMutex));
+	std::swap(droppedSamples, *(p_renderer->pacedSamples));
+	g_mutex_unlock(&(p_renderer->pacedSamplesMutex));
+
+	for (PacedSample const &pacedSample : droppedSamples)
+		gst_sample_unref(pacedSample.sample);
+}
+
+
+void publishSample(GStreamerVideoRenderer *p_renderer, GstSample *p_sample)
+{
+	// Must only be called by the streaming thread, since this
+	// is the producer side of the sample triple buffer.
+
+	GstClockTime displayTime = GST_CLOCK_TIME_NONE;
+	GstClockTime captureTime = GST_CLOCK_TIME_NONE;
+
+	if (p_sample != nullptr)
+	{
+		// Detect caps changes here, once per produced frame, instead
+		// of in the consumer. Comparing the pointers first avoids the
+		// full caps comparison in the common case where consecutive
+		// samples share the same caps instance.
+		GstCaps *caps = gst_sample_get_caps(p_sample);
+		if ((caps != p_renderer->lastProducedCaps) && ((p_renderer->lastProducedCaps == nullptr) || !gst_caps_is_equal(p_renderer->lastProducedCaps, caps)))
+			++(p_renderer->producedCapsGeneration);
+		gst_caps_replace(&(p_renderer->lastProducedCaps), caps);
+
+		displayTime = getDisplayTime(p_renderer, p_sample);
+
+		// Stamp the frame with its capture time right when it arrives,
+		// so the consumer can measure the latency up to the display.
+		if (g_atomic_int_get(&(p_renderer->lowLatencyEnabled)))
+			captureTime = getCaptureTime(p_renderer, p_sample);
+
+		// If frame pacing was toggled since the last frame, the consumer
+		// now looks at the other hand-over path, so a frame that is still
+		// waiting in the previous one would never be picked up (and would
+		// hold on to its buffer). Drop it before handing over this frame.
+		gint framePacing = g_atomic_int_get(&(p_renderer->framePacingEnabled));
+		if (framePacing != p_renderer->producedFramePacing)
+		{
+			p_renderer->producedFramePacing = framePacing;
+			if (framePacing)
+				publishSample(p_renderer, nullptr);
+			else
+				clearPacedSamples(p_renderer);
+		}
+
+		// With frame pacing, the consumer picks frames from a queue.
+		if (framePacing)
+		{
+			queuePacedSample(p_renderer, { p_sample, p_renderer->producedCapsGeneration, displayTime, captureTime });
+			return;
+		}
+	}
 
-		GstAppSinkCallbacks callbacks;
-		std::memset(&callbacks, 0, sizeof(callbacks));
-		callbacks.new_sample = newSampleCB;
-		gst_app_sink_set_callbacks(GST_APP_SINK_CAST(p_videoRenderer.videoAppsink), &callbacks, gpointer(&p_videoRenderer), nullptr);
+	// The back slot is always empty here (see below).
+	VideoSampleSlot &backSlot = p_renderer->sampleBuffer->getBackSlot();
+	backSlot.sample = p_sample;
+	backSlot.capsGeneration = p_renderer->producedCapsGeneration;
+	backSlot.displayTime = displayTime;
+	backSlot.captureTime = captureTime;
+
+	// If the consumer did not take the previously published sample,
+	// that sample is now in the back slot. It is dropped right away,
+	// so its buffer can be returned to its pool.
+	if (p_renderer->sampleBuffer->publish())
+	{
+		VideoSampleSlot &droppedSlot = p_renderer->sampleBuffer->getBackSlot();
+		if (droppedSlot.sample != nullptr)
+		{
+			// Only count frames that were replaced by a newer frame,
+			// not the ones that were discarded by a flush.
+			if (p_sample != nullptr)
+				g_atomic_int_inc(&(p_renderer->numSkippedFrames));
+			gst_sample_unref(droppedSlot.sample);
+			droppedSlot.sample = nullptr;
+		}
+	}
+}
+
+
+GstPadProbeReturn flushEventProbe(GstPad *, GstPadProbeInfo *p_info, gpointer p_user_data)
+{
+	GStreamerVideoRenderer *self = reinterpret_cast < GStreamerVideoRenderer* > (p_user_data);
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(p_info);
+
+	// Flush-stop events are sent while the pad's stream lock is held,
+	// so this cannot run concurrently with the appsink callbacks,
+	// and the single producer rule of the triple buffer is upheld.
+	// Publishing an empty slot drops any frame that was produced
+	// before the flush (for example, before a seek) and was not
+	// consumed yet, just like the appsink drops its queued samples.
+	if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+	{
+		publishSample(self, nullptr);
+		clearPacedSamples(self);
+		gst_buffer_replace(&(self->prerollBuffer), nullptr);
 	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void setupConverterElements(GStreamerVideoRenderer *p_renderer, bool const p_useGLMemory)
+{
+	GstBin *bin = GST_BIN(p_renderer->videoBin);
+
+	// Remove any previously added converter elements.
+	// This is only possible as long as playback hasn't started.
+	for (GList *elem = p_renderer->converterElements; elem != nullptr; elem = elem->next)
+	{
+		GstElement *element = GST_ELEMENT(elem->data);
+		gst_element_set_state(element, GST_STATE_NULL);
+		gst_bin_remove(bin, element);
+	}
+	g_list_free(p_renderer->converterElements);
+	p_renderer->converterElements = nullptr;
+
+	if (p_useGLMemory)
+	{
+		// glupload uploads frames into GL memory (or just passes them
+		// through if they already are in GL memory), and glcolorconvert
+		// converts them to RGBA with shaders. glcolorscale downscales
+		// the frames if the sink caps limit the frame size. It is not
+		// present in all GStreamer versions; without it, frames are
+		// not downscaled.
+		p_renderer->converterElements = g_list_append(p_renderer->converterElements, gst_element_factory_make("glupload", nullptr));
+		p_renderer->converterElements = g_list_append(p_renderer->converterElements, gst_element_factory_make("glcolorconvert", nullptr));
+		GstElement *glcolorscale = gst_element_factory_make("glcolorscale", nullptr);
+		if (glcolorscale != nullptr)
+			p_renderer->converterElements = g_list_append(p_renderer->converterElements, glcolorscale);
+	}
+	else
+	{
+		// videoscale downscales frames if the sink caps limit the frame
+		// size. It is placed in front of videoconvert, so that the latter
+		// has fewer pixels to convert. If no scaling is necessary, it
+		// operates in passthrough mode, and does not touch the frames.
+		p_renderer->converterElements = g_list_append(p_renderer->converterElements, gst_element_factory_make("videoscale", nullptr));
+		p_renderer->converterElements = g_list_append(p_renderer->converterElements, gst_element_factory_make("videoconvert", nullptr));
+	}
+
+	// Add the elements to the bin and link them to each other and to
+	// the appsink. Elements that are added to a bin get any contexts
+	// that were set on that bin.
+	GstElement *prevElement = nullptr;
+	for (GList *elem = p_renderer->converterElements; elem != nullptr; elem = elem->next)
+	{
+		GstElement *element = GST_ELEMENT(elem->data);
+		gst_bin_add(bin, element);
+		if (prevElement != nullptr)
+			gst_element_link(prevElement, element);
+		prevElement = element;
+	}
+	gst_element_link(prevElement, p_renderer->videoAppsink);
+
+	// Point the ghost pad to the first converter element.
+	GstPad *pad = gst_element_get_static_pad(GST_ELEMENT(p_renderer->converterElements->data), "sink");
+	gst_ghost_pad_set_target(GST_GHOST_PAD(p_renderer->videoBinSinkPad), pad);
+	gst_object_unref(GST_OBJECT(pad));
+
+	p_renderer->usesGLMemory = p_useGLMemory;
+}
+
+
+void notifyNewVideoFrame(GStreamerVideoRenderer *p_renderer)
+{
+	g_mutex_lock(&(p_renderer->callbacksMutex));
+	if (p_renderer->newVideoFrameAvailableCB)
+		p_renderer->newVideoFrameAvailableCB();
+	g_mutex_unlock(&(p_renderer->callbacksMutex));
+}
+
+
+void installSampleCallbacks(GStreamerVideoRenderer &p_videoRenderer)
+{
+	// Install new_sample callback function that pulls the new sample
+	// right away in the streaming thread and publishes it in the sample
+	// triple buffer. This way, the consumer never has to go through the
+	// appsink's mutex-protected queue; it just picks up the newest
+	// sample with one atomic exchange. Afterwards, the callback invokes
+	// the newVideoFrameAvailableCB function object (if it is valid).
+	GstFlowReturn (*newSampleCB)(GstAppSink *, gpointer) = [](GstAppSink *p_appsink, gpointer p_user_data) -> GstFlowReturn {
+		GStreamerVideoRenderer *renderer = reinterpret_cast < GStreamerVideoRenderer* > (p_user_data);
+
+		GstSample *sample = gst_app_sink_pull_sample(p_appsink);
+		if (sample == nullptr)
+			return GST_FLOW_OK;
+
+		g_mutex_lock(&(renderer->callbacksMutex));
+		if (renderer->sampleObserver != nullptr)
+			(*(renderer->sampleObserver))(sample);
+		g_mutex_unlock(&(renderer->callbacksMutex));
+
+		// The first frame that is rendered after prerolling is the
+		// preroll frame, which was already published by the new_preroll
+		// callback below. Publishing it again would make it show up
+		// as a duplicate frame (or as a skipped one).
+		bool isPrerollFrame = (gst_sample_get_buffer(sample) == renderer->prerollBuffer);
+		gst_buffer_replace(&(renderer->prerollBuffer), nullptr);
+		if (isPrerollFrame)
+		{
+			gst_sample_unref(sample);
+			return GST_FLOW_OK;
+		}
+
+		publishSample(renderer, sample);
+		notifyNewVideoFrame(renderer);
+		return GST_FLOW_OK;
+	};
+
+	// Install new_preroll callback function that publishes the preroll
+	// frame the same way. Paused pipelines do not render frames, so
+	// without this, the first frame of a pipeline that is prerolled
+	// ahead of playback (and the frame after a seek in the paused
+	// state) would only become available once playback starts. The
+	// sample observer does not get the preroll frame, since it gets
+	// the same frame through new_sample once playback starts.
+	GstFlowReturn (*newPrerollCB)(GstAppSink *, gpointer) = [](GstAppSink *p_appsink, gpointer p_user_data) -> GstFlowReturn {
+		GStreamerVideoRenderer *renderer = reinterpret_cast < GStreamerVideoRenderer* > (p_user_data);
+
+		GstSample *sample = gst_app_sink_pull_preroll(p_appsink);
+		if (sample == nullptr)
+			return GST_FLOW_OK;
+
+		gst_buffer_replace(&(renderer->prerollBuffer), gst_sample_get_buffer(sample));
+		publishSample(renderer, sample);
+		notifyNewVideoFrame(renderer);
+		return GST_FLOW_OK;
+	};
+
+	GstAppSinkCallbacks callbacks;
+	std::memset(&callbacks, 0, sizeof(callbacks));
+	callbacks.new_preroll = newPrerollCB;
+	callbacks.new_sample = newSampleCB;
+	gst_app_sink_set_callbacks(GST_APP_SINK_CAST(p_videoRenderer.videoAppsink), &callbacks, gpointer(&p_videoRenderer), nullptr);
 }
 
 
@@ -183,7 +729,8 @@ GstPlayerVideoRenderer* createGStreamerVideoRenderer(NewVideoFrameAvailableCB ne
 	// Create the video renderer instance.
 	gpointer renderer = g_object_new(gstreamer_video_renderer_get_type(), nullptr);
 	// Pass the frame available callback to the new renderer.
-	setNewVideoFrameAvailableCB(*(static_cast < GStreamerVideoRenderer* > (renderer)), std::move(newVideoFrameAvailableCB));
+	installSampleCallbacks(*(static_cast < GStreamerVideoRenderer* > (renderer)));
+	setGStreamerVideoRendererNewVideoFrameAvailableCB(static_cast < GstPlayerVideoRenderer* > (renderer), std::move(newVideoFrameAvailableCB));
 	// We are done, return the new renderer.
 	return static_cast < GstPlayerVideoRenderer* > (renderer);
 }
@@ -196,10 +743,256 @@ GstElement* getGStreamerVideoRendererVideoAppsink(GstPlayerVideoRenderer *render
 }
 
 
+GStreamerMediaSample pullGStreamerVideoRendererSample(GstPlayerVideoRenderer *renderer, GstClockTime vsyncTime, GstClockTime vsyncInterval)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	bool haveVsync = GST_CLOCK_TIME_IS_VALID(vsyncTime) && GST_CLOCK_TIME_IS_VALID(vsyncInterval);
+	PacedSample pacedSample = { nullptr, 0, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE };
+
+	// Convert the vsync time from the monotonic clock to the pipeline
+	// clock, which the display times of the frames are based on.
+	GstClockTime vsyncClockTime = GST_CLOCK_TIME_NONE;
+	if (haveVsync)
+	{
+		GstClock *clock = gst_element_get_clock(self->videoAppsink);
+		if (clock != nullptr)
+		{
+			GstClockTimeDiff untilVsync = GstClockTimeDiff(vsyncTime) - GstClockTimeDiff(g_get_monotonic_time() * GST_USECOND);
+			vsyncClockTime = GstClockTime(std::max(GstClockTimeDiff(gst_clock_get_time(clock)) + untilVsync, GstClockTimeDiff(0)));
+			gst_object_unref(GST_OBJECT(clock));
+		}
+	}
+
+	if (g_atomic_int_get(&(self->framePacingEnabled)))
+	{
+		// Only one frame is shown per vsync, so if the consumer
+		// already got a frame for this vsync, it gets no other.
+		if (haveVsync && (vsyncTime == self->lastVsyncTime))
+			return GStreamerMediaSample(nullptr, false);
+
+		// Pick the newest frame that is due at the vsync, meaning that
+		// its display time is closer to this vsync than to the next
+		// one. Older frames that are due as well are skipped. If the
+		// vsync time is unknown, just pick the newest frame.
+		GstClockTime deadline = GST_CLOCK_TIME_IS_VALID(vsyncClockTime) ? (vsyncClockTime + vsyncInterval / 2) : GST_CLOCK_TIME_NONE;
+		guint numSkipped = 0;
+
+		g_mutex_lock(&(self->pacedSamplesMutex));
+		while (!self->pacedSamples->empty())
+		{
+			PacedSample const &front = self->pacedSamples->front();
+			if (GST_CLOCK_TIME_IS_VALID(deadline) && GST_CLOCK_TIME_IS_VALID(front.displayTime) && (front.displayTime > deadline))
+				break;
+
+			if (pacedSample.sample != nullptr)
+			{
+				gst_sample_unref(pacedSample.sample);
+				++numSkipped;
+			}
+			pacedSample = front;
+			self->pacedSamples->pop_front();
+		}
+		g_mutex_unlock(&(self->pacedSamplesMutex));
+
+		if (numSkipped > 0)
+			g_atomic_int_add(&(self->numSkippedFrames), gint(numSkipped));
+	}
+	else if (self->sampleBuffer->consume())
+	{
+		// Take over the sample's reference from the slot. The slot stays
+		// empty until the producer reuses it, which keeps publishSample()
+		// from unref'ing a sample that was handed over to the consumer.
+		// (A null sample was published by a flush.)
+		VideoSampleSlot &frontSlot = self->sampleBuffer->getFrontSlot();
+		pacedSample = { frontSlot.sample, frontSlot.capsGeneration, frontSlot.displayTime, frontSlot.captureTime };
+		frontSlot.sample = nullptr;
+	}
+
+	if (pacedSample.sample == nullptr)
+		return GStreamerMediaSample(nullptr, false);
+
+	if (haveVsync)
+	{
+		// Another frame for the same vsync means that the previous
+		// frame was uploaded for nothing, since it is never shown.
+		if (vsyncTime == self->lastVsyncTime)
+			g_atomic_int_inc(&(self->numDuplicateFrames));
+		self->lastVsyncTime = vsyncTime;
+
+		// The frame is shown at the wrong vsync if its display time is
+		// closer to another vsync than to the one it is shown at.
+		if (GST_CLOCK_TIME_IS_VALID(vsyncClockTime) && GST_CLOCK_TIME_IS_VALID(pacedSample.displayTime))
+		{
+			GstClockTimeDiff error = GST_CLOCK_DIFF(pacedSample.displayTime, vsyncClockTime);
+			if (std::abs(error) > GstClockTimeDiff(vsyncInterval / 2))
+				g_atomic_int_inc(&(self->numJudderFrames));
+		}
+	}
+
+	bool hasNewCaps = (pacedSample.capsGeneration != self->consumedCapsGeneration);
+	self->consumedCapsGeneration = pacedSample.capsGeneration;
+
+	GStreamerMediaSample videoSample(pacedSample.sample, hasNewCaps);
+	videoSample.setCaptureTime(pacedSample.captureTime);
+	return videoSample;
+}
+
+
+bool hasGStreamerVideoRendererQueuedSamples(GstPlayerVideoRenderer *renderer)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	g_mutex_lock(&(self->pacedSamplesMutex));
+	bool hasQueuedSamples = !self->pacedSamples->empty();
+	g_mutex_unlock(&(self->pacedSamplesMutex));
+
+	return hasQueuedSamples;
+}
+
+
+void setGStreamerVideoRendererNewVideoFrameAvailableCB(GstPlayerVideoRenderer *renderer, NewVideoFrameAvailableCB newVideoFrameAvailableCB)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	// The previous function object is destroyed outside of the lock,
+	// in case destroying it drops the last reference to something
+	// that is also used by the callbacks.
+	NewVideoFrameAvailableCB previousCB;
+
+	g_mutex_lock(&(self->callbacksMutex));
+	previousCB = std::move(self->newVideoFrameAvailableCB);
+	self->newVideoFrameAvailableCB = std::move(newVideoFrameAvailableCB);
+	g_mutex_unlock(&(self->callbacksMutex));
+}
+
+
+void discardGStreamerVideoRendererSamples(GstPlayerVideoRenderer *renderer)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	// No streaming thread is running here, so this thread can
+	// act as the producer of the triple buffer, like the flush
+	// event probe does. The consumer picks up the empty slot.
+	publishSample(self, nullptr);
+	clearPacedSamples(self);
+	gst_buffer_replace(&(self->prerollBuffer), nullptr);
+
+	self->lastVsyncTime = GST_CLOCK_TIME_NONE;
+	g_atomic_int_set(&(self->numSkippedFrames), 0);
+	g_atomic_int_set(&(self->numDuplicateFrames), 0);
+	g_atomic_int_set(&(self->numJudderFrames), 0);
+}
+
+
+void setGStreamerVideoRendererSampleObserver(GstPlayerVideoRenderer *renderer, SampleObserver observer)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+	SampleObserver *newObserver = observer ? new SampleObserver(std::move(observer)) : nullptr;
+
+	g_mutex_lock(&(self->callbacksMutex));
+	SampleObserver *previousObserver = self->sampleObserver;
+	self->sampleObserver = newObserver;
+	g_mutex_unlock(&(self->callbacksMutex));
+
+	delete previousObserver;
+}
+
+
+void setGStreamerVideoRendererFramePacing(GstPlayerVideoRenderer *renderer, bool enabled)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	// The streaming thread picks up the change with the next frame,
+	// and drops any frame that is still waiting in the previous
+	// hand-over path then (see publishSample()).
+	g_atomic_int_set(&(self->framePacingEnabled), enabled ? 1 : 0);
+
+	// A negative timestamp offset makes the appsink hand over frames
+	// before their display time, so they can be queued until then.
+	g_object_set(G_OBJECT(self->videoAppsink), "ts-offset", gint64(enabled ? -FramePacingLead : 0), nullptr);
+}
+
+
+void setGStreamerVideoRendererLowLatency(GstPlayerVideoRenderer *renderer, bool enabled)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	g_atomic_int_set(&(self->lowLatencyEnabled), enabled ? 1 : 0);
+
+	// Without clock synchronization, the appsink hands over each frame
+	// as soon as it arrives. Together with max-buffers=1 and drop=TRUE,
+	// it then only ever holds the newest frame.
+	g_object_set(G_OBJECT(self->videoAppsink), "sync", gboolean(enabled ? FALSE : TRUE), nullptr);
+}
+
+
+FramePacingStats getGStreamerVideoRendererFramePacingStats(GstPlayerVideoRenderer *renderer)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	FramePacingStats stats;
+	stats.m_numSkippedFrames = g_atomic_int_get(&(self->numSkippedFrames));
+	stats.m_numDuplicateFrames = g_atomic_int_get(&(self->numDuplicateFrames));
+	stats.m_numJudderFrames = g_atomic_int_get(&(self->numJudderFrames));
+	return stats;
+}
+
+
 void setGStreamerVideoRendererSinkCaps(GstPlayerVideoRenderer *renderer, GstCaps *sinkCaps)
 {
 	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	// Check if frames shall be in GL memory, and if so,
+	// replace the converter elements with OpenGL based ones.
+	bool useGLMemory = false;
+	if ((sinkCaps != nullptr) && !gst_caps_is_empty(sinkCaps))
+	{
+		GstCapsFeatures *features = gst_caps_get_features(sinkCaps, 0);
+		useGLMemory = (features != nullptr) && gst_caps_features_contains(features, "memory:GLMemory");
+	}
+	if (useGLMemory != bool(self->usesGLMemory))
+		setupConverterElements(self, useGLMemory);
+
 	gst_app_sink_set_caps(GST_APP_SINK_CAST(self->videoAppsink), sinkCaps);
+
+	// If the caps are changed during playback, upstream elements have
+	// to be informed that they need to renegotiate. (Before playback,
+	// there are no negotiated caps yet, so this does nothing then.)
+	GstPad *appsinkPad = gst_element_get_static_pad(self->videoAppsink, "sink");
+	gst_pad_push_event(appsinkPad, gst_event_new_reconfigure());
+	gst_object_unref(GST_OBJECT(appsinkPad));
+}
+
+
+void setGStreamerVideoRendererContext(GstPlayerVideoRenderer *renderer, GstContext *context)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+	// The bin passes on the context to all of its current elements,
+	// and to any elements that are added later.
+	gst_element_set_context(self->videoBin, context);
+}
+
+
+void setGStreamerVideoRendererBufferPoolFactory(GstPlayerVideoRenderer *renderer, BufferPoolFactory factory, unsigned int numHeldBuffers)
+{
+	GStreamerVideoRenderer *self = (GStreamerVideoRenderer *)renderer;
+
+	BufferPoolFactory *newFactory = factory ? new BufferPoolFactory(std::move(factory)) : nullptr;
+
+	g_mutex_lock(&(self->bufferPoolFactoryMutex));
+	std::swap(self->bufferPoolFactory, newFactory);
+	self->numHeldBuffers = numHeldBuffers;
+	g_mutex_unlock(&(self->bufferPoolFactoryMutex));
+
+	// newFactory now contains the old factory.
+	delete newFactory;
+
+	// If caps were already negotiated, make upstream send a new
+	// allocation query, so that it picks up the new pool.
+	GstPad *appsinkPad = gst_element_get_static_pad(self->videoAppsink, "sink");
+	gst_pad_push_event(appsinkPad, gst_event_new_reconfigure());
+	gst_object_unref(GST_OBJECT(appsinkPad));
 }
 
 
@@ -24,12 +24,37 @@
 #include <gst/gst.h>
 #include <gst/player/player.h>
 #include "GStreamerCommon.hpp"
+#include "GStreamerMediaSample.hpp"
 
 
 namespace qtglviddemo
 {
 
 
+/**
+ * Frame pacing statistics of a video renderer.
+ *
+ * These are only counted for samples that are retrieved with a vsync
+ * time, except for the skipped frames, which are always counted.
+ */
+struct FramePacingStats
+{
+	/// Number of frames that were dropped without being retrieved.
+	int m_numSkippedFrames;
+	/**
+	 * Number of frames that were retrieved for a vsync that a frame was
+	 * already retrieved for. The previous frame was then uploaded for
+	 * nothing, since it never got shown.
+	 */
+	int m_numDuplicateFrames;
+	/**
+	 * Number of frames whose display time was closer to another vsync
+	 * than to the one they were retrieved for.
+	 */
+	int m_numJudderFrames;
+};
+
+
 /**
  * Creates an implementation of GstPlayerVideoRenderer.
  *
@@ -40,8 +65,16 @@ namespace qtglviddemo
  * the appsink can notify about a newly received frame if newVideoFrameAvailableCB
  * is a valid function object.
  *
- * The GStreamerPlayer pullVideoSample() function pulls video samples from
- * this renderer's appsink.
+ * New samples are pulled from the appsink in the streaming thread as soon
+ * as they arrive, and are handed over to the consumer through a lock-free
+ * triple buffer. The GStreamerPlayer pullVideoSample() function retrieves
+ * them by calling pullGStreamerVideoRendererSample().
+ *
+ * Frames are scaled and converted by videoscale and videoconvert elements in
+ * front of the appsink if necessary. If the sink caps that are set by
+ * setGStreamerVideoRendererSinkCaps() contain the "memory:GLMemory" caps feature,
+ * the frames are instead uploaded, converted, and scaled by glupload,
+ * glcolorconvert, and glcolorscale elements.
  *
  * @param newVideoFrameAvailableCB Callback function object that shall be
  *        invoked whenever a new video frame is available in the appsink.
@@ -49,6 +82,118 @@ namespace qtglviddemo
  *        Note that this is called from a GStreamer streaming thread.
  */
 GstPlayerVideoRenderer* createGStreamerVideoRenderer(NewVideoFrameAvailableCB newVideoFrameAvailableCB = NewVideoFrameAvailableCB());
+/**
+ * Retrieves the newest video sample that arrived since the last call.
+ *
+ * This never blocks the streaming thread or gets blocked by it. If
+ * several samples arrived since the last call, only the newest one is
+ * returned; the others were already dropped. Caps changes are detected
+ * by the streaming thread, and are reported even if the sample that
+ * carried the new caps was dropped. If no new sample arrived, or if the
+ * pipeline was flushed since then, the media sample's getSample()
+ * function returns a null pointer.
+ *
+ * If frame pacing is enabled (see setGStreamerVideoRendererFramePacing()),
+ * the newest sample whose display time is closest to the given vsync is
+ * returned instead, and at most one sample is returned per vsync. Newer
+ * samples stay queued for later vsyncs.
+ *
+ * Only one thread may call this at the same time.
+ *
+ * @param renderer Video renderer instance to get the sample from.
+ * @param vsyncTime Predicted time of the vsync at which the sample will
+ *        be shown, in nanoseconds of the monotonic clock (the one used by
+ *        g_get_monotonic_time()). If this is GST_CLOCK_TIME_NONE, frames
+ *        are not paced, and no frame pacing statistics are counted.
+ * @param vsyncInterval Time between two vsyncs, in nanoseconds.
+ */
+GStreamerMediaSample pullGStreamerVideoRendererSample(GstPlayerVideoRenderer *renderer, GstClockTime vsyncTime = GST_CLOCK_TIME_NONE, GstClockTime vsyncInterval = GST_CLOCK_TIME_NONE);
+/**
+ * Returns true if frame pacing is enabled, and samples are queued
+ * for later vsyncs.
+ *
+ * @param renderer Video renderer instance to check.
+ */
+bool hasGStreamerVideoRendererQueuedSamples(GstPlayerVideoRenderer *renderer);
+/**
+ * Replaces the function object that is invoked for each new video frame.
+ *
+ * This can be called at any time. Once it returns, the previous function
+ * object is no longer invoked by the streaming threads.
+ *
+ * @param renderer Video renderer instance to configure.
+ * @param newVideoFrameAvailableCB New callback function object. If this
+ *        is not a valid function object, no notification is done.
+ */
+void setGStreamerVideoRendererNewVideoFrameAvailableCB(GstPlayerVideoRenderer *renderer, NewVideoFrameAvailableCB newVideoFrameAvailableCB);
+/**
+ * Discards all frames that were not retrieved yet, and resets the
+ * frame pacing statistics.
+ *
+ * This is used before a renderer is passed on to another consumer. It
+ * must only be called while the pipeline the renderer belongs to is in
+ * the NULL state, and while no other thread retrieves samples, since it
+ * takes the place of both the streaming thread and the consumer.
+ *
+ * @param renderer Video renderer instance to reset.
+ */
+void discardGStreamerVideoRendererSamples(GstPlayerVideoRenderer *renderer);
+/**
+ * Sets the function object that gets to see every decoded frame.
+ *
+ * The observer is invoked in the streaming thread for every sample that
+ * arrives at the appsink, before the sample is handed over to the consumer
+ * (and before samples are dropped). Like the new video frame callback,
+ * it can be replaced at any time; once this returns, the previous
+ * observer is no longer invoked.
+ *
+ * @param renderer Video renderer instance to configure.
+ * @param observer Sample observer. If this is not a valid function
+ *        object, no observer is invoked.
+ */
+void setGStreamerVideoRendererSampleObserver(GstPlayerVideoRenderer *renderer, SampleObserver observer);
+/**
+ * Enables or disables frame pacing.
+ *
+ * With frame pacing, the appsink hands over frames some time ahead of
+ * their display time, and the frames are queued. The consumer then picks
+ * the frame that best matches the vsync it will be shown at, instead of
+ * whichever frame arrived last. This avoids irregular cadences, for
+ * example when showing 24 fps content on a 60 Hz display.
+ *
+ * This can be called during playback. Frames that were handed over
+ * before the change and were not pulled yet are dropped once the
+ * next frame arrives.
+ *
+ * @param renderer Video renderer instance to configure.
+ * @param enabled Whether or not to enable frame pacing.
+ */
+void setGStreamerVideoRendererFramePacing(GstPlayerVideoRenderer *renderer, bool enabled);
+/**
+ * Enables or disables low latency mode.
+ *
+ * This is meant for live capture devices. In low latency mode, the appsink
+ * does not synchronize frames against the pipeline clock; each frame is
+ * handed over to the consumer as soon as it arrives. Frames are also
+ * stamped with their capture time, which pullGStreamerVideoRendererSample()
+ * passes on (see GStreamerMediaSample::getCaptureTime()). Frame pacing
+ * must not be enabled at the same time, since it relies on the clock
+ * synchronization.
+ *
+ * This can be called at any time.
+ *
+ * @param renderer Video renderer instance to configure.
+ * @param enabled Whether or not to enable low latency mode.
+ */
+void setGStreamerVideoRendererLowLatency(GstPlayerVideoRenderer *renderer, bool enabled);
+/**
+ * Returns the frame pacing statistics of the video renderer.
+ *
+ * This can be called from any thread.
+ *
+ * @param renderer Video renderer instance to get the statistics from.
+ */
+FramePacingStats getGStreamerVideoRendererFramePacingStats(GstPlayerVideoRenderer *renderer);
 /**
  * Retrieves the video renderer's appsink.
  *
@@ -66,10 +211,45 @@ GstElement* getGStreamerVideoRendererVideoAppsink(GstPlayerVideoRenderer *render
  *
  * If the sink caps are null, then the formats are unrestricted.
  *
+ * The sink caps can be changed during playback. The elements in front of the
+ * appsink then renegotiate their caps. For example, if the new caps restrict
+ * the width and height of the frames, the frames are downscaled.
+ *
  * @param renderer Video renderer instance whose sink caps shall be set.
  * @param sinkCaps Sink caps to set.
  */
 void setGStreamerVideoRendererSinkCaps(GstPlayerVideoRenderer *renderer, GstCaps *sinkCaps);
+/**
+ * Sets a GStreamer context on the video renderer's elements.
+ *
+ * This is used for passing shared resources such as OpenGL contexts
+ * to the elements. Contexts must be set before playback starts.
+ *
+ * @param renderer Video renderer instance whose elements shall get the context.
+ * @param context GStreamer context to set. This does not take ownership
+ *        over the context.
+ */
+void setGStreamerVideoRendererContext(GstPlayerVideoRenderer *renderer, GstContext *context);
+/**
+ * Sets the factory for buffer pools that are proposed to upstream elements.
+ *
+ * When upstream elements send an allocation query to the appsink, a pool
+ * created by the factory is proposed to them, along with GstVideoMeta
+ * support. This way, upstream writes frames directly into memory chosen
+ * by the consumer of the frames. This is not done if frames are in GL
+ * memory. The factory can be changed or reset at any time; it is not
+ * invoked anymore once this call returns. Pools that were already
+ * created are not affected, but upstream is asked to renegotiate, so
+ * it sends a new allocation query.
+ *
+ * @param renderer Video renderer instance whose factory shall be set.
+ * @param factory Buffer pool factory. If this is not a valid function
+ *        object, no pools are proposed.
+ * @param numHeldBuffers How many buffers the consumer of the frames holds
+ *        at most at the same time. This is used for the minimum number of
+ *        buffers in the pool.
+ */
+void setGStreamerVideoRendererBufferPoolFactory(GstPlayerVideoRenderer *renderer, BufferPoolFactory factory, unsigned int numHeldBuffers);
 
 
 } // namespace qtglviddemo end
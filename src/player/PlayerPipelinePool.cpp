@@ -0,0 +1,379 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <gst/app/gstappsink.h>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QLoggingCategory>
+#include "GStreamerVideoRenderer.hpp"
+#include "GStreamerSignalDispatcher.hpp"
+#include "PlayerPipelinePool.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+
+constexpr unsigned int DefaultNumSparePipelines = 2;
+constexpr int DefaultIdleTimeout = 30000;
+
+
+qint64 getMonotonicTimeInMs()
+{
+	return qint64(g_get_monotonic_time() / 1000);
+}
+
+
+} // unnamed namespace end
+
+
+PlayerPipeline::PlayerPipeline(QObject *p_signalReceiver)
+	: m_gstplayer(nullptr)
+	, m_gstdispatcher(nullptr)
+	, m_gstvidrenderer(nullptr)
+	, m_subtitleAppsink(nullptr)
+{
+	// Set up the core GstPlayer instance. Create the associated signal
+	// dispatcher and video renderer and pass them to the GstPlayer.
+	m_gstdispatcher = createGStreamerSignalDispatcher(p_signalReceiver);
+	m_gstvidrenderer = createGStreamerVideoRenderer();
+	m_gstplayer = gst_player_new(m_gstvidrenderer, m_gstdispatcher);
+	watchCoalescableGStreamerSignals(m_gstplayer);
+
+	// Set up the subtitle appsink. appsink does not emit
+	// signals by default, so we need to enable it.
+	m_subtitleAppsink = gst_element_factory_make("appsink", "subtitleAppsink");
+	gst_app_sink_set_emit_signals(GST_APP_SINK(m_subtitleAppsink), TRUE);
+
+	// There is currently no GstPlayer API to set the subtitle sink, so we
+	// have to manually do that by acquiring a reference to the GstPlayer's
+	// playbin and setting its text-sink property. playbin takes ownership
+	// over the subtitle appsink; we don't have to worry about unref'ing it.
+	GstElement *playbin = gst_player_get_pipeline(m_gstplayer);
+	g_object_set(G_OBJECT(playbin), "text-sink", m_subtitleAppsink, "flags", gint(0x55), nullptr);
+	gst_object_unref(GST_OBJECT(playbin));
+
+	// Enable video and subtitle tracks, but disable audio, since at this
+	// moment we do not care for audio output.
+	gst_player_set_video_track_enabled(m_gstplayer, true);
+	gst_player_set_audio_track_enabled(m_gstplayer, false);
+	gst_player_set_subtitle_track_enabled(m_gstplayer, true);
+}
+
+
+PlayerPipeline::~PlayerPipeline()
+{
+	// Stopping the GstPlayer sets an internal flag that makes sure
+	// any signals that were queued by the dispatcher and might still
+	// be in the Qt event loop won't do anything.
+	gst_player_stop(m_gstplayer);
+
+	// Unref the GstPlayer.
+	// Note that this may not always destroy the gstplayer instance right
+	// away. If there is an unemitted signal in the event loop remaining,
+	// then the gstplayer is destroyed once this signal is torn down,
+	// because these signals hold references to the gstplayer. (The signals
+	// are marshaled into the event loop by GStreamerSignalDispatcher.)
+	// But this is okay, since there are no adverse effects of a lingering
+	// gstplayer instance.
+	gst_object_unref(GST_OBJECT(m_gstplayer));
+}
+
+
+PlayerPipelinePool::PlayerPipelinePool()
+	: m_numPipelines(0)
+	, m_numSparePipelines(DefaultNumSparePipelines)
+	, m_idleTimeout(DefaultIdleTimeout)
+	, m_shutDown(false)
+	, m_stopTeardownThread(false)
+{
+	// Spare pipelines are created one at a time whenever the
+	// event loop is otherwise idle, so that creating them does
+	// not hold up startup or user interface updates.
+	m_refillTimer.setSingleShot(true);
+	m_refillTimer.setInterval(0);
+	connect(&m_refillTimer, &QTimer::timeout, this, &PlayerPipelinePool::refill);
+
+	m_idleTimer.setSingleShot(true);
+	connect(&m_idleTimer, &QTimer::timeout, this, &PlayerPipelinePool::destroyExpiredPipelines);
+
+	// The pool outlives the application object, but pipelines
+	// must not outlive GStreamer, so get rid of them early.
+	if (QCoreApplication::instance() != nullptr)
+		connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &PlayerPipelinePool::shutdown);
+}
+
+
+PlayerPipelinePool::~PlayerPipelinePool()
+{
+	shutdown();
+}
+
+
+void PlayerPipelinePool::setNumSparePipelines(unsigned int const p_numSparePipelines)
+{
+	m_numSparePipelines = p_numSparePipelines;
+
+	// Surplus pipelines are left to the idle timeout.
+	destroyExpiredPipelines();
+	scheduleRefill();
+}
+
+
+unsigned int PlayerPipelinePool::getNumSparePipelines() const
+{
+	return m_numSparePipelines;
+}
+
+
+void PlayerPipelinePool::setIdleTimeout(int const p_idleTimeout)
+{
+	m_idleTimeout = p_idleTimeout;
+	destroyExpiredPipelines();
+}
+
+
+int PlayerPipelinePool::getIdleTimeout() const
+{
+	return m_idleTimeout;
+}
+
+
+unsigned int PlayerPipelinePool::getNumPipelines() const
+{
+	return m_numPipelines;
+}
+
+
+unsigned int PlayerPipelinePool::getNumIdlePipelines() const
+{
+	return m_idlePipelines.size();
+}
+
+
+PlayerPipelineUPtr PlayerPipelinePool::acquire()
+{
+	PlayerPipelineUPtr pipeline;
+
+	// Hand out the most recently released pipeline, so that
+	// the older ones are the ones that expire.
+	if (!m_idlePipelines.empty())
+	{
+		pipeline = std::move(m_idlePipelines.back().m_pipeline);
+		m_idlePipelines.pop_back();
+	}
+	else
+	{
+		qCDebug(lcQtGLVidDemo) << "No idle player pipeline available; creating one";
+		pipeline = createPipeline();
+	}
+
+	// Replace the spare pipeline that was just used up.
+	scheduleRefill();
+
+	return pipeline;
+}
+
+
+void PlayerPipelinePool::release(PlayerPipelineUPtr p_pipeline)
+{
+	if (!p_pipeline)
+		return;
+
+	if (m_shutDown)
+	{
+		// The teardown thread is not available anymore at this
+		// point, so shut down the pipeline synchronously.
+		GstElement *playbin = gst_player_get_pipeline(p_pipeline->m_gstplayer);
+		gst_element_set_state(playbin, GST_STATE_NULL);
+		gst_object_unref(GST_OBJECT(playbin));
+		discardGStreamerVideoRendererSamples(p_pipeline->m_gstvidrenderer);
+		p_pipeline.reset();
+		--m_numPipelines;
+		return;
+	}
+
+	std::unique_lock < std::mutex > lock(m_teardownMutex);
+
+	if (!m_teardownThread.joinable())
+		m_teardownThread = std::thread([this]() { runTeardownThread(); });
+
+	m_pipelinesToTearDown.push_back(std::move(p_pipeline));
+	m_teardownCondition.notify_all();
+}
+
+
+PlayerPipelinePool & PlayerPipelinePool::instance()
+{
+	static PlayerPipelinePool playerPipelinePool;
+	return playerPipelinePool;
+}
+
+
+PlayerPipelineUPtr PlayerPipelinePool::createPipeline()
+{
+	++m_numPipelines;
+	return PlayerPipelineUPtr(new PlayerPipeline(this));
+}
+
+
+void PlayerPipelinePool::scheduleRefill()
+{
+	if (!m_shutDown && (m_idlePipelines.size() < m_numSparePipelines) && !m_refillTimer.isActive())
+		m_refillTimer.start();
+}
+
+
+void PlayerPipelinePool::refill()
+{
+	if (m_shutDown || (m_idlePipelines.size() >= m_numSparePipelines))
+		return;
+
+	m_idlePipelines.push_back(IdlePipeline { createPipeline(), getMonotonicTimeInMs() });
+	qCDebug(lcQtGLVidDemo) << "Created spare player pipeline; now" << m_idlePipelines.size() << "idle of" << m_numPipelines << "pipelines";
+
+	// Create the next one in the next event loop iteration.
+	scheduleRefill();
+}
+
+
+void PlayerPipelinePool::destroyExpiredPipelines()
+{
+	m_idleTimer.stop();
+
+	// The spare pipelines are kept regardless of how long they
+	// were idle. Since the most recently released pipelines are
+	// handed out first, the least recently released ones expire.
+	qint64 now = getMonotonicTimeInMs();
+	while ((m_idlePipelines.size() > m_numSparePipelines) && ((now - m_idlePipelines.front().m_idleSince) >= m_idleTimeout))
+	{
+		m_idlePipelines.pop_front();
+		--m_numPipelines;
+		qCDebug(lcQtGLVidDemo) << "Destroyed idle player pipeline; now" << m_idlePipelines.size() << "idle of" << m_numPipelines << "pipelines";
+	}
+
+	// Wake up again once the next surplus pipeline expires.
+	if (m_idlePipelines.size() > m_numSparePipelines)
+		m_idleTimer.start(int(m_idleTimeout - (now - m_idlePipelines.front().m_idleSince)));
+}
+
+
+void PlayerPipelinePool::shutdown()
+{
+	if (m_shutDown)
+		return;
+
+	m_shutDown = true;
+	m_refillTimer.stop();
+	m_idleTimer.stop();
+
+	// Let the teardown thread finish the pipelines it has. The main
+	// thread does not process onPipelinesTornDown() calls anymore,
+	// so the pipelines that were torn down are destroyed right here.
+	if (m_teardownThread.joinable())
+	{
+		{
+			std::unique_lock < std::mutex > lock(m_teardownMutex);
+			m_stopTeardownThread = true;
+			m_teardownCondition.notify_all();
+		}
+
+		m_teardownThread.join();
+	}
+
+	m_numPipelines -= m_tornDownPipelines.size();
+	m_tornDownPipelines.clear();
+
+	m_numPipelines -= m_idlePipelines.size();
+	m_idlePipelines.clear();
+}
+
+
+void PlayerPipelinePool::runTeardownThread()
+{
+	std::unique_lock < std::mutex > lock(m_teardownMutex);
+
+	while (true)
+	{
+		m_teardownCondition.wait(lock, [this]() { return m_stopTeardownThread || !m_pipelinesToTearDown.empty(); });
+
+		// Pipelines that are still queued are torn down even if
+		// the thread is asked to stop, so none of them is destroyed
+		// while its streaming threads are running.
+		if (m_pipelinesToTearDown.empty())
+			break;
+
+		PlayerPipelineUPtr pipeline = std::move(m_pipelinesToTearDown.front());
+		m_pipelinesToTearDown.pop_front();
+
+		lock.unlock();
+
+		// gst_player_stop() only asks the GstPlayer thread to stop the
+		// pipeline. Shut it down right here as well, so that the next
+		// user of the pipeline gets it in the NULL state. This waits
+		// for the streaming threads to finish.
+		GstElement *playbin = gst_player_get_pipeline(pipeline->m_gstplayer);
+		gst_element_set_state(playbin, GST_STATE_NULL);
+		gst_object_unref(GST_OBJECT(playbin));
+
+		// Frames that were not pulled yet may come from buffer pools of
+		// the previous player's consumer, so drop them before passing
+		// the pipeline on. No streaming thread is running anymore, and
+		// the previous player does not access the renderer anymore.
+		discardGStreamerVideoRendererSamples(pipeline->m_gstvidrenderer);
+
+		lock.lock();
+
+		m_tornDownPipelines.push_back(std::move(pipeline));
+		QMetaObject::invokeMethod(this, "onPipelinesTornDown", Qt::QueuedConnection);
+	}
+}
+
+
+void PlayerPipelinePool::onPipelinesTornDown()
+{
+	std::vector < PlayerPipelineUPtr > tornDownPipelines;
+
+	{
+		std::unique_lock < std::mutex > lock(m_teardownMutex);
+		tornDownPipelines = std::move(m_tornDownPipelines);
+		m_tornDownPipelines.clear();
+	}
+
+	if (tornDownPipelines.empty())
+		return;
+
+	qint64 now = getMonotonicTimeInMs();
+	for (auto & pipeline : tornDownPipelines)
+		m_idlePipelines.push_back(IdlePipeline { std::move(pipeline), now });
+
+	qCDebug(lcQtGLVidDemo) << "Player pipeline teardown finished; now" << m_idlePipelines.size() << "idle of" << m_numPipelines << "pipelines";
+
+	destroyExpiredPipelines();
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,203 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_PLAYER_PIPELINE_POOL_HPP
+#define QTGLVIDDEMO_PLAYER_PIPELINE_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QObject>
+#include <QTimer>
+#include <gst/gst.h>
+#include <gst/player/player.h>
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * GstPlayer instance together with the objects GStreamerPlayer attaches to it.
+ *
+ * Creating these is comparatively expensive: gst_player_new() creates the
+ * playbin and spawns the GstPlayer thread, and the video renderer creates
+ * its video bin. For this reason, GStreamerPlayer only creates a pipeline
+ * once playback actually starts, and PlayerPipelinePool keeps pipelines
+ * around for reuse.
+ *
+ * The constructor sets up the pipeline without any media, signal connections,
+ * or video output configuration; all of these are done by GStreamerPlayer.
+ */
+struct PlayerPipeline
+{
+	/**
+	 * Constructor.
+	 *
+	 * @param p_signalReceiver QObject that receives the GstPlayer signal
+	 *        emissions (see createGStreamerSignalDispatcher()). It must
+	 *        outlive the pipeline.
+	 */
+	explicit PlayerPipeline(QObject *p_signalReceiver);
+	/**
+	 * Destructor.
+	 *
+	 * Stops and unrefs the GstPlayer. This also unrefs the other
+	 * objects, since they are owned by the GstPlayer and its playbin.
+	 */
+	~PlayerPipeline();
+
+	PlayerPipeline(PlayerPipeline const &) = delete;
+	PlayerPipeline& operator = (PlayerPipeline const &) = delete;
+
+	GstPlayer *m_gstplayer;
+	GstPlayerSignalDispatcher *m_gstdispatcher;
+	GstPlayerVideoRenderer *m_gstvidrenderer;
+	GstElement *m_subtitleAppsink;
+};
+
+typedef std::unique_ptr < PlayerPipeline > PlayerPipelineUPtr;
+
+
+/**
+ * Process-wide pool of player pipelines.
+ *
+ * Players acquire a pipeline from the pool when playback starts, and
+ * release it back to the pool when playback is stopped or the player
+ * is destroyed. Released pipelines are reused by the next player that
+ * starts playback, so scrolling through many video objects does not
+ * create and destroy a pipeline for each one.
+ *
+ * A few idle pipelines (the spare pipelines) are created in advance,
+ * one per event loop iteration, so that a player that starts playback
+ * normally gets a pipeline right away. Idle pipelines beyond the number
+ * of spare pipelines are destroyed once they were idle for longer than
+ * the idle timeout.
+ *
+ * Released pipelines are shut down in a separate teardown thread,
+ * since setting a playbin to the NULL state waits for its streaming
+ * threads to finish, which can take a while. Until the teardown thread
+ * is done with a pipeline, the pipeline's callbacks are disconnected,
+ * but its elements may still be processing data. Once a pipeline is
+ * in the NULL state, it is put into the idle pipeline list.
+ *
+ * All functions must be called from the main Qt thread. Once the
+ * application is about to quit, idle pipelines are destroyed, and
+ * released pipelines are not kept anymore.
+ */
+class PlayerPipelinePool
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	~PlayerPipelinePool();
+
+	/**
+	 * Sets how many idle pipelines are kept ready.
+	 *
+	 * Missing ones are created in the background. 0 disables creating
+	 * pipelines in advance. The default is 2.
+	 */
+	void setNumSparePipelines(unsigned int const p_numSparePipelines);
+	unsigned int getNumSparePipelines() const;
+	/**
+	 * Sets how long surplus idle pipelines are kept, in milliseconds.
+	 *
+	 * The default is 30 seconds.
+	 */
+	void setIdleTimeout(int const p_idleTimeout);
+	int getIdleTimeout() const;
+
+	/**
+	 * Returns the number of pipelines that exist, including idle ones
+	 * and the ones that are still being torn down.
+	 */
+	unsigned int getNumPipelines() const;
+	/// Returns the number of idle pipelines.
+	unsigned int getNumIdlePipelines() const;
+
+	/**
+	 * Takes a pipeline out of the pool.
+	 *
+	 * If no idle pipeline is available, a new one is created.
+	 * The pipeline is stopped and has no media set.
+	 */
+	PlayerPipelineUPtr acquire();
+	/**
+	 * Returns a pipeline to the pool.
+	 *
+	 * The caller must have disconnected from the pipeline's signals
+	 * and reset the video renderer callbacks. The pipeline does not
+	 * have to be in the NULL state yet; the pool takes care of that
+	 * in its teardown thread, so this does not block.
+	 */
+	void release(PlayerPipelineUPtr p_pipeline);
+
+	/// Returns the global pool instance.
+	static PlayerPipelinePool & instance();
+
+
+private:
+	PlayerPipelinePool();
+
+	PlayerPipelineUPtr createPipeline();
+	void scheduleRefill();
+	void refill();
+	void destroyExpiredPipelines();
+	void shutdown();
+	void runTeardownThread();
+	Q_INVOKABLE void onPipelinesTornDown();
+
+	struct IdlePipeline
+	{
+		PlayerPipelineUPtr m_pipeline;
+		// Monotonic time the pipeline was released at, in milliseconds.
+		qint64 m_idleSince;
+	};
+
+	// Least recently released pipelines come first.
+	std::deque < IdlePipeline > m_idlePipelines;
+	unsigned int m_numPipelines;
+	unsigned int m_numSparePipelines;
+	int m_idleTimeout;
+	bool m_shutDown;
+	QTimer m_refillTimer;
+	QTimer m_idleTimer;
+
+	// Teardown thread states. The thread is started once the first
+	// pipeline is released. m_pipelinesToTearDown are the pipelines
+	// the thread still has to set to the NULL state, m_tornDownPipelines
+	// the ones that the main thread has to move to the idle list.
+	std::thread m_teardownThread;
+	std::mutex m_teardownMutex;
+	std::condition_variable m_teardownCondition;
+	std::deque < PlayerPipelineUPtr > m_pipelinesToTearDown;
+	std::vector < PlayerPipelineUPtr > m_tornDownPipelines;
+	bool m_stopTeardownThread;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -0,0 +1,196 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <QDebug>
+#include <QGuiApplication>
+#include <QLoggingCategory>
+#include <QQuickItem>
+#include <QScreen>
+#include "FrameArrivalAggregator.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+// Used if the refresh rate of the primary screen is unknown.
+qreal const DefaultRefreshRate = 60.0;
+
+} // unnamed namespace end
+
+
+FrameArrivalAggregator & FrameArrivalAggregator::instance()
+{
+	static FrameArrivalAggregator aggregator;
+	return aggregator;
+}
+
+
+FrameArrivalAggregator::FrameArrivalAggregator()
+	: m_wakeupScheduled(false)
+	, m_numFrameArrivals(0)
+	, m_numWakeups(0)
+{
+	for (auto &dirtyItems : m_dirtyItems)
+		dirtyItems = 0;
+	for (auto &item : m_items)
+		item = nullptr;
+
+	QScreen *screen = QGuiApplication::primaryScreen();
+	qreal refreshRate = (screen != nullptr) ? screen->refreshRate() : 0.0;
+	if (refreshRate < 1.0)
+		refreshRate = DefaultRefreshRate;
+
+	// Check for newly arrived frames once per window frame.
+	m_frameTimer.setSingleShot(true);
+	m_frameTimer.setTimerType(Qt::PreciseTimer);
+	m_frameTimer.setInterval(int(std::ceil(1000.0 / refreshRate)));
+	connect(&m_frameTimer, &QTimer::timeout, this, &FrameArrivalAggregator::dispatch);
+
+	qCDebug(lcQtGLVidDemo) << "Coalescing frame arrivals every" << m_frameTimer.interval() << "ms";
+}
+
+
+int FrameArrivalAggregator::addItem(QQuickItem *p_item)
+{
+	for (int slot = 0; slot < MaxItems; ++slot)
+	{
+		if (m_items[slot] == nullptr)
+		{
+			m_items[slot] = p_item;
+			return slot;
+		}
+	}
+
+	qCWarning(lcQtGLVidDemo) << "No free frame arrival slot for item" << p_item;
+	return -1;
+}
+
+
+void FrameArrivalAggregator::removeItem(int p_slot)
+{
+	if ((p_slot >= 0) && (p_slot < MaxItems))
+		m_items[p_slot] = nullptr;
+}
+
+
+void FrameArrivalAggregator::markDirty(int p_slot)
+{
+	++m_numFrameArrivals;
+	m_dirtyItems[p_slot / BitsPerWord].fetch_or(std::uint64_t(1) << (p_slot % BitsPerWord));
+
+	// Only post an event if none is pending and the frame timer is
+	// not active. Otherwise, the GUI thread picks up the bit anyway.
+	if (!m_wakeupScheduled.exchange(true))
+	{
+		++m_numWakeups;
+		QMetaObject::invokeMethod(this, "dispatch", Qt::QueuedConnection);
+	}
+}
+
+
+std::uint64_t FrameArrivalAggregator::getNumFrameArrivals() const
+{
+	return m_numFrameArrivals;
+}
+
+
+std::uint64_t FrameArrivalAggregator::getNumWakeups() const
+{
+	return m_numWakeups;
+}
+
+
+std::uint64_t FrameArrivalAggregator::getNumWakeupsSaved() const
+{
+	// Read the wakeups first, since they never exceed the arrivals.
+	std::uint64_t numWakeups = m_numWakeups;
+	return m_numFrameArrivals - numWakeups;
+}
+
+
+void FrameArrivalAggregator::dispatch()
+{
+	if (updateDirtyItems())
+	{
+		// Frames keep arriving, so keep the flag set, and check
+		// again in the next window frame.
+		m_frameTimer.start();
+		return;
+	}
+
+	// No frames arrived during the last window frame, so go idle.
+	// Frames that arrive between the check above and the reset of
+	// the flag did not post an event, so check once more afterwards.
+	m_wakeupScheduled = false;
+	if (hasDirtyItems() && !m_wakeupScheduled.exchange(true))
+	{
+		updateDirtyItems();
+		m_frameTimer.start();
+	}
+}
+
+
+bool FrameArrivalAggregator::updateDirtyItems()
+{
+	bool anyDirty = false;
+
+	for (int word = 0; word < NumWords; ++word)
+	{
+		std::uint64_t bits = m_dirtyItems[word].exchange(0);
+		if (bits == 0)
+			continue;
+
+		anyDirty = true;
+
+		for (int bit = 0; bits != 0; ++bit, bits >>= 1)
+		{
+			if ((bits & 1) == 0)
+				continue;
+
+			QQuickItem *item = m_items[word * BitsPerWord + bit];
+			if (item != nullptr)
+				item->update();
+		}
+	}
+
+	return anyDirty;
+}
+
+
+bool FrameArrivalAggregator::hasDirtyItems() const
+{
+	for (auto const &dirtyItems : m_dirtyItems)
+	{
+		if (dirtyItems != 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,132 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_FRAME_ARRIVAL_AGGREGATOR_HPP
+#define QTGLVIDDEMO_FRAME_ARRIVAL_AGGREGATOR_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <QObject>
+#include <QTimer>
+
+
+class QQuickItem;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Coalesces frame arrival notifications of all video objects.
+ *
+ * Without this class, each new video frame of each player causes a queued
+ * cross-thread event that makes the GUI thread update the item. With many
+ * streams, most of these events are redundant, since the window renders
+ * only once per vsync interval anyway.
+ *
+ * Items are registered and get a slot in a dirty bitset. When a frame
+ * arrives, the streaming thread sets the item's bit with one atomic
+ * operation. Only the first arrival after an idle period posts an event
+ * to the GUI thread. The GUI thread then updates all items whose bits are
+ * set, and afterwards checks again once per window frame (based on the
+ * refresh rate of the primary screen) for as long as frames keep arriving.
+ * Arrivals in between do not cause any events.
+ *
+ * The instance must be created and used (except for markDirty()) in
+ * the GUI thread.
+ */
+class FrameArrivalAggregator
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	/// Maximum number of items that can be registered at the same time.
+	enum : int { MaxItems = 256 };
+
+	/// Returns the global aggregator instance.
+	static FrameArrivalAggregator & instance();
+
+	/**
+	 * Registers an item.
+	 *
+	 * @param p_item Item to update when frames arrive for it.
+	 * @return The item's slot, or -1 if all slots are in use. In the
+	 *         latter case, the caller has to update the item by itself.
+	 */
+	int addItem(QQuickItem *p_item);
+	/**
+	 * Unregisters an item.
+	 *
+	 * The slot may be reused right away by another item. Calling
+	 * markDirty() for the old slot afterwards is harmless; at most,
+	 * the other item is updated once more than necessary.
+	 *
+	 * @param p_slot Slot returned by addItem().
+	 */
+	void removeItem(int p_slot);
+
+	/**
+	 * Marks the item in the given slot as having a new frame.
+	 *
+	 * This can be called from any thread.
+	 *
+	 * @param p_slot Slot returned by addItem().
+	 */
+	void markDirty(int p_slot);
+
+	/// Returns how many frame arrivals were reported by markDirty().
+	std::uint64_t getNumFrameArrivals() const;
+	/// Returns how many events were posted to the GUI thread.
+	std::uint64_t getNumWakeups() const;
+	/**
+	 * Returns how many events were saved compared to posting
+	 * one event per frame arrival.
+	 */
+	std::uint64_t getNumWakeupsSaved() const;
+
+
+private:
+	FrameArrivalAggregator();
+
+	Q_INVOKABLE void dispatch();
+	bool updateDirtyItems();
+	bool hasDirtyItems() const;
+
+	enum : int { BitsPerWord = 64, NumWords = MaxItems / BitsPerWord };
+
+	std::atomic < std::uint64_t > m_dirtyItems[NumWords];
+	// Set while an event is posted or the frame timer is active.
+	// Producers only post an event if they are the ones that set
+	// this flag; dispatch() clears it once no frames arrive anymore.
+	std::atomic < bool > m_wakeupScheduled;
+	std::atomic < std::uint64_t > m_numFrameArrivals;
+	std::atomic < std::uint64_t > m_numWakeups;
+
+	// Only accessed by the GUI thread.
+	QQuickItem *m_items[MaxItems];
+	QTimer m_frameTimer;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
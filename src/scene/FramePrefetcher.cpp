@@ -0,0 +1,141 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <algorithm>
+#include <QLoggingCategory>
+#include "FramePrefetcher.hpp"
+#include "SharedVideoStream.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+FramePrefetcher & FramePrefetcher::instance()
+{
+	static FramePrefetcher prefetcher;
+	return prefetcher;
+}
+
+
+FramePrefetcher::FramePrefetcher()
+	: m_vidmatProvider(nullptr)
+	, m_numRenderers(0)
+{
+}
+
+
+void FramePrefetcher::addRenderer(VideoMaterialProvider &p_vidmatProvider)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	m_vidmatProvider = &p_vidmatProvider;
+	++m_numRenderers;
+}
+
+
+void FramePrefetcher::removeRenderer()
+{
+	std::vector < PrefetchedFrame > frames;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+		assert(m_numRenderers > 0);
+		if (--m_numRenderers > 0)
+			return;
+
+		// The provider is destroyed together with the OpenGL
+		// context, so do not hand it out anymore.
+		m_vidmatProvider = nullptr;
+	}
+
+	// No renderer would upload frames or release them anymore.
+	// Release them outside of the lock, since this may destroy
+	// the last reference to their streams.
+	frames.swap(m_frames);
+	frames.clear();
+}
+
+
+VideoMaterialProvider * FramePrefetcher::getVideoMaterialProvider() const
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	return m_vidmatProvider;
+}
+
+
+void FramePrefetcher::addStream(void const *p_requester, std::shared_ptr < SharedVideoStream > const &p_stream)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	m_streams[p_requester] = p_stream;
+}
+
+
+void FramePrefetcher::removeStream(void const *p_requester)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	m_streams.erase(p_requester);
+}
+
+
+void FramePrefetcher::uploadFrames(QOpenGLContext *p_glcontext)
+{
+	// Several video objects may prefetch the same stream.
+	std::vector < std::shared_ptr < SharedVideoStream > > streams;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+		for (auto const &entry : m_streams)
+		{
+			std::shared_ptr < SharedVideoStream > stream = entry.second.lock();
+			if (stream && (std::find(streams.begin(), streams.end(), stream) == streams.end()))
+				streams.push_back(std::move(stream));
+		}
+	}
+
+	// Release the frames of streams that are not prefetched anymore.
+	// If a renderer got such a frame in the meantime, it keeps it.
+	m_frames.erase(std::remove_if(m_frames.begin(), m_frames.end(), [&streams](PrefetchedFrame const &p_frame) {
+		return std::none_of(streams.begin(), streams.end(), [&p_frame](std::shared_ptr < SharedVideoStream > const &p_stream) { return p_stream.get() == p_frame.m_stream; });
+	}), m_frames.end());
+
+	for (std::shared_ptr < SharedVideoStream > const &stream : streams)
+	{
+		auto frameIter = std::find_if(m_frames.begin(), m_frames.end(), [&stream](PrefetchedFrame const &p_frame) { return p_frame.m_stream == stream.get(); });
+		if (frameIter == m_frames.end())
+		{
+			qCDebug(lcQtGLVidDemo) << "Prefetching first frame of stream" << stream->getUrl();
+			m_frames.push_back({ stream.get(), stream->getFrame(p_glcontext, 1) });
+			frameIter = m_frames.end() - 1;
+		}
+
+		// Only the first frame is uploaded. Later ones are pulled by
+		// the renderers once the video objects are shown. (Players
+		// that are prerolled do not produce later frames anyway.)
+		SharedVideoFrame &frame = *(frameIter->m_frame);
+		if (frame.getFrameNumber() == 0)
+			frame.pullAndUploadVideoSample(GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE);
+	}
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,140 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_FRAME_PREFETCHER_HPP
+#define QTGLVIDDEMO_FRAME_PREFETCHER_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+class QOpenGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+class SharedVideoFrame;
+class SharedVideoStream;
+class VideoMaterialProvider;
+
+
+/**
+ * Uploads the first frames of streams that are prefetched by video objects.
+ *
+ * Video objects that are not shown (for example, the ones that PathView
+ * keeps cached off its path) have no renderer, so nothing would upload
+ * the frames of their streams until they are shown. Video objects that
+ * are likely to be shown soon can therefore register their stream here.
+ * Once its player prerolled (see GStreamerPlayer::setPreroll()), the
+ * first frame is uploaded into the stream's SharedVideoFrame by whichever
+ * renderer runs next. The frame is kept until the stream is unregistered,
+ * so the renderer that is created once the video object is shown gets the
+ * same frame, and can draw it right away.
+ *
+ * Renderers also register themselves, so that video objects without a
+ * renderer know the video material provider their players need to be
+ * set up for, and so that the frames are released while an OpenGL
+ * context is still current.
+ */
+class FramePrefetcher
+{
+public:
+	/// Returns the global prefetcher instance.
+	static FramePrefetcher & instance();
+
+	/**
+	 * Registers a renderer.
+	 *
+	 * This must be called while the main thread is blocked,
+	 * since it changes the provider getVideoMaterialProvider()
+	 * returns.
+	 *
+	 * @param p_vidmatProvider Provider the renderer uses.
+	 */
+	void addRenderer(VideoMaterialProvider &p_vidmatProvider);
+	/**
+	 * Unregisters a renderer.
+	 *
+	 * This must be called in the render thread, with the renderer's
+	 * OpenGL context being current. Once the last renderer is gone,
+	 * all frames are released.
+	 */
+	void removeRenderer();
+	/**
+	 * Returns the provider renderers use, or null if no renderer
+	 * exists yet. This must be called in the main thread.
+	 */
+	VideoMaterialProvider * getVideoMaterialProvider() const;
+
+	/**
+	 * Registers the stream a video object prefetches.
+	 *
+	 * This replaces the stream p_requester registered before.
+	 * It must be called in the main thread.
+	 *
+	 * @param p_requester Video object which prefetches the stream.
+	 *        Only used for identifying it in removeStream().
+	 * @param p_stream Stream to prefetch.
+	 */
+	void addStream(void const *p_requester, std::shared_ptr < SharedVideoStream > const &p_stream);
+	/// Unregisters the stream p_requester prefetches (if any).
+	void removeStream(void const *p_requester);
+
+	/**
+	 * Uploads the first frames of the prefetched streams.
+	 *
+	 * Frames are created for newly registered streams and released
+	 * for unregistered ones. This must be called in the render thread,
+	 * with p_glcontext being current. It is cheap once the first frames
+	 * are uploaded, so renderers call it whenever they render.
+	 */
+	void uploadFrames(QOpenGLContext *p_glcontext);
+
+
+private:
+	FramePrefetcher();
+
+	// Protects the members which are accessed by
+	// both the main thread and the render thread.
+	mutable std::mutex m_mutex;
+	VideoMaterialProvider *m_vidmatProvider;
+	unsigned int m_numRenderers;
+	// Weak pointers, so the streams can be destroyed once
+	// they are not used anymore. The frames below then
+	// hold the last references until uploadFrames() runs.
+	std::map < void const *, std::weak_ptr < SharedVideoStream > > m_streams;
+
+	// Only accessed by the render thread.
+	struct PrefetchedFrame
+	{
+		SharedVideoStream *m_stream;
+		std::shared_ptr < SharedVideoFrame > m_frame;
+	};
+	std::vector < PrefetchedFrame > m_frames;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <utility>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include "player/GStreamerPlayer.hpp"
+#include "FrameUploadThread.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+FrameUploadThread::FrameUploadThread(GStreamerPlayer &p_player, FrameUploadedCallback p_frameUploadedCallback)
+	: m_player(p_player)
+	, m_frameUploadedCallback(std::move(p_frameUploadedCallback))
+	, m_setupDone(false)
+	, m_running(false)
+	, m_stopRequested(false)
+	, m_framePending(false)
+	, m_backMaterialState(BackMaterialState::Free)
+	, m_fence(nullptr)
+	, m_cropRectangle(0, 0, 100, 100)
+	, m_newCapsSample(nullptr, false)
+{
+}
+
+
+FrameUploadThread::~FrameUploadThread()
+{
+	stop();
+}
+
+
+bool FrameUploadThread::isSupported(QOpenGLContext *p_glcontext)
+{
+	assert(p_glcontext != nullptr);
+
+	if (!QOpenGLContext::supportsThreadedOpenGL())
+		return false;
+
+	QSurfaceFormat const &format = p_glcontext->format();
+	if (p_glcontext->isOpenGLES())
+		return (format.majorVersion() >= 3);
+	else
+		return (format.version() >= qMakePair(3, 2)) || p_glcontext->hasExtension(QByteArray("GL_ARB_sync"));
+}
+
+
+bool FrameUploadThread::start(QOpenGLContext *p_shareContext, QOffscreenSurface *p_surface, VideoMaterial p_backMaterial)
+{
+	assert(p_shareContext != nullptr);
+	assert(p_surface != nullptr);
+
+	std::lock_guard < std::mutex > controlLock(m_controlMutex);
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	if (m_thread.joinable())
+	{
+		qCWarning(lcQtGLVidDemo) << "Frame upload thread is already running";
+		return false;
+	}
+
+	m_backMaterial = std::move(p_backMaterial);
+	m_cropRectangle = m_backMaterial.getCropRectangle();
+	m_backMaterialState = BackMaterialState::Free;
+	m_setupDone = false;
+	m_running = false;
+	m_stopRequested = false;
+	// The player may already have a frame, and
+	// it would not notify us about that one.
+	m_framePending = true;
+
+	m_thread = std::thread([this, p_shareContext, p_surface]() { run(p_shareContext, p_surface); });
+
+	// Wait until the thread set up its context.
+	m_condition.wait(lock, [this]() { return m_setupDone; });
+	if (m_running)
+	{
+		qCDebug(lcQtGLVidDemo) << "Started frame upload thread";
+		return true;
+	}
+
+	lock.unlock();
+	m_thread.join();
+
+	// The thread could not make its context current, so
+	// destroy the back material here. The share context
+	// is current in this thread.
+	{
+		VideoMaterial backMaterial(std::move(m_backMaterial));
+	}
+
+	return false;
+}
+
+
+void FrameUploadThread::stop()
+{
+	std::lock_guard < std::mutex > controlLock(m_controlMutex);
+
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+		m_running = false;
+		m_stopRequested = true;
+		m_condition.notify_all();
+	}
+
+	m_thread.join();
+
+	qCDebug(lcQtGLVidDemo) << "Stopped frame upload thread";
+}
+
+
+bool FrameUploadThread::notifyFrameAvailable()
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	if (!m_running)
+		return false;
+
+	m_framePending = true;
+	m_condition.notify_all();
+
+	return true;
+}
+
+
+void FrameUploadThread::setCropRectangle(QRect p_cropRectangle)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+	m_cropRectangle = std::move(p_cropRectangle);
+}
+
+
+FrameUploadThread::SwapResult FrameUploadThread::swapMaterials(VideoMaterial &p_frontMaterial)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	if (!m_running)
+		return SwapResult::NoNewFrame;
+
+	// A frame with new caps was pulled. Set up both materials for
+	// the new caps, and upload the frame here. The upload thread
+	// does not touch the back material until m_newCapsSample
+	// is cleared, so it is safe to access it here.
+	GstSample *newCapsSample = m_newCapsSample.getSample();
+	if (newCapsSample != nullptr)
+	{
+		assert(m_backMaterialState == BackMaterialState::Free);
+
+		GstVideoInfo videoInfo;
+		gst_video_info_from_caps(&videoInfo, gst_sample_get_caps(newCapsSample));
+		p_frontMaterial.setVideoInfo(videoInfo);
+		m_backMaterial.setVideoInfo(videoInfo);
+
+		p_frontMaterial.setVideoGstbuffer(gst_sample_get_buffer(newCapsSample));
+
+		m_newCapsSample = GStreamerMediaSample(nullptr, false);
+		m_condition.notify_all();
+
+		return SwapResult::NewFrame;
+	}
+
+	if (m_backMaterialState != BackMaterialState::Ready)
+		return SwapResult::NoNewFrame;
+
+	// Check if the GPU finished the upload. Use a zero timeout,
+	// since frame composition must not wait for uploads.
+	QOpenGLExtraFunctions *glextrafuncs = QOpenGLContext::currentContext()->extraFunctions();
+	GLenum waitResult = glextrafuncs->glClientWaitSync(m_fence, 0, 0);
+	if (waitResult == GL_TIMEOUT_EXPIRED)
+		return SwapResult::FrameNotReady;
+	else if (waitResult == GL_WAIT_FAILED)
+		qCWarning(lcQtGLVidDemo) << "Waiting for frame upload fence failed; using uploaded frame anyway";
+
+	glextrafuncs->glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	// The crop rectangle and texture rotation are set by the render
+	// thread, so keep the ones from the current front material.
+	// (Setting a different crop rectangle causes the frame to be
+	// uploaded again by the next bind() call. This only happens
+	// if the crop rectangle changed during the upload.)
+	QRect cropRectangle = p_frontMaterial.getCropRectangle();
+	int textureRotation = p_frontMaterial.getTextureRotation();
+
+	std::swap(p_frontMaterial, m_backMaterial);
+
+	if (p_frontMaterial.getCropRectangle() != cropRectangle)
+		p_frontMaterial.setCropRectangle(cropRectangle);
+	p_frontMaterial.setTextureRotation(textureRotation);
+
+	// The previous front material is now free for the next upload.
+	m_backMaterialState = BackMaterialState::Free;
+	m_condition.notify_all();
+
+	return SwapResult::NewFrame;
+}
+
+
+void FrameUploadThread::run(QOpenGLContext *p_shareContext, QOffscreenSurface *p_surface)
+{
+	// Create the context here, so it is associated with this thread.
+	QOpenGLContext glcontext;
+	glcontext.setFormat(p_shareContext->format());
+	glcontext.setShareContext(p_shareContext);
+
+	bool contextReady = glcontext.create() && glcontext.makeCurrent(p_surface);
+	if (!contextReady)
+		qCWarning(lcQtGLVidDemo) << "Could not set up OpenGL context for frame upload thread; uploading frames in the render thread";
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+		m_setupDone = true;
+		m_running = contextReady;
+		m_condition.notify_all();
+	}
+
+	if (!contextReady)
+		return;
+
+	uploadFrames(glcontext);
+
+	// Clean up while the context is still current. The back
+	// material's textures go back into the texture pool.
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		if (m_fence != nullptr)
+		{
+			glcontext.extraFunctions()->glDeleteSync(m_fence);
+			m_fence = nullptr;
+		}
+
+		{
+			VideoMaterial backMaterial(std::move(m_backMaterial));
+		}
+
+		m_newCapsSample = GStreamerMediaSample(nullptr, false);
+	}
+
+	glcontext.doneCurrent();
+}
+
+
+void FrameUploadThread::uploadFrames(QOpenGLContext &p_glcontext)
+{
+	QOpenGLExtraFunctions *glextrafuncs = p_glcontext.extraFunctions();
+
+	std::unique_lock < std::mutex > lock(m_mutex);
+
+	while (true)
+	{
+		// Wait until there is a frame to upload and the back material
+		// is not in use. If a frame with new caps is pending, the render
+		// thread has to process it first (see swapMaterials()).
+		m_condition.wait(lock, [this]() {
+			return m_stopRequested || (m_framePending && (m_backMaterialState == BackMaterialState::Free) && (m_newCapsSample.getSample() == nullptr));
+		});
+
+		if (m_stopRequested)
+			break;
+
+		m_framePending = false;
+		m_backMaterialState = BackMaterialState::Uploading;
+		QRect cropRectangle = m_cropRectangle;
+
+		// Do the actual upload without holding the lock,
+		// so the render thread is never blocked by it.
+		lock.unlock();
+
+		GStreamerMediaSample videoSample = m_player.pullVideoSample();
+		GstSample *sample = videoSample.getSample();
+		GLsync fence = nullptr;
+
+		if ((sample != nullptr) && !videoSample.sampleHasNewCaps())
+		{
+			if (m_backMaterial.getCropRectangle() != cropRectangle)
+				m_backMaterial.setCropRectangle(cropRectangle);
+
+			m_backMaterial.setVideoGstbuffer(gst_sample_get_buffer(sample));
+
+			// The fence is signaled once the GPU finished the upload.
+			// Flush, otherwise the render thread might check the fence
+			// before it even reached the GPU.
+			fence = glextrafuncs->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glextrafuncs->glFlush();
+		}
+
+		lock.lock();
+
+		if (sample == nullptr)
+		{
+			// The player had no frame for us after all.
+			m_backMaterialState = BackMaterialState::Free;
+			continue;
+		}
+
+		if (videoSample.sampleHasNewCaps())
+		{
+			m_newCapsSample = std::move(videoSample);
+			m_backMaterialState = BackMaterialState::Free;
+		}
+		else
+		{
+			m_fence = fence;
+			m_backMaterialState = BackMaterialState::Ready;
+		}
+
+		// Let the render thread pick up the frame.
+		lock.unlock();
+		m_frameUploadedCallback();
+		lock.lock();
+	}
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,240 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_FRAME_UPLOAD_THREAD_HPP
+#define QTGLVIDDEMO_FRAME_UPLOAD_THREAD_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <QOpenGLExtraFunctions>
+#include <QRect>
+#include "player/GStreamerMediaSample.hpp"
+#include "videomaterial/VideoMaterial.hpp"
+
+
+class QOpenGLContext;
+class QOffscreenSurface;
+
+
+namespace qtglviddemo
+{
+
+
+class GStreamerPlayer;
+
+
+/**
+ * Thread which uploads video frames into video materials.
+ *
+ * Normally, frames are pulled from the player and uploaded by the render
+ * thread right before the video object is drawn. Large frames then directly
+ * lengthen the time it takes to render the QtQuick 2 scene. This class moves
+ * the uploads into a separate thread, which has its own OpenGL context that
+ * shares resources with the render thread's context.
+ *
+ * The video materials are double buffered. The render thread draws with the
+ * "front" material, while this thread uploads the next frame into the "back"
+ * material. Once an upload is done, this thread inserts a fence into its
+ * OpenGL command stream, and invokes the frame uploaded callback. The next
+ * swapMaterials() call in the render thread checks if the fence has been
+ * signaled, and if so, exchanges the front and back materials. If the fence
+ * has not been signaled yet, the render thread keeps drawing with the front
+ * material. This means that the render thread never waits for uploads.
+ *
+ * Frames with new caps are an exception. Setting up a material for different
+ * caps may require creating shader programs, which must happen in the render
+ * thread. So, when this thread pulls such a frame, it passes it on to the
+ * render thread, which then sets up both materials and uploads the frame on
+ * its own. This happens rarely (typically once, at the beginning).
+ *
+ * Only video material providers whose supportsThreadedUploads() function
+ * returns true can be used with this class. The OpenGL implementation also
+ * needs to support fences; see isSupported().
+ *
+ * All functions except for notifyFrameAvailable() and stop() must be called
+ * in the render thread.
+ */
+class FrameUploadThread
+{
+public:
+	/// Result of a swapMaterials() call.
+	enum class SwapResult
+	{
+		/// There is no new frame. The front material is unchanged.
+		NoNewFrame,
+		/// The front material now contains a new frame.
+		NewFrame,
+		/**
+		 * A frame has been uploaded, but the GPU has not finished
+		 * the upload yet. The front material is unchanged. The caller
+		 * should try again during the next rendering.
+		 */
+		FrameNotReady
+	};
+
+	/**
+	 * Function to call whenever a frame has been uploaded.
+	 *
+	 * This is called in the upload thread.
+	 */
+	typedef std::function < void() > FrameUploadedCallback;
+
+	/**
+	 * Constructor.
+	 *
+	 * Does not start the thread yet. Use start() for that.
+	 *
+	 * @param p_player Player to pull video frames from. Must outlive
+	 *        the upload thread (the thread is stopped by stop()).
+	 * @param p_frameUploadedCallback Function to call whenever a frame
+	 *        has been uploaded. Typically, this schedules a rendering
+	 *        of the video object.
+	 */
+	explicit FrameUploadThread(GStreamerPlayer &p_player, FrameUploadedCallback p_frameUploadedCallback);
+	/**
+	 * Destructor.
+	 *
+	 * Stops the thread if it is still running.
+	 */
+	~FrameUploadThread();
+
+	/**
+	 * Returns true if the OpenGL implementation supports threaded uploads.
+	 *
+	 * This requires the platform to support OpenGL contexts in different
+	 * threads, and it requires fences (OpenGL ES 3.0, OpenGL 3.2, or the
+	 * GL_ARB_sync extension).
+	 *
+	 * @param p_glcontext Context of the render thread.
+	 */
+	static bool isSupported(QOpenGLContext *p_glcontext);
+
+	/**
+	 * Starts the thread.
+	 *
+	 * The thread creates its own OpenGL context, which shares resources
+	 * with the given one. This function waits until that context is set
+	 * up. If this fails, the thread is not started, and false is returned;
+	 * the caller then has to upload frames itself.
+	 *
+	 * Once the thread is running, the render thread must not pull video
+	 * samples from the player anymore, since this thread does that.
+	 *
+	 * @param p_shareContext Context of the render thread. Must be current.
+	 * @param p_surface Offscreen surface for this thread's context. Must
+	 *        have been created with a format that is compatible with the
+	 *        share context's format, and must outlive the thread.
+	 * @param p_backMaterial Initial back material. Must have been created
+	 *        by the same provider as the front material, and the provider
+	 *        must support threaded uploads.
+	 * @return true if the thread was started.
+	 */
+	bool start(QOpenGLContext *p_shareContext, QOffscreenSurface *p_surface, VideoMaterial p_backMaterial);
+	/**
+	 * Stops the thread.
+	 *
+	 * Waits until the thread finished. The back material is destroyed by
+	 * the thread before it finishes. If the thread is not running, this
+	 * function does nothing.
+	 */
+	void stop();
+
+	/**
+	 * Informs the thread that the player has a new frame.
+	 *
+	 * This can be called from any thread. If the thread is not running,
+	 * this does nothing and returns false.
+	 *
+	 * @return true if the thread will pull and upload the new frame.
+	 */
+	bool notifyFrameAvailable();
+
+	/**
+	 * Sets the crop rectangle to use for the following uploads.
+	 *
+	 * This is necessary because providers may only upload the
+	 * region of the frame that is inside the crop rectangle.
+	 */
+	void setCropRectangle(QRect p_cropRectangle);
+
+	/**
+	 * Exchanges the given front material with the back material if the
+	 * back material contains a new, completely uploaded frame.
+	 *
+	 * The crop rectangle and texture rotation of the front material
+	 * are retained. If a frame with new caps was pulled, the front
+	 * material is set up for these caps and the frame is uploaded
+	 * into it directly.
+	 *
+	 * This never waits for an upload to finish.
+	 *
+	 * @param p_frontMaterial Material the render thread draws with.
+	 * @return What happened to the front material.
+	 */
+	SwapResult swapMaterials(VideoMaterial &p_frontMaterial);
+
+	/// FrameUploadThread is neither copyable nor movable.
+	FrameUploadThread(FrameUploadThread const &) = delete;
+	FrameUploadThread& operator = (FrameUploadThread const &) = delete;
+
+
+private:
+	enum class BackMaterialState
+	{
+		/// The back material can be used for the next upload.
+		Free,
+		/// A frame is being uploaded into the back material.
+		Uploading,
+		/// The back material contains a frame that has not been swapped yet.
+		Ready
+	};
+
+	void run(QOpenGLContext *p_shareContext, QOffscreenSurface *p_surface);
+	void uploadFrames(QOpenGLContext &p_glcontext);
+
+	GStreamerPlayer &m_player;
+	FrameUploadedCallback m_frameUploadedCallback;
+
+	// Serializes start() and stop() calls.
+	std::mutex m_controlMutex;
+	std::thread m_thread;
+
+	// The states below are protected by m_mutex. The exception is
+	// m_backMaterial while it is in the Uploading state; only the
+	// upload thread accesses it then.
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_setupDone;
+	bool m_running;
+	bool m_stopRequested;
+	bool m_framePending;
+	BackMaterialState m_backMaterialState;
+	VideoMaterial m_backMaterial;
+	GLsync m_fence;
+	QRect m_cropRectangle;
+	GStreamerMediaSample m_newCapsSample;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -21,10 +21,17 @@
 #include <QDebug>
 #include <QLoggingCategory>
 #include <QOpenGLContext>
+#include "base/Settings.hpp"
 #include "GLResources.hpp"
 #include "videomaterial/VideoMaterialProviderGeneric.hpp"
 #include "videomaterial/VideoMaterialProviderVivante.hpp"
 #include "videomaterial/GLVIVDirectTextureExtension.hpp"
+#ifdef WITH_GST_GL
+#include "videomaterial/VideoMaterialProviderGLMemory.hpp"
+#endif
+#ifdef WITH_DMABUF
+#include "videomaterial/VideoMaterialProviderDmaBuf.hpp"
+#endif
 #include "mesh/CubeMesh.hpp"
 #include "mesh/QuadMesh.hpp"
 #include "mesh/TeapotMesh.hpp"
@@ -46,33 +53,87 @@ GLResources::GLResources(QOpenGLContext *p_glcontext)
 {
 	// This constructor is called when the singleton instance is created.
 
-	// Create the video material provider.
+	// Create the texture pool first, since the
+	// video material provider needs it.
+	m_texturePool = TexturePoolUPtr(new TexturePool(p_glcontext));
+
+	createVideoMaterialProvider(p_glcontext);
+}
+
+
+GLResources::~GLResources()
+{
+	// Destroy all allocated meshes by clearing the map.
+	m_meshMap.clear();
+	// Destroy the video material provider.
+	m_videoMaterialProvider.reset();
+	// Destroy the texture pool. This must happen after the video
+	// material provider is gone, since the provider's materials
+	// release their textures to the pool.
+	m_texturePool.reset();
+}
+
+
+void GLResources::createVideoMaterialProvider(QOpenGLContext *p_glcontext)
+{
+	Settings const &settings = Settings::instance();
+
+#ifdef WITH_GST_GL
+	// Use the GstGLMemory based provider if explicitely requested.
+	if (settings.m_videoMaterialProviderType == Settings::VideoMaterialProviderType::GLMemory)
+	{
+		GstGLContext *gstglContext = createWrappedGstGLContext(p_glcontext);
+		if (gstglContext != nullptr)
+		{
+			qCDebug(lcQtGLVidDemo) << "using GstGLMemory video material provider";
+			m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderGLMemory(p_glcontext, *m_texturePool, gstglContext));
+		}
+		else
+			qCWarning(lcQtGLVidDemo) << "could not set up GstGLMemory video material provider; falling back to other providers";
+	}
+#else
+	if (settings.m_videoMaterialProviderType == Settings::VideoMaterialProviderType::GLMemory)
+		qCWarning(lcQtGLVidDemo) << "GstGLMemory video material provider requested, but support for it was not built in";
+#endif
+
+#ifdef WITH_DMABUF
+	// Use the DMA-BUF import provider if explicitely requested.
+	if (settings.m_videoMaterialProviderType == Settings::VideoMaterialProviderType::DmaBuf)
+	{
+		if (isDmaBufImportSupported(p_glcontext))
+		{
+			qCDebug(lcQtGLVidDemo) << "using DMA-BUF import video material provider";
+			m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderDmaBuf(p_glcontext, *m_texturePool));
+		}
+		else
+			qCWarning(lcQtGLVidDemo) << "DMA-BUF import not supported; falling back to other providers";
+	}
+#else
+	if (settings.m_videoMaterialProviderType == Settings::VideoMaterialProviderType::DmaBuf)
+		qCWarning(lcQtGLVidDemo) << "DMA-BUF import video material provider requested, but support for it was not built in";
+#endif
+
+	// If a provider was already created above, we are done.
+	if (m_videoMaterialProvider)
+		return;
+
 #ifdef WITH_VIV_GPU
 	// On platforms with a Vivante GPU, try to create a Vivante video
-	// material provider first.
-	if (isVivDirectTextureSupported(p_glcontext))
+	// material provider first (unless the generic one was requested).
+	if ((settings.m_videoMaterialProviderType != Settings::VideoMaterialProviderType::Generic) && isVivDirectTextureSupported(p_glcontext))
 	{
 		qCDebug(lcQtGLVidDemo) << "Vivante direct textures supported - using Vivante video material provider";
-		m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderVivante(p_glcontext));
+		m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderVivante(p_glcontext, *m_texturePool));
 	}
 	else
 #endif
 	{
 		qCDebug(lcQtGLVidDemo) << "using generic video material provider";
-		m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderGeneric(p_glcontext));
+		m_videoMaterialProvider = VideoMaterialProviderUPtr(new VideoMaterialProviderGeneric(p_glcontext, *m_texturePool, settings.m_uploadMode));
 	}
 }
 
 
-GLResources::~GLResources()
-{
-	// Destroy all allocated meshes by clearing the map.
-	m_meshMap.clear();
-	// Destroy the video material provider.
-	m_videoMaterialProvider.reset();
-}
-
-
 QOpenGLVertexArrayObject & GLResources::getVAO()
 {
 	return m_vao;
@@ -86,6 +147,13 @@ VideoMaterialProvider & GLResources::getVideoMaterialProvider()
 }
 
 
+TexturePool & GLResources::getTexturePool()
+{
+	assert(m_texturePool);
+	return *m_texturePool;
+}
+
+
 Mesh & GLResources::getMesh(QString const &p_meshType)
 {
 	auto iter = m_meshMap.find(p_meshType);
@@ -24,6 +24,7 @@
 #include <memory>
 #include <QOpenGLVertexArrayObject>
 #include "mesh/Mesh.hpp"
+#include "videomaterial/TexturePool.hpp"
 #include "videomaterial/VideoMaterial.hpp"
 
 
@@ -43,6 +44,7 @@ namespace qtglviddemo
  *
  * This class contains the common resources, which are:
  * - Video material provider
+ * - Texture pool for the video materials
  * - Vertex array object
  * - Map containing Mesh instances (with OpenGL index/vertex buffer objects)
  *
@@ -88,10 +90,20 @@ public:
 	/**
 	 * Returns the video material provider.
 	 *
-	 * Which provider is used depends on the platform.
+	 * Which provider is used depends on the platform and on
+	 * the "videoMaterialProvider" setting (see Settings).
 	 */
 	VideoMaterialProvider & getVideoMaterialProvider();
 
+	/**
+	 * Returns the texture pool.
+	 *
+	 * Video materials acquire their textures from this pool, so
+	 * textures are recycled when video objects are removed and added
+	 * or when the video frame size changes.
+	 */
+	TexturePool & getTexturePool();
+
 	/**
 	 * Returns a mesh of the given type.
 	 *
@@ -121,8 +133,12 @@ private:
 	explicit GLResources(QOpenGLContext *p_glcontext);
 	~GLResources();
 
+	void createVideoMaterialProvider(QOpenGLContext *p_glcontext);
+
 	QOpenGLVertexArrayObject m_vao;
 
+	TexturePoolUPtr m_texturePool;
+
 	typedef std::unique_ptr < VideoMaterialProvider > VideoMaterialProviderUPtr;
 	VideoMaterialProviderUPtr m_videoMaterialProvider;
 
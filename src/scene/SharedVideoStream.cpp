@@ -0,0 +1,419 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <QCoreApplication>
+#include <QLoggingCategory>
+#include <QThread>
+#include <QTimer>
+#include "base/Settings.hpp"
+#include "GLResources.hpp"
+#include "SharedVideoStream.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+SharedVideoStream::SharedVideoStream(QUrl const &p_url)
+	: m_url(p_url)
+	, m_player([this]() { onNewFrameAvailable(); })
+{
+}
+
+
+SharedVideoStream::~SharedVideoStream()
+{
+	qCDebug(lcQtGLVidDemo) << "Destroyed shared video stream" << m_url;
+}
+
+
+std::shared_ptr < SharedVideoStream > SharedVideoStream::acquire(QUrl const &p_url, VideoMaterialProvider &p_vidmatProvider)
+{
+	// The subscribers own the streams, so only weak pointers are kept here.
+	static std::map < QString, std::weak_ptr < SharedVideoStream > > streams;
+
+	// Remove the entries of streams that no longer exist.
+	for (auto iter = streams.begin(); iter != streams.end();)
+	{
+		if (iter->second.expired())
+			iter = streams.erase(iter);
+		else
+			++iter;
+	}
+
+	std::weak_ptr < SharedVideoStream > &entry = streams[p_url.toString()];
+
+	std::shared_ptr < SharedVideoStream > stream = entry.lock();
+	if (!stream)
+	{
+		stream.reset(new SharedVideoStream(p_url), &SharedVideoStream::destroy);
+		stream->setUpPlayer(p_vidmatProvider, Settings::instance().m_framePacing);
+		stream->m_player.setUrl(p_url);
+		entry = stream;
+
+		qCDebug(lcQtGLVidDemo) << "Created shared video stream" << p_url;
+	}
+
+	return stream;
+}
+
+
+std::shared_ptr < SharedVideoStream > SharedVideoStream::createUnshared()
+{
+	return std::shared_ptr < SharedVideoStream > (new SharedVideoStream(QUrl()), &SharedVideoStream::destroy);
+}
+
+
+QUrl const & SharedVideoStream::getUrl() const
+{
+	return m_url;
+}
+
+
+GStreamerPlayer & SharedVideoStream::getPlayer()
+{
+	return m_player;
+}
+
+
+void SharedVideoStream::setUpPlayer(VideoMaterialProvider &p_vidmatProvider, bool const p_framePacing)
+{
+	// Set the formats the player is allowed to use for the video
+	// frames. This makes sure that the player only produces frames
+	// that are compatible with the video material.
+	m_player.setSinkCapsFromVideoFormats(p_vidmatProvider.getSupportedVideoFormats(), p_vidmatProvider.getSinkCapsFeature());
+
+	// Pass on any contexts the provider needs to share with
+	// the player's pipeline (for example OpenGL contexts).
+	for (GstContext *context : p_vidmatProvider.getGStreamerContexts())
+		m_player.setVideoSinkContext(context);
+
+	// Let sources and decoders export DMA-BUFs if the
+	// provider can import them without copying.
+	m_player.setPreferDmaBufMemory(p_vidmatProvider.prefersDmaBufMemory());
+
+	m_player.setFramePacing(p_framePacing);
+	m_player.setLowLatencyCapture(Settings::instance().m_lowLatencyCapture);
+}
+
+
+void SharedVideoStream::addSubscriber(QObject *p_subscriber, FrameAvailableCB p_frameAvailableCB)
+{
+	Subscriber subscriber;
+	subscriber.m_subscriber = p_subscriber;
+	subscriber.m_frameAvailableCB = std::move(p_frameAvailableCB);
+	subscriber.m_decodingTier = GStreamerPlayer::DecodingTier::Full;
+	subscriber.m_prefetch = false;
+
+	{
+		std::lock_guard < std::mutex > lock(m_subscribersMutex);
+		m_subscribers.push_back(std::move(subscriber));
+	}
+
+	updateDecodingTier();
+	updatePrefetch();
+	updateMaxVideoSize();
+}
+
+
+void SharedVideoStream::removeSubscriber(QObject *p_subscriber)
+{
+	{
+		std::lock_guard < std::mutex > lock(m_subscribersMutex);
+		m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(), [p_subscriber](Subscriber const &p_entry) { return p_entry.m_subscriber == p_subscriber; }), m_subscribers.end());
+	}
+
+	updateDecodingTier();
+	updatePrefetch();
+	updateMaxVideoSize();
+}
+
+
+void SharedVideoStream::setDecodingTier(QObject *p_subscriber, GStreamerPlayer::DecodingTier const p_decodingTier)
+{
+	// The list is only modified in the main thread, so no
+	// lock is needed for accessing it in the main thread.
+	for (Subscriber &subscriber : m_subscribers)
+	{
+		if (subscriber.m_subscriber == p_subscriber)
+			subscriber.m_decodingTier = p_decodingTier;
+	}
+
+	updateDecodingTier();
+}
+
+
+void SharedVideoStream::setPrefetch(QObject *p_subscriber, bool const p_prefetch)
+{
+	for (Subscriber &subscriber : m_subscribers)
+	{
+		if (subscriber.m_subscriber == p_subscriber)
+			subscriber.m_prefetch = p_prefetch;
+	}
+
+	updatePrefetch();
+}
+
+
+void SharedVideoStream::setMaxVideoSize(QObject *p_subscriber, QSize const p_maxVideoSize)
+{
+	for (Subscriber &subscriber : m_subscribers)
+	{
+		if (subscriber.m_subscriber == p_subscriber)
+			subscriber.m_maxVideoSize = p_maxVideoSize;
+	}
+
+	updateMaxVideoSize();
+}
+
+
+std::shared_ptr < SharedVideoFrame > SharedVideoStream::getFrame(QOpenGLContext *p_glcontext, unsigned int const p_numMaterials)
+{
+	// The renderers own the frame, so only a weak pointer is kept here.
+	// Since the demo application has only one window, there is no
+	// need to keep track of more than one frame.
+	std::shared_ptr < SharedVideoFrame > frame = m_frame.lock();
+	if (!frame || (frame->getGLContext() != p_glcontext))
+	{
+		frame = std::make_shared < SharedVideoFrame > (shared_from_this(), p_glcontext, p_numMaterials);
+		m_frame = frame;
+	}
+
+	return frame;
+}
+
+
+void SharedVideoStream::destroy(SharedVideoStream *p_stream)
+{
+	// The player lives in the main thread, and its timers must be
+	// stopped there. Renderers may drop the last reference to the
+	// stream in the render thread, so in that case, the stream
+	// is destroyed in the main thread later.
+	QCoreApplication *application = QCoreApplication::instance();
+	if ((application == nullptr) || (QThread::currentThread() == application->thread()))
+		delete p_stream;
+	else
+		QTimer::singleShot(0, application, [p_stream]() { delete p_stream; });
+}
+
+
+void SharedVideoStream::onNewFrameAvailable()
+{
+	std::lock_guard < std::mutex > lock(m_subscribersMutex);
+	for (Subscriber const &subscriber : m_subscribers)
+		subscriber.m_frameAvailableCB();
+}
+
+
+void SharedVideoStream::updateDecodingTier()
+{
+	// Keep the current tier if there are no subscribers. The
+	// stream is typically destroyed shortly afterwards anyway.
+	if (m_subscribers.empty())
+		return;
+
+	// The tiers are ordered from most to least decoding work.
+	GStreamerPlayer::DecodingTier decodingTier = GStreamerPlayer::DecodingTier::Suspended;
+	for (Subscriber const &subscriber : m_subscribers)
+		decodingTier = std::min(decodingTier, subscriber.m_decodingTier);
+
+	if (decodingTier != m_player.getDecodingTier())
+		m_player.setDecodingTier(decodingTier);
+}
+
+
+void SharedVideoStream::updatePrefetch()
+{
+	if (m_subscribers.empty())
+		return;
+
+	bool prefetch = std::any_of(m_subscribers.begin(), m_subscribers.end(), [](Subscriber const &p_entry) { return p_entry.m_prefetch; });
+	m_player.setPreroll(prefetch);
+}
+
+
+void SharedVideoStream::updateMaxVideoSize()
+{
+	if (m_subscribers.empty())
+		return;
+
+	// If one of the subscribers does not limit the size,
+	// the frames must not be downscaled at all.
+	QSize maxVideoSize(0, 0);
+	for (Subscriber const &subscriber : m_subscribers)
+	{
+		if (subscriber.m_maxVideoSize.isEmpty())
+		{
+			maxVideoSize = QSize();
+			break;
+		}
+
+		maxVideoSize = maxVideoSize.expandedTo(subscriber.m_maxVideoSize);
+	}
+
+	m_player.setMaxVideoSize(maxVideoSize);
+}
+
+
+
+
+SharedVideoFrame::SharedVideoFrame(std::shared_ptr < SharedVideoStream > p_stream, QOpenGLContext *p_glcontext, unsigned int const p_numMaterials)
+	: m_stream(std::move(p_stream))
+	, m_glcontext(p_glcontext)
+	, m_frameNumber(0)
+	, m_captureTime(GST_CLOCK_TIME_NONE)
+	, m_lastVsyncTime(GST_CLOCK_TIME_NONE)
+{
+	VideoMaterialProvider &vidmatProvider = GLResources::instance().getVideoMaterialProvider();
+
+	// Create the video material.
+	m_videoMaterial = vidmatProvider.createVideoMaterial();
+
+	// Let upstream elements write frames into buffers from pools
+	// that the provider creates (if it supports that). Each video
+	// material holds its current frame, and the provider may hold
+	// one more frame per material while the GPU transfers it.
+	// The factory is reset in the destructor, so the reference
+	// to the provider does not outlive the frame.
+	m_stream->getPlayer().setVideoSinkBufferPoolFactory([&vidmatProvider]() { return vidmatProvider.createUpstreamBufferPool(); }, p_numMaterials * 2);
+
+	qCDebug(lcQtGLVidDemo) << "Created shared video frame for stream" << m_stream->getUrl();
+}
+
+
+SharedVideoFrame::~SharedVideoFrame()
+{
+	m_stream->getPlayer().setVideoSinkBufferPoolFactory(BufferPoolFactory(), 0);
+
+	qCDebug(lcQtGLVidDemo) << "Destroyed shared video frame for stream" << m_stream->getUrl();
+}
+
+
+QOpenGLContext * SharedVideoFrame::getGLContext() const
+{
+	return m_glcontext;
+}
+
+
+VideoMaterial & SharedVideoFrame::getVideoMaterial()
+{
+	return m_videoMaterial;
+}
+
+
+bool SharedVideoFrame::pullAndUploadVideoSample(GstClockTime const p_vsyncTime, GstClockTime const p_vsyncInterval)
+{
+	GStreamerPlayer &player = m_stream->getPlayer();
+
+	// Only the first renderer that draws the frame for a vsync pulls
+	// a new video frame. Otherwise, a frame that arrives in between two
+	// renderers would only be drawn by the second one, and the objects
+	// would show different frames until the next vsync.
+	if (GST_CLOCK_TIME_IS_VALID(p_vsyncTime) && (p_vsyncTime == m_lastVsyncTime))
+		return player.hasQueuedVideoSamples();
+	m_lastVsyncTime = p_vsyncTime;
+
+	// Try to get a new video frame to render.
+	GStreamerMediaSample videoSample = player.pullVideoSample(p_vsyncTime, p_vsyncInterval);
+
+	// With frame pacing, frames that are not due yet stay queued.
+	bool hasQueuedVideoSamples = player.hasQueuedVideoSamples();
+
+	GstSample *sample = videoSample.getSample();
+	if (sample == nullptr)
+		return hasQueuedVideoSamples;
+
+	// This media sample contains a video frame with new caps.
+	// One example of why this can happen is that the width and
+	// height of video frames changed.
+	if (videoSample.sampleHasNewCaps())
+	{
+		// If caps changed, convert them to GstVideoInfo and
+		// pass this new video info to the video material to
+		// make sure the texture has the right format and size.
+
+		GstVideoInfo videoInfo;
+		gst_video_info_from_caps(&videoInfo, gst_sample_get_caps(sample));
+		m_videoMaterial.setVideoInfo(std::move(videoInfo));
+	}
+
+	// Pass on the GstBuffer the new video frame is contained in to
+	// the video material. It refs the GstBuffer (and unrefs it when
+	// it is done with it), so we can safely discard the media sample
+	// afterwards.
+	m_videoMaterial.setVideoGstbuffer(gst_sample_get_buffer(sample));
+
+	++m_frameNumber;
+	m_captureTime = videoSample.getCaptureTime();
+
+	return hasQueuedVideoSamples;
+}
+
+
+unsigned int SharedVideoFrame::getFrameNumber() const
+{
+	return m_frameNumber;
+}
+
+
+GstClockTime SharedVideoFrame::getCaptureTime() const
+{
+	return m_captureTime;
+}
+
+
+void SharedVideoFrame::setCropRectangle(void const *p_renderer, QRect const &p_cropRectangle)
+{
+	m_cropRectangles[p_renderer] = p_cropRectangle;
+	updateUploadCropRectangle();
+}
+
+
+void SharedVideoFrame::removeCropRectangle(void const *p_renderer)
+{
+	m_cropRectangles.erase(p_renderer);
+	updateUploadCropRectangle();
+}
+
+
+void SharedVideoFrame::updateUploadCropRectangle()
+{
+	// With just one renderer, the material is always drawn with
+	// the same crop rectangle, so there is no need for a separate
+	// upload crop rectangle. (This is always the case with threaded
+	// uploads, whose materials are swapped in and out of this frame.)
+	if (m_cropRectangles.size() <= 1)
+	{
+		m_videoMaterial.setUploadCropRectangle(QRect());
+		return;
+	}
+
+	QRect uploadCropRectangle;
+	for (auto const &entry : m_cropRectangles)
+		uploadCropRectangle |= entry.second;
+
+	m_videoMaterial.setUploadCropRectangle(uploadCropRectangle);
+}
+
+
+} // namespace qtglviddemo end
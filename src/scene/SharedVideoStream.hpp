@@ -0,0 +1,312 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_SHARED_VIDEO_STREAM_HPP
+#define QTGLVIDDEMO_SHARED_VIDEO_STREAM_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <QRect>
+#include <QSize>
+#include <QUrl>
+#include <gst/gst.h>
+#include "player/GStreamerPlayer.hpp"
+#include "videomaterial/VideoMaterial.hpp"
+
+
+class QObject;
+class QOpenGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+class SharedVideoFrame;
+
+
+/**
+ * Player that is shared by all video objects which show the same URL.
+ *
+ * Without sharing, each video object would decode its stream on its own,
+ * even if other video objects already decode the same one (for example,
+ * when several objects show different crop regions of the same video).
+ * With this class, the stream is decoded once, and its frames are uploaded
+ * once per OpenGL context (see SharedVideoFrame). The video objects that
+ * show the stream are the stream's subscribers. Each one still renders the
+ * frames with its own mesh, crop rectangle, and texture rotation.
+ *
+ * Since the subscribers share the player, controlling playback (pausing,
+ * seeking etc.) affects all of them. Settings that depend on how the
+ * subscribers show the stream are combined: the player uses the decoding
+ * tier with the most work of all subscribers, and the largest maximum
+ * video size of all of them, and it prerolls if any of them prefetches.
+ *
+ * Streams are reference counted. They are created by acquire() and
+ * destroyed together with the last reference to them. All functions
+ * except for setUpPlayer() and getFrame() must be called in the main
+ * thread.
+ */
+class SharedVideoStream
+	: public std::enable_shared_from_this < SharedVideoStream >
+{
+public:
+	/**
+	 * Function to call whenever the player has a new video frame.
+	 *
+	 * This is called from GStreamer streaming threads.
+	 */
+	typedef std::function < void() > FrameAvailableCB;
+
+	~SharedVideoStream();
+
+	/**
+	 * Returns the stream for p_url.
+	 *
+	 * If there is a stream for this URL already, it is returned.
+	 * Otherwise, a new stream is created, its player is set up
+	 * with setUpPlayer(), and its URL is set to p_url.
+	 *
+	 * @param p_url URL of the stream. Must not be empty.
+	 * @param p_vidmatProvider Provider the frames are rendered with.
+	 */
+	static std::shared_ptr < SharedVideoStream > acquire(QUrl const &p_url, VideoMaterialProvider &p_vidmatProvider);
+	/**
+	 * Creates a stream that is not shared with anyone.
+	 *
+	 * This is necessary if the subscriber needs exclusive access to
+	 * the player, for example because it pulls frames from the player
+	 * in its own thread (see FrameUploadThread). The subscriber has to
+	 * set up the player with setUpPlayer() and set its URL itself.
+	 */
+	static std::shared_ptr < SharedVideoStream > createUnshared();
+
+	/// Returns the URL of the stream. This is empty if it is unshared.
+	QUrl const & getUrl() const;
+	/// Returns the stream's player.
+	GStreamerPlayer & getPlayer();
+
+	/**
+	 * Sets up the player for rendering its frames with p_vidmatProvider.
+	 *
+	 * This sets the sink caps, the GStreamer contexts, and the DMA-BUF
+	 * preference of the player. Like these, it must be called before
+	 * playback is started.
+	 *
+	 * @param p_vidmatProvider Provider the frames are rendered with.
+	 * @param p_framePacing Whether to enable frame pacing in the player.
+	 */
+	void setUpPlayer(VideoMaterialProvider &p_vidmatProvider, bool const p_framePacing);
+
+	/**
+	 * Adds a subscriber.
+	 *
+	 * @param p_subscriber Subscriber to add. Only used for identifying
+	 *        the subscriber in the other calls.
+	 * @param p_frameAvailableCB Function to call whenever the player
+	 *        has a new video frame.
+	 */
+	void addSubscriber(QObject *p_subscriber, FrameAvailableCB p_frameAvailableCB);
+	/**
+	 * Removes a subscriber.
+	 *
+	 * After this call returns, the subscriber's frame available
+	 * callback is not called anymore.
+	 */
+	void removeSubscriber(QObject *p_subscriber);
+
+	/**
+	 * Sets the decoding tier a subscriber needs.
+	 *
+	 * The player uses the tier with the most decoding work of all
+	 * subscribers. See GStreamerPlayer::setDecodingTier().
+	 */
+	void setDecodingTier(QObject *p_subscriber, GStreamerPlayer::DecodingTier const p_decodingTier);
+	/**
+	 * Sets whether a subscriber is likely to show the stream soon.
+	 *
+	 * The player prerolls if at least one subscriber prefetches.
+	 * See GStreamerPlayer::setPreroll().
+	 */
+	void setPrefetch(QObject *p_subscriber, bool const p_prefetch);
+	/**
+	 * Sets the largest video frame size a subscriber can make use of.
+	 *
+	 * The player downscales frames to the largest width and height of
+	 * all subscribers. An invalid size means that the subscriber does
+	 * not limit the size. See GStreamerPlayer::setMaxVideoSize().
+	 */
+	void setMaxVideoSize(QObject *p_subscriber, QSize const p_maxVideoSize);
+
+	/**
+	 * Returns the frame for the given OpenGL context.
+	 *
+	 * The frame is created if it does not exist yet. It is shared by
+	 * all renderers of the subscribers and destroyed together with the
+	 * last one of them. This must be called in the render thread with
+	 * p_glcontext being current.
+	 *
+	 * @param p_glcontext Context the frames are drawn with.
+	 * @param p_numMaterials Number of video materials the caller
+	 *        fills with frames (2 with threaded uploads, 1 otherwise).
+	 */
+	std::shared_ptr < SharedVideoFrame > getFrame(QOpenGLContext *p_glcontext, unsigned int const p_numMaterials);
+
+
+private:
+	explicit SharedVideoStream(QUrl const &p_url);
+
+	static void destroy(SharedVideoStream *p_stream);
+
+	void onNewFrameAvailable();
+	void updateDecodingTier();
+	void updatePrefetch();
+	void updateMaxVideoSize();
+
+	struct Subscriber
+	{
+		QObject *m_subscriber;
+		FrameAvailableCB m_frameAvailableCB;
+		GStreamerPlayer::DecodingTier m_decodingTier;
+		bool m_prefetch;
+		QSize m_maxVideoSize;
+	};
+
+	QUrl m_url;
+
+	// The callbacks are invoked from streaming threads,
+	// so the subscriber list is protected by a mutex.
+	std::mutex m_subscribersMutex;
+	std::vector < Subscriber > m_subscribers;
+
+	std::weak_ptr < SharedVideoFrame > m_frame;
+
+	// Declared last, so it is destroyed first. The player
+	// may invoke onNewFrameAvailable() until then.
+	GStreamerPlayer m_player;
+};
+
+
+/**
+ * Video material that is filled with the frames of a SharedVideoStream.
+ *
+ * There is one frame per stream and OpenGL context. The first renderer
+ * that calls pullAndUploadVideoSample() for the frame that is rendered
+ * next pulls the video frame from the player and uploads it. The other
+ * renderers then draw the same texture.
+ *
+ * The frame also lets the stream's player propose buffer pools of
+ * the video material provider to upstream elements.
+ *
+ * All functions must be called in the render thread.
+ */
+class SharedVideoFrame
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * Use SharedVideoStream::getFrame() instead of constructing
+	 * frames directly.
+	 */
+	explicit SharedVideoFrame(std::shared_ptr < SharedVideoStream > p_stream, QOpenGLContext *p_glcontext, unsigned int const p_numMaterials);
+	~SharedVideoFrame();
+
+	/// Returns the OpenGL context the frame was created for.
+	QOpenGLContext * getGLContext() const;
+
+	/**
+	 * Returns the video material the frames are uploaded into.
+	 *
+	 * Renderers set their crop rectangle and texture rotation right
+	 * before drawing with it (see setCropRectangle()).
+	 */
+	VideoMaterial & getVideoMaterial();
+
+	/**
+	 * Gets the next video frame from the player and uploads it.
+	 *
+	 * If a frame was already pulled for the same vsync, this does
+	 * nothing, so all renderers draw the same frame at each vsync.
+	 *
+	 * @param p_vsyncTime Predicted time of the vsync the frame is shown
+	 *        at, or GST_CLOCK_TIME_NONE if unknown.
+	 * @param p_vsyncInterval Estimated time between two vsyncs, or
+	 *        GST_CLOCK_TIME_NONE if unknown.
+	 * @return true if the player has queued frames that are not due
+	 *         yet, meaning that this must be called again at the
+	 *         next vsync.
+	 */
+	bool pullAndUploadVideoSample(GstClockTime const p_vsyncTime, GstClockTime const p_vsyncInterval);
+
+	/**
+	 * Returns the number of frames that were uploaded so far.
+	 *
+	 * Renderers compare this with the value they saw last to
+	 * find out if they need to draw again.
+	 */
+	unsigned int getFrameNumber() const;
+	/**
+	 * Returns the time the current frame was captured at.
+	 *
+	 * This is a monotonic time in nanoseconds as returned by
+	 * g_get_monotonic_time() (scaled to nanoseconds), or
+	 * GST_CLOCK_TIME_NONE if the stream is not a live capture
+	 * device or the capture time is not known.
+	 */
+	GstClockTime getCaptureTime() const;
+
+	/**
+	 * Sets the crop rectangle a renderer draws the frames with.
+	 *
+	 * Providers may only upload the region of the frames inside the
+	 * crop rectangle (see VideoMaterialPrivIFace::uploadsCropRegionOnly()).
+	 * If several renderers draw the frame, the region inside all of
+	 * their crop rectangles is uploaded, so switching between them
+	 * while drawing does not require uploading the frame again.
+	 *
+	 * @param p_renderer Renderer which uses the crop rectangle.
+	 * @param p_cropRectangle Crop rectangle to use.
+	 */
+	void setCropRectangle(void const *p_renderer, QRect const &p_cropRectangle);
+	/// Removes the crop rectangle of p_renderer.
+	void removeCropRectangle(void const *p_renderer);
+
+
+private:
+	void updateUploadCropRectangle();
+
+	std::shared_ptr < SharedVideoStream > m_stream;
+	QOpenGLContext *m_glcontext;
+	VideoMaterial m_videoMaterial;
+	unsigned int m_frameNumber;
+	GstClockTime m_captureTime;
+	GstClockTime m_lastVsyncTime;
+
+	std::map < void const *, QRect > m_cropRectangles;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -18,15 +18,32 @@
 
 
 #include <assert.h>
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <memory>
+#include <vector>
+#include <QOffscreenSurface>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
 #include <QOpenGLFramebufferObject>
 #include <QQuickWindow>
 #include <QLoggingCategory>
+#include <QtGlobal>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+#include <QSGNode>
+#include <QSGRenderNode>
+#endif
+#include "base/Settings.hpp"
+#include "videomaterial/VideoTextureArray.hpp"
+#include "FrameArrivalAggregator.hpp"
+#include "FramePrefetcher.hpp"
+#include "FrameUploadThread.hpp"
 #include "GLResources.hpp"
+#include "SharedVideoStream.hpp"
 #include "VideoObjectItem.hpp"
+#include "VsyncPredictor.hpp"
 
 
 Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
@@ -36,39 +53,126 @@ namespace qtglviddemo
 {
 
 
+namespace
+{
+
+
+// How often the item's visibility is checked, in milliseconds.
+constexpr int VisibilityCheckInterval = 250;
+
+// How many checks in a row must yield a lower decoding tier before it is
+// applied. Higher tiers are applied right away, so that items that come
+// into view get all of their frames quickly, while items that are only
+// briefly less visible (for example during PathView animations) do not
+// cause a series of pipeline changes.
+constexpr int DecodingTierDowngradeCheckCount = 4;
+
+// Visibility thresholds for the decoding tiers. The visibility is the
+// item's effective opacity multiplied with the fraction of the window
+// area that the item covers. These values are heuristics.
+constexpr qreal FullDecodingMinVisibility = 0.04;
+constexpr qreal ReducedRateMinVisibility = 0.01;
+constexpr qreal KeyframesOnlyMinVisibility = 0.001;
+
+// How long a seamless URL switch waits for the first frame of the new
+// stream, in milliseconds. Afterwards, the item switches anyway, so an
+// unplayable URL does not keep the previous stream around forever.
+constexpr int UrlSwitchTimeout = 5000;
+
+
+} // unnamed namespace end
+
+
 /**
  * Renderer for the VideoObjectItem.
  *
  * VideoObjectItem is derived from QQuickFramebufferObject, which expects
  * a renderer class to be defined.
  *
- * In this class, the actual rendering is performed.
+ * In this class, the actual rendering is performed. Normally, the video
+ * object is rendered into the FBO by render(). If the render mode is set
+ * to "scenegraph", the renderer is owned by a RenderNode instead, which
+ * calls renderDirectly() to draw into the window without an FBO.
+ *
+ * The video frames are taken from the SharedVideoFrame of the item's
+ * stream. Renderers of other items with the same stream draw with the
+ * same frame, so each renderer applies its crop rectangle and texture
+ * rotation to the frame's material right before drawing.
  */
 class VideoObjectItem::Renderer
 	: public QQuickFramebufferObject::Renderer
 {
 public:
-	explicit Renderer(VideoObjectItem &p_item, QOpenGLContext *p_glcontext)
+	explicit Renderer(VideoObjectItem &p_item, QOpenGLContext *p_glcontext, bool const p_renderIntoFBO)
 		: m_glcontext(p_glcontext)
+		, m_window(nullptr)
 		, m_item(p_item)
 		, m_mesh(nullptr)
 		, m_mustRender(true)
 		, m_firstRender(true)
+		, m_renderIntoFBO(p_renderIntoFBO)
+		, m_mirrorVertically(false)
+		, m_cropRectangle(0, 0, 100, 100)
+		, m_textureRotation(0)
+		, m_frameNumber(0)
+		, m_lastFrameChangeTime(-1)
+		, m_showCount(0)
+		, m_reportedShowCount(0)
+		, m_urlSwitchCount(p_item.m_urlSwitchCount)
+		, m_reportedUrlSwitchCount(p_item.m_urlSwitchCount)
+		, m_probedCaptureTime(GST_CLOCK_TIME_NONE)
+		, m_pendingCaptureTime(GST_CLOCK_TIME_NONE)
 	{
-		// Set the formats the player is allowed to use for the video
-		// frames. This makes sure that the player only produces frames
-		// that are compatible with the video material.
-		m_item.m_player.setSinkCapsFromVideoFormats(GLResources::instance().getVideoMaterialProvider().getSupportedVideoFormats());
+		VideoMaterialProvider &vidmatProvider = GLResources::instance().getVideoMaterialProvider();
+
+		// The item needs the provider for setting up the players of
+		// the streams it acquires. The main thread is blocked while
+		// renderers are created, so the item can be accessed here.
+		m_item.m_vidmatProvider = &vidmatProvider;
+		FramePrefetcher::instance().addRenderer(vidmatProvider);
+
+		// With threaded uploads, the item has an unshared stream right
+		// from the start, and its player is set up here. Otherwise, the
+		// stream is acquired by the item once its URL is set, and
+		// attached to the renderer in synchronize().
+		if (m_item.m_uploadThread)
+		{
+			// Let a separate thread upload the frames.
+			startUploadThread(vidmatProvider);
+
+			// If configured, let the player queue frames so that the one
+			// that best matches the next vsync can be picked. The upload
+			// thread uploads frames as soon as they arrive, independently
+			// of the vsyncs, so frame pacing is not used together with it.
+			bool framePacing = Settings::instance().m_framePacing;
+			if (framePacing && m_uploadThread)
+			{
+				qCWarning(lcQtGLVidDemo) << "Frame pacing is not supported with threaded uploads; disabling frame pacing";
+				framePacing = false;
+			}
 
-		// Create the video material.
-		m_videoMaterial = GLResources::instance().getVideoMaterialProvider().createVideoMaterial();
+			m_item.m_stream->setUpPlayer(vidmatProvider, framePacing);
+			attachStream(m_item.m_stream);
+		}
 
-		qCDebug(lcQtGLVidDemo) << "Created FBO renderer";
+		qCDebug(lcQtGLVidDemo) << "Created" << (m_renderIntoFBO ? "FBO" : "render node") << "renderer";
 	}
 
 	~Renderer()
 	{
-		qCDebug(lcQtGLVidDemo) << "Destroyed FBO renderer";
+		// The upload thread's context shares resources with
+		// m_glcontext, so the thread must be stopped now.
+		// It also swaps materials with the shared frame.
+		if (m_uploadThread)
+			m_uploadThread->stop();
+
+		QObject::disconnect(m_frameSwappedConnection);
+
+		setPendingStream(nullptr);
+		attachStream(nullptr);
+		FramePrefetcher::instance().removeRenderer();
+
+		qCDebug(lcQtGLVidDemo) << "Destroyed" << (m_renderIntoFBO ? "FBO" : "render node") << "renderer";
 	}
 
 	QOpenGLFramebufferObject *createFramebufferObject(QSize const & p_size)
@@ -81,6 +185,10 @@ public:
 		// and the old FBO contents are lost.
 		m_mustRender = true;
 
+		// The FBO size limits how much detail of the video frames
+		// can be visible, so let the player downscale larger frames.
+		setTargetSize(p_size);
+
 		// Create the FBO.
 		return new QOpenGLFramebufferObject(p_size, format);
 	}
@@ -105,68 +213,18 @@ public:
 			m_firstRender = false;
 		}
 
-		// Exit if there is no mesh set at the moment. No need to
-		// call update(), since changes in the mesh type will trigger
-		// synchronize() and render() calls anyway.
-		if (m_mesh == nullptr)
-			return;
-
-		// Mesh is set, but has no contents. This should not happen,
-		// but check anyway to be safe. We do need to call update()
-		// to force the base class to schedule another call to render()
-		// because the frame isn't automatically redrawn once contents
-		// are set.
-		if (!m_mesh->hasContents())
-		{
-			update();
+		// Get the next frame. If there is nothing to
+		// render at all, there is nothing more to do.
+		if (!prepareFrame())
 			return;
-		}
-
-		// Try to get a new video frame to render.
-		GStreamerMediaSample videoSample = m_item.m_player.pullVideoSample();
-		GstSample *sample = videoSample.getSample();
-		if (sample != nullptr)
-		{
-			// This media sample contains a video frame with new caps.
-			// One example of why this can happen is that the width and
-			// height of video frames changed.
-			if (videoSample.sampleHasNewCaps())
-			{
-				// If caps changed, convert them to GstVideoInfo and
-				// pass this new video info to the video material to
-				// make sure the texture has the right format and size.
-
-				GstVideoInfo videoInfo;
-				gst_video_info_from_caps(&videoInfo, gst_sample_get_caps(sample));
-				m_videoMaterial.setVideoInfo(std::move(videoInfo));
-			}
-
-			// Pass on the GstBuffer the new video frame is contained in to
-			// the video material. It refs the GstBuffer (and unrefs it when
-			// it is done with it), so we can safely discard the media sample
-			// afterwards.
-			m_videoMaterial.setVideoGstbuffer(gst_sample_get_buffer(sample));
-
-			// We have a new video frame, so we must re-render the FBO contents.
-			m_mustRender = true;
-		}
 
 		// Only render something if something else declared it necessary
-		// (meaning, m_mustRender is set to true) and if there is actually
-		// a video frame to render (otherwise we can't render anything).
-		if (!m_mustRender || !m_videoMaterial.hasVideoGstbuffer())
-		{
-			// Rendering currently is not necessary, or there's no
-			// video frame at the moment.
+		// (meaning, m_mustRender is set to true).
+		if (!m_mustRender)
 			return;
-		}
 
 		qCDebug(lcQtGLVidDemo) << "Rendering video object item FBO frame";
 
-		GLResources & glresources = GLResources::instance();
-		VideoMaterialProvider &vidmatProvider = glresources.getVideoMaterialProvider();
-		QOpenGLShaderProgram &prog = vidmatProvider.getShaderProgram();
-
 		QOpenGLFunctions *glfuncs = m_glcontext->functions();
 
 		// Clear the FBO for the new rendering.
@@ -181,24 +239,50 @@ public:
 		glfuncs->glEnable(GL_CULL_FACE);
 		glfuncs->glDisable(GL_BLEND);
 
+		drawMesh(m_modelviewprojMatrix, 1.0f);
+
+		// We just rendered into the FBO, so we do not
+		// _have_ render again at the moment.
+		m_mustRender = false;
+
+		// Reset any modified OpenGL state.
+		m_window->resetOpenGLState();
+	}
+
+	/**
+	 * Binds the shader program and the mesh, and sets up the vertex attributes.
+	 *
+	 * Video objects with the same shader program and mesh can be drawn
+	 * with drawMaterial() calls in between one bindMesh() and one
+	 * releaseMesh() call, which is what RenderNodeBatch does.
+	 */
+	void bindMesh()
+	{
+		// The shader program depends on the video material's pixel
+		// format, so get it from the material.
+		bindMesh(getVideoMaterial().getShaderProgram());
+	}
+
+	/**
+	 * Binds the given shader program and the mesh, and sets up
+	 * the vertex attributes.
+	 *
+	 * RenderNodeBatch uses this for binding the instanced counterpart
+	 * of the material's program (see
+	 * VideoMaterialProvider::getInstancedShaderProgram()).
+	 */
+	void bindMesh(VideoShaderProgram &p_vidShaderProgram)
+	{
+		GLResources & glresources = GLResources::instance();
+		QOpenGLShaderProgram &prog = p_vidShaderProgram.getProgram();
+
 		// Bind the video material shader.
-		vidmatProvider.getShaderProgram().bind();
+		prog.bind();
 
 		// Bind the VAO if one is present.
 		if (glresources.getVAO().isCreated())
 			glresources.getVAO().bind();
 
-		// Bind the video material and set the shader uniform values
-		// associated with the material.
-		m_videoMaterial.bind();
-		m_videoMaterial.setShaderUniformValues();
-
-		// Set the shader uniform values associated with transformation
-		// matrices to make sure the mesh is rendered with rotation,
-		// perspective etc. applied.
-		vidmatProvider.getShaderProgram().setUniformValue(vidmatProvider.getModelviewMatrixUniform(), m_modelviewMatrix.normalMatrix());
-		vidmatProvider.getShaderProgram().setUniformValue(vidmatProvider.getModelviewprojMatrixUniform(), m_modelviewprojMatrix);
-
 		// Bind the mesh vertex and index buffers.
 		m_mesh->bindBuffers();
 
@@ -207,115 +291,1556 @@ public:
 		// have position, normal vector, and texture coordinate attributes,
 		// so we need three attribute arrays and the relative offsets
 		// of each one of these vertex attributes.
-		prog.enableAttributeArray(vidmatProvider.getVertexPositionAttrib());
-		prog.setAttributeBuffer(vidmatProvider.getVertexPositionAttrib(), GL_FLOAT, 0, 3, sizeof(Mesh::Vertices::value_type));
-		prog.enableAttributeArray(vidmatProvider.getVertexNormalAttrib());
-		prog.setAttributeBuffer(vidmatProvider.getVertexNormalAttrib(), GL_FLOAT, sizeof(float)*3, 3, sizeof(Mesh::Vertices::value_type));
-		prog.enableAttributeArray(vidmatProvider.getVertexTexcoordsAttrib());
-		prog.setAttributeBuffer(vidmatProvider.getVertexTexcoordsAttrib(), GL_FLOAT, sizeof(float)*6, 2, sizeof(Mesh::Vertices::value_type));
+		prog.enableAttributeArray(p_vidShaderProgram.getVertexPositionAttrib());
+		prog.setAttributeBuffer(p_vidShaderProgram.getVertexPositionAttrib(), GL_FLOAT, 0, 3, sizeof(Mesh::Vertices::value_type));
+		prog.enableAttributeArray(p_vidShaderProgram.getVertexNormalAttrib());
+		prog.setAttributeBuffer(p_vidShaderProgram.getVertexNormalAttrib(), GL_FLOAT, sizeof(float)*3, 3, sizeof(Mesh::Vertices::value_type));
+		prog.enableAttributeArray(p_vidShaderProgram.getVertexTexcoordsAttrib());
+		prog.setAttributeBuffer(p_vidShaderProgram.getVertexTexcoordsAttrib(), GL_FLOAT, sizeof(float)*6, 2, sizeof(Mesh::Vertices::value_type));
+	}
+
+	/**
+	 * Draws the mesh with the video material.
+	 *
+	 * bindMesh() must have been called before, either by this renderer
+	 * or by one with the same shader program and mesh.
+	 */
+	void drawMaterial(QMatrix4x4 const &p_modelviewprojMatrix, float const p_opacity)
+	{
+		VideoMaterial &videoMaterial = getVideoMaterial();
+		VideoShaderProgram &vidShaderProgram = videoMaterial.getShaderProgram();
+		QOpenGLShaderProgram &prog = vidShaderProgram.getProgram();
+
+		QOpenGLFunctions *glfuncs = m_glcontext->functions();
+
+		applyMaterialStates(videoMaterial);
+
+		// Bind the video material and set the shader uniform values
+		// associated with the material.
+		videoMaterial.bind();
+		videoMaterial.setShaderUniformValues();
+
+		// Set the shader uniform values associated with transformation
+		// matrices to make sure the mesh is rendered with rotation,
+		// perspective etc. applied. The opacity uniform has to be set
+		// every time, since the program is shared by all items.
+		prog.setUniformValue(vidShaderProgram.getModelviewMatrixUniform(), getNormalMatrix());
+		prog.setUniformValue(vidShaderProgram.getModelviewprojMatrixUniform(), p_modelviewprojMatrix);
+		prog.setUniformValue(vidShaderProgram.getOpacityUniform(), GLfloat(p_opacity));
 
 		// Everything is ready, we can now render the mesh.
 		glfuncs->glDrawElements(GL_TRIANGLES, m_mesh->getNumIndices(), GL_UNSIGNED_SHORT, nullptr);
 
-		// We rendered the mesh. Cleanup.
+		videoMaterial.unbind();
 
-		prog.disableAttributeArray(vidmatProvider.getVertexPositionAttrib());
-		prog.disableAttributeArray(vidmatProvider.getVertexNormalAttrib());
-		prog.disableAttributeArray(vidmatProvider.getVertexTexcoordsAttrib());
+		probeCaptureLatency();
+	}
 
-		m_mesh->releaseBuffers();
+	/// Undoes the bindMesh() call.
+	void releaseMesh()
+	{
+		releaseMesh(getVideoMaterial().getShaderProgram());
+	}
 
-		m_videoMaterial.unbind();
+	/// Undoes the bindMesh(VideoShaderProgram &) call.
+	void releaseMesh(VideoShaderProgram &p_vidShaderProgram)
+	{
+		GLResources & glresources = GLResources::instance();
+		QOpenGLShaderProgram &prog = p_vidShaderProgram.getProgram();
+
+		prog.disableAttributeArray(p_vidShaderProgram.getVertexPositionAttrib());
+		prog.disableAttributeArray(p_vidShaderProgram.getVertexNormalAttrib());
+		prog.disableAttributeArray(p_vidShaderProgram.getVertexTexcoordsAttrib());
+
+		m_mesh->releaseBuffers();
 
 		if (glresources.getVAO().isCreated())
 			glresources.getVAO().release();
 
-		vidmatProvider.getShaderProgram().release();
+		prog.release();
+	}
+
+	// The shader program and the mesh are what bindMesh() binds.
+	VideoShaderProgram & getShaderProgram()
+	{
+		return getVideoMaterial().getShaderProgram();
+	}
+
+	Mesh * getMesh()
+	{
+		return m_mesh;
+	}
+
+	// The matrix for transforming the mesh normals into view space.
+	QMatrix3x3 getNormalMatrix() const
+	{
+		return m_modelviewMatrix.normalMatrix();
+	}
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+	/**
+	 * Prepares drawing the video object directly into p_viewport.
+	 *
+	 * p_viewport is the item's area in the current render target, in
+	 * OpenGL window coordinates. This gets the next video frame.
+	 *
+	 * @return true if there is anything to draw.
+	 */
+	bool prepareDirectRendering(QRect const &p_viewport)
+	{
+		// The item's size on screen limits the frame size just like
+		// the FBO size does in createFramebufferObject().
+		setTargetSize(p_viewport.size());
+
+		return prepareFrame() && !p_viewport.isEmpty();
+	}
+
+	/**
+	 * Returns the modelviewprojection matrix for direct rendering.
+	 *
+	 * The FBO contents are mirrored by the scenegraph if the item's
+	 * mirrorVertically property is set. Do the same here by flipping
+	 * the Y axis. This reverses the winding order of the triangles,
+	 * so the front face winding is set accordingly.
+	 */
+	QMatrix4x4 applyMirroring()
+	{
+		m_glcontext->functions()->glFrontFace(m_mirrorVertically ? GL_CW : GL_CCW);
+		return getMirroredModelviewprojMatrix();
+	}
+
+	/**
+	 * Returns the modelviewprojection matrix for direct rendering.
+	 *
+	 * Unlike applyMirroring(), this does not set the front face winding.
+	 * Callers that draw several objects at once use isMirroredVertically()
+	 * for that instead.
+	 */
+	QMatrix4x4 getMirroredModelviewprojMatrix() const
+	{
+		if (!m_mirrorVertically)
+			return m_modelviewprojMatrix;
+
+		QMatrix4x4 mirrorMatrix;
+		mirrorMatrix.scale(1.0f, -1.0f, 1.0f);
+		return mirrorMatrix * m_modelviewprojMatrix;
+	}
+
+	bool isMirroredVertically() const
+	{
+		return m_mirrorVertically;
+	}
+
+	/**
+	 * Prepares drawing the video object with an instanced draw call.
+	 *
+	 * RenderNodeBatch calls this instead of drawMaterial() for objects it
+	 * draws together with others. This applies the item's crop rectangle
+	 * and texture rotation to the material and uploads the frame again if
+	 * necessary, so the material's textures can be copied, and the values
+	 * for the per-instance vertex attributes can be read off the material.
+	 */
+	VideoMaterial & prepareInstance()
+	{
+		VideoMaterial &videoMaterial = getVideoMaterial();
+
+		applyMaterialStates(videoMaterial);
+		videoMaterial.updateTextures();
+
+		probeCaptureLatency();
+
+		return videoMaterial;
+	}
+
+	/**
+	 * Renders the video object directly into the current render target.
+	 *
+	 * This is used by RenderNode instead of render(). The scenegraph has
+	 * already set up the render target; p_viewport is the item's area in
+	 * it, in OpenGL window coordinates. Unlike with FBOs, the scenegraph
+	 * does not apply the item opacity afterwards, so the mesh is blended
+	 * with p_opacity here. The clip the scenegraph uses for the item
+	 * (scissor or stencil based) is applied as well.
+	 */
+	void renderDirectly(QSGRenderNode::RenderState const *p_state, QRect const &p_viewport, float const p_opacity)
+	{
+		if (!prepareDirectRendering(p_viewport))
+			return;
+
+		QOpenGLFunctions *glfuncs = m_glcontext->functions();
+
+		glfuncs->glViewport(p_viewport.x(), p_viewport.y(), p_viewport.width(), p_viewport.height());
+
+		// Restrict all drawing and clearing to the item's area,
+		// and to the scissor clip rectangle if there is one.
+		QRect scissorRect = p_viewport;
+		if (p_state->scissorEnabled())
+			scissorRect &= p_state->scissorRect();
+		if (scissorRect.isEmpty())
+			return;
+		glfuncs->glEnable(GL_SCISSOR_TEST);
+		glfuncs->glScissor(scissorRect.x(), scissorRect.y(), scissorRect.width(), scissorRect.height());
+
+		// Non-rectangular clips are implemented by the
+		// scenegraph with the stencil buffer.
+		if (p_state->stencilEnabled())
+		{
+			glfuncs->glEnable(GL_STENCIL_TEST);
+			glfuncs->glStencilFunc(GL_EQUAL, p_state->stencilValue(), 0xFF);
+			glfuncs->glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			glfuncs->glStencilMask(0);
+		}
+		else
+			glfuncs->glDisable(GL_STENCIL_TEST);
+
+		// The mesh needs its own depth values. Since the node is not
+		// flagged as depth aware, the scenegraph does not rely on
+		// the depth buffer contents, so it can be cleared here.
+		glfuncs->glDepthMask(GL_TRUE);
+		glfuncs->glClear(GL_DEPTH_BUFFER_BIT);
+		glfuncs->glEnable(GL_DEPTH_TEST);
+		glfuncs->glDepthFunc(GL_LESS);
+		glfuncs->glEnable(GL_CULL_FACE);
+
+		QMatrix4x4 modelviewprojMatrix = applyMirroring();
+
+		if (p_opacity >= 1.0f)
+		{
+			// Opaque objects can be drawn like in render().
+			glfuncs->glDisable(GL_BLEND);
+			drawMesh(modelviewprojMatrix, 1.0f);
+		}
+		else
+		{
+			// With FBOs, the scenegraph blends the finished image of
+			// the object, so only the frontmost surface is visible.
+			// Blending the mesh directly would also show surfaces that
+			// are hidden behind other parts of the mesh (for example,
+			// with the teapot and torus meshes). To get the same result,
+			// first fill the depth buffer without touching the colors,
+			// then blend only the fragments that passed that pass.
+			glfuncs->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glfuncs->glDisable(GL_BLEND);
+			drawMesh(modelviewprojMatrix, 1.0f);
+
+			glfuncs->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glfuncs->glDepthMask(GL_FALSE);
+			glfuncs->glDepthFunc(GL_LEQUAL);
+			// The scenegraph uses premultiplied alpha, and the
+			// shader premultiplies its output with the opacity.
+			glfuncs->glEnable(GL_BLEND);
+			glfuncs->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+			drawMesh(modelviewprojMatrix, p_opacity);
+		}
+
+		// The states this changed are listed in RenderNode::changedStates(),
+		// so the scenegraph resets them. Only the depth mask and function
+		// and the front face winding are set back to their defaults here.
+		glfuncs->glDepthMask(GL_TRUE);
+		glfuncs->glDepthFunc(GL_LESS);
+		glfuncs->glFrontFace(GL_CCW);
+	}
+#endif
+
+	virtual void synchronize(QQuickFramebufferObject *) override
+	{
+		// In here, check if any states changed that affect
+		// the mesh rendering. If so, set m_mustRender to
+		// true so that render() re-renders the FBO contents.
+
+		// The vsync predictor is used for picking frames (if frame pacing
+		// is enabled) and for the frame pacing statistics.
+		QQuickWindow *window = m_item.window();
+		if (window != m_window)
+		{
+			m_window = window;
+			m_vsyncPredictor = (m_window != nullptr) ? VsyncPredictor::get(m_window) : nullptr;
+
+			// The capture latency probe is connected
+			// to the new window once it is needed.
+			QObject::disconnect(m_frameSwappedConnection);
+			m_frameSwappedConnection = QMetaObject::Connection();
+			m_pendingCaptureTime = GST_CLOCK_TIME_NONE;
+		}
+		m_mirrorVertically = m_item.mirrorVertically();
+		m_showCount = m_item.m_showCount;
+
+		// Attach the stream the item acquired since the last call.
+		// (With threaded uploads, the stream never changes.) During a
+		// seamless URL switch, keep drawing the outgoing stream, and
+		// hold on to the new one until its first frame is uploaded
+		// (see updatePendingStream()). If the item switched back, or
+		// gave up on the switch, the pending stream is dropped.
+		if (!m_item.m_uploadThread)
+		{
+			m_urlSwitchCount = m_item.m_urlSwitchCount;
+
+			if (m_item.m_outgoingStream && (!m_stream || (m_stream == m_item.m_outgoingStream)))
+			{
+				if (m_pendingStream != m_item.m_stream)
+					setPendingStream(m_item.m_stream);
+			}
+			else
+			{
+				if (m_pendingStream)
+					setPendingStream(nullptr);
+				if (m_item.m_stream != m_stream)
+					attachStream(m_item.m_stream);
+			}
+		}
+
+		// Get current transformation matrices and combine
+		// them into modelview and modelviewprojection ones.
+		QMatrix4x4 modelMatrix = m_item.m_transform.getMatrix();
+		m_modelviewMatrix = m_item.m_camera.getViewMatrix() * modelMatrix;
+		QMatrix4x4 newModelviewprojMatrix = m_item.m_camera.getProjectionMatrix() * m_modelviewMatrix;
+		// Check that either the camera or the mesh transform
+		// changed, and if so, force a re-rendering.
+		// (We do not check for changes in m_modelviewMatrix,
+		// just m_modelviewprojMatrix, since changes in the
+		// former also affect the latter.)
+		if (m_modelviewprojMatrix != newModelviewprojMatrix)
+		{
+			qCDebug(lcQtGLVidDemo) << "New ModelViewProjection matrix";
+			m_modelviewprojMatrix = newModelviewprojMatrix;
+			m_mustRender = true;
+		}
+
+		// If the mesh type changed, we must re-render.
+		if (m_meshType != m_item.m_meshType)
+		{
+			m_meshType = m_item.m_meshType;
+			qCDebug(lcQtGLVidDemo) << "New mesh type:" << m_meshType;
+			m_mesh = &(GLResources::instance().getMesh(m_meshType));
+			m_mustRender = true;
+		}
+
+		// If the crop rectangle changed, we must re-render. It is
+		// applied to the material in drawMaterial(), but the frame
+		// needs to know it already, since it determines which region
+		// of the video frames gets uploaded.
+		if (m_cropRectangle != m_item.m_cropRectangle)
+		{
+			qCDebug(lcQtGLVidDemo) << "New crop rectangle:" << m_item.m_cropRectangle;
+			m_cropRectangle = m_item.m_cropRectangle;
+			if (m_sharedFrame)
+				m_sharedFrame->setCropRectangle(this, m_cropRectangle);
+			if (m_pendingFrame)
+				m_pendingFrame->setCropRectangle(this, m_cropRectangle);
+			// The upload thread retains the crop rectangle of the
+			// front material when swapping, so set it right away.
+			if (m_uploadThread)
+			{
+				m_uploadThread->setCropRectangle(m_cropRectangle);
+				getVideoMaterial().setCropRectangle(m_cropRectangle);
+			}
+			m_mustRender = true;
+			updateMaxVideoSize();
+		}
+
+		// If the texture rotation changed, we must re-render.
+		if (m_textureRotation != m_item.m_textureRotation)
+		{
+			qCDebug(lcQtGLVidDemo) << "New texture rotation angle:" << m_item.m_textureRotation;
+			m_textureRotation = m_item.m_textureRotation;
+			m_mustRender = true;
+		}
+	}
+
+
+private:
+	// Performs the steps that are necessary before the video object
+	// can be drawn: it makes sure there is a mesh, and gets the next
+	// video frame if there is one. Returns true if there is anything
+	// to draw.
+	bool prepareFrame()
+	{
+		// Create buffers that the provider's upstream buffer pools
+		// requested, since this requires the OpenGL context.
+		GLResources::instance().getVideoMaterialProvider().serviceUpstreamBufferPools();
+
+		// Upload the first frames of the streams that items without a
+		// renderer prefetch, so these can be drawn once they are shown.
+		FramePrefetcher::instance().uploadFrames(m_glcontext);
+
+		// Exit if there is no mesh set at the moment. No need to
+		// call update(), since changes in the mesh type will trigger
+		// synchronize() and render() calls anyway.
+		if (m_mesh == nullptr)
+			return false;
+
+		// Mesh is set, but has no contents. This should not happen,
+		// but check anyway to be safe. We do need to request an update
+		// to force another render() call because the frame isn't
+		// automatically redrawn once contents are set.
+		if (!m_mesh->hasContents())
+		{
+			requestUpdate();
+			return false;
+		}
+
+		// Switch to the pending stream if its first frame is there.
+		updatePendingStream();
+
+		// There is nothing to draw until the item has a stream.
+		if (!m_sharedFrame)
+			return false;
+
+		// If frames are uploaded by the upload thread, check if it
+		// has a new frame for us. Otherwise, try to get a new video
+		// frame to render from the player.
+		if (m_uploadThread)
+		{
+			switch (m_uploadThread->swapMaterials(getVideoMaterial()))
+			{
+				case FrameUploadThread::SwapResult::NewFrame:
+					m_mustRender = true;
+					break;
+
+				case FrameUploadThread::SwapResult::FrameNotReady:
+					// The GPU is not done with the upload yet. Do not
+					// wait for it; render the current frame instead (if
+					// necessary) and check again during the next frame.
+					qCDebug(lcQtGLVidDemo) << "Uploaded frame not ready yet; trying again later";
+					requestUpdate();
+					break;
+
+				default:
+					break;
+			}
+		}
+		else
+			pullAndUploadVideoSample();
+
+		// There is nothing to draw if there is no video frame yet.
+		if (!getVideoMaterial().hasVideoGstbuffer())
+			return false;
+
+		// Let the item measure how long it took until it showed
+		// a video frame after it was shown by its view.
+		if (m_reportedShowCount != m_showCount)
+		{
+			m_reportedShowCount = m_showCount;
+			QMetaObject::invokeMethod(&m_item, "onFirstFrameDrawn", Qt::QueuedConnection, Q_ARG(unsigned int, m_showCount), Q_ARG(qint64, g_get_monotonic_time()));
+		}
+
+		// URL switches that are not done by updatePendingStream() are
+		// reported once the first frame of the new stream is drawn.
+		// The item was empty until then, so there is no separate gap.
+		if (!m_pendingFrame && (m_reportedUrlSwitchCount != m_urlSwitchCount))
+		{
+			m_reportedUrlSwitchCount = m_urlSwitchCount;
+			QMetaObject::invokeMethod(&m_item, "onUrlSwitched", Qt::QueuedConnection, Q_ARG(unsigned int, m_urlSwitchCount), Q_ARG(qint64, g_get_monotonic_time()), Q_ARG(qint64, -1));
+		}
+
+		return true;
+	}
+
+	VideoMaterial & getVideoMaterial()
+	{
+		return m_sharedFrame->getVideoMaterial();
+	}
+
+	// Replaces the stream whose frames are drawn. A null stream
+	// detaches the current one.
+	void attachStream(std::shared_ptr < SharedVideoStream > p_stream)
+	{
+		if (m_sharedFrame)
+			m_sharedFrame->removeCropRectangle(this);
+		m_sharedFrame.reset();
+
+		m_stream = std::move(p_stream);
+		if (!m_stream)
+			return;
+
+		// Two materials are filled with frames if the upload
+		// thread is running (see setVideoSinkBufferPoolFactory()).
+		m_sharedFrame = m_stream->getFrame(m_glcontext, m_uploadThread ? 2 : 1);
+		m_sharedFrame->setCropRectangle(this, m_cropRectangle);
+
+		// The frame may already contain a video frame if
+		// it is shared with renderers of other items.
+		m_frameNumber = m_sharedFrame->getFrameNumber();
+		m_lastFrameChangeTime = (m_frameNumber > 0) ? g_get_monotonic_time() : -1;
+		m_mustRender = true;
+
+		qCDebug(lcQtGLVidDemo) << "Attached stream" << m_stream->getUrl() << "to renderer";
+	}
+
+	// Replaces the stream that is switched to once its first frame
+	// is uploaded. A null stream drops the current pending one.
+	void setPendingStream(std::shared_ptr < SharedVideoStream > p_stream)
+	{
+		if (m_pendingFrame)
+			m_pendingFrame->removeCropRectangle(this);
+		m_pendingFrame.reset();
+
+		m_pendingStream = std::move(p_stream);
+		if (!m_pendingStream)
+			return;
+
+		m_pendingFrame = m_pendingStream->getFrame(m_glcontext, 1);
+		m_pendingFrame->setCropRectangle(this, m_cropRectangle);
+
+		qCDebug(lcQtGLVidDemo) << "Waiting for the first frame of stream" << m_pendingStream->getUrl() << "before switching to it";
+	}
+
+	// Uploads the first frame of the pending stream, and switches over
+	// to that stream once there is one. Until then, the current stream
+	// is drawn. Since this happens right before drawing, the item never
+	// shows an empty frame during the switch.
+	void updatePendingStream()
+	{
+		if (!m_pendingFrame)
+			return;
+
+		// The player of the pending stream is prerolled, so there is
+		// only one frame to pull, and no need for frame pacing.
+		m_pendingFrame->pullAndUploadVideoSample(GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE);
+		if (m_pendingFrame->getFrameNumber() == 0)
+			return;
+
+		// The gap is the time since the current stream's last frame.
+		qint64 now = g_get_monotonic_time();
+		qint64 gap = (m_sharedFrame && (m_lastFrameChangeTime >= 0)) ? (now - m_lastFrameChangeTime) : -1;
+
+		if (m_sharedFrame)
+			m_sharedFrame->removeCropRectangle(this);
+
+		m_stream = std::move(m_pendingStream);
+		m_sharedFrame = std::move(m_pendingFrame);
+		m_pendingStream.reset();
+		m_pendingFrame.reset();
+
+		m_frameNumber = m_sharedFrame->getFrameNumber();
+		m_lastFrameChangeTime = now;
+		m_mustRender = true;
+
+		// Let the item release the outgoing stream.
+		m_reportedUrlSwitchCount = m_urlSwitchCount;
+		QMetaObject::invokeMethod(&m_item, "onUrlSwitched", Qt::QueuedConnection, Q_ARG(unsigned int, m_urlSwitchCount), Q_ARG(qint64, now), Q_ARG(qint64, gap));
+
+		qCDebug(lcQtGLVidDemo) << "Switched renderer to stream" << m_stream->getUrl();
+	}
+
+	// The material may be shared with renderers of other items,
+	// so apply this item's crop rectangle and texture rotation.
+	void applyMaterialStates(VideoMaterial &p_videoMaterial)
+	{
+		if (p_videoMaterial.getCropRectangle() != m_cropRectangle)
+			p_videoMaterial.setCropRectangle(m_cropRectangle);
+		if (p_videoMaterial.getTextureRotation() != m_textureRotation)
+			p_videoMaterial.setTextureRotation(m_textureRotation);
+	}
+
+	// Draws the mesh with the video material. The caller sets up the
+	// depth, culling, and blending states. The shader multiplies its
+	// output (including alpha) with p_opacity.
+	void drawMesh(QMatrix4x4 const &p_modelviewprojMatrix, float const p_opacity)
+	{
+		bindMesh();
+		drawMaterial(p_modelviewprojMatrix, p_opacity);
+		releaseMesh();
+	}
+
+	// Measures how long it takes from the capture of the frame that was
+	// just drawn until the window's buffers are swapped. Only frames of
+	// live capture devices have a capture time. The swap happens after
+	// all items were drawn, so the measurement is finished in the
+	// window's frameSwapped signal, which is emitted in the render thread.
+	void probeCaptureLatency()
+	{
+		if (!m_sharedFrame || m_uploadThread || (m_window == nullptr))
+			return;
+
+		GstClockTime captureTime = m_sharedFrame->getCaptureTime();
+		if (!GST_CLOCK_TIME_IS_VALID(captureTime) || (captureTime == m_probedCaptureTime))
+			return;
+
+		m_probedCaptureTime = captureTime;
+		m_pendingCaptureTime = captureTime;
+
+		if (!m_frameSwappedConnection)
+		{
+			m_frameSwappedConnection = QObject::connect(m_window, &QQuickWindow::frameSwapped, [this]() {
+				if (!GST_CLOCK_TIME_IS_VALID(m_pendingCaptureTime))
+					return;
+
+				GstClockTime now = GstClockTime(g_get_monotonic_time()) * GST_USECOND;
+				qint64 latency = (now > m_pendingCaptureTime) ? qint64(now - m_pendingCaptureTime) : 0;
+				m_pendingCaptureTime = GST_CLOCK_TIME_NONE;
+
+				QMetaObject::invokeMethod(&m_item, "onCaptureLatencyMeasured", Qt::QueuedConnection, Q_ARG(qint64, latency));
+			});
+		}
+	}
+
+	// Schedules another rendering. With FBOs, this is done through the
+	// FBO node. Render nodes have no such mechanism, so the item is
+	// updated instead. (The signal is delivered in the item's thread.)
+	void requestUpdate()
+	{
+		if (m_renderIntoFBO)
+			update();
+		else
+			emit m_item.fboNeedsChange();
+	}
+
+	// Sets the size of the area the video object is rendered into
+	// (the FBO or the item's area in the window).
+	void setTargetSize(QSize const &p_size)
+	{
+		if (p_size == m_targetSize)
+			return;
+
+		m_targetSize = p_size;
+		updateMaxVideoSize();
+	}
+
+	void pullAndUploadVideoSample()
+	{
+		// Predict when the frame that is rendered now will be shown.
+		GstClockTime vsyncTime = GST_CLOCK_TIME_NONE;
+		GstClockTime vsyncInterval = GST_CLOCK_TIME_NONE;
+		if (m_vsyncPredictor)
+		{
+			vsyncTime = m_vsyncPredictor->predictNextVsync();
+			vsyncInterval = m_vsyncPredictor->getVsyncInterval();
+		}
+
+		// Try to get a new video frame to render. (Renderers of other
+		// items with the same stream may have done that already for
+		// this vsync.) With frame pacing, frames that are not due yet
+		// stay queued. No new frame arrival may trigger another rendering
+		// before they are due, so request one to check again at the next
+		// vsync.
+		if (m_sharedFrame->pullAndUploadVideoSample(vsyncTime, vsyncInterval))
+			requestUpdate();
+
+		// If there is a new video frame, we must re-render the FBO contents.
+		if (m_sharedFrame->getFrameNumber() != m_frameNumber)
+		{
+			m_frameNumber = m_sharedFrame->getFrameNumber();
+			m_lastFrameChangeTime = g_get_monotonic_time();
+			m_mustRender = true;
+		}
+	}
+
+	void startUploadThread(VideoMaterialProvider &p_vidmatProvider)
+	{
+		if (!p_vidmatProvider.supportsThreadedUploads())
+		{
+			qCWarning(lcQtGLVidDemo) << "Video material provider does not support threaded uploads; uploading frames in the render thread";
+			return;
+		}
+
+		if (!FrameUploadThread::isSupported(m_glcontext))
+		{
+			qCWarning(lcQtGLVidDemo) << "OpenGL implementation does not support threaded uploads; uploading frames in the render thread";
+			return;
+		}
+
+		if (!m_item.m_uploadSurface)
+		{
+			qCWarning(lcQtGLVidDemo) << "No offscreen surface for the upload thread; uploading frames in the render thread";
+			return;
+		}
+
+		// The upload thread gets its own material. The shared frame's
+		// material and this one are then swapped after each upload.
+		if (m_item.m_uploadThread->start(m_glcontext, m_item.m_uploadSurface.get(), p_vidmatProvider.createVideoMaterial()))
+		{
+			m_uploadThread = m_item.m_uploadThread;
+			m_uploadThread->setCropRectangle(m_cropRectangle);
+		}
+	}
+
+	void updateMaxVideoSize()
+	{
+		// Frames never need to be larger than the render target (the
+		// FBO or the item's area in the window), since details that are
+		// smaller than one of its pixels cannot be seen. If the frames
+		// are cropped, only the cropped region is stretched over the
+		// target, so the frames can be correspondingly larger. This is
+		// just a heuristic, since the object may not fill the target.
+		QRect const &cropRectangle = m_item.m_cropRectangle;
+		int cropWidth = std::max(1, std::min(cropRectangle.width(), 100 - cropRectangle.x()));
+		int cropHeight = std::max(1, std::min(cropRectangle.height(), 100 - cropRectangle.y()));
+
+		QSize maxVideoSize(m_targetSize.width() * 100 / cropWidth, m_targetSize.height() * 100 / cropHeight);
+		if (maxVideoSize == m_maxVideoSize)
+			return;
+
+		m_maxVideoSize = maxVideoSize;
+
+		// This is called in the render thread, but the item and the
+		// player live in the main thread, so use a queued invocation.
+		// (The player uses a timer internally, which must be started
+		// in its thread.) The item passes the size on to its stream.
+		QMetaObject::invokeMethod(&m_item, "setMaxVideoSize", Qt::QueuedConnection, Q_ARG(QSize, maxVideoSize));
+	}
+
+	void clearFBO()
+	{
+		// Clear the FBO. Make sure the alpha channel values are set to 0
+		// so the FBO produces an image where the background pixels are
+		// 100% translucent.
+
+		QOpenGLFunctions *glfuncs = m_glcontext->functions();
+		glfuncs->glClearColor(0, 0, 0, 0);
+		glfuncs->glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	}
+
+	QOpenGLContext *m_glcontext;
+	QQuickWindow *m_window;
+	VideoObjectItem &m_item;
+	Mesh *m_mesh;
+
+	QString m_meshType;
+	QMatrix4x4 m_modelviewMatrix;
+	QMatrix4x4 m_modelviewprojMatrix;
+	bool m_mustRender;
+	bool m_firstRender;
+	bool m_renderIntoFBO;
+	bool m_mirrorVertically;
+
+	QSize m_targetSize;
+	QSize m_maxVideoSize;
+
+	// The item's crop rectangle and texture rotation. These are applied
+	// to the shared frame's material in drawMaterial().
+	QRect m_cropRectangle;
+	int m_textureRotation;
+
+	// The stream whose frames are drawn, and its frame for m_glcontext.
+	// m_frameNumber is the frame number that was drawn last, and
+	// m_lastFrameChangeTime is when it changed (-1 if unknown), in
+	// microseconds of the monotonic clock.
+	std::shared_ptr < SharedVideoStream > m_stream;
+	std::shared_ptr < SharedVideoFrame > m_sharedFrame;
+	unsigned int m_frameNumber;
+	qint64 m_lastFrameChangeTime;
+
+	// The stream that is switched to once its first frame is uploaded,
+	// and its frame for m_glcontext. Only set during seamless URL switches.
+	std::shared_ptr < SharedVideoStream > m_pendingStream;
+	std::shared_ptr < SharedVideoFrame > m_pendingFrame;
+
+	// The item's show count, and the one the first
+	// drawn frame was last reported for.
+	unsigned int m_showCount;
+	unsigned int m_reportedShowCount;
+
+	// The item's URL switch count, and the one the
+	// first frame of the new stream was reported for.
+	unsigned int m_urlSwitchCount;
+	unsigned int m_reportedUrlSwitchCount;
+
+	// Set if the upload thread is running. Then, this renderer
+	// does not pull frames from the player on its own.
+	std::shared_ptr < FrameUploadThread > m_uploadThread;
+
+	// Predicts the vsync of the frame that is currently rendered.
+	std::shared_ptr < VsyncPredictor > m_vsyncPredictor;
+
+	// Capture latency probe. m_probedCaptureTime is the capture time
+	// of the frame that was measured last (so a frame that is drawn
+	// several times is only measured once), and m_pendingCaptureTime
+	// the one of the frame that was drawn but not swapped yet.
+	GstClockTime m_probedCaptureTime;
+	GstClockTime m_pendingCaptureTime;
+	QMetaObject::Connection m_frameSwappedConnection;
+};
+
+
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+
+namespace
+{
+
+
+// Maps p_rect through p_matrix into normalized device coordinates, and
+// from there into pixels of p_viewport. The result is in OpenGL window
+// coordinates (origin at the bottom left corner), just like the scissor
+// rectangle. Since only two corners are mapped, this is only correct
+// if p_matrix does not rotate the rectangle.
+QRect mapToViewport(QMatrix4x4 const &p_matrix, QRectF const &p_rect, GLint const *p_viewport)
+{
+	QPointF corners[2] = { p_rect.topLeft(), p_rect.bottomRight() };
+	for (QPointF &corner : corners)
+	{
+		QVector3D ndc = p_matrix.map(QVector3D(corner.x(), corner.y(), 0.0f));
+		corner = QPointF(
+			p_viewport[0] + (ndc.x() + 1.0f) * 0.5f * p_viewport[2],
+			p_viewport[1] + (ndc.y() + 1.0f) * 0.5f * p_viewport[3]
+		);
+	}
+
+	return QRectF(corners[0], corners[1]).normalized().toAlignedRect();
+}
+
+
+} // unnamed namespace end
+
+
+
+
+/**
+ * Draws the video objects of all render nodes in a window together.
+ *
+ * This is used if the render mode is set to "batched". The first render
+ * node the scenegraph renders in a frame draws all video objects, and the
+ * other nodes do nothing in that frame. The objects are sorted by shader
+ * program and mesh, and the program, the mesh buffers, and the vertex
+ * attributes are set up once per combination instead of once per object.
+ *
+ * Since the objects are not drawn at the positions of their nodes in the
+ * scenegraph anymore, each object gets its own slice of the depth range.
+ * Objects whose nodes come later in the scenegraph get slices closer to
+ * the viewer, so they occlude the objects behind them just like before.
+ * Semi-transparent objects are drawn after the opaque ones, in scenegraph
+ * order, so they are blended over what is behind them.
+ *
+ * If the video material provider supports it (see
+ * VideoMaterialProvider::supportsInstancedDrawing()), opaque objects that
+ * share the shader program, the mesh, and the mirroring, and whose frames
+ * have the same sizes and formats, are drawn with one instanced draw call.
+ * Their frames are copied into the layers of texture arrays for this (see
+ * VideoTextureArray), and everything that differs between the objects
+ * (modelviewprojection and normal matrices, crop rectangle, texture
+ * rotation, clip rectangle, depth range slice, and layer) is passed
+ * through per-instance vertex attributes. The viewport and the depth range
+ * slice of each object are folded into its modelviewprojection matrix, and
+ * the clip rectangle and the depth range slice are enforced in the
+ * fragment shader, since the objects are not clipped against their own
+ * viewports anymore. Each frame is only copied once, even if it is drawn
+ * several times, or by several items that share a stream.
+ *
+ * All other objects are drawn one by one, with the material, the uniforms,
+ * the viewport, and the scissor rectangle changing in between the draw
+ * calls. This is the case for semi-transparent objects, for objects whose
+ * frames are in textures that are owned by the driver or by GStreamer (with
+ * the Vivante and GstGL providers, and the DMA-BUF provider's EGLImages),
+ * since these cannot be copied into texture arrays, and for objects without
+ * compatible ones to share the draw call with.
+ *
+ * In frames where one of the nodes cannot be drawn by the batch (because it
+ * is clipped with the stencil buffer, or because it is rendered into a
+ * layer, for example), all nodes draw their objects individually, like in
+ * the "scenegraph" render mode.
+ */
+class VideoObjectItem::RenderNodeBatch
+{
+public:
+	~RenderNodeBatch();
+
+	/**
+	 * Returns the batch for the render nodes in p_window.
+	 *
+	 * The batch is created if it does not exist yet. It is shared by
+	 * the nodes and destroyed together with the last one of them.
+	 */
+	static std::shared_ptr < RenderNodeBatch > get(QQuickWindow *p_window);
+
+	void addNode(RenderNode *p_node);
+	void removeNode(RenderNode *p_node);
+
+	/**
+	 * Called by RenderNode::render().
+	 *
+	 * In the first call in a frame, all video objects are drawn.
+	 *
+	 * @return true if the video object of p_node was drawn by the batch,
+	 *         false if the node must draw its video object by itself.
+	 */
+	bool render(RenderNode *p_node, QSGRenderNode::RenderState const *p_state);
+
+
+private:
+	explicit RenderNodeBatch(QQuickWindow *p_window);
+
+	// State accumulated while walking down the scenegraph.
+	struct TraversalState
+	{
+		QMatrix4x4 m_matrix;
+		float m_opacity;
+		bool m_clipped;
+		QRect m_clipRect;
+	};
+
+	// A video object to draw, and where to draw it. The material and
+	// the values read off it are only set for objects that may be
+	// drawn with an instanced draw call.
+	struct Entry
+	{
+		Renderer *m_renderer;
+		QRect m_viewport;
+		QRect m_scissorRect;
+		float m_opacity;
+		float m_depthRangeNear, m_depthRangeFar;
+
+		VideoMaterial *m_material;
+		QVector4D m_shaderCropRectangle;
+		QMatrix2x2 m_textureRotationMatrix;
+	};
+
+	typedef std::vector < Entry* >::iterator EntryIterator;
+
+	bool collectEntries(QSGNode *p_node, TraversalState p_traversalState);
+	void drawEntries();
+	void drawOpaqueEntries(EntryIterator p_begin, EntryIterator p_end);
+	bool drawInstanced(EntryIterator p_begin, EntryIterator p_end, VideoShaderProgram &p_instancedShaderProgram);
+	void drawEntry(Entry const &p_entry, float const p_opacity);
+
+	QQuickWindow *m_window;
+	QMetaObject::Connection m_afterRenderingConnection;
+
+	std::vector < RenderNode* > m_nodes;
+	std::vector < Entry > m_entries;
+	std::vector < Entry* > m_sortedEntries;
+
+	QMatrix4x4 m_projectionMatrix;
+	GLint m_viewport[4];
+
+	Renderer *m_boundRenderer;
+	bool m_frameStarted;
+	bool m_batched;
+
+	// Texture arrays for the instanced draw calls. They are kept across
+	// frames, so they only have to be reallocated if the objects or their
+	// frame formats change. m_numUsedTextureArrays is the number of arrays
+	// used in the current frame.
+	std::vector < VideoTextureArrayUPtr > m_textureArrays;
+	std::size_t m_numUsedTextureArrays;
+
+	// The materials of the current instanced draw call (one per texture
+	// array layer), and the per-instance vertex attribute values.
+	std::vector < VideoMaterial* > m_instanceMaterials;
+	std::vector < float > m_instanceData;
+	QOpenGLBuffer m_instanceBuffer;
+};
+
+
+
+
+/**
+ * Scenegraph node for rendering the VideoObjectItem without an FBO.
+ *
+ * This is used instead of the QQuickFramebufferObject node if the render
+ * mode is set to "scenegraph" or "batched". The node owns a Renderer, and
+ * lets it draw the video object directly into the window (or into whatever
+ * target the scenegraph is currently rendering into). This avoids the extra
+ * FBO render pass and the additional memory bandwidth for the FBO texture.
+ * With "batched", the video objects are drawn by a RenderNodeBatch instead
+ * if possible.
+ *
+ * Only the item's bounding rectangle in the window is used for placing
+ * the video object, so the item may be moved and scaled, but rotating
+ * it (with the QtQuick 2 rotation property) is not supported.
+ */
+class VideoObjectItem::RenderNode
+	: public QSGRenderNode
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param p_item Item to render.
+	 * @param p_glcontext The scenegraph's OpenGL context.
+	 * @param p_batch Batch to add the node to. If null, the node
+	 *        always draws its video object by itself.
+	 */
+	explicit RenderNode(VideoObjectItem &p_item, QOpenGLContext *p_glcontext, std::shared_ptr < RenderNodeBatch > p_batch)
+		: m_renderer(new Renderer(p_item, p_glcontext, false))
+		, m_batch(std::move(p_batch))
+	{
+		if (m_batch)
+			m_batch->addNode(this);
+	}
+
+	~RenderNode()
+	{
+		if (m_batch)
+			m_batch->removeNode(this);
+	}
+
+	// Called by updatePaintNode(), so the item can be accessed safely.
+	void synchronize(VideoObjectItem &p_item)
+	{
+		m_renderer->synchronize(&p_item);
+		m_rect = QRectF(0, 0, p_item.width(), p_item.height());
+	}
+
+	Renderer & getRenderer()
+	{
+		return *m_renderer;
+	}
+
+	virtual void render(RenderState const *p_state) override
+	{
+		if (m_batch && m_batch->render(this, p_state))
+			return;
+
+		// Map the item's rectangle to the current viewport. The
+		// projection and node matrices transform it into normalized
+		// device coordinates, which are then mapped to pixels.
+		GLint viewport[4];
+		QOpenGLContext::currentContext()->functions()->glGetIntegerv(GL_VIEWPORT, viewport);
+		QRect itemViewport = mapToViewport(*(p_state->projectionMatrix()) * *(this->matrix()), m_rect, viewport);
+
+		m_renderer->renderDirectly(p_state, itemViewport, float(inheritedOpacity()));
+	}
+
+	virtual StateFlags changedStates() const override
+	{
+		return DepthState | StencilState | ScissorState | ColorState | BlendState | CullState | ViewportState;
+	}
+
+	virtual RenderingFlags flags() const override
+	{
+		// Drawing is restricted to the item's rectangle. The node does
+		// not write depth values the scenegraph could use, since the mesh
+		// depth values have nothing to do with the scenegraph's z order.
+		return BoundedRectRendering;
+	}
+
+	virtual QRectF rect() const override
+	{
+		return m_rect;
+	}
+
+
+private:
+	std::unique_ptr < Renderer > m_renderer;
+	std::shared_ptr < RenderNodeBatch > m_batch;
+	QRectF m_rect;
+};
+
+
+
+
+VideoObjectItem::RenderNodeBatch::RenderNodeBatch(QQuickWindow *p_window)
+	: m_window(p_window)
+	, m_boundRenderer(nullptr)
+	, m_frameStarted(false)
+	, m_batched(false)
+	, m_numUsedTextureArrays(0)
+	, m_instanceBuffer(QOpenGLBuffer::VertexBuffer)
+{
+	// afterRendering is emitted in the render thread once the
+	// scenegraph rendered the frame. The next render() call
+	// then belongs to the next frame.
+	m_afterRenderingConnection = QObject::connect(m_window, &QQuickWindow::afterRendering, [this]() { m_frameStarted = false; });
+}
+
+
+VideoObjectItem::RenderNodeBatch::~RenderNodeBatch()
+{
+	QObject::disconnect(m_afterRenderingConnection);
+}
+
+
+std::shared_ptr < VideoObjectItem::RenderNodeBatch > VideoObjectItem::RenderNodeBatch::get(QQuickWindow *p_window)
+{
+	// The nodes own the batch, so only a weak pointer is kept here.
+	// Since the demo application has only one window, there is no
+	// need to keep track of more than one batch.
+	static std::weak_ptr < RenderNodeBatch > currentBatch;
+
+	std::shared_ptr < RenderNodeBatch > batch = currentBatch.lock();
+	if (!batch || (batch->m_window != p_window))
+	{
+		batch.reset(new RenderNodeBatch(p_window));
+		currentBatch = batch;
+	}
+
+	return batch;
+}
+
+
+void VideoObjectItem::RenderNodeBatch::addNode(RenderNode *p_node)
+{
+	m_nodes.push_back(p_node);
+}
+
+
+void VideoObjectItem::RenderNodeBatch::removeNode(RenderNode *p_node)
+{
+	m_nodes.erase(std::remove(m_nodes.begin(), m_nodes.end(), p_node), m_nodes.end());
+}
+
+
+bool VideoObjectItem::RenderNodeBatch::render(RenderNode *p_node, QSGRenderNode::RenderState const *p_state)
+{
+	if (m_frameStarted)
+		return m_batched;
+
+	m_frameStarted = true;
+
+	// All nodes in a render pass use the same projection matrix
+	// and viewport, so the ones of the first node can be used
+	// for placing all video objects.
+	m_projectionMatrix = *(p_state->projectionMatrix());
+	QOpenGLContext::currentContext()->functions()->glGetIntegerv(GL_VIEWPORT, m_viewport);
+
+	// Walk through the scenegraph the node is part of, and collect
+	// the video objects in the order the scenegraph would draw them.
+	QSGNode *rootNode = p_node;
+	while (rootNode->parent() != nullptr)
+		rootNode = rootNode->parent();
+
+	TraversalState traversalState;
+	traversalState.m_opacity = 1.0f;
+	traversalState.m_clipped = false;
+
+	m_entries.clear();
+	bool batched = collectEntries(rootNode, traversalState) && (m_entries.size() == m_nodes.size());
+
+	if (batched != m_batched)
+		qCDebug(lcQtGLVidDemo) << "Video objects are now drawn" << (batched ? "in a batch" : "individually");
+	m_batched = batched;
+
+	if (m_batched)
+		drawEntries();
+
+	return m_batched;
+}
+
+
+bool VideoObjectItem::RenderNodeBatch::collectEntries(QSGNode *p_node, TraversalState p_traversalState)
+{
+	switch (p_node->type())
+	{
+		case QSGNode::TransformNodeType:
+			p_traversalState.m_matrix = p_traversalState.m_matrix * static_cast < QSGTransformNode* > (p_node)->matrix();
+			break;
+
+		case QSGNode::OpacityNodeType:
+			p_traversalState.m_opacity *= float(static_cast < QSGOpacityNode* > (p_node)->opacity());
+			break;
+
+		case QSGNode::ClipNodeType:
+		{
+			// The scenegraph uses the stencil buffer for clip nodes
+			// that are not rectangular or that are rotated. This is
+			// not supported here.
+			QSGClipNode *clipNode = static_cast < QSGClipNode* > (p_node);
+			QMatrix4x4 matrix = m_projectionMatrix * p_traversalState.m_matrix;
+			if (!clipNode->isRectangular() || !qFuzzyIsNull(matrix(0, 1)) || !qFuzzyIsNull(matrix(1, 0)))
+				return false;
+
+			QRect clipRect = mapToViewport(matrix, clipNode->clipRect(), m_viewport);
+			p_traversalState.m_clipRect = p_traversalState.m_clipped ? (p_traversalState.m_clipRect & clipRect) : clipRect;
+			p_traversalState.m_clipped = true;
+
+			break;
+		}
+
+		case QSGNode::RenderNodeType:
+		{
+			auto nodeIter = std::find(m_nodes.begin(), m_nodes.end(), p_node);
+			if (nodeIter == m_nodes.end())
+				break;
+
+			RenderNode *renderNode = *nodeIter;
+
+			Entry entry;
+			entry.m_renderer = &(renderNode->getRenderer());
+			entry.m_viewport = mapToViewport(m_projectionMatrix * p_traversalState.m_matrix, renderNode->rect(), m_viewport);
+			entry.m_scissorRect = p_traversalState.m_clipped ? (entry.m_viewport & p_traversalState.m_clipRect) : entry.m_viewport;
+			entry.m_opacity = p_traversalState.m_opacity;
+			entry.m_material = nullptr;
+			m_entries.push_back(entry);
+
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	for (QSGNode *childNode = p_node->firstChild(); childNode != nullptr; childNode = childNode->nextSibling())
+	{
+		if (!collectEntries(childNode, p_traversalState))
+			return false;
+	}
+
+	return true;
+}
+
+
+void VideoObjectItem::RenderNodeBatch::drawEntries()
+{
+	QOpenGLFunctions *glfuncs = QOpenGLContext::currentContext()->functions();
+
+	// Get the next video frames, and skip the objects that
+	// have nothing to draw, or are invisible. (The scenegraph
+	// does not render nodes below such a low opacity.)
+	m_sortedEntries.clear();
+	for (Entry &entry : m_entries)
+	{
+		if (entry.m_opacity < 0.001f)
+			continue;
+		if (entry.m_renderer->prepareDirectRendering(entry.m_viewport) && !entry.m_scissorRect.isEmpty())
+			m_sortedEntries.push_back(&entry);
+	}
+
+	if (m_sortedEntries.empty())
+		return;
+
+	// Assign the depth range slices. The entries are still in the
+	// order the scenegraph would draw them, so later entries are
+	// in front of earlier ones.
+	std::size_t numEntries = m_sortedEntries.size();
+	for (std::size_t i = 0; i < numEntries; ++i)
+	{
+		m_sortedEntries[i]->m_depthRangeNear = float(numEntries - 1 - i) / float(numEntries);
+		m_sortedEntries[i]->m_depthRangeFar = float(numEntries - i) / float(numEntries);
+	}
+
+	// The nodes are not flagged as depth aware, so the scenegraph
+	// does not rely on the depth buffer contents, and it can be
+	// cleared here (see RenderNode::flags()).
+	glfuncs->glDisable(GL_SCISSOR_TEST);
+	glfuncs->glDisable(GL_STENCIL_TEST);
+	glfuncs->glDepthMask(GL_TRUE);
+	glfuncs->glClear(GL_DEPTH_BUFFER_BIT);
+
+	glfuncs->glEnable(GL_SCISSOR_TEST);
+	glfuncs->glEnable(GL_DEPTH_TEST);
+	glfuncs->glDepthFunc(GL_LESS);
+	glfuncs->glEnable(GL_CULL_FACE);
+	glfuncs->glDisable(GL_BLEND);
+	// The scenegraph uses premultiplied alpha, and the
+	// shader premultiplies its output with the opacity.
+	glfuncs->glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	// Semi-transparent objects must be drawn in scenegraph order,
+	// so keep a copy of that order before sorting.
+	std::vector < Entry* > transparentEntries;
+	for (Entry *entry : m_sortedEntries)
+	{
+		if (entry->m_opacity < 1.0f)
+			transparentEntries.push_back(entry);
+	}
+
+	// Draw the opaque objects first, sorted by shader program, mesh, and
+	// mirroring, so that objects which share these are drawn one after the
+	// other, or together with instanced draw calls. Their order does not
+	// matter otherwise, thanks to the depth slices. The sort is stable, so
+	// that the objects end up in the same texture arrays in every frame.
+	m_sortedEntries.erase(std::remove_if(m_sortedEntries.begin(), m_sortedEntries.end(), [](Entry const *p_entry) { return p_entry->m_opacity < 1.0f; }), m_sortedEntries.end());
+	std::stable_sort(m_sortedEntries.begin(), m_sortedEntries.end(), [](Entry const *p_first, Entry const *p_second) {
+		std::less < void const* > less;
+		void const *firstProgram = &(p_first->m_renderer->getShaderProgram());
+		void const *secondProgram = &(p_second->m_renderer->getShaderProgram());
+		if (firstProgram != secondProgram)
+			return less(firstProgram, secondProgram);
+		if (p_first->m_renderer->getMesh() != p_second->m_renderer->getMesh())
+			return less(p_first->m_renderer->getMesh(), p_second->m_renderer->getMesh());
+		return p_first->m_renderer->isMirroredVertically() < p_second->m_renderer->isMirroredVertically();
+	});
+
+	m_boundRenderer = nullptr;
+	m_numUsedTextureArrays = 0;
+
+	EntryIterator runBegin = m_sortedEntries.begin();
+	while (runBegin != m_sortedEntries.end())
+	{
+		Renderer *firstRenderer = (*runBegin)->m_renderer;
+		EntryIterator runEnd = std::find_if(runBegin, m_sortedEntries.end(), [firstRenderer](Entry const *p_entry) {
+			return (&(p_entry->m_renderer->getShaderProgram()) != &(firstRenderer->getShaderProgram()))
+			    || (p_entry->m_renderer->getMesh() != firstRenderer->getMesh())
+			    || (p_entry->m_renderer->isMirroredVertically() != firstRenderer->isMirroredVertically());
+		});
+
+		drawOpaqueEntries(runBegin, runEnd);
+		runBegin = runEnd;
+	}
+
+	// Texture arrays of groups that no longer exist are not needed anymore.
+	m_textureArrays.resize(m_numUsedTextureArrays);
+
+	// Then draw the semi-transparent objects. Like in
+	// Renderer::renderDirectly(), a depth prepass makes sure
+	// that only the frontmost surfaces of a mesh are blended.
+	for (Entry *entry : transparentEntries)
+	{
+		glfuncs->glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		drawEntry(*entry, 1.0f);
+
+		glfuncs->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glfuncs->glDepthMask(GL_FALSE);
+		glfuncs->glDepthFunc(GL_LEQUAL);
+		glfuncs->glEnable(GL_BLEND);
+		drawEntry(*entry, entry->m_opacity);
+
+		glfuncs->glDisable(GL_BLEND);
+		glfuncs->glDepthMask(GL_TRUE);
+		glfuncs->glDepthFunc(GL_LESS);
+	}
+
+	if (m_boundRenderer != nullptr)
+		m_boundRenderer->releaseMesh();
+
+	qCDebug(lcQtGLVidDemo) << "Drew" << numEntries << "video objects in a batch";
+
+	// The states this changed are listed in RenderNode::changedStates(),
+	// so the scenegraph resets them. The depth range and the front face
+	// winding are not covered by these, so reset them here.
+	glfuncs->glDepthRangef(0.0f, 1.0f);
+	glfuncs->glFrontFace(GL_CCW);
+}
+
+
+void VideoObjectItem::RenderNodeBatch::drawOpaqueEntries(EntryIterator p_begin, EntryIterator p_end)
+{
+	// The entries all have the same shader program, mesh, and mirroring.
+	// Look up the instanced counterpart of the program. If there is none,
+	// or if there is just one object, draw the objects one by one.
+	VideoMaterialProvider &vidmatProvider = GLResources::instance().getVideoMaterialProvider();
+	VideoShaderProgram *instancedShaderProgram = ((p_end - p_begin) >= 2) ? vidmatProvider.getInstancedShaderProgram((*p_begin)->m_renderer->getShaderProgram()) : nullptr;
+
+	if (instancedShaderProgram == nullptr)
+	{
+		for (EntryIterator entryIter = p_begin; entryIter != p_end; ++entryIter)
+			drawEntry(**entryIter, 1.0f);
+		return;
+	}
+
+	// Apply the crop rectangles and texture rotations of the objects
+	// to their materials, and keep the resulting values, since items
+	// that share a stream also share the material.
+	for (EntryIterator entryIter = p_begin; entryIter != p_end; ++entryIter)
+	{
+		Entry *entry = *entryIter;
+		entry->m_material = &(entry->m_renderer->prepareInstance());
+		entry->m_shaderCropRectangle = entry->m_material->getShaderCropRectangle();
+		entry->m_textureRotationMatrix = entry->m_material->getTextureRotationMatrix();
+	}
+
+	// Split the entries into groups whose materials can share texture
+	// arrays, and draw each group with one instanced draw call. Entries
+	// that have no compatible ones (or whose textures cannot be copied)
+	// are drawn one by one.
+	std::vector < Entry* > ungroupedEntries(p_begin, p_end);
+	while (!ungroupedEntries.empty())
+	{
+		VideoMaterial &firstMaterial = *(ungroupedEntries.front()->m_material);
+		EntryIterator groupEnd = std::stable_partition(ungroupedEntries.begin(), ungroupedEntries.end(), [&firstMaterial](Entry const *p_entry) {
+			return VideoTextureArray::areCompatible(firstMaterial, *(p_entry->m_material));
+		});
+
+		// A material whose textures have no storage is not compatible
+		// with anything, not even with itself.
+		if (groupEnd == ungroupedEntries.begin())
+			groupEnd = ungroupedEntries.begin() + 1;
+
+		if (((groupEnd - ungroupedEntries.begin()) < 2) || !drawInstanced(ungroupedEntries.begin(), groupEnd, *instancedShaderProgram))
+		{
+			for (EntryIterator entryIter = ungroupedEntries.begin(); entryIter != groupEnd; ++entryIter)
+				drawEntry(**entryIter, 1.0f);
+		}
+
+		ungroupedEntries.erase(ungroupedEntries.begin(), groupEnd);
+	}
+}
+
+
+bool VideoObjectItem::RenderNodeBatch::drawInstanced(EntryIterator p_begin, EntryIterator p_end, VideoShaderProgram &p_instancedShaderProgram)
+{
+	QOpenGLContext *glcontext = QOpenGLContext::currentContext();
+	QOpenGLFunctions *glfuncs = glcontext->functions();
+	QOpenGLExtraFunctions *glextrafuncs = glcontext->extraFunctions();
+
+	// Items that show the same stream share the material,
+	// so their objects sample from the same layer.
+	m_instanceMaterials.clear();
+	for (EntryIterator entryIter = p_begin; entryIter != p_end; ++entryIter)
+	{
+		VideoMaterial *material = (*entryIter)->m_material;
+		if (std::find(m_instanceMaterials.begin(), m_instanceMaterials.end(), material) == m_instanceMaterials.end())
+			m_instanceMaterials.push_back(material);
+	}
+
+	// Copy the frames into the texture arrays. Frames that were
+	// copied in an earlier frame already are not copied again.
+	if (m_numUsedTextureArrays == m_textureArrays.size())
+		m_textureArrays.emplace_back(new VideoTextureArray(glcontext));
+	VideoTextureArray &textureArray = *(m_textureArrays[m_numUsedTextureArrays++]);
+
+	textureArray.setup(*(m_instanceMaterials[0]), m_instanceMaterials.size());
+	for (std::size_t layer = 0; layer < m_instanceMaterials.size(); ++layer)
+	{
+		if (!textureArray.copyIntoLayer(*(m_instanceMaterials[layer]), layer))
+			return false;
+	}
+
+	// Fill in the per-instance vertex attribute values. Instead of setting
+	// the viewport and depth range of each object, the clip space coordinates
+	// are transformed so that they end up in the object's viewport and depth
+	// range slice with the window's viewport and the full depth range. The
+	// scissor rectangle is replaced by discarding fragments in the shader.
+	// The same is done with fragments outside of the depth range slice,
+	// since clipping only keeps the objects inside the full depth range.
+	constexpr std::size_t NumFloatsPerInstance = 16 + 9 + 4 + 4 + 4 + 2 + 1;
 
-		// We just rendered into the FBO, so we do not
-		// _have_ render again at the moment.
-		m_mustRender = false;
+	float windowViewportWidth = float(m_viewport[2]);
+	float windowViewportHeight = float(m_viewport[3]);
 
-		// Reset any modified OpenGL state.
-		m_window->resetOpenGLState();
+	m_instanceData.clear();
+	QRect scissorRect;
+
+	for (EntryIterator entryIter = p_begin; entryIter != p_end; ++entryIter)
+	{
+		Entry const &entry = **entryIter;
+		QRect const &viewport = entry.m_viewport;
+		QRect const &clipRect = entry.m_scissorRect;
+
+		QMatrix4x4 viewportMatrix(
+			viewport.width() / windowViewportWidth, 0.0f, 0.0f, (2.0f * (viewport.x() - m_viewport[0]) + viewport.width()) / windowViewportWidth - 1.0f,
+			0.0f, viewport.height() / windowViewportHeight, 0.0f, (2.0f * (viewport.y() - m_viewport[1]) + viewport.height()) / windowViewportHeight - 1.0f,
+			0.0f, 0.0f, entry.m_depthRangeFar - entry.m_depthRangeNear, entry.m_depthRangeFar + entry.m_depthRangeNear - 1.0f,
+			0.0f, 0.0f, 0.0f, 1.0f
+		);
+		QMatrix4x4 modelviewprojMatrix = viewportMatrix * entry.m_renderer->getMirroredModelviewprojMatrix();
+		QMatrix3x3 normalMatrix = entry.m_renderer->getNormalMatrix();
+		float layer = float(std::find(m_instanceMaterials.begin(), m_instanceMaterials.end(), entry.m_material) - m_instanceMaterials.begin());
+
+		// The Qt matrices store their values in column-major
+		// order, which is what the shader expects.
+		m_instanceData.insert(m_instanceData.end(), modelviewprojMatrix.constData(), modelviewprojMatrix.constData() + 16);
+		m_instanceData.insert(m_instanceData.end(), normalMatrix.constData(), normalMatrix.constData() + 9);
+		m_instanceData.insert(m_instanceData.end(), { entry.m_shaderCropRectangle.x(), entry.m_shaderCropRectangle.y(), entry.m_shaderCropRectangle.z(), entry.m_shaderCropRectangle.w() });
+		m_instanceData.insert(m_instanceData.end(), entry.m_textureRotationMatrix.constData(), entry.m_textureRotationMatrix.constData() + 4);
+		m_instanceData.insert(m_instanceData.end(), { float(clipRect.x()), float(clipRect.y()), float(clipRect.width()), float(clipRect.height()) });
+		m_instanceData.insert(m_instanceData.end(), { entry.m_depthRangeNear, entry.m_depthRangeFar });
+		m_instanceData.push_back(layer);
+
+		scissorRect |= clipRect;
 	}
 
-	virtual void synchronize(QQuickFramebufferObject *) override
+	GLsizei numInstances = GLsizei(p_end - p_begin);
+	assert(m_instanceData.size() == NumFloatsPerInstance * std::size_t(numInstances));
+
+	// Set up the instanced program and the mesh.
+	if (m_boundRenderer != nullptr)
 	{
-		// In here, check if any states changed that affect
-		// the mesh rendering. If so, set m_mustRender to
-		// true so that render() re-renders the FBO contents.
+		m_boundRenderer->releaseMesh();
+		m_boundRenderer = nullptr;
+	}
 
-		m_window = m_item.window();
+	Renderer *renderer = (*p_begin)->m_renderer;
+	renderer->bindMesh(p_instancedShaderProgram);
 
-		// Get current transformation matrices and combine
-		// them into modelview and modelviewprojection ones.
-		QMatrix4x4 modelMatrix = m_item.m_transform.getMatrix();
-		m_modelviewMatrix = m_item.m_camera.getViewMatrix() * modelMatrix;
-		QMatrix4x4 newModelviewprojMatrix = m_item.m_camera.getProjectionMatrix() * m_modelviewMatrix;
-		// Check that either the camera or the mesh transform
-		// changed, and if so, force a re-rendering.
-		// (We do not check for changes in m_modelviewMatrix,
-		// just m_modelviewprojMatrix, since changes in the
-		// former also affect the latter.)
-		if (m_modelviewprojMatrix != newModelviewprojMatrix)
-		{
-			qCDebug(lcQtGLVidDemo) << "New ModelViewProjection matrix";
-			m_modelviewprojMatrix = newModelviewprojMatrix;
-			m_mustRender = true;
-		}
+	// The YUV->RGB conversion coefficients are the same
+	// for all materials (see VideoTextureArray::areCompatible()).
+	QOpenGLShaderProgram &prog = p_instancedShaderProgram.getProgram();
+	prog.setUniformValue(p_instancedShaderProgram.getColorMatrixUniform(), m_instanceMaterials[0]->getColorMatrix());
+	prog.setUniformValue(p_instancedShaderProgram.getColorOffsetUniform(), m_instanceMaterials[0]->getColorOffset());
+	prog.setUniformValue(p_instancedShaderProgram.getOpacityUniform(), GLfloat(1.0f));
 
-		// If the mesh type changed, we must re-render.
-		if (m_meshType != m_item.m_meshType)
-		{
-			m_meshType = m_item.m_meshType;
-			qCDebug(lcQtGLVidDemo) << "New mesh type:" << m_meshType;
-			m_mesh = &(GLResources::instance().getMesh(m_meshType));
-			m_mustRender = true;
-		}
+	if (!m_instanceBuffer.isCreated())
+	{
+		m_instanceBuffer.create();
+		m_instanceBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+	}
+	m_instanceBuffer.bind();
+	m_instanceBuffer.allocate(m_instanceData.data(), int(m_instanceData.size() * sizeof(float)));
 
-		// If the crop rectangle changed, we must re-render.
-		if (m_videoMaterial.getCropRectangle() != m_item.m_cropRectangle)
+	// Set up the per-instance vertex attributes. Matrix attributes
+	// occupy one attribute location per column.
+	struct InstanceAttrib
+	{
+		int m_location;
+		int m_numColumns;
+		int m_numComponents;
+	};
+	InstanceAttrib const instanceAttribs[] = {
+		{ p_instancedShaderProgram.getInstanceModelviewprojMatrixAttrib(), 4, 4 },
+		{ p_instancedShaderProgram.getInstanceNormalMatrixAttrib(), 3, 3 },
+		{ p_instancedShaderProgram.getInstanceCropRectangleAttrib(), 1, 4 },
+		{ p_instancedShaderProgram.getInstanceTextureRotationAttrib(), 1, 4 },
+		{ p_instancedShaderProgram.getInstanceClipRectangleAttrib(), 1, 4 },
+		{ p_instancedShaderProgram.getInstanceDepthRangeAttrib(), 1, 2 },
+		{ p_instancedShaderProgram.getInstanceLayerAttrib(), 1, 1 }
+	};
+
+	std::size_t offset = 0;
+	for (InstanceAttrib const &attrib : instanceAttribs)
+	{
+		for (int column = 0; column < attrib.m_numColumns; ++column)
 		{
-			qCDebug(lcQtGLVidDemo) << "New crop rectangle:" << m_item.m_cropRectangle;
-			m_videoMaterial.setCropRectangle(m_item.m_cropRectangle);
-			m_mustRender = true;
+			if (attrib.m_location >= 0)
+			{
+				GLuint location = GLuint(attrib.m_location + column);
+				glfuncs->glEnableVertexAttribArray(location);
+				glfuncs->glVertexAttribPointer(location, attrib.m_numComponents, GL_FLOAT, GL_FALSE, GLsizei(NumFloatsPerInstance * sizeof(float)), reinterpret_cast < void const * > (offset));
+				glextrafuncs->glVertexAttribDivisor(location, 1);
+			}
+
+			offset += attrib.m_numComponents * sizeof(float);
 		}
+	}
 
-		// If the texture rotation changed, we must re-render.
-		if (m_videoMaterial.getTextureRotation() != m_item.m_textureRotation)
+	glfuncs->glViewport(m_viewport[0], m_viewport[1], m_viewport[2], m_viewport[3]);
+	glfuncs->glScissor(scissorRect.x(), scissorRect.y(), scissorRect.width(), scissorRect.height());
+	glfuncs->glDepthRangef(0.0f, 1.0f);
+	glfuncs->glFrontFace(renderer->isMirroredVertically() ? GL_CW : GL_CCW);
+
+	textureArray.bind();
+	glextrafuncs->glDrawElementsInstanced(GL_TRIANGLES, renderer->getMesh()->getNumIndices(), GL_UNSIGNED_SHORT, nullptr, numInstances);
+	textureArray.unbind();
+
+	// The divisors are part of the vertex attribute state,
+	// so reset them for the programs that are drawn later.
+	for (InstanceAttrib const &attrib : instanceAttribs)
+	{
+		for (int column = 0; (attrib.m_location >= 0) && (column < attrib.m_numColumns); ++column)
 		{
-			qCDebug(lcQtGLVidDemo) << "New texture rotation angle:" << m_item.m_textureRotation;
-			m_videoMaterial.setTextureRotation(m_item.m_textureRotation);
-			m_mustRender = true;
+			GLuint location = GLuint(attrib.m_location + column);
+			glextrafuncs->glVertexAttribDivisor(location, 0);
+			glfuncs->glDisableVertexAttribArray(location);
 		}
 	}
 
+	m_instanceBuffer.release();
+	renderer->releaseMesh(p_instancedShaderProgram);
 
-private:
-	void clearFBO()
-	{
-		// Clear the FBO. Make sure the alpha channel values are set to 0
-		// so the FBO produces an image where the background pixels are
-		// 100% translucent.
+	qCDebug(lcQtGLVidDemo) << "Drew" << numInstances << "video objects with" << m_instanceMaterials.size() << "frame(s) in one instanced draw call";
 
-		QOpenGLFunctions *glfuncs = m_glcontext->functions();
-		glfuncs->glClearColor(0, 0, 0, 0);
-		glfuncs->glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+	return true;
+}
+
+
+void VideoObjectItem::RenderNodeBatch::drawEntry(Entry const &p_entry, float const p_opacity)
+{
+	QOpenGLFunctions *glfuncs = QOpenGLContext::currentContext()->functions();
+	Renderer *renderer = p_entry.m_renderer;
+
+	// Only set up the shader program and the mesh if
+	// they differ from the ones of the previous object.
+	if ((m_boundRenderer == nullptr)
+	 || (&(m_boundRenderer->getShaderProgram()) != &(renderer->getShaderProgram()))
+	 || (m_boundRenderer->getMesh() != renderer->getMesh()))
+	{
+		if (m_boundRenderer != nullptr)
+			m_boundRenderer->releaseMesh();
+		renderer->bindMesh();
+		m_boundRenderer = renderer;
 	}
 
-	QOpenGLContext *m_glcontext;
-	QQuickWindow *m_window;
-	VideoObjectItem &m_item;
-	Mesh *m_mesh;
-	VideoMaterial m_videoMaterial;
+	QRect const &viewport = p_entry.m_viewport;
+	QRect const &scissorRect = p_entry.m_scissorRect;
+	glfuncs->glViewport(viewport.x(), viewport.y(), viewport.width(), viewport.height());
+	glfuncs->glScissor(scissorRect.x(), scissorRect.y(), scissorRect.width(), scissorRect.height());
+	glfuncs->glDepthRangef(p_entry.m_depthRangeNear, p_entry.m_depthRangeFar);
 
-	QString m_meshType;
-	QMatrix4x4 m_modelviewMatrix;
-	QMatrix4x4 m_modelviewprojMatrix;
-	bool m_mustRender;
-	bool m_firstRender;
-};
+	renderer->drawMaterial(renderer->applyMirroring(), p_opacity);
+}
+
+#endif
 
 
 
@@ -325,7 +1850,22 @@ VideoObjectItem::VideoObjectItem(QQuickItem *p_parent)
 	, m_mouseButtonPressed(false)
 	, m_cropRectangle(0, 0, 100, 100)
 	, m_textureRotation(0)
-	, m_player([this]() { onNewFrameAvailable(); })
+	, m_inView(true)
+	, m_prefetch(false)
+	, m_showCount(0)
+	, m_shownTime(0)
+	, m_firstFrameLatency(-1.0)
+	, m_decodingTier(GStreamerPlayer::DecodingTier::Full)
+	, m_pendingDecodingTier(GStreamerPlayer::DecodingTier::Full)
+	, m_pendingDecodingTierCount(0)
+	, m_frameArrivalSlot(FrameArrivalAggregator::instance().addItem(this))
+	, m_vidmatProvider(nullptr)
+	, m_outgoingPlayerState(GStreamerPlayer::State::Stopped)
+	, m_urlSwitchCount(0)
+	, m_urlSwitchStartTime(-1)
+	, m_urlSwitchLatency(-1.0)
+	, m_urlSwitchGap(-1.0)
+	, m_captureLatency(-1.0)
 {
 	// Connect the forceFBOUpdate signal to update(). We cannot
 	// call update() directly in the GStreamerPlayer new frame
@@ -334,6 +1874,21 @@ VideoObjectItem::VideoObjectItem(QQuickItem *p_parent)
 	// called in the right thread.
 	connect(this, &VideoObjectItem::fboNeedsChange, this, &VideoObjectItem::update);
 
+	// The stream can only be acquired once the renderer was created,
+	// since the player must be set up for the renderer's video material
+	// provider. If the URL was set before, acquire the stream now. This
+	// connection is made before any QML handler is connected, so the
+	// player exists by the time those are invoked.
+	connect(this, &VideoObjectItem::canStartPlayback, this, &VideoObjectItem::acquireStream);
+
+	// Switch to the new stream even if its first frame never arrives.
+	m_urlSwitchTimer.setSingleShot(true);
+	m_urlSwitchTimer.setInterval(UrlSwitchTimeout);
+	connect(&m_urlSwitchTimer, &QTimer::timeout, this, [this]() {
+		qCWarning(lcQtGLVidDemo) << "Stream" << m_url << "did not deliver a frame in time; switching to it anyway";
+		finishUrlSwitch();
+	});
+
 	// This item accepts mouse and touch events.
 	setAcceptHoverEvents(true);
 	setAcceptedMouseButtons(Qt::AllButtons);
@@ -353,12 +1908,51 @@ VideoObjectItem::VideoObjectItem(QQuickItem *p_parent)
 	// is automatically updated to contain the arcball's rotation.
 	m_arcball.setTransform(&m_transform);
 
+	// Set up the upload thread if enabled. It is started by the
+	// renderer, since it needs the renderer's OpenGL context.
+	// Once it uploaded a frame, the FBO needs to be updated.
+	// The thread pulls the frames from the player, so the player
+	// cannot be shared with other items.
+	if (Settings::instance().m_threadedUpload)
+	{
+		m_stream = SharedVideoStream::createUnshared();
+		m_stream->addSubscriber(this, [this]() { onNewFrameAvailable(); });
+		m_uploadThread = std::make_shared < FrameUploadThread > (m_stream->getPlayer(), [this]() { scheduleFrameUpdate(); });
+	}
+
+	// Periodically check how visible the item is, and let the player
+	// do less decoding work if the item is barely visible. Polling is
+	// used since not all relevant changes are signaled to the item
+	// (for example, opacity and position changes of its ancestors).
+	if (Settings::instance().m_visibilityThrottling)
+	{
+		m_visibilityTimer.setInterval(VisibilityCheckInterval);
+		connect(&m_visibilityTimer, &QTimer::timeout, this, &VideoObjectItem::updateDecodingTier);
+		m_visibilityTimer.start();
+	}
+
 	qCDebug(lcQtGLVidDemo) << "Created video object item" << this;
 }
 
 
 VideoObjectItem::~VideoObjectItem()
 {
+	// The upload thread accesses the player, so make sure
+	// it is not running anymore. (The renderer may still
+	// exist at this point, and it shares the thread.)
+	if (m_uploadThread)
+		m_uploadThread->stop();
+
+	// Unsubscribe, so the stream does not invoke
+	// onNewFrameAvailable() anymore.
+	if (m_stream)
+		m_stream->removeSubscriber(this);
+	if (m_outgoingStream)
+		m_outgoingStream->removeSubscriber(this);
+
+	FramePrefetcher::instance().removeStream(this);
+	FrameArrivalAggregator::instance().removeItem(m_frameArrivalSlot);
+
 	qCDebug(lcQtGLVidDemo) << "Destroyed video object item" << this;
 }
 
@@ -377,7 +1971,7 @@ QQuickFramebufferObject::Renderer* VideoObjectItem::createRenderer() const
 	// The main problem is that createRenderer() is const.
 	VideoObjectItem &self = *(const_cast < VideoObjectItem* > (this));
 
-	std::unique_ptr < Renderer > renderer(new Renderer(self, QOpenGLContext::currentContext()));
+	std::unique_ptr < Renderer > renderer(new Renderer(self, QOpenGLContext::currentContext(), true));
 
 	// Inform listeners that they can start playback now.
 	emit self.canStartPlayback();
@@ -389,7 +1983,30 @@ QQuickFramebufferObject::Renderer* VideoObjectItem::createRenderer() const
 
 GStreamerPlayer* VideoObjectItem::getPlayer()
 {
-	return &m_player;
+	return m_stream ? &(m_stream->getPlayer()) : nullptr;
+}
+
+
+void VideoObjectItem::setUrl(QUrl p_url)
+{
+	if (m_url == p_url)
+		return;
+
+	m_url = std::move(p_url);
+
+	// The unshared stream is kept; only its player's URL changes.
+	if (m_uploadThread)
+		m_stream->getPlayer().setUrl(m_url);
+	else
+		acquireStream();
+
+	emit urlChanged();
+}
+
+
+QUrl VideoObjectItem::getUrl() const
+{
+	return m_url;
 }
 
 
@@ -449,6 +2066,85 @@ int VideoObjectItem::getTextureRotation() const
 }
 
 
+void VideoObjectItem::setInView(bool const p_inView)
+{
+	if (m_inView == p_inView)
+		return;
+
+	m_inView = p_inView;
+
+	// Start measuring how long it takes until the first
+	// frame is drawn (see onFirstFrameDrawn()).
+	if (m_inView)
+	{
+		++m_showCount;
+		m_shownTime = g_get_monotonic_time();
+		update();
+	}
+
+	emit inViewChanged();
+}
+
+
+bool VideoObjectItem::isInView() const
+{
+	return m_inView;
+}
+
+
+void VideoObjectItem::setPrefetch(bool const p_prefetch)
+{
+	if (m_prefetch == p_prefetch)
+		return;
+
+	m_prefetch = p_prefetch;
+
+	// With threaded uploads, the stream is unshared, and its player
+	// is set up by the renderer, so it cannot be prefetched.
+	if (!m_uploadThread)
+	{
+		if (m_stream)
+			m_stream->setPrefetch(this, m_prefetch);
+
+		// Items without a renderer can acquire their stream now.
+		acquireStream();
+		updateFramePrefetch();
+	}
+
+	emit prefetchChanged();
+}
+
+
+bool VideoObjectItem::isPrefetching() const
+{
+	return m_prefetch;
+}
+
+
+double VideoObjectItem::getFirstFrameLatency() const
+{
+	return m_firstFrameLatency;
+}
+
+
+double VideoObjectItem::getUrlSwitchLatency() const
+{
+	return m_urlSwitchLatency;
+}
+
+
+double VideoObjectItem::getUrlSwitchGap() const
+{
+	return m_urlSwitchGap;
+}
+
+
+double VideoObjectItem::getCaptureLatency() const
+{
+	return m_captureLatency;
+}
+
+
 QSGNode* VideoObjectItem::updatePaintNode(QSGNode *p_oldNode, UpdatePaintNodeData *p_updatePaintNodeData)
 {
 	QQuickWindow *win = window();
@@ -507,10 +2203,65 @@ QSGNode* VideoObjectItem::updatePaintNode(QSGNode *p_oldNode, UpdatePaintNodeDat
 		}
 	}
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+	Settings::RenderMode renderMode = Settings::instance().m_renderMode;
+	if (renderMode != Settings::RenderMode::FramebufferObject)
+	{
+		// Render the video object directly with our own node
+		// instead of the QQuickFramebufferObject one. Just like
+		// createRenderer(), this is called in the render thread
+		// with the scenegraph's OpenGL context being current.
+		RenderNode *node = static_cast < RenderNode* > (p_oldNode);
+		if (node == nullptr)
+		{
+			qCDebug(lcQtGLVidDemo) << "Creating new render node";
+			std::shared_ptr < RenderNodeBatch > batch;
+			if (renderMode == Settings::RenderMode::BatchedSceneGraph)
+				batch = RenderNodeBatch::get(win);
+			node = new RenderNode(*this, QOpenGLContext::currentContext(), std::move(batch));
+
+			// Inform listeners that they can start playback now.
+			emit canStartPlayback();
+		}
+
+		node->synchronize(*this);
+		// Make sure the scenegraph renders the node again.
+		node->markDirty(QSGNode::DirtyMaterial);
+
+		return node;
+	}
+#endif
+
 	return QQuickFramebufferObject::updatePaintNode(p_oldNode, p_updatePaintNodeData);
 }
 
 
+void VideoObjectItem::itemChange(ItemChange p_change, ItemChangeData const &p_value)
+{
+	QQuickFramebufferObject::itemChange(p_change, p_value);
+
+	// Create the upload thread's surface once the item is added to
+	// a window, since the surface format has to be compatible with
+	// the format of the window's OpenGL context.
+	// Prefetching items may be able to acquire their stream now.
+	if ((p_change == ItemSceneChange) && (p_value.window != nullptr) && m_prefetch && !m_stream && !m_uploadThread)
+		acquireStream();
+
+	if ((p_change == ItemSceneChange) && (p_value.window != nullptr) && m_uploadThread && !m_uploadSurface)
+	{
+		m_uploadSurface.reset(new QOffscreenSurface);
+		m_uploadSurface->setFormat(p_value.window->format());
+		m_uploadSurface->create();
+
+		if (!m_uploadSurface->isValid())
+		{
+			qCWarning(lcQtGLVidDemo) << "Could not create offscreen surface for the upload thread";
+			m_uploadSurface.reset();
+		}
+	}
+}
+
+
 void VideoObjectItem::mousePressEvent(QMouseEvent *p_event)
 {
 	QQuickItem::mousePressEvent(p_event);
@@ -604,11 +2355,301 @@ void VideoObjectItem::mouseReleaseEvent(QMouseEvent *p_event)
 }
 
 
+void VideoObjectItem::acquireStream()
+{
+	// With threaded uploads, the stream is created by the constructor.
+	if (m_uploadThread)
+		return;
+
+	// Wait for the renderer if it was not created yet. Prefetching
+	// items do not wait, and use the provider of other items'
+	// renderers instead. If there are none yet, they try again once
+	// the window rendered a frame, since the renderers of the items
+	// that are shown exist by then.
+	VideoMaterialProvider *vidmatProvider = m_vidmatProvider;
+	if ((vidmatProvider == nullptr) && m_prefetch)
+		vidmatProvider = FramePrefetcher::instance().getVideoMaterialProvider();
+
+	QQuickWindow *win = window();
+	if (win != nullptr)
+	{
+		if ((vidmatProvider == nullptr) && m_prefetch)
+			connect(win, &QQuickWindow::frameSwapped, this, &VideoObjectItem::acquireStream, Qt::UniqueConnection);
+		else
+			disconnect(win, &QQuickWindow::frameSwapped, this, &VideoObjectItem::acquireStream);
+	}
+
+	if (vidmatProvider == nullptr)
+		return;
+
+	if (m_stream && (m_stream->getUrl() == m_url))
+		return;
+
+	// Switching back to the URL of the outgoing stream before the
+	// switch is done cancels it. The renderer still draws that stream.
+	if (m_outgoingStream && (m_outgoingStream->getUrl() == m_url))
+	{
+		m_urlSwitchTimer.stop();
+		m_urlSwitchStartTime = -1;
+		m_stream->removeSubscriber(this);
+		m_stream = std::move(m_outgoingStream);
+		m_outgoingStream.reset();
+
+		updateFramePrefetch();
+
+		qCDebug(lcQtGLVidDemo) << "Item" << this << "cancelled switching away from stream" << m_url;
+
+		update();
+		emit playerChanged();
+		return;
+	}
+
+	// Keep drawing the current stream until the new one has a frame
+	// (see setUrl()). This needs the item's own renderer. If a switch
+	// is pending already, its new stream was never shown, so it is
+	// dropped, and the outgoing stream stays.
+	bool hadStream = m_stream || m_outgoingStream;
+	bool seamless = Settings::instance().m_seamlessUrlSwitching && hadStream && !m_url.isEmpty() && m_inView && (m_vidmatProvider != nullptr);
+
+	if (seamless && !m_outgoingStream)
+	{
+		m_outgoingStream = std::move(m_stream);
+		GStreamerPlayer &outgoingPlayer = m_outgoingStream->getPlayer();
+		m_outgoingPlayerState = outgoingPlayer.isPlaybackRequested() ? GStreamerPlayer::State::Playing : outgoingPlayer.getState();
+	}
+	else if (m_stream)
+		m_stream->removeSubscriber(this);
+	m_stream.reset();
+
+	if (!seamless && m_outgoingStream)
+	{
+		m_urlSwitchTimer.stop();
+		m_outgoingStream->removeSubscriber(this);
+		m_outgoingStream.reset();
+	}
+
+	if (!m_url.isEmpty())
+	{
+		m_stream = SharedVideoStream::acquire(m_url, *vidmatProvider);
+		// Frames of live capture devices are drawn as soon as they
+		// arrive instead of waiting for the aggregator's next poll.
+		if (m_stream->getPlayer().isLiveCapture())
+			m_stream->addSubscriber(this, [this]() { emit fboNeedsChange(); });
+		else
+			m_stream->addSubscriber(this, [this]() { onNewFrameAvailable(); });
+		m_stream->setDecodingTier(this, m_decodingTier);
+		// During a seamless switch, the new stream is prerolled,
+		// so its first frame is decoded while the outgoing stream
+		// is still shown.
+		m_stream->setPrefetch(this, m_prefetch || m_outgoingStream);
+		m_stream->setMaxVideoSize(this, m_maxVideoSize);
+	}
+
+	// Measure how long it takes until the new stream is drawn. The
+	// renderer reports that with an onUrlSwitched() invocation.
+	if (hadStream && m_stream)
+	{
+		++m_urlSwitchCount;
+		m_urlSwitchStartTime = g_get_monotonic_time();
+		if (m_outgoingStream)
+			m_urlSwitchTimer.start();
+	}
+
+	updateFramePrefetch();
+
+	qCDebug(lcQtGLVidDemo) << "Item" << this << "now shows stream" << m_url;
+
+	// The renderer attaches the new stream in synchronize().
+	update();
+	emit playerChanged();
+}
+
+
+void VideoObjectItem::updateFramePrefetch()
+{
+	if (m_prefetch && m_stream)
+		FramePrefetcher::instance().addStream(this, m_stream);
+	else
+		FramePrefetcher::instance().removeStream(this);
+}
+
+
+void VideoObjectItem::setMaxVideoSize(QSize p_maxVideoSize)
+{
+	m_maxVideoSize = std::move(p_maxVideoSize);
+	if (m_stream)
+		m_stream->setMaxVideoSize(this, m_maxVideoSize);
+}
+
+
+void VideoObjectItem::onFirstFrameDrawn(unsigned int p_showCount, qint64 p_drawTime)
+{
+	// The item may have been shown again in the meantime.
+	if (p_showCount != m_showCount)
+		return;
+
+	m_firstFrameLatency = double(p_drawTime - m_shownTime) / 1000.0;
+	qCDebug(lcQtGLVidDemo) << "Item" << this << "drew its first frame" << m_firstFrameLatency << "ms after it was shown";
+	emit firstFrameLatencyChanged();
+}
+
+
+void VideoObjectItem::onUrlSwitched(unsigned int p_urlSwitchCount, qint64 p_drawTime, qint64 p_gap)
+{
+	// The URL may have changed again in the meantime,
+	// or the switch may have been reported already.
+	if ((p_urlSwitchCount != m_urlSwitchCount) || (m_urlSwitchStartTime < 0))
+		return;
+
+	finishUrlSwitch();
+
+	// The item cannot have shown no new frame for longer than the
+	// switch took, unless the previous stream was stalled or paused.
+	qint64 latency = p_drawTime - m_urlSwitchStartTime;
+	qint64 gap = (p_gap >= 0) ? std::min(p_gap, latency) : latency;
+	m_urlSwitchStartTime = -1;
+
+	m_urlSwitchLatency = double(latency) / 1000.0;
+	m_urlSwitchGap = double(gap) / 1000.0;
+	qCDebug(lcQtGLVidDemo) << "Item" << this << "drew the first frame of its new stream" << m_urlSwitchLatency << "ms after the URL changed; gap:" << m_urlSwitchGap << "ms";
+	emit urlSwitchLatencyChanged();
+}
+
+
+void VideoObjectItem::finishUrlSwitch()
+{
+	if (!m_outgoingStream)
+		return;
+
+	m_urlSwitchTimer.stop();
+
+	// Releasing the outgoing stream may release its player's pipeline,
+	// which the pipeline pool shuts down in its teardown thread.
+	m_outgoingStream->removeSubscriber(this);
+	m_outgoingStream.reset();
+
+	// Carry the playback state over. If the new player is shared with
+	// other items, it may already be playing; leave it alone then.
+	GStreamerPlayer &player = m_stream->getPlayer();
+	if (!player.isPlaybackRequested())
+	{
+		if (m_outgoingPlayerState == GStreamerPlayer::State::Playing)
+			player.play();
+		else if (m_outgoingPlayerState == GStreamerPlayer::State::Paused)
+			player.pause();
+	}
+
+	// The new stream only had to be prerolled for the switch.
+	m_stream->setPrefetch(this, m_prefetch);
+
+	qCDebug(lcQtGLVidDemo) << "Item" << this << "finished switching to stream" << m_url;
+
+	// If the renderer did not switch yet, it attaches the stream now.
+	update();
+}
+
+
+void VideoObjectItem::onCaptureLatencyMeasured(qint64 p_latency)
+{
+	m_captureLatency = double(p_latency) / 1000000.0;
+	qCDebug(lcQtGLVidDemo) << "Item" << this << "swapped a captured frame" << m_captureLatency << "ms after its capture";
+	emit captureLatencyChanged();
+}
+
+
 void VideoObjectItem::onNewFrameAvailable()
 {
-	// Don't call update() directly here. Instead, for thread safety
-	// reasons, emit fboNeedsChange().
-	emit fboNeedsChange();
+	// If the upload thread is running, let it upload the frame.
+	// It calls scheduleFrameUpdate() once the upload is done.
+	if (m_uploadThread && m_uploadThread->notifyFrameAvailable())
+		return;
+
+	scheduleFrameUpdate();
+}
+
+
+void VideoObjectItem::scheduleFrameUpdate()
+{
+	// Don't call update() directly here, since this is called from
+	// other threads. Instead, let the aggregator update the item in
+	// the GUI thread, together with all other items that got new
+	// frames in the meantime. If the item got no slot, fall back
+	// to fboNeedsChange(), which is delivered in the GUI thread.
+	if (m_frameArrivalSlot >= 0)
+		FrameArrivalAggregator::instance().markDirty(m_frameArrivalSlot);
+	else
+		emit fboNeedsChange();
+}
+
+
+GStreamerPlayer::DecodingTier VideoObjectItem::calculateDecodingTier() const
+{
+	QQuickWindow *win = window();
+	if ((win == nullptr) || !isVisible() || !m_inView)
+		return GStreamerPlayer::DecodingTier::Suspended;
+
+	// The item's opacity only covers the item itself. Its ancestors'
+	// opacities are applied as well when the scene is rendered.
+	qreal opacity = 1.0;
+	for (QQuickItem const *item = this; item != nullptr; item = item->parentItem())
+		opacity *= item->opacity();
+
+	// Calculate how much of the window the item covers. Parts that
+	// are outside of the window are not visible, so cut these off.
+	qreal windowArea = qreal(win->width()) * qreal(win->height());
+	QRectF visibleRect = mapRectToScene(QRectF(0, 0, width(), height())) & QRectF(0, 0, win->width(), win->height());
+	qreal areaFraction = ((windowArea > 0) && !visibleRect.isEmpty()) ? (visibleRect.width() * visibleRect.height() / windowArea) : 0.0;
+
+	qreal visibility = opacity * areaFraction;
+
+	if (visibility >= FullDecodingMinVisibility)
+		return GStreamerPlayer::DecodingTier::Full;
+	else if (visibility >= ReducedRateMinVisibility)
+		return GStreamerPlayer::DecodingTier::ReducedRate;
+	else if (visibility >= KeyframesOnlyMinVisibility)
+		return GStreamerPlayer::DecodingTier::KeyframesOnly;
+	else
+		return GStreamerPlayer::DecodingTier::Suspended;
+}
+
+
+void VideoObjectItem::updateDecodingTier()
+{
+	GStreamerPlayer::DecodingTier newTier = calculateDecodingTier();
+
+	// The tiers are ordered from most to least decoding work.
+	if (newTier <= m_decodingTier)
+	{
+		// Apply higher tiers (and the current one) right away.
+		m_pendingDecodingTierCount = 0;
+		setDecodingTier(newTier);
+		return;
+	}
+
+	// Lower tiers are only applied once they were calculated in
+	// DecodingTierDowngradeCheckCount checks in a row.
+	if (newTier != m_pendingDecodingTier)
+	{
+		m_pendingDecodingTier = newTier;
+		m_pendingDecodingTierCount = 0;
+	}
+
+	++m_pendingDecodingTierCount;
+	if (m_pendingDecodingTierCount >= DecodingTierDowngradeCheckCount)
+	{
+		m_pendingDecodingTierCount = 0;
+		setDecodingTier(newTier);
+	}
+}
+
+
+void VideoObjectItem::setDecodingTier(GStreamerPlayer::DecodingTier const p_decodingTier)
+{
+	// Streams combine the tiers of all of their subscribers,
+	// so the tier is not necessarily the one the player uses.
+	m_decodingTier = p_decodingTier;
+	if (m_stream)
+		m_stream->setDecodingTier(this, m_decodingTier);
 }
 
 
@@ -20,8 +20,11 @@
 #ifndef QTGLVIDDEMO_VIDEO_OBJECT_ITEM_HPP
 #define QTGLVIDDEMO_VIDEO_OBJECT_ITEM_HPP
 
+#include <memory>
 #include <QQuickFramebufferObject>
 #include <QRectF>
+#include <QTimer>
+#include <QUrl>
 #include "player/GStreamerPlayer.hpp"
 #include "Arcball.hpp"
 #include "Camera.hpp"
@@ -29,12 +32,18 @@
 
 
 class QOpenGLContext;
+class QOffscreenSurface;
 
 
 namespace qtglviddemo
 {
 
 
+class FrameUploadThread;
+class SharedVideoStream;
+class VideoMaterialProvider;
+
+
 /**
  * QtQuick 2 item for rendering video objects.
  *
@@ -46,6 +55,11 @@ namespace qtglviddemo
  * It is a QtQuick 2 item that can be used as the delegate of a QtQuick 2
  * view.
  *
+ * Items with the same URL share one player and one video material (see
+ * SharedVideoStream), so each stream is only decoded and uploaded once.
+ * If threaded uploads are enabled, each item has its own player instead,
+ * since the upload thread needs exclusive access to it.
+ *
  * The properties (meshType, rotation etc.) may be set manually in C++
  * or QML, but typically they are defined by using VideoObjectItem as a
  * QtQuick 2 view delegate, and using an instance of VideoObjectModel
@@ -55,14 +69,32 @@ namespace qtglviddemo
  * is actually rendered to an OpenGL framebuffer object (which is why
  * this item inherits from QQuickFramebufferObject and not directly
  * from QQuickItem). This is the recommended way of integrating custom
- * 3D rendering into the QtQuick 2 scenegraph.
+ * 3D rendering into the QtQuick 2 scenegraph. Alternatively, if the
+ * render mode in the settings is Settings::RenderMode::SceneGraph, the
+ * object is drawn directly into the window by a QSGRenderNode, and no
+ * FBO is used.
  */
 class VideoObjectItem
 	: public QQuickFramebufferObject
 {
 	Q_OBJECT
 
-	Q_PROPERTY(qtglviddemo::GStreamerPlayer* player READ getPlayer)
+	/**
+	 * Player which produces the video frames.
+	 *
+	 * This is null until the url property is set (unless threaded
+	 * uploads are enabled). Since items with the same URL share the
+	 * player, controlling the playback affects all of them.
+	 */
+	Q_PROPERTY(qtglviddemo::GStreamerPlayer* player READ getPlayer NOTIFY playerChanged)
+	/**
+	 * URL of the media to play. Use this instead of the player's url property.
+	 *
+	 * If seamless URL switching is enabled in the settings, changing
+	 * the URL while a stream is shown keeps that stream on screen until
+	 * the first frame of the new one is ready (see setUrl()).
+	 */
+	Q_PROPERTY(QUrl url READ getUrl WRITE setUrl NOTIFY urlChanged)
 
 	/// Rotation quaternion to use for rotating the 3D object.
 	Q_PROPERTY(QQuaternion rotation READ getRotation WRITE setRotation NOTIFY rotationChanged)
@@ -72,8 +104,58 @@ class VideoObjectItem
 	Q_PROPERTY(QString meshType READ getMeshType WRITE setMeshType NOTIFY meshTypeChanged)
 	/// Texture rotation angle to use in the video material.
 	Q_PROPERTY(int textureRotation READ getTextureRotation WRITE setTextureRotation NOTIFY textureRotationChanged)
+	/**
+	 * Whether the item is currently shown by the view it is part of.
+	 *
+	 * Views such as PathView keep cached items around that are not
+	 * shown. Binding this to PathView.onPath lets the item suspend
+	 * decoding for these. Default is true.
+	 */
+	Q_PROPERTY(bool inView READ isInView WRITE setInView NOTIFY inViewChanged)
+	/**
+	 * Whether the item is likely to be shown soon.
+	 *
+	 * If set, the item acquires its stream even if it has no renderer
+	 * yet, prerolls the stream's player, and lets the renderers of other
+	 * items upload the first frame (see FramePrefetcher). Once the item
+	 * is shown, the first frame can then be drawn right away. Has no
+	 * effect with threaded uploads. Default is false.
+	 */
+	Q_PROPERTY(bool prefetch READ isPrefetching WRITE setPrefetch NOTIFY prefetchChanged)
+	/**
+	 * Time from the moment the inView property last changed to true
+	 * until the first video frame was drawn afterwards, in milliseconds.
+	 * -1 if unknown. This is updated every time the item is shown.
+	 */
+	Q_PROPERTY(double firstFrameLatency READ getFirstFrameLatency NOTIFY firstFrameLatencyChanged)
+	/**
+	 * Time from the last URL change until the first video frame of the
+	 * new stream was drawn, in milliseconds. -1 if unknown.
+	 */
+	Q_PROPERTY(double urlSwitchLatency READ getUrlSwitchLatency NOTIFY urlSwitchLatencyChanged)
+	/**
+	 * How long the item showed no new video frame during the last URL
+	 * change, in milliseconds. -1 if unknown. With seamless switching,
+	 * this is the time between the last drawn frame of the previous
+	 * stream and the first one of the new stream (but at most the
+	 * switch latency). Otherwise, the item is empty until the new
+	 * stream delivers a frame, so this is the switch latency.
+	 */
+	Q_PROPERTY(double urlSwitchGap READ getUrlSwitchGap NOTIFY urlSwitchLatencyChanged)
+	/**
+	 * Time from the capture of the last drawn video frame until the
+	 * buffers of the frame it was drawn in were swapped, in milliseconds.
+	 * -1 if unknown. Only measured for live capture devices in low
+	 * latency mode (see GStreamerPlayer::setLowLatencyCapture()), and
+	 * not with threaded uploads. This does not include the time before
+	 * the driver timestamped the frame (exposure and readout), and the
+	 * time after the swap until the frame is scanned out.
+	 */
+	Q_PROPERTY(double captureLatency READ getCaptureLatency NOTIFY captureLatencyChanged)
 
 	class Renderer;
+	class RenderNode;
+	class RenderNodeBatch;
 
 public:
 	/**
@@ -97,6 +179,25 @@ public:
 
 	GStreamerPlayer* getPlayer();
 
+	/**
+	 * Sets the URL of the media to play.
+	 *
+	 * If a stream is shown already, seamless URL switching is enabled in
+	 * the settings, and the item is in view, the previous stream is kept,
+	 * and the renderer keeps drawing it. The player of the new stream
+	 * prerolls in the meantime. Once the renderer uploaded the first
+	 * frame of the new stream, it switches over to that stream, and the
+	 * previous one is released. If the previous player was playing, the
+	 * new one starts playing, otherwise it stays paused. If the new
+	 * stream does not deliver a frame in time, the item switches anyway.
+	 *
+	 * Without seamless switching, the previous stream is released
+	 * right away, and the item is empty until the new stream delivers
+	 * its first frame.
+	 */
+	void setUrl(QUrl p_url);
+	QUrl getUrl() const;
+
 	void setRotation(QQuaternion p_rotation);
 	QQuaternion const & getRotation() const;
 
@@ -109,19 +210,38 @@ public:
 	void setTextureRotation(int const p_rotation);
 	int getTextureRotation() const;
 
+	void setInView(bool const p_inView);
+	bool isInView() const;
+
+	void setPrefetch(bool const p_prefetch);
+	bool isPrefetching() const;
+
+	double getFirstFrameLatency() const;
+
+	double getUrlSwitchLatency() const;
+	double getUrlSwitchGap() const;
+
+	double getCaptureLatency() const;
+
 
 signals:
 	/**
 	 * This signal is emitted when it is OK to start playback.
 	 *
-	 * In a QML script, this is useful for autostarting playback. Calling
-	 * the player's setUrl() and play() functions in the Component.onComplete()
-	 * signal is not an option, since the renderer might not be set up
-	 * at that point yet. So, instead, by listening to this signal, the
-	 * setUrl() and play() functions can be done at the right moment.
+	 * In a QML script, this is useful for autostarting playback. Setting
+	 * the url property and calling the player's play() function in the
+	 * Component.onComplete() signal is not an option, since the renderer
+	 * might not be set up at that point yet. So, instead, by listening to
+	 * this signal, the url can be set and play() can be called at the
+	 * right moment.
 	 */
 	void canStartPlayback();
 
+	/// This signal is emitted when the player changes.
+	void playerChanged();
+	/// This signal is emitted when the URL changes.
+	void urlChanged();
+
 	/// This signal is emitted when the rotation quaternion changes.
 	void rotationChanged();
 	/// This signal is emitted when the crop rectangle changes.
@@ -130,6 +250,16 @@ signals:
 	void meshTypeChanged();
 	/// This signal is emitted when the texture rotation angle changes.
 	void textureRotationChanged();
+	/// This signal is emitted when the inView property changes.
+	void inViewChanged();
+	/// This signal is emitted when the prefetch property changes.
+	void prefetchChanged();
+	/// This signal is emitted when a new first frame latency was measured.
+	void firstFrameLatencyChanged();
+	/// This signal is emitted when a URL switch latency and gap were measured.
+	void urlSwitchLatencyChanged();
+	/// This signal is emitted when a new capture latency was measured.
+	void captureLatencyChanged();
 
 	// Internal signal for when the FBO needs to be updated. Typically
 	// this is emitted when the player has a new video frame.
@@ -138,6 +268,7 @@ signals:
 
 protected:
 	virtual QSGNode* updatePaintNode(QSGNode *p_oldNode, UpdatePaintNodeData *p_updatePaintNodeData) override;
+	virtual void itemChange(ItemChange p_change, ItemChangeData const &p_value) override;
 
 
 private:
@@ -145,7 +276,20 @@ private:
 	virtual void mouseMoveEvent(QMouseEvent *p_event);
 	virtual void mouseReleaseEvent(QMouseEvent *p_event);
 
+	void acquireStream();
+	void updateFramePrefetch();
+	Q_INVOKABLE void setMaxVideoSize(QSize p_maxVideoSize);
+	Q_INVOKABLE void onFirstFrameDrawn(unsigned int p_showCount, qint64 p_drawTime);
+	Q_INVOKABLE void onUrlSwitched(unsigned int p_urlSwitchCount, qint64 p_drawTime, qint64 p_gap);
+	void finishUrlSwitch();
+	Q_INVOKABLE void onCaptureLatencyMeasured(qint64 p_latency);
+
 	void onNewFrameAvailable();
+	void scheduleFrameUpdate();
+
+	GStreamerPlayer::DecodingTier calculateDecodingTier() const;
+	void updateDecodingTier();
+	void setDecodingTier(GStreamerPlayer::DecodingTier const p_decodingTier);
 
 	Arcball m_arcball;
 	bool m_mouseButtonPressed;
@@ -155,6 +299,28 @@ private:
 	QRect m_cropRectangle;
 	QString m_meshType;
 	int m_textureRotation;
+	bool m_inView;
+	bool m_prefetch;
+
+	// How often the item was shown (that is, how often inView changed
+	// to true), and when that happened last, in microseconds of the
+	// monotonic clock. The renderer reports the first frame it draws
+	// afterwards through a queued onFirstFrameDrawn() invocation.
+	unsigned int m_showCount;
+	qint64 m_shownTime;
+	double m_firstFrameLatency;
+
+	// Timer for periodically checking how visible the item is, and
+	// the decoding tier that is applied once it was calculated
+	// for long enough in a row (see updateDecodingTier()). The
+	// current tier is the one this item requests from the stream.
+	QTimer m_visibilityTimer;
+	GStreamerPlayer::DecodingTier m_decodingTier;
+	GStreamerPlayer::DecodingTier m_pendingDecodingTier;
+	int m_pendingDecodingTierCount;
+
+	// Slot in the FrameArrivalAggregator, or -1 if none was free.
+	int m_frameArrivalSlot;
 
 	QVector3D m_lastRotationAxis;
 	float m_lastRotationAngle;
@@ -162,7 +328,49 @@ private:
 	float m_rotAttenuation;
 	GstClockTime m_lastUpdateTimestamp;
 
-	mutable GStreamerPlayer m_player;
+	// Largest frame size the renderer can make use of. Set by the
+	// renderer through a queued setMaxVideoSize() invocation.
+	QSize m_maxVideoSize;
+
+	// The stream whose frames are shown, and the provider the renderer
+	// uses. The stream is acquired once both the URL and the provider
+	// are known, since the provider determines how its player is set up.
+	// (Prefetching items use the provider of other items' renderers.)
+	QUrl m_url;
+	VideoMaterialProvider *m_vidmatProvider;
+	std::shared_ptr < SharedVideoStream > m_stream;
+
+	// URL switch states. While a seamless switch is pending, the item
+	// stays subscribed to the previous (outgoing) stream, and the renderer
+	// keeps drawing it until the first frame of m_stream is uploaded. The
+	// renderer then reports the switch with a queued onUrlSwitched()
+	// invocation, which releases the outgoing stream. m_urlSwitchCount
+	// identifies the latest switch; m_urlSwitchStartTime is the time it
+	// started at, in microseconds of the monotonic clock (-1 once it was
+	// reported). If the timer runs out before the renderer switched, the
+	// item switches anyway. The outgoing player's state is carried over
+	// to the new player; Playing also stands for a requested playback.
+	std::shared_ptr < SharedVideoStream > m_outgoingStream;
+	GStreamerPlayer::State m_outgoingPlayerState;
+	unsigned int m_urlSwitchCount;
+	qint64 m_urlSwitchStartTime;
+	double m_urlSwitchLatency;
+	double m_urlSwitchGap;
+	QTimer m_urlSwitchTimer;
+
+	// Capture to swap latency of the last drawn frame of a live
+	// capture device. Reported by the renderer through a queued
+	// onCaptureLatencyMeasured() invocation.
+	double m_captureLatency;
+
+	// Frame upload thread and the surface for its OpenGL context.
+	// These are only created if threaded uploads are enabled in the
+	// settings. The surface is created here in the main thread, since
+	// some platforms do not allow for creating surfaces in other threads.
+	// The thread is shared with the renderer, which starts and stops it.
+	// (It is declared after m_stream so it is destroyed before it.)
+	std::unique_ptr < QOffscreenSurface > m_uploadSurface;
+	std::shared_ptr < FrameUploadThread > m_uploadThread;
 };
 
 
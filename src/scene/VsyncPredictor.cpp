@@ -0,0 +1,124 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <QQuickWindow>
+#include <QScreen>
+#include "VsyncPredictor.hpp"
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+// Used if the refresh rate of the window's screen is unknown.
+qreal const DefaultRefreshRate = 60.0;
+
+// Weight of the previous estimate when a new interval is measured.
+// Higher values make the estimate smoother, but adapt more slowly.
+int const IntervalSmoothing = 7;
+
+GstClockTime getMonotonicTime()
+{
+	return GstClockTime(g_get_monotonic_time()) * GST_USECOND;
+}
+
+} // unnamed namespace end
+
+
+VsyncPredictor::VsyncPredictor(QQuickWindow *p_window)
+	: m_window(p_window)
+	, m_lastSwapTime(GST_CLOCK_TIME_NONE)
+{
+	QScreen *screen = m_window->screen();
+	qreal refreshRate = (screen != nullptr) ? screen->refreshRate() : 0.0;
+	if (refreshRate < 1.0)
+		refreshRate = DefaultRefreshRate;
+	m_vsyncInterval = GstClockTime(GST_SECOND / refreshRate);
+
+	// frameSwapped is emitted in the render thread, which is the
+	// thread the predictor is used in, so a direct connection is used.
+	m_frameSwappedConnection = QObject::connect(m_window, &QQuickWindow::frameSwapped, [this]() { onFrameSwapped(); });
+}
+
+
+VsyncPredictor::~VsyncPredictor()
+{
+	QObject::disconnect(m_frameSwappedConnection);
+}
+
+
+std::shared_ptr < VsyncPredictor > VsyncPredictor::get(QQuickWindow *p_window)
+{
+	// The users own the predictor, so only a weak pointer is kept here.
+	// Since the demo application has only one window, there is no
+	// need to keep track of more than one predictor.
+	static std::weak_ptr < VsyncPredictor > currentPredictor;
+
+	std::shared_ptr < VsyncPredictor > predictor = currentPredictor.lock();
+	if (!predictor || (predictor->m_window != p_window))
+	{
+		predictor.reset(new VsyncPredictor(p_window));
+		currentPredictor = predictor;
+	}
+
+	return predictor;
+}
+
+
+GstClockTime VsyncPredictor::predictNextVsync() const
+{
+	if (!GST_CLOCK_TIME_IS_VALID(m_lastSwapTime))
+		return GST_CLOCK_TIME_NONE;
+
+	// Swaps happen at vsyncs, so the next vsync is a whole
+	// number of intervals after the last swap.
+	GstClockTime now = getMonotonicTime();
+	GstClockTime numIntervals = (now > m_lastSwapTime) ? ((now - m_lastSwapTime) / m_vsyncInterval + 1) : 1;
+	return m_lastSwapTime + numIntervals * m_vsyncInterval;
+}
+
+
+GstClockTime VsyncPredictor::getVsyncInterval() const
+{
+	return m_vsyncInterval;
+}
+
+
+void VsyncPredictor::onFrameSwapped()
+{
+	GstClockTime now = getMonotonicTime();
+
+	if (GST_CLOCK_TIME_IS_VALID(m_lastSwapTime) && (now > m_lastSwapTime))
+	{
+		// Only use swaps that are about one interval apart for the
+		// estimate. Longer gaps span several vsyncs, and shorter
+		// ones happen if swaps do not block until the vsync.
+		GstClockTime delta = now - m_lastSwapTime;
+		if ((delta > m_vsyncInterval / 2) && (delta < m_vsyncInterval * 3 / 2))
+			m_vsyncInterval = (m_vsyncInterval * IntervalSmoothing + delta) / (IntervalSmoothing + 1);
+	}
+
+	m_lastSwapTime = now;
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,87 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_VSYNC_PREDICTOR_HPP
+#define QTGLVIDDEMO_VSYNC_PREDICTOR_HPP
+
+#include <memory>
+#include <QMetaObject>
+#include <gst/gst.h>
+
+
+class QQuickWindow;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Predicts when the next frame of a window will be shown.
+ *
+ * The predictor records the times at which the window's frames are
+ * swapped, and estimates the vsync interval from them. Swaps that are
+ * roughly one interval apart refine the estimate; others (for example
+ * after idle periods or missed vsyncs) only update the time of the last
+ * swap. The initial estimate is based on the refresh rate of the
+ * window's screen.
+ *
+ * All times are in nanoseconds of the monotonic clock, which is the one
+ * used by g_get_monotonic_time().
+ *
+ * The predictor must only be used in the window's render thread.
+ */
+class VsyncPredictor
+{
+public:
+	~VsyncPredictor();
+
+	/**
+	 * Returns the predictor for p_window.
+	 *
+	 * The predictor is created if it does not exist yet. It is shared
+	 * by all users and destroyed together with the last one of them.
+	 */
+	static std::shared_ptr < VsyncPredictor > get(QQuickWindow *p_window);
+
+	/**
+	 * Returns the predicted time of the next vsync, or
+	 * GST_CLOCK_TIME_NONE if no frame was swapped yet.
+	 */
+	GstClockTime predictNextVsync() const;
+	/// Returns the estimated time between two vsyncs.
+	GstClockTime getVsyncInterval() const;
+
+
+private:
+	explicit VsyncPredictor(QQuickWindow *p_window);
+
+	void onFrameSwapped();
+
+	QQuickWindow *m_window;
+	QMetaObject::Connection m_frameSwappedConnection;
+	GstClockTime m_lastSwapTime;
+	GstClockTime m_vsyncInterval;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
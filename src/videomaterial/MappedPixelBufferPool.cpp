@@ -0,0 +1,535 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <algorithm>
+#include <gst/video/video.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include "MappedPixelBufferPool.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// These are not defined in older OpenGL headers.
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_MAP_READ_BIT
+#define GL_MAP_READ_BIT 0x0001
+#endif
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+
+struct MappedPixelBufferPool
+{
+	GstBufferPool parent;
+	// Pointer to a shared pointer, since GObject
+	// instances are not constructed like C++ objects.
+	qtglviddemo::MappedPixelBufferAllocatorSPtr *allocator;
+	GstVideoInfo videoInfo;
+	gboolean addVideoMeta;
+};
+
+
+struct MappedPixelBufferPoolClass
+{
+	GstBufferPoolClass parent_class;
+};
+
+
+namespace
+{
+
+gchar const ** getPoolOptions(GstBufferPool *p_pool);
+gboolean setPoolConfig(GstBufferPool *p_pool, GstStructure *p_config);
+GstFlowReturn allocPoolBuffer(GstBufferPool *p_pool, GstBuffer **p_buffer, GstBufferPoolAcquireParams *p_params);
+void releasePoolBuffer(GstBufferPool *p_pool, GstBuffer *p_buffer);
+void finalizePool(GObject *p_object);
+
+} // unnamed namespace end
+
+
+G_DEFINE_TYPE(MappedPixelBufferPool, mapped_pixel_buffer_pool, GST_TYPE_BUFFER_POOL)
+
+
+// These _class_init and _init functions are declared by the
+// G_DEFINE_TYPE() boilerplate.
+static void mapped_pixel_buffer_pool_class_init(MappedPixelBufferPoolClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+	GstBufferPoolClass *pool_class = GST_BUFFER_POOL_CLASS(klass);
+
+	gobject_class->finalize = GST_DEBUG_FUNCPTR(finalizePool);
+
+	pool_class->get_options = GST_DEBUG_FUNCPTR(getPoolOptions);
+	pool_class->set_config = GST_DEBUG_FUNCPTR(setPoolConfig);
+	pool_class->alloc_buffer = GST_DEBUG_FUNCPTR(allocPoolBuffer);
+	pool_class->release_buffer = GST_DEBUG_FUNCPTR(releasePoolBuffer);
+}
+
+
+static void mapped_pixel_buffer_pool_init(MappedPixelBufferPool *pool)
+{
+	pool->allocator = nullptr;
+	gst_video_info_init(&(pool->videoInfo));
+	pool->addVideoMeta = FALSE;
+}
+
+
+
+
+namespace
+{
+
+
+// Attached to memory blocks that wrap a mapped PBO. Releases
+// the PBO back to the allocator when the memory is freed.
+struct MappedPixelBufferMemoryData
+{
+	qtglviddemo::MappedPixelBuffer m_buffer;
+	qtglviddemo::MappedPixelBufferAllocatorSPtr m_allocator;
+};
+
+
+GQuark getMappedPixelBufferQuark()
+{
+	static GQuark quark = g_quark_from_static_string("qtglviddemo-mapped-pixel-buffer");
+	return quark;
+}
+
+
+gchar const ** getPoolOptions(GstBufferPool *)
+{
+	static gchar const *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, nullptr };
+	return options;
+}
+
+
+gboolean setPoolConfig(GstBufferPool *p_pool, GstStructure *p_config)
+{
+	MappedPixelBufferPool *self = reinterpret_cast < MappedPixelBufferPool* > (p_pool);
+
+	GstCaps *caps;
+	guint size, minBuffers, maxBuffers;
+	if (!gst_buffer_pool_config_get_params(p_config, &caps, &size, &minBuffers, &maxBuffers) || (caps == nullptr))
+	{
+		qCWarning(lcQtGLVidDemo) << "Mapped pixel buffer pool configuration has no caps";
+		return FALSE;
+	}
+
+	GstVideoInfo videoInfo;
+	if (!gst_video_info_from_caps(&videoInfo, caps))
+	{
+		qCWarning(lcQtGLVidDemo) << "Mapped pixel buffer pool configuration has invalid caps";
+		return FALSE;
+	}
+
+	// All planes of a frame are placed in one PBO.
+	size = std::max(size, guint(GST_VIDEO_INFO_SIZE(&videoInfo)));
+	gst_buffer_pool_config_set_params(p_config, caps, size, minBuffers, maxBuffers);
+
+	self->videoInfo = videoInfo;
+	GST_VIDEO_INFO_SIZE(&(self->videoInfo)) = size;
+	self->addVideoMeta = gst_buffer_pool_config_has_option(p_config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+	// Let the render thread create the PBOs. Until they exist,
+	// the pool uses system memory (see allocPoolBuffer()).
+	(*(self->allocator))->requestBuffers(self, size, std::max(minBuffers, guint(1)));
+
+	return GST_BUFFER_POOL_CLASS(mapped_pixel_buffer_pool_parent_class)->set_config(p_pool, p_config);
+}
+
+
+GstFlowReturn allocPoolBuffer(GstBufferPool *p_pool, GstBuffer **p_buffer, GstBufferPoolAcquireParams *)
+{
+	MappedPixelBufferPool *self = reinterpret_cast < MappedPixelBufferPool* > (p_pool);
+	qtglviddemo::MappedPixelBufferAllocatorSPtr &allocator = *(self->allocator);
+	GstVideoInfo *videoInfo = &(self->videoInfo);
+	gsize size = GST_VIDEO_INFO_SIZE(videoInfo);
+
+	GstBuffer *buffer = gst_buffer_new();
+
+	qtglviddemo::MappedPixelBuffer mappedPixelBuffer;
+	if (allocator->takeBuffer(self, mappedPixelBuffer))
+	{
+		// Wrap the mapped PBO memory in a GstMemory. The PBO is
+		// released back to the allocator when the memory is freed.
+		MappedPixelBufferMemoryData *memoryData = new MappedPixelBufferMemoryData { mappedPixelBuffer, allocator };
+		GstMemory *memory = gst_memory_new_wrapped(
+			GstMemoryFlags(0),
+			mappedPixelBuffer.m_mappedData, mappedPixelBuffer.m_size,
+			0, size,
+			memoryData,
+			[](gpointer p_data) {
+				MappedPixelBufferMemoryData *data = reinterpret_cast < MappedPixelBufferMemoryData* > (p_data);
+				data->m_allocator->releaseBuffer(data->m_buffer);
+				delete data;
+			}
+		);
+		gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(memory), getMappedPixelBufferQuark(), &(memoryData->m_buffer), nullptr);
+		gst_buffer_append_memory(buffer, memory);
+	}
+	else
+	{
+		// No PBO is available (yet). Do not wait for the render
+		// thread; use system memory for now. This buffer is
+		// replaced once a PBO is available (see releasePoolBuffer()).
+		allocator->requestAdditionalBuffer(self);
+		gst_buffer_append_memory(buffer, gst_allocator_alloc(nullptr, size, nullptr));
+	}
+
+	if (self->addVideoMeta)
+	{
+		gst_buffer_add_video_meta_full(
+			buffer,
+			GST_VIDEO_FRAME_FLAG_NONE,
+			GST_VIDEO_INFO_FORMAT(videoInfo),
+			GST_VIDEO_INFO_WIDTH(videoInfo),
+			GST_VIDEO_INFO_HEIGHT(videoInfo),
+			GST_VIDEO_INFO_N_PLANES(videoInfo),
+			videoInfo->offset,
+			videoInfo->stride
+		);
+	}
+
+	*p_buffer = buffer;
+
+	return GST_FLOW_OK;
+}
+
+
+void releasePoolBuffer(GstBufferPool *p_pool, GstBuffer *p_buffer)
+{
+	MappedPixelBufferPool *self = reinterpret_cast < MappedPixelBufferPool* > (p_pool);
+
+	// If this buffer uses system memory, and a PBO is available by now,
+	// tag the memory. The base class then discards the buffer instead
+	// of putting it back into the pool, so the next acquisition allocates
+	// a new buffer, which will use the PBO.
+	bool usesPBO = (gst_buffer_n_memory(p_buffer) == 1) && (qtglviddemo::getMappedPixelBuffer(gst_buffer_peek_memory(p_buffer, 0)) != nullptr);
+	if (!usesPBO && (*(self->allocator))->hasBuffers(self))
+		GST_BUFFER_FLAG_SET(p_buffer, GST_BUFFER_FLAG_TAG_MEMORY);
+
+	GST_BUFFER_POOL_CLASS(mapped_pixel_buffer_pool_parent_class)->release_buffer(p_pool, p_buffer);
+}
+
+
+void finalizePool(GObject *p_object)
+{
+	MappedPixelBufferPool *self = reinterpret_cast < MappedPixelBufferPool* > (p_object);
+
+	if (self->allocator != nullptr)
+	{
+		(*(self->allocator))->cancelRequest(self);
+		delete self->allocator;
+		self->allocator = nullptr;
+	}
+
+	G_OBJECT_CLASS(mapped_pixel_buffer_pool_parent_class)->finalize(p_object);
+}
+
+
+} // unnamed namespace end
+
+
+namespace qtglviddemo
+{
+
+
+MappedPixelBufferAllocator::MappedPixelBufferAllocator(QOpenGLContext *p_glcontext)
+	: m_glcontext(p_glcontext)
+	, m_bufferStorageFunc(nullptr)
+	, m_shutDown(false)
+	, m_creationFailed(false)
+{
+	assert(m_glcontext != nullptr);
+
+	// glBufferStorage() is not part of QOpenGLExtraFunctions,
+	// so it has to be resolved manually.
+	char const *funcName = m_glcontext->isOpenGLES() ? "glBufferStorageEXT" : "glBufferStorage";
+	m_bufferStorageFunc = reinterpret_cast < BufferStorageFunc > (m_glcontext->getProcAddress(funcName));
+	if (m_bufferStorageFunc == nullptr)
+		qCWarning(lcQtGLVidDemo) << "Could not resolve" << funcName << "; cannot create mapped pixel buffers";
+}
+
+
+MappedPixelBufferAllocator::~MappedPixelBufferAllocator()
+{
+}
+
+
+bool MappedPixelBufferAllocator::isSupported(QOpenGLContext *p_glcontext)
+{
+	assert(p_glcontext != nullptr);
+
+	QSurfaceFormat const &format = p_glcontext->format();
+	if (p_glcontext->isOpenGLES())
+		return (format.version() >= qMakePair(3, 1)) && p_glcontext->hasExtension(QByteArray("GL_EXT_buffer_storage"));
+	else
+		return (format.version() >= qMakePair(4, 4)) || p_glcontext->hasExtension(QByteArray("GL_ARB_buffer_storage"));
+}
+
+
+GstBufferPool* MappedPixelBufferAllocator::createBufferPool()
+{
+	MappedPixelBufferPool *pool = reinterpret_cast < MappedPixelBufferPool* > (g_object_new(mapped_pixel_buffer_pool_get_type(), nullptr));
+	pool->allocator = new MappedPixelBufferAllocatorSPtr(shared_from_this());
+
+	// Like gst_buffer_pool_new(), clear the floating flag,
+	// so the caller gets a regular reference.
+	gst_object_ref_sink(GST_OBJECT(pool));
+
+	return GST_BUFFER_POOL_CAST(pool);
+}
+
+
+void MappedPixelBufferAllocator::processRequests()
+{
+	// Creating a PBO can take a while, so only
+	// create a few of them in each call.
+	static constexpr guint MaxNumBuffersCreatedPerCall = 4;
+
+	std::vector < GLuint > buffersToDelete;
+	std::vector < std::pair < void const *, gsize > > buffersToCreate;
+
+	// Collect the work to do, but do not call OpenGL functions
+	// while holding the lock, since the pools would otherwise
+	// have to wait for these calls to finish.
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		if (m_shutDown)
+			return;
+
+		buffersToDelete.swap(m_buffersToDelete);
+
+		guint numBuffersLeft = m_creationFailed ? 0 : MaxNumBuffersCreatedPerCall;
+		for (auto & entry : m_requests)
+		{
+			Request &request = entry.second;
+			guint numBuffers = std::min(request.m_numMissingBuffers, numBuffersLeft);
+			for (guint i = 0; i < numBuffers; ++i)
+				buffersToCreate.emplace_back(entry.first, request.m_size);
+			request.m_numMissingBuffers -= numBuffers;
+			numBuffersLeft -= numBuffers;
+		}
+	}
+
+	// Deleting the PBOs also unmaps them.
+	if (!buffersToDelete.empty())
+		m_glcontext->functions()->glDeleteBuffers(buffersToDelete.size(), &buffersToDelete[0]);
+
+	for (auto const & entry : buffersToCreate)
+	{
+		MappedPixelBuffer buffer;
+		if (!createBuffer(entry.second, buffer))
+		{
+			// Do not try again; the pools keep using system memory.
+			std::lock_guard < std::mutex > lock(m_mutex);
+			m_creationFailed = true;
+			break;
+		}
+
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		// The request may have been canceled or changed in
+		// the meantime. Then, the PBO is not needed anymore.
+		auto iter = m_requests.find(entry.first);
+		if ((iter != m_requests.end()) && (iter->second.m_size == buffer.m_size))
+			iter->second.m_availableBuffers.push_back(buffer);
+		else
+			m_buffersToDelete.push_back(buffer.m_bufferId);
+	}
+}
+
+
+void MappedPixelBufferAllocator::shutdown()
+{
+	std::vector < GLuint > buffersToDelete;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		m_shutDown = true;
+
+		buffersToDelete.swap(m_buffersToDelete);
+		for (auto & entry : m_requests)
+		{
+			for (MappedPixelBuffer const & buffer : entry.second.m_availableBuffers)
+				buffersToDelete.push_back(buffer.m_bufferId);
+			entry.second.m_availableBuffers.clear();
+			entry.second.m_numMissingBuffers = 0;
+		}
+	}
+
+	if (!buffersToDelete.empty())
+		m_glcontext->functions()->glDeleteBuffers(buffersToDelete.size(), &buffersToDelete[0]);
+
+	qCDebug(lcQtGLVidDemo) << "Mapped pixel buffer allocator shut down; deleted" << buffersToDelete.size() << "PBO(s)";
+}
+
+
+void MappedPixelBufferAllocator::requestBuffers(void const *p_requester, gsize const p_size, guint const p_numBuffers)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	Request &request = m_requests[p_requester];
+
+	if (request.m_size != p_size)
+	{
+		for (MappedPixelBuffer const & buffer : request.m_availableBuffers)
+			m_buffersToDelete.push_back(buffer.m_bufferId);
+		request.m_availableBuffers.clear();
+		request.m_size = p_size;
+	}
+
+	request.m_numMissingBuffers = (p_numBuffers > request.m_availableBuffers.size()) ? (p_numBuffers - request.m_availableBuffers.size()) : 0;
+}
+
+
+void MappedPixelBufferAllocator::requestAdditionalBuffer(void const *p_requester)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	auto iter = m_requests.find(p_requester);
+	if (iter == m_requests.end())
+		return;
+
+	Request &request = iter->second;
+	if ((request.m_numMissingBuffers == 0) && request.m_availableBuffers.empty())
+		request.m_numMissingBuffers = 1;
+}
+
+
+void MappedPixelBufferAllocator::cancelRequest(void const *p_requester)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	auto iter = m_requests.find(p_requester);
+	if (iter == m_requests.end())
+		return;
+
+	if (!m_shutDown)
+	{
+		for (MappedPixelBuffer const & buffer : iter->second.m_availableBuffers)
+			m_buffersToDelete.push_back(buffer.m_bufferId);
+	}
+
+	m_requests.erase(iter);
+}
+
+
+bool MappedPixelBufferAllocator::takeBuffer(void const *p_requester, MappedPixelBuffer &p_buffer)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	auto iter = m_requests.find(p_requester);
+	if ((iter == m_requests.end()) || iter->second.m_availableBuffers.empty())
+		return false;
+
+	p_buffer = iter->second.m_availableBuffers.back();
+	iter->second.m_availableBuffers.pop_back();
+
+	return true;
+}
+
+
+bool MappedPixelBufferAllocator::hasBuffers(void const *p_requester)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	auto iter = m_requests.find(p_requester);
+	return (iter != m_requests.end()) && !(iter->second.m_availableBuffers.empty());
+}
+
+
+void MappedPixelBufferAllocator::releaseBuffer(MappedPixelBuffer const &p_buffer)
+{
+	std::lock_guard < std::mutex > lock(m_mutex);
+
+	// After shutdown, there may not be a context anymore. The
+	// PBO is then freed together with the context.
+	if (!m_shutDown)
+		m_buffersToDelete.push_back(p_buffer.m_bufferId);
+}
+
+
+bool MappedPixelBufferAllocator::createBuffer(gsize const p_size, MappedPixelBuffer &p_buffer)
+{
+	if (m_bufferStorageFunc == nullptr)
+		return false;
+
+	QOpenGLExtraFunctions *glextrafuncs = m_glcontext->extraFunctions();
+
+	// Upstream elements may also read from the frames (for example,
+	// decoders that use previous frames as references), so the PBO
+	// is mapped for reading as well. With some drivers, reading from
+	// such memory is slow, however.
+	GLbitfield const flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	GLuint bufferId;
+	glextrafuncs->glGenBuffers(1, &bufferId);
+	glextrafuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferId);
+	m_bufferStorageFunc(GL_PIXEL_UNPACK_BUFFER, p_size, nullptr, flags);
+	void *mappedData = glextrafuncs->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, p_size, flags);
+	glextrafuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (mappedData == nullptr)
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not map pixel buffer object persistently; upstream elements will use system memory";
+		glextrafuncs->glDeleteBuffers(1, &bufferId);
+		return false;
+	}
+
+	qCDebug(lcQtGLVidDemo) << "Created mapped pixel buffer object with" << p_size << "byte(s)";
+
+	p_buffer.m_bufferId = bufferId;
+	p_buffer.m_size = p_size;
+	p_buffer.m_mappedData = reinterpret_cast < guint8* > (mappedData);
+
+	return true;
+}
+
+
+MappedPixelBuffer const * getMappedPixelBuffer(GstMemory *p_memory)
+{
+	return reinterpret_cast < MappedPixelBuffer const * > (gst_mini_object_get_qdata(GST_MINI_OBJECT_CAST(p_memory), getMappedPixelBufferQuark()));
+}
+
+
+} // namespace qtglviddemo end
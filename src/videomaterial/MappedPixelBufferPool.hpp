@@ -0,0 +1,201 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_MAPPED_PIXEL_BUFFER_POOL_HPP
+#define QTGLVIDDEMO_MAPPED_PIXEL_BUFFER_POOL_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <gst/gst.h>
+#include <QOpenGLFunctions>
+
+
+class QOpenGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Pixel buffer object (PBO) that is persistently mapped into memory.
+ *
+ * The memory block at m_mappedData stays valid for as long as the PBO
+ * exists, and can be written to by any thread, even while OpenGL uses
+ * the PBO. The mapping is coherent, so the GPU sees the written data
+ * without any explicit flushes.
+ */
+struct MappedPixelBuffer
+{
+	GLuint m_bufferId;
+	gsize m_size;
+	guint8 *m_mappedData;
+};
+
+
+/**
+ * Allocator for persistently mapped pixel buffer objects.
+ *
+ * This allocator creates GstBufferPools whose buffers are backed by
+ * persistently mapped PBOs. These pools are proposed to upstream elements
+ * (decoders, converters) in allocation queries. Upstream then writes the
+ * frame pixels directly into GPU visible memory, and texture uploads become
+ * PBO-to-texture copies done by the GPU, without another copy by the CPU.
+ *
+ * Creating and deleting PBOs requires an OpenGL context, but pools allocate
+ * buffers in GStreamer streaming threads. To keep these threads from ever
+ * waiting for the render thread, pools only request PBOs from the allocator.
+ * The render thread creates the requested PBOs in processRequests(). Until
+ * the PBOs exist, pools hand out buffers with regular system memory, which
+ * are discarded once they are returned to the pool and PBOs are available.
+ * Likewise, PBOs are not deleted immediately when the pool is done with
+ * them; they are deleted by the next processRequests() call.
+ *
+ * Persistent mapping requires OpenGL 4.4, GL_ARB_buffer_storage, or (with
+ * OpenGL ES 3.1 and newer) GL_EXT_buffer_storage. See isSupported().
+ *
+ * The consumer of the buffers has to make sure that a buffer is not returned
+ * to the pool while the GPU still reads from its PBO, since upstream might
+ * overwrite the pixels otherwise. VideoMaterialProviderGeneric does this with
+ * fences.
+ *
+ * The allocator is always used through a shared pointer, since pools and
+ * buffers may outlive the provider that created it.
+ */
+class MappedPixelBufferAllocator
+	: public std::enable_shared_from_this < MappedPixelBufferAllocator >
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param p_glcontext OpenGL context to create the PBOs in. Must
+	 *        be valid until shutdown() is called.
+	 */
+	explicit MappedPixelBufferAllocator(QOpenGLContext *p_glcontext);
+	/**
+	 * Destructor.
+	 *
+	 * Does not delete any PBOs, since there might not be an OpenGL
+	 * context anymore. Call shutdown() before for that purpose.
+	 */
+	~MappedPixelBufferAllocator();
+
+	/// Returns true if the given context supports persistently mapped PBOs.
+	static bool isSupported(QOpenGLContext *p_glcontext);
+
+	/**
+	 * Creates a new buffer pool whose buffers are backed by PBOs from
+	 * this allocator.
+	 *
+	 * The pool is not configured. This can be called from any thread.
+	 *
+	 * @return New buffer pool. The caller owns the reference.
+	 */
+	GstBufferPool* createBufferPool();
+
+	/**
+	 * Creates requested PBOs and deletes PBOs that are no longer used.
+	 *
+	 * This must be called regularly by the render thread. At most a few
+	 * PBOs are created per call, to limit the time this call takes. The
+	 * OpenGL context passed to the constructor must be current.
+	 */
+	void processRequests();
+
+	/**
+	 * Deletes all PBOs that are not in use.
+	 *
+	 * After this call, PBOs are neither created nor deleted anymore.
+	 * PBOs that are still in use by buffers are then freed when the
+	 * OpenGL context is destroyed. The OpenGL context passed to the
+	 * constructor must be current.
+	 */
+	void shutdown();
+
+	// Functions used by the buffer pools. A requester is a buffer
+	// pool. They can be called from any thread.
+
+	/**
+	 * Requests a number of PBOs of the given size.
+	 *
+	 * Any previous request by the same requester is replaced. PBOs of
+	 * a different size that were created for the requester and not yet
+	 * taken by it are deleted.
+	 */
+	void requestBuffers(void const *p_requester, gsize const p_size, guint const p_numBuffers);
+	/**
+	 * Requests one more PBO of the size the requester currently uses,
+	 * unless PBOs are already pending or available for the requester.
+	 */
+	void requestAdditionalBuffer(void const *p_requester);
+	/// Cancels the requester's request and deletes PBOs created for it.
+	void cancelRequest(void const *p_requester);
+	/**
+	 * Takes a PBO that was created for the requester.
+	 *
+	 * @return true if a PBO was available, false otherwise.
+	 */
+	bool takeBuffer(void const *p_requester, MappedPixelBuffer &p_buffer);
+	/// Returns true if a PBO for the requester is available.
+	bool hasBuffers(void const *p_requester);
+	/// Marks a PBO as no longer used. It is deleted later.
+	void releaseBuffer(MappedPixelBuffer const &p_buffer);
+
+
+private:
+	struct Request
+	{
+		gsize m_size;
+		guint m_numMissingBuffers;
+		std::vector < MappedPixelBuffer > m_availableBuffers;
+	};
+
+	typedef void (QOPENGLF_APIENTRYP BufferStorageFunc)(GLenum p_target, GLsizeiptr p_size, void const *p_data, GLbitfield p_flags);
+
+	bool createBuffer(gsize const p_size, MappedPixelBuffer &p_buffer);
+
+	QOpenGLContext *m_glcontext;
+	BufferStorageFunc m_bufferStorageFunc;
+
+	std::mutex m_mutex;
+	bool m_shutDown;
+	bool m_creationFailed;
+	std::map < void const *, Request > m_requests;
+	std::vector < GLuint > m_buffersToDelete;
+};
+
+typedef std::shared_ptr < MappedPixelBufferAllocator > MappedPixelBufferAllocatorSPtr;
+
+
+/**
+ * Returns the PBO that backs the given memory.
+ *
+ * @return Pointer to the PBO, or null if the memory is not backed by a PBO
+ *         from a MappedPixelBufferAllocator.
+ */
+MappedPixelBuffer const * getMappedPixelBuffer(GstMemory *p_memory);
+
+
+} // namespace qtglviddemo end
+
+
+#endif
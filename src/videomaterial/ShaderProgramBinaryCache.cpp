@@ -0,0 +1,239 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "ShaderProgramBinaryCache.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// These are not defined in OpenGL ES 2 headers, but are available
+// with OpenGL ES 3, OpenGL 4.1, and GL_ARB_get_program_binary.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+
+// Identifies cache files, and is changed if their layout changes.
+constexpr quint32 CacheFileMagic = 0x51475642; // "QGVB"
+constexpr quint32 CacheFileVersion = 1;
+
+
+} // unnamed namespace end
+
+
+ShaderProgramBinaryCache::ShaderProgramBinaryCache(QOpenGLContext *p_glcontext)
+	: m_glcontext(p_glcontext)
+	, m_enabled(false)
+{
+	assert(m_glcontext != nullptr);
+
+	QSurfaceFormat const &format = m_glcontext->format();
+	if (m_glcontext->isOpenGLES())
+		m_enabled = (format.majorVersion() >= 3);
+	else
+		m_enabled = (format.version() >= qMakePair(4, 1)) || m_glcontext->hasExtension(QByteArray("GL_ARB_get_program_binary"));
+
+	QOpenGLFunctions *glfuncs = m_glcontext->functions();
+
+	// Program binaries may be supported in principle, but the
+	// driver may not offer any formats to store them in.
+	if (m_enabled)
+	{
+		GLint numFormats = 0;
+		glfuncs->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		m_enabled = (numFormats > 0);
+	}
+
+	if (!m_enabled)
+	{
+		qCDebug(lcQtGLVidDemo) << "Shader program binaries not supported; shader program binary cache disabled";
+		return;
+	}
+
+	// Binaries are only valid for the driver that produced them.
+	m_driverID = QByteArray(reinterpret_cast < char const * > (glfuncs->glGetString(GL_VENDOR))) + '\n'
+	           + QByteArray(reinterpret_cast < char const * > (glfuncs->glGetString(GL_RENDERER))) + '\n'
+	           + QByteArray(reinterpret_cast < char const * > (glfuncs->glGetString(GL_VERSION)));
+
+	// GenericCacheLocation is $XDG_CACHE_HOME (or ~/.cache) on Linux.
+	m_directory = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/qtglviddemo";
+
+	qCDebug(lcQtGLVidDemo) << "Using shader program binary cache directory" << m_directory;
+}
+
+
+bool ShaderProgramBinaryCache::isEnabled() const
+{
+	return m_enabled;
+}
+
+
+bool ShaderProgramBinaryCache::load(QOpenGLShaderProgram &p_program, QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource)
+{
+	if (!m_enabled)
+		return false;
+
+	QString filename = getFilename(p_vertexShaderSource, p_fragmentShaderSource);
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qCDebug(lcQtGLVidDemo) << "No cached binary for shader program in" << filename;
+		return false;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	quint32 magic = 0, version = 0, binaryFormat = 0;
+	QByteArray binary;
+	stream >> magic >> version >> binaryFormat >> binary;
+	file.close();
+
+	if ((stream.status() != QDataStream::Ok) || (magic != CacheFileMagic) || (version != CacheFileVersion) || binary.isEmpty())
+	{
+		qCWarning(lcQtGLVidDemo) << "Shader program binary cache file" << filename << "is invalid; removing it";
+		QFile::remove(filename);
+		return false;
+	}
+
+	// With a program that has no shaders, link() does not actually
+	// link; it just checks if the binary was accepted.
+	p_program.create();
+	m_glcontext->extraFunctions()->glProgramBinary(p_program.programId(), GLenum(binaryFormat), binary.constData(), binary.size());
+	if (!p_program.link())
+	{
+		qCDebug(lcQtGLVidDemo) << "Driver rejected cached shader program binary; removing" << filename;
+		QFile::remove(filename);
+		return false;
+	}
+
+	return true;
+}
+
+
+void ShaderProgramBinaryCache::prepareForStoring(QOpenGLShaderProgram &p_program)
+{
+	if (!m_enabled)
+		return;
+
+	p_program.create();
+	m_glcontext->extraFunctions()->glProgramParameteri(p_program.programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+void ShaderProgramBinaryCache::store(QOpenGLShaderProgram &p_program, QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource)
+{
+	if (!m_enabled || !p_program.isLinked())
+		return;
+
+	GLint binaryLength = 0;
+	m_glcontext->functions()->glGetProgramiv(p_program.programId(), GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0)
+	{
+		qCDebug(lcQtGLVidDemo) << "Driver provides no binary for shader program; not caching it";
+		return;
+	}
+
+	QByteArray binary(binaryLength, Qt::Uninitialized);
+	GLsizei actualLength = 0;
+	GLenum binaryFormat = 0;
+	m_glcontext->extraFunctions()->glGetProgramBinary(p_program.programId(), binaryLength, &actualLength, &binaryFormat, binary.data());
+	binary.resize(actualLength);
+	if (binary.isEmpty())
+	{
+		qCDebug(lcQtGLVidDemo) << "Could not get shader program binary; not caching it";
+		return;
+	}
+
+	if (!QDir().mkpath(m_directory))
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not create shader program binary cache directory" << m_directory;
+		return;
+	}
+
+	// Use QSaveFile to make sure that other instances of
+	// this program never see partially written files.
+	QString filename = getFilename(p_vertexShaderSource, p_fragmentShaderSource);
+	QSaveFile file(filename);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not open shader program binary cache file" << filename << "for writing:" << file.errorString();
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_0);
+	stream << CacheFileMagic << CacheFileVersion << quint32(binaryFormat) << binary;
+
+	if (!file.commit())
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not write shader program binary cache file" << filename << ":" << file.errorString();
+		return;
+	}
+
+	qCDebug(lcQtGLVidDemo) << "Stored shader program binary with" << binary.size() << "byte(s) in" << filename;
+}
+
+
+QString ShaderProgramBinaryCache::getFilename(QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource) const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(m_driverID);
+	hash.addData("\0", 1);
+	hash.addData(p_vertexShaderSource.toUtf8());
+	hash.addData("\0", 1);
+	hash.addData(p_fragmentShaderSource.toUtf8());
+
+	return m_directory + "/" + QString::fromLatin1(hash.result().toHex()) + ".bin";
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,115 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_SHADER_PROGRAM_BINARY_CACHE_HPP
+#define QTGLVIDDEMO_SHADER_PROGRAM_BINARY_CACHE_HPP
+
+#include <QByteArray>
+#include <QString>
+
+
+class QOpenGLContext;
+class QOpenGLShaderProgram;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * On-disk cache for linked shader program binaries.
+ *
+ * Compiling and linking GLSL programs can take hundreds of milliseconds
+ * on embedded GPUs. This cache stores the binaries of linked programs
+ * (retrieved with glGetProgramBinary()) in files, and loads them with
+ * glProgramBinary() the next time the same program is needed, skipping
+ * compilation altogether.
+ *
+ * The files are placed in the "qtglviddemo" subdirectory of the user's
+ * cache directory ($XDG_CACHE_HOME, or ~/.cache if it is not set). Each
+ * file is named after a hash of the OpenGL vendor, renderer, and version
+ * strings and the shader sources, so driver updates and shader changes
+ * automatically lead to different files. If the driver still rejects a
+ * binary, the file is removed, and the program is compiled from source.
+ *
+ * Program binaries require OpenGL ES 3.0, OpenGL 4.1, or the
+ * GL_ARB_get_program_binary extension. Without them, the cache is
+ * disabled, and all functions do nothing.
+ *
+ * All functions must be called with the cache's OpenGL context being current.
+ */
+class ShaderProgramBinaryCache
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * Checks if program binaries are supported, and queries the driver
+	 * strings. The OpenGL context must be current.
+	 *
+	 * @param p_glcontext OpenGL context the programs are used with.
+	 */
+	explicit ShaderProgramBinaryCache(QOpenGLContext *p_glcontext);
+
+	/// Returns true if program binaries are supported.
+	bool isEnabled() const;
+
+	/**
+	 * Tries to load the binary of a program with the given sources.
+	 *
+	 * If this succeeds, p_program is linked, and no shaders have to be
+	 * added to it. Otherwise, p_program is left unlinked.
+	 *
+	 * @param p_program Program to load the binary into. Must not have
+	 *        any shaders yet.
+	 * @param p_vertexShaderSource GLSL source of the vertex shader.
+	 * @param p_fragmentShaderSource GLSL source of the fragment shader.
+	 * @return true if the binary was loaded, false otherwise.
+	 */
+	bool load(QOpenGLShaderProgram &p_program, QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource);
+	/**
+	 * Prepares a program for storing its binary later.
+	 *
+	 * Some drivers only retain the binary if they are told so before
+	 * the program is linked. So, this must be called before linking.
+	 */
+	void prepareForStoring(QOpenGLShaderProgram &p_program);
+	/**
+	 * Stores the binary of a linked program with the given sources.
+	 *
+	 * Errors are logged, but otherwise ignored, since the cache is just
+	 * an optimization.
+	 */
+	void store(QOpenGLShaderProgram &p_program, QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource);
+
+
+private:
+	QString getFilename(QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource) const;
+
+	QOpenGLContext *m_glcontext;
+	bool m_enabled;
+	QByteArray m_driverID;
+	QString m_directory;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include "TexturePool.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// These are not defined in OpenGL ES 2 headers, but
+// are available with OpenGL ES 3 and desktop OpenGL 3.
+
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+
+#ifndef GL_RG8
+#define GL_RG8 0x822B
+#endif
+
+#ifndef GL_RGBA8
+#define GL_RGBA8 0x8058
+#endif
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+
+// Maximum number of unused textures to keep per format. This is
+// enough for several video materials with up to three textures
+// each to be recreated without allocations, while making sure
+// that textures for formats that are no longer used do not pile
+// up in the pool.
+constexpr std::size_t MaxNumFreeTexturesPerFormat = 12;
+
+
+// glTexStorage2D() requires sized internal formats. Returns
+// 0 if there is no sized counterpart to the given format.
+GLenum getSizedInternalFormat(GLint const p_internalFormat)
+{
+	switch (p_internalFormat)
+	{
+		case GL_R8:
+		case GL_RG8:
+		case GL_RGBA8:
+			return p_internalFormat;
+		case GL_RGBA:
+			return GL_RGBA8;
+		default:
+			return 0;
+	}
+}
+
+
+} // unnamed namespace end
+
+
+TexturePool::TextureFormat::TextureFormat()
+	: m_width(0)
+	, m_height(0)
+	, m_internalFormat(0)
+	, m_format(0)
+	, m_type(0)
+{
+}
+
+
+TexturePool::TextureFormat::TextureFormat(GLsizei const p_width, GLsizei const p_height, GLint const p_internalFormat, GLenum const p_format, GLenum const p_type)
+	: m_width(p_width)
+	, m_height(p_height)
+	, m_internalFormat(p_internalFormat)
+	, m_format(p_format)
+	, m_type(p_type)
+{
+}
+
+
+bool TexturePool::TextureFormat::operator == (TextureFormat const &p_other) const
+{
+	return (m_width == p_other.m_width)
+	    && (m_height == p_other.m_height)
+	    && (m_internalFormat == p_other.m_internalFormat)
+	    && (m_format == p_other.m_format)
+	    && (m_type == p_other.m_type);
+}
+
+
+bool TexturePool::TextureFormat::operator != (TextureFormat const &p_other) const
+{
+	return !(*this == p_other);
+}
+
+
+bool TexturePool::TextureFormat::operator < (TextureFormat const &p_other) const
+{
+	if (m_width != p_other.m_width) return m_width < p_other.m_width;
+	if (m_height != p_other.m_height) return m_height < p_other.m_height;
+	if (m_internalFormat != p_other.m_internalFormat) return m_internalFormat < p_other.m_internalFormat;
+	if (m_format != p_other.m_format) return m_format < p_other.m_format;
+	return m_type < p_other.m_type;
+}
+
+
+TexturePool::TexturePool(QOpenGLContext *p_glcontext)
+	: m_glcontext(p_glcontext)
+{
+	assert(m_glcontext != nullptr);
+
+	QSurfaceFormat const &format = m_glcontext->format();
+	if (m_glcontext->isOpenGLES())
+		m_useTextureStorage = (format.majorVersion() >= 3);
+	else
+		m_useTextureStorage = (format.version() >= qMakePair(4, 2)) || m_glcontext->hasExtension(QByteArray("GL_ARB_texture_storage"));
+
+	qCDebug(lcQtGLVidDemo) << "Texture pool uses immutable texture storage:" << m_useTextureStorage;
+}
+
+
+TexturePool::~TexturePool()
+{
+	std::size_t numTextures = 0;
+
+	for (auto & entry : m_freeTextures)
+	{
+		if (entry.second.empty())
+			continue;
+
+		m_glcontext->functions()->glDeleteTextures(entry.second.size(), &(entry.second[0]));
+		numTextures += entry.second.size();
+	}
+
+	qCDebug(lcQtGLVidDemo) << "Deleted" << numTextures << "pooled texture(s)";
+}
+
+
+GLuint TexturePool::acquireTexture(TextureFormat const &p_format)
+{
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		auto iter = m_freeTextures.find(p_format);
+		if ((iter != m_freeTextures.end()) && !(iter->second.empty()))
+		{
+			GLuint textureId = iter->second.back();
+			iter->second.pop_back();
+			return textureId;
+		}
+	}
+
+	// No mutex lock necessary here, since creating the
+	// texture does not access the pool's states.
+	return createTexture(p_format);
+}
+
+
+void TexturePool::releaseTexture(TextureFormat const &p_format, GLuint const p_textureId)
+{
+	if (p_textureId == 0)
+		return;
+
+	{
+		std::lock_guard < std::mutex > lock(m_mutex);
+
+		std::vector < GLuint > &freeTextures = m_freeTextures[p_format];
+		if (freeTextures.size() < MaxNumFreeTexturesPerFormat)
+		{
+			freeTextures.push_back(p_textureId);
+			return;
+		}
+	}
+
+	QOpenGLContext::currentContext()->functions()->glDeleteTextures(1, &p_textureId);
+}
+
+
+GLuint TexturePool::createTexture(TextureFormat const &p_format)
+{
+	// Use the current context instead of m_glcontext, since textures
+	// may also be acquired by threads with a shared context.
+	QOpenGLContext *glcontext = QOpenGLContext::currentContext();
+	QOpenGLFunctions *glfuncs = glcontext->functions();
+
+	GLuint textureId;
+	glfuncs->glGenTextures(1, &textureId);
+	glfuncs->glBindTexture(GL_TEXTURE_2D, textureId);
+
+	// Set min/mag filter to GL_LINEAR to make sure OpenGL
+	// does not attempt to use any mipmapping.
+	glfuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glfuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Set wrap values to GL_REPEAT to make the GPU repeat
+	// the texture for coordinates outside of the 0.0-1.0
+	// range.
+	glfuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glfuncs->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	if (p_format.m_internalFormat != 0)
+	{
+		GLenum sizedInternalFormat = m_useTextureStorage ? getSizedInternalFormat(p_format.m_internalFormat) : 0;
+
+		qCDebug(lcQtGLVidDemo).nospace() << "Allocating " << p_format.m_width << "x" << p_format.m_height << " texture with internal format " << p_format.m_internalFormat << (sizedInternalFormat != 0 ? " (immutable)" : "");
+
+		if (sizedInternalFormat != 0)
+			glcontext->extraFunctions()->glTexStorage2D(GL_TEXTURE_2D, 1, sizedInternalFormat, p_format.m_width, p_format.m_height);
+		else
+			glfuncs->glTexImage2D(GL_TEXTURE_2D, 0, p_format.m_internalFormat, p_format.m_width, p_format.m_height, 0, p_format.m_format, p_format.m_type, nullptr);
+	}
+
+	glfuncs->glBindTexture(GL_TEXTURE_2D, 0);
+
+	return textureId;
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,150 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_TEXTURE_POOL_HPP
+#define QTGLVIDDEMO_TEXTURE_POOL_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <qopengl.h>
+
+
+class QOpenGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Pool of OpenGL textures, grouped by their size and format.
+ *
+ * Allocating texture storage is expensive, and so is deleting it. Video
+ * materials need new textures whenever they are created or when the format
+ * or size of the video frames changes. Instead of allocating and deleting
+ * textures every time, video materials acquire textures from this pool,
+ * and release them back into the pool once they no longer need them.
+ * Another material that needs a texture of the same size and format can
+ * then reuse it without any allocation.
+ *
+ * If the OpenGL implementation supports it (OpenGL ES 3.0, OpenGL 4.2,
+ * or GL_ARB_texture_storage), texture storage is allocated with
+ * glTexStorage2D(), which creates immutable storage. This lets the driver
+ * skip consistency checks it otherwise would have to perform whenever the
+ * texture is used. Otherwise, glTexImage2D() is used.
+ *
+ * Textures can also be acquired without any storage. This is useful for
+ * mechanisms that bring their own storage, like Vivante direct textures.
+ *
+ * All textures have their min/mag filters set to GL_LINEAR and their wrap
+ * modes set to GL_REPEAT.
+ *
+ * The pool is thread safe. However, the OpenGL context the pool was created
+ * with (or one sharing resources with it) must be current when calling the
+ * pool's functions.
+ */
+class TexturePool
+{
+public:
+	/**
+	 * Size and format of a texture.
+	 *
+	 * A default constructed instance describes a texture without storage.
+	 */
+	struct TextureFormat
+	{
+		TextureFormat();
+		TextureFormat(GLsizei const p_width, GLsizei const p_height, GLint const p_internalFormat, GLenum const p_format, GLenum const p_type);
+
+		bool operator == (TextureFormat const &p_other) const;
+		bool operator != (TextureFormat const &p_other) const;
+		bool operator < (TextureFormat const &p_other) const;
+
+		/// Texture width, in texels.
+		GLsizei m_width;
+		/// Texture height, in texels.
+		GLsizei m_height;
+		/// Internal format, as passed to glTexImage2D(). 0 means no storage.
+		GLint m_internalFormat;
+		/// Pixel transfer format, as passed to glTexImage2D().
+		GLenum m_format;
+		/// Pixel transfer type, as passed to glTexImage2D().
+		GLenum m_type;
+	};
+
+	/**
+	 * Constructor.
+	 *
+	 * @param p_glcontext Qt OpenGL context object pointer. Must not be null.
+	 */
+	explicit TexturePool(QOpenGLContext *p_glcontext);
+	/**
+	 * Destructor.
+	 *
+	 * Deletes all textures that are currently in the pool. Textures that
+	 * were acquired and not released are not deleted.
+	 */
+	~TexturePool();
+
+	/**
+	 * Takes a texture with the given format out of the pool.
+	 *
+	 * If there is no such texture in the pool, a new one is created.
+	 *
+	 * @param p_format Format of the texture to acquire.
+	 * @return ID of the texture.
+	 */
+	GLuint acquireTexture(TextureFormat const &p_format);
+	/**
+	 * Puts a texture into the pool.
+	 *
+	 * If the pool already contains many textures of the same format,
+	 * the texture is deleted instead.
+	 *
+	 * @param p_format Format the texture was acquired with.
+	 * @param p_textureId ID of the texture. Must have been acquired
+	 *        from this pool with the same format.
+	 */
+	void releaseTexture(TextureFormat const &p_format, GLuint const p_textureId);
+
+	/// TexturePool is neither copyable nor movable.
+	TexturePool(TexturePool const &) = delete;
+	TexturePool& operator = (TexturePool const &) = delete;
+
+
+private:
+	GLuint createTexture(TextureFormat const &p_format);
+
+	QOpenGLContext *m_glcontext;
+	bool m_useTextureStorage;
+
+	std::mutex m_mutex;
+	typedef std::map < TextureFormat, std::vector < GLuint > > FreeTextureMap;
+	FreeTextureMap m_freeTextures;
+};
+
+typedef std::unique_ptr < TexturePool > TexturePoolUPtr;
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -18,7 +18,11 @@
 
 
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QLoggingCategory>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
@@ -67,30 +71,502 @@ void main(void)
 ); // LONG_STRING_CONST end
 
 
-QString const defaultFragmentShaderSource = LONG_STRING_CONST(
+// The fragment shader is assembled out of several pieces. First come
+// the declarations, then the fetchRGB() function of the shader variant,
+// then the main function. fetchRGB() returns the RGB value of the video
+// frame at the given texture coordinates. If the frame uses a YUV pixel
+// format, fetchRGB() converts the YUV values to RGB with the colorMatrix
+// and colorOffset uniforms. Note that SECOND_CHANNEL and
+// VIDEO_TEXTURE0_SAMPLER are #defined prior to the declarations (the
+// stringized sources cannot contain preprocessor directives, since these
+// require line breaks).
+
+QString const fragmentShaderDeclarationsSource = LONG_STRING_CONST(
 
 const vec3 lightVector = vec3(0.0, 0.0, 1.0);
 
 varying highp vec2 texcoordsVariant;
 varying highp vec3 normalVariant;
 
-uniform sampler2D videoTexture;
+uniform VIDEO_TEXTURE0_SAMPLER videoTexture0;
+uniform sampler2D videoTexture1;
+uniform sampler2D videoTexture2;
+
+uniform highp mat3 colorMatrix;
+uniform highp vec3 colorOffset;
+
+uniform lowp float opacity;
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchRGBASource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	return texture2D(videoTexture0, uv).rgb;
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchBGRASource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	return texture2D(videoTexture0, uv).bgr;
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchThreePlaneYUVSource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	highp vec3 yuv = vec3(
+		texture2D(videoTexture0, uv).r,
+		texture2D(videoTexture1, uv).r,
+		texture2D(videoTexture2, uv).r
+	);
+	return colorMatrix * (yuv - colorOffset);
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchTwoPlaneYUVSource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	highp vec4 chroma = texture2D(videoTexture1, uv);
+	highp vec3 yuv = vec3(texture2D(videoTexture0, uv).r, chroma.r, chroma.SECOND_CHANNEL);
+	return colorMatrix * (yuv - colorOffset);
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchTwoPlaneYVUSource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	highp vec4 chroma = texture2D(videoTexture1, uv);
+	highp vec3 yuv = vec3(texture2D(videoTexture0, uv).r, chroma.SECOND_CHANNEL, chroma.r);
+	return colorMatrix * (yuv - colorOffset);
+}
+
+); // LONG_STRING_CONST end
+
+
+// Packed 4:2:2 formats are uploaded twice: once into a two-channel texture
+// with full width (one texel per pixel, used for the Y values), and once
+// into an RGBA texture with half width (one texel per macropixel, used
+// for the U and V values). This way, the GPU's texture filtering works
+// correctly for both luma and chroma.
+
+QString const fetchPackedYUY2Source = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	highp vec4 chroma = texture2D(videoTexture1, uv);
+	highp vec3 yuv = vec3(texture2D(videoTexture0, uv).r, chroma.g, chroma.a);
+	return colorMatrix * (yuv - colorOffset);
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fetchPackedUYVYSource = LONG_STRING_CONST(
+
+vec3 fetchRGB(highp vec2 uv)
+{
+	highp vec4 chroma = texture2D(videoTexture1, uv);
+	highp vec3 yuv = vec3(texture2D(videoTexture0, uv).SECOND_CHANNEL, chroma.r, chroma.b);
+	return colorMatrix * (yuv - colorOffset);
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const fragmentShaderMainSource = LONG_STRING_CONST(
 
 void main(void)
 {
 	float lighting = clamp(dot(lightVector, normalize(normalVariant)), 0.0, 1.0);
-	vec4 texel = texture2D(videoTexture, texcoordsVariant);
-	gl_FragColor = vec4(lighting * texel.rgb, 1.0);
+	gl_FragColor = vec4(lighting * fetchRGB(texcoordsVariant), 1.0) * opacity;
 }
 
 ); // LONG_STRING_CONST end
 
 
+// Shaders for drawing several video materials with one instanced draw
+// call. The frames of the materials are copied into the layers of
+// texture arrays, so the instanced fragment shader samples from
+// sampler2DArray uniforms. Everything the regular shaders get through
+// uniforms that differs between the instances comes from per-instance
+// vertex attributes instead. The objects are not drawn with their own
+// viewport, scissor rectangle, and depth range; instead, the
+// modelviewprojection matrix also maps into the object's viewport and
+// depth range, and fragments outside of the object's clip rectangle
+// (in window coordinates) and depth range are discarded.
+// The #version directive and the GL_ES specific precision statements
+// are prepended by getInstancedVertexShaderSource() and
+// getInstancedFragmentShaderSource(). The latter also #defines
+// texture2D() so that the fetchRGB() sources from above sample from
+// the instance's layer.
+
+QString const instancedVertexShaderSource = LONG_STRING_CONST(
+
+in highp vec3 vertexPosition;
+in highp vec3 vertexNormal;
+in highp vec2 vertexTexcoords;
+
+in highp mat4 instanceModelviewprojMatrix;
+in highp mat3 instanceNormalMatrix;
+in highp vec4 instanceCropRectangle;
+in highp vec4 instanceTextureRotation;
+in highp vec4 instanceClipRectangle;
+in highp vec2 instanceDepthRange;
+in highp float instanceLayer;
+
+out highp vec2 texcoordsVariant;
+out highp vec3 normalVariant;
+flat out highp vec4 clipRectangleVariant;
+flat out highp vec2 depthRangeVariant;
+flat out highp float layerVariant;
+
+void main(void)
+{
+	gl_Position = instanceModelviewprojMatrix * vec4(vertexPosition, 1.0);
+	mat2 textureRotationMatrix = mat2(instanceTextureRotation.xy, instanceTextureRotation.zw);
+	vec2 uvRotCenter = instanceCropRectangle.zw * 0.5;
+	vec2 uv = vertexTexcoords * instanceCropRectangle.zw;
+	uv = textureRotationMatrix * (uv - uvRotCenter) + uvRotCenter;
+	texcoordsVariant = uv + instanceCropRectangle.xy;
+	normalVariant = instanceNormalMatrix * vertexNormal;
+	clipRectangleVariant = instanceClipRectangle;
+	depthRangeVariant = instanceDepthRange;
+	layerVariant = instanceLayer;
+}
+
+); // LONG_STRING_CONST end
+
+
+QString const instancedFragmentShaderDeclarationsSource = LONG_STRING_CONST(
+
+const vec3 lightVector = vec3(0.0, 0.0, 1.0);
+
+in highp vec2 texcoordsVariant;
+in highp vec3 normalVariant;
+flat in highp vec4 clipRectangleVariant;
+flat in highp vec2 depthRangeVariant;
+flat in highp float layerVariant;
+
+uniform highp sampler2DArray videoTexture0;
+uniform highp sampler2DArray videoTexture1;
+uniform highp sampler2DArray videoTexture2;
+
+uniform highp mat3 colorMatrix;
+uniform highp vec3 colorOffset;
+
+uniform lowp float opacity;
+
+out lowp vec4 fragColor;
+
+); // LONG_STRING_CONST end
+
+
+QString const instancedFragmentShaderMainSource = LONG_STRING_CONST(
+
+void main(void)
+{
+	if (any(lessThan(gl_FragCoord.xy, clipRectangleVariant.xy)) || any(greaterThanEqual(gl_FragCoord.xy, clipRectangleVariant.xy + clipRectangleVariant.zw)))
+		discard;
+	if ((gl_FragCoord.z < depthRangeVariant.x) || (gl_FragCoord.z > depthRangeVariant.y))
+		discard;
+
+	float lighting = clamp(dot(lightVector, normalize(normalVariant)), 0.0, 1.0);
+	fragColor = vec4(lighting * fetchRGB(texcoordsVariant), 1.0) * opacity;
+}
+
+); // LONG_STRING_CONST end
+
+
+// Source of the video material content serials (see
+// VideoMaterial::getContentSerial()). Uploads can happen
+// in upload threads, so this is atomic.
+std::atomic < guint64 > nextContentSerial(1);
+
+
+void calculateColorMatrix(GstVideoInfo const &p_videoInfo, QMatrix3x3 &p_colorMatrix, QVector3D &p_colorOffset)
+{
+	GstVideoColorimetry const &colorimetry = p_videoInfo.colorimetry;
+
+	// Get the Kr and Kb coefficients of the YUV->RGB conversion. If
+	// the colorimetry does not specify a known matrix, fall back to
+	// BT.601, since this is what most SD content uses.
+	gdouble Kr, Kb;
+	if (!gst_video_color_matrix_get_Kr_Kb(colorimetry.matrix, &Kr, &Kb))
+	{
+		Kr = 0.299;
+		Kb = 0.114;
+	}
+	gdouble Kg = 1.0 - Kr - Kb;
+
+	// Limited range ("TV range") YUV uses Y values from 16 to 235 and
+	// U/V values from 16 to 240. These are stretched to the full range
+	// by scaling the matrix columns. Unless the colorimetry explicitly
+	// says that the full range is used, assume limited range, since
+	// this is by far the most common case in video streams.
+	float scaleY, scaleUV, offsetY;
+	if (colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255)
+	{
+		scaleY = 1.0f;
+		scaleUV = 1.0f;
+		offsetY = 0.0f;
+	}
+	else
+	{
+		scaleY = 255.0f / 219.0f;
+		scaleUV = 255.0f / 224.0f;
+		offsetY = 16.0f / 255.0f;
+	}
+
+	// Fill the matrix. Rows are the R, G, B outputs, columns are the
+	// Y, U, V inputs.
+	p_colorMatrix(0, 0) = scaleY;
+	p_colorMatrix(0, 1) = 0.0f;
+	p_colorMatrix(0, 2) = scaleUV * float(2.0 * (1.0 - Kr));
+
+	p_colorMatrix(1, 0) = scaleY;
+	p_colorMatrix(1, 1) = scaleUV * float(-2.0 * Kb * (1.0 - Kb) / Kg);
+	p_colorMatrix(1, 2) = scaleUV * float(-2.0 * Kr * (1.0 - Kr) / Kg);
+
+	p_colorMatrix(2, 0) = scaleY;
+	p_colorMatrix(2, 1) = scaleUV * float(2.0 * (1.0 - Kb));
+	p_colorMatrix(2, 2) = 0.0f;
+
+	p_colorOffset = QVector3D(offsetY, 128.0f / 255.0f, 128.0f / 255.0f);
+
+	// Formats with more than 8 bits per component are uploaded into
+	// 16-bit normalized textures, so the shader gets a value v of
+	// (N << shift) / 65535 for a component value N. The values above
+	// are for 8-bit components, and a 10-bit value of 4*N corresponds
+	// to the 8-bit value N. So, v needs to be scaled to N / (255 * 4)
+	// (or generally, N / (255 << (depth - 8))). Instead of doing that
+	// in the shader, fold the scale into the matrix and the offset:
+	// M * (s*v - o) = (M*s) * (v - o/s). This way, the same shaders
+	// can be used for all bit depths.
+	GstVideoFormatInfo const *finfo = p_videoInfo.finfo;
+	if ((finfo != nullptr) && GST_VIDEO_FORMAT_INFO_IS_YUV(finfo) && (GST_VIDEO_FORMAT_INFO_DEPTH(finfo, 0) > 8))
+	{
+		unsigned int depth = GST_VIDEO_FORMAT_INFO_DEPTH(finfo, 0);
+		unsigned int shift = GST_VIDEO_FORMAT_INFO_SHIFT(finfo, 0);
+		float sampleScale = 65535.0f / float((1u << shift) * (255u << (depth - 8)));
+
+		p_colorMatrix *= sampleScale;
+		p_colorOffset /= sampleScale;
+	}
+}
+
+
 } // unnamed namespace end
 
 
 
 
+VideoShaderProgram::VideoShaderProgram(QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource, unsigned int const p_numTextures, ShaderProgramBinaryCache *p_binaryCache)
+	: m_numTextures(p_numTextures)
+{
+	assert(m_numTextures <= VideoMaterial::MaxNumTextures);
+
+	// Measure how long it takes to set up the program, since
+	// this is a notable part of the startup time on some GPUs.
+	QElapsedTimer timer;
+	timer.start();
+
+	// Try the binary cache first. If it has no usable binary,
+	// compile and link the shaders, and store the result.
+	bool loadedFromCache = (p_binaryCache != nullptr) && p_binaryCache->load(m_program, p_vertexShaderSource, p_fragmentShaderSource);
+	if (!loadedFromCache)
+	{
+		if (p_binaryCache != nullptr)
+			p_binaryCache->prepareForStoring(m_program);
+
+		// Set up the shaders.
+		m_program.addShaderFromSourceCode(QOpenGLShader::Vertex, p_vertexShaderSource);
+		m_program.addShaderFromSourceCode(QOpenGLShader::Fragment, p_fragmentShaderSource);
+		m_program.link();
+		qCDebug(lcQtGLVidDemo) << "Shader program link result:" << m_program.log();
+
+		if (p_binaryCache != nullptr)
+			p_binaryCache->store(m_program, p_vertexShaderSource, p_fragmentShaderSource);
+	}
+
+	qCDebug(lcQtGLVidDemo) << "Shader program" << (loadedFromCache ? "loaded from binary cache" : "compiled from source") << "in" << timer.elapsed() << "ms";
+
+	// Bind the program to get the uniform and attribute IDs.
+
+	m_program.bind();
+
+	m_cropRectangleUniform = m_program.uniformLocation("cropRectangle");
+	m_textureRotationMatrixUniform = m_program.uniformLocation("textureRotationMatrix");
+	m_colorMatrixUniform = m_program.uniformLocation("colorMatrix");
+	m_colorOffsetUniform = m_program.uniformLocation("colorOffset");
+
+	m_modelviewMatrixUniform = m_program.uniformLocation("modelviewMatrix");
+	m_modelviewprojMatrixUniform = m_program.uniformLocation("modelviewprojMatrix");
+	m_opacityUniform = m_program.uniformLocation("opacity");
+	m_vertexPositionAttrib = m_program.attributeLocation("vertexPosition");
+	m_vertexNormalAttrib = m_program.attributeLocation("vertexNormal");
+	m_vertexTexcoordsAttrib = m_program.attributeLocation("vertexTexcoords");
+
+	m_instanceModelviewprojMatrixAttrib = m_program.attributeLocation("instanceModelviewprojMatrix");
+	m_instanceNormalMatrixAttrib = m_program.attributeLocation("instanceNormalMatrix");
+	m_instanceCropRectangleAttrib = m_program.attributeLocation("instanceCropRectangle");
+	m_instanceTextureRotationAttrib = m_program.attributeLocation("instanceTextureRotation");
+	m_instanceClipRectangleAttrib = m_program.attributeLocation("instanceClipRectangle");
+	m_instanceDepthRangeAttrib = m_program.attributeLocation("instanceDepthRange");
+	m_instanceLayerAttrib = m_program.attributeLocation("instanceLayer");
+
+	// Instruct the shader to fetch texels of texture #N from texture
+	// unit #N. This is where the video material textures will be bound to.
+	m_program.setUniformValue("videoTexture0", GLint(0));
+	m_program.setUniformValue("videoTexture1", GLint(1));
+	m_program.setUniformValue("videoTexture2", GLint(2));
+
+	// Uniforms are initialized to zero, so make sure the
+	// output is visible if the opacity is never set.
+	m_program.setUniformValue(m_opacityUniform, GLfloat(1.0f));
+
+	m_program.release();
+}
+
+
+QOpenGLShaderProgram& VideoShaderProgram::getProgram()
+{
+	return m_program;
+}
+
+
+unsigned int VideoShaderProgram::getNumTextures() const
+{
+	return m_numTextures;
+}
+
+
+int VideoShaderProgram::getCropRectangleUniform() const
+{
+	return m_cropRectangleUniform;
+}
+
+
+int VideoShaderProgram::getTextureRotationMatrixUniform() const
+{
+	return m_textureRotationMatrixUniform;
+}
+
+
+int VideoShaderProgram::getColorMatrixUniform() const
+{
+	return m_colorMatrixUniform;
+}
+
+
+int VideoShaderProgram::getColorOffsetUniform() const
+{
+	return m_colorOffsetUniform;
+}
+
+
+int VideoShaderProgram::getModelviewMatrixUniform() const
+{
+	return m_modelviewMatrixUniform;
+}
+
+
+int VideoShaderProgram::getModelviewprojMatrixUniform() const
+{
+	return m_modelviewprojMatrixUniform;
+}
+
+
+int VideoShaderProgram::getOpacityUniform() const
+{
+	return m_opacityUniform;
+}
+
+
+int VideoShaderProgram::getVertexPositionAttrib() const
+{
+	return m_vertexPositionAttrib;
+}
+
+
+int VideoShaderProgram::getVertexNormalAttrib() const
+{
+	return m_vertexNormalAttrib;
+}
+
+
+int VideoShaderProgram::getVertexTexcoordsAttrib() const
+{
+	return m_vertexTexcoordsAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceModelviewprojMatrixAttrib() const
+{
+	return m_instanceModelviewprojMatrixAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceNormalMatrixAttrib() const
+{
+	return m_instanceNormalMatrixAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceCropRectangleAttrib() const
+{
+	return m_instanceCropRectangleAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceTextureRotationAttrib() const
+{
+	return m_instanceTextureRotationAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceClipRectangleAttrib() const
+{
+	return m_instanceClipRectangleAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceDepthRangeAttrib() const
+{
+	return m_instanceDepthRangeAttrib;
+}
+
+
+int VideoShaderProgram::getInstanceLayerAttrib() const
+{
+	return m_instanceLayerAttrib;
+}
+
+
+
+
+VideoMaterialPrivData::~VideoMaterialPrivData()
+{
+}
+
+
+
+
 VideoMaterialPrivIFace::~VideoMaterialPrivIFace()
 {
 }
@@ -100,52 +576,72 @@ VideoMaterialPrivIFace::~VideoMaterialPrivIFace()
 
 VideoMaterial::VideoMaterial()
 	: m_privIFace(nullptr)
-	, m_textureId(0)
+	, m_texturePool(nullptr)
+	, m_shaderProgram(nullptr)
+	, m_textureIds{0, 0, 0}
 {
 }
 
 
-VideoMaterial::VideoMaterial(VideoMaterialPrivIFace &p_privIFace, QOpenGLContext *p_glcontext)
+VideoMaterial::VideoMaterial(VideoMaterialPrivIFace &p_privIFace, QOpenGLContext *p_glcontext, TexturePool &p_texturePool)
 	: m_privIFace(&p_privIFace)
 	, m_glcontext(p_glcontext)
-	, m_textureId(0)
+	, m_texturePool(&p_texturePool)
+	, m_shaderProgram(nullptr)
+	, m_textureIds{0, 0, 0}
 	, m_curBuffer(nullptr)
+	, m_frameWidth(0)
+	, m_frameHeight(0)
+	, m_totalWidth(0)
+	, m_totalHeight(0)
+	, m_reuploadNeeded(false)
+	, m_contentSerial(0)
 	, m_cropRectangle(0.0f, 0.0f, 1.0f, 1.0f)
 	, m_textureRotation(0)
 {
 	assert(p_glcontext != nullptr);
-	m_glcontext->functions()->glGenTextures(1, &m_textureId);
 
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, m_textureId);
+	gst_video_info_init(&m_videoInfo);
 
-	// Set min/mag filter to GL_LINEAR to make sure OpenGL
-	// does not attempt to use any mipmapping.
-	m_glcontext->functions()->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	m_glcontext->functions()->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// Until setVideoInfo() is called, use the RGBA shader program.
+	m_shaderProgram = &(m_privIFace->getShaderProgram(GST_VIDEO_FORMAT_UNKNOWN));
 
-	// Set wrap values to GL_REPEAT to make the GPU repeat
-	// the texture for coordinates outside of the 0.0-1.0
-	// range.
-	m_glcontext->functions()->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	m_glcontext->functions()->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, 0);
+	// Acquire all textures right away, even though not all pixel
+	// formats use them all. The textures have no storage yet; it is
+	// up to the provider to give them a format (see setTextureFormat()).
+	// Textures without storage are taken from the pool as well, so
+	// creating video materials does not generate new textures if
+	// previously destroyed materials released theirs.
+	for (GLuint & textureId : m_textureIds)
+		textureId = m_texturePool->acquireTexture(TexturePool::TextureFormat());
 }
 
 
 VideoMaterial::VideoMaterial(VideoMaterial && p_other)
 	: m_privIFace(p_other.m_privIFace)
 	, m_glcontext(p_other.m_glcontext)
-	, m_textureId(p_other.m_textureId)
+	, m_texturePool(p_other.m_texturePool)
+	, m_shaderProgram(p_other.m_shaderProgram)
 	, m_curBuffer(p_other.m_curBuffer)
 	, m_videoInfo(std::move(p_other.m_videoInfo))
 	, m_frameWidth(p_other.m_frameWidth)
 	, m_frameHeight(p_other.m_frameHeight)
 	, m_totalWidth(p_other.m_totalWidth)
 	, m_totalHeight(p_other.m_totalHeight)
+	, m_uploadRectangle(std::move(p_other.m_uploadRectangle))
+	, m_reuploadNeeded(p_other.m_reuploadNeeded)
+	, m_contentSerial(p_other.m_contentSerial)
 	, m_cropRectangle(std::move(p_other.m_cropRectangle))
+	, m_uploadCropRectangle(std::move(p_other.m_uploadCropRectangle))
 	, m_textureRotation(p_other.m_textureRotation)
+	, m_textureRotationMatrix(p_other.m_textureRotationMatrix)
+	, m_colorMatrix(p_other.m_colorMatrix)
+	, m_colorOffset(p_other.m_colorOffset)
+	, m_privData(std::move(p_other.m_privData))
 {
+	std::copy(std::begin(p_other.m_textureIds), std::end(p_other.m_textureIds), m_textureIds);
+	std::copy(std::begin(p_other.m_textureFormats), std::end(p_other.m_textureFormats), m_textureFormats);
+
 	// Mark the other instance as empty for its destructor.
 	p_other.m_privIFace = nullptr;
 }
@@ -156,8 +652,17 @@ VideoMaterial::~VideoMaterial()
 	if (m_privIFace == nullptr)
 		return;
 
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, 0);
-	m_glcontext->functions()->glDeleteTextures(1, &m_textureId);
+	// Destroy the provider data first, since it may
+	// contain OpenGL objects associated with the textures.
+	m_privData.reset();
+
+	// Give the textures back to the pool, so other video
+	// materials can reuse them without new allocations.
+	// Use the current context, since materials that are filled
+	// by an upload thread are also destroyed there.
+	QOpenGLContext::currentContext()->functions()->glBindTexture(GL_TEXTURE_2D, 0);
+	for (unsigned int i = 0; i < MaxNumTextures; ++i)
+		m_texturePool->releaseTexture(m_textureFormats[i], m_textureIds[i]);
 
 	if (m_curBuffer != nullptr)
 		gst_buffer_unref(m_curBuffer);
@@ -168,15 +673,26 @@ VideoMaterial& VideoMaterial::operator = (VideoMaterial && p_other)
 {
 	m_privIFace = p_other.m_privIFace;
 	m_glcontext = p_other.m_glcontext;
-	m_textureId = p_other.m_textureId;
+	m_texturePool = p_other.m_texturePool;
+	m_shaderProgram = p_other.m_shaderProgram;
+	std::copy(std::begin(p_other.m_textureIds), std::end(p_other.m_textureIds), m_textureIds);
+	std::copy(std::begin(p_other.m_textureFormats), std::end(p_other.m_textureFormats), m_textureFormats);
 	m_curBuffer = p_other.m_curBuffer;
 	m_videoInfo = std::move(p_other.m_videoInfo);
 	m_frameWidth = p_other.m_frameWidth;
 	m_frameHeight = p_other.m_frameHeight;
 	m_totalWidth = p_other.m_totalWidth;
 	m_totalHeight = p_other.m_totalHeight;
+	m_uploadRectangle = std::move(p_other.m_uploadRectangle);
+	m_reuploadNeeded = p_other.m_reuploadNeeded;
+	m_contentSerial = p_other.m_contentSerial;
 	m_cropRectangle = std::move(p_other.m_cropRectangle);
+	m_uploadCropRectangle = std::move(p_other.m_uploadCropRectangle);
 	m_textureRotation = p_other.m_textureRotation;
+	m_textureRotationMatrix = p_other.m_textureRotationMatrix;
+	m_colorMatrix = p_other.m_colorMatrix;
+	m_colorOffset = p_other.m_colorOffset;
+	m_privData = std::move(p_other.m_privData);
 
 	// Mark the other instance as empty for its destructor.
 	p_other.m_privIFace = nullptr;
@@ -195,6 +711,8 @@ void VideoMaterial::setShaderUniformValues()
 void VideoMaterial::bind()
 {
 	assert(m_privIFace != nullptr);
+
+	updateTextures();
 	m_privIFace->bindMaterial(*this);
 }
 
@@ -202,14 +720,37 @@ void VideoMaterial::bind()
 void VideoMaterial::unbind()
 {
 	assert(m_privIFace != nullptr);
-	m_privIFace->unbindTexture();
+	m_privIFace->unbindMaterial(*this);
+}
+
+
+void VideoMaterial::updateTextures()
+{
+	assert(m_privIFace != nullptr);
+
+	// If the crop rectangle changed since the current frame was
+	// uploaded, and the provider only uploads the cropped region,
+	// upload the frame again, since otherwise, the textures would
+	// not contain the pixels that are now visible.
+	if (m_reuploadNeeded && (m_curBuffer != nullptr))
+		uploadCurrentBuffer();
 }
 
 
 void VideoMaterial::setVideoInfo(GstVideoInfo p_videoInfo)
 {
+	assert(m_privIFace != nullptr);
+
 	m_videoInfo = std::move(p_videoInfo);
-	m_privIFace->setVideoInfoChangedFlag(true);
+
+	m_shaderProgram = &(m_privIFace->getShaderProgram(GST_VIDEO_INFO_FORMAT(&m_videoInfo)));
+	calculateColorMatrix(m_videoInfo, m_colorMatrix, m_colorOffset);
+}
+
+
+GstVideoInfo const & VideoMaterial::getVideoInfo() const
+{
+	return m_videoInfo;
 }
 
 
@@ -221,17 +762,31 @@ void VideoMaterial::setVideoGstbuffer(GstBuffer *p_buffer)
 	// Set the GstBuffer. If a buffer was set previously, m_curBuffer
 	gst_buffer_replace(&m_curBuffer, p_buffer);
 
+	uploadCurrentBuffer();
+}
+
+
+void VideoMaterial::uploadCurrentBuffer()
+{
+	m_reuploadNeeded = false;
+
 	// Map the frame. This provides access to a pointer to the frame's pixels
-	// and also to frame metadata. gst_video_frame_map() copies the provided
-	// video info. If the GstBuffer contains a GstVideoMeta, it then updates
-	// its copy with the information from the meta.
+	// (or, depending on the provider's map flags, to other data such as
+	// OpenGL texture IDs) and also to frame metadata. gst_video_frame_map()
+	// copies the provided video info. If the GstBuffer contains a
+	// GstVideoMeta, it then updates its copy with the information from
+	// the meta.
 	GstVideoFrame vframe;
-	gst_video_frame_map(&vframe, &m_videoInfo, m_curBuffer, GST_MAP_READ);
+	gst_video_frame_map(&vframe, &m_videoInfo, m_curBuffer, m_privIFace->getFrameMapFlags());
 
-	// Bind the material's texture. Also make sure that texture unit #0 is
-	// the one that OpenGL calls here will use.
-	m_glcontext->functions()->glActiveTexture(GL_TEXTURE0);
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, m_textureId);
+	// Bind the material's first texture. Also make sure that texture unit
+	// #0 is the one that OpenGL calls here will use. Providers that use
+	// more than one texture bind the other ones themselves. The current
+	// context is not necessarily m_glcontext, since the upload may take
+	// place in an upload thread (see supportsThreadedUploads()).
+	QOpenGLFunctions *glfuncs = QOpenGLContext::currentContext()->functions();
+	glfuncs->glActiveTexture(GL_TEXTURE0);
+	glfuncs->glBindTexture(GL_TEXTURE_2D, m_textureIds[0]);
 
 	// Get the frame sizes - the sizes of the subregion of the frame
 	// that contains the actual pixels, excluding any padding pixels.
@@ -270,8 +825,11 @@ void VideoMaterial::setVideoGstbuffer(GstBuffer *p_buffer)
 	// We are done with the frame pixels, unmap.
 	gst_video_frame_unmap(&vframe);
 
+	// The textures have new contents now.
+	m_contentSerial = nextContentSerial++;
+
 	// We are done with the texture, unbind it now.
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, 0);
+	glfuncs->glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 
@@ -283,7 +841,11 @@ bool VideoMaterial::hasVideoGstbuffer() const
 
 void VideoMaterial::setCropRectangle(QRect p_cropRectangle)
 {
+	assert(m_privIFace != nullptr);
+
 	m_cropRectangle = std::move(p_cropRectangle);
+	if (m_privIFace->uploadsCropRegionOnly() && m_uploadCropRectangle.isNull())
+		m_reuploadNeeded = true;
 }
 
 
@@ -293,6 +855,25 @@ QRect const & VideoMaterial::getCropRectangle() const
 }
 
 
+void VideoMaterial::setUploadCropRectangle(QRect p_uploadCropRectangle)
+{
+	assert(m_privIFace != nullptr);
+
+	if (p_uploadCropRectangle == m_uploadCropRectangle)
+		return;
+
+	m_uploadCropRectangle = std::move(p_uploadCropRectangle);
+	if (m_privIFace->uploadsCropRegionOnly())
+		m_reuploadNeeded = true;
+}
+
+
+QRect const & VideoMaterial::getUploadCropRectangle() const
+{
+	return m_uploadCropRectangle.isNull() ? m_cropRectangle : m_uploadCropRectangle;
+}
+
+
 void VideoMaterial::setTextureRotation(int const p_rotation)
 {
 	m_textureRotation = p_rotation;
@@ -321,6 +902,42 @@ QMatrix2x2 const & VideoMaterial::getTextureRotationMatrix() const
 }
 
 
+QVector4D VideoMaterial::getShaderCropRectangle() const
+{
+	// Calculate crop rectangle values for the shader based on the specified
+	// crop rectangle and the region of the frame the textures contain.
+	//
+	// We need to skip the padding frame pixels and also make sure only
+	// the pixels in the crop rectangle are used. To that end, the crop
+	// rectangle's coordinates are transformed from the 0-100 scale to
+	// frame pixel coordinates. These are then transformed into the
+	// 0.0-1.0 texture coordinate space of the upload rectangle. By
+	// default, the upload rectangle covers the whole frame including
+	// the padding pixels. But providers may upload only a subregion
+	// of the frame (for example only the cropped region), in which case
+	// the upload rectangle is set to that subregion.
+
+	QRect uploadRectangle = m_uploadRectangle;
+	if (uploadRectangle.isNull())
+		uploadRectangle = QRect(0, 0, m_totalWidth, m_totalHeight);
+
+	float frameWidth = float(m_frameWidth);
+	float frameHeight = float(m_frameHeight);
+
+	// Transform the rectangle coordinates from the 0-100 to the 0.0-1.0 range.
+	float cw = std::min(m_cropRectangle.width() / 100.0f, 1.0f - m_cropRectangle.x() / 100.0f);
+	float ch = std::min(m_cropRectangle.height() / 100.0f, 1.0f - m_cropRectangle.y() / 100.0f);
+
+	// Transform the coordinates into the upload rectangle's space.
+	float x = ((m_cropRectangle.x() / 100.0f) * frameWidth - uploadRectangle.x()) / float(uploadRectangle.width());
+	float y = ((m_cropRectangle.y() / 100.0f) * frameHeight - uploadRectangle.y()) / float(uploadRectangle.height());
+	float w = (cw * frameWidth) / float(uploadRectangle.width());
+	float h = (ch * frameHeight) / float(uploadRectangle.height());
+
+	return QVector4D(x, y, w, h);
+}
+
+
 guint VideoMaterial::getFrameWidth() const
 {
 	return m_frameWidth;
@@ -345,60 +962,133 @@ guint VideoMaterial::getTotalHeight() const
 }
 
 
-GLuint VideoMaterial::getTextureId() const
+void VideoMaterial::setTotalSizes(guint const p_totalWidth, guint const p_totalHeight)
 {
-	return m_textureId;
+	m_totalWidth = p_totalWidth;
+	m_totalHeight = p_totalHeight;
 }
 
 
+void VideoMaterial::setUploadRectangle(QRect p_uploadRectangle)
+{
+	m_uploadRectangle = std::move(p_uploadRectangle);
+}
 
 
-VideoMaterialProvider::VideoMaterialProvider(QOpenGLContext *p_glcontext, SupportedVideoFormats p_formats, QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource)
-	: m_glcontext(p_glcontext)
-	, m_formats(std::move(p_formats))
+QRect const & VideoMaterial::getUploadRectangle() const
 {
-	// Set up the shaders.
-	m_shaderProgram.addShaderFromSourceCode(QOpenGLShader::Vertex, p_vertexShaderSource.isEmpty() ? defaultVertexShaderSource : p_vertexShaderSource);
-	m_shaderProgram.addShaderFromSourceCode(QOpenGLShader::Fragment, p_fragmentShaderSource.isEmpty() ? defaultFragmentShaderSource : p_fragmentShaderSource);
-	m_shaderProgram.link();
-	qCDebug(lcQtGLVidDemo) << "Shader program link result:" << m_shaderProgram.log();
+	return m_uploadRectangle;
+}
 
-	// Bind the program to get the uniform and attribute IDs.
 
-	m_shaderProgram.bind();
+GLuint VideoMaterial::getTextureId(unsigned int const p_index) const
+{
+	assert(p_index < MaxNumTextures);
+	return m_textureIds[p_index];
+}
 
-	m_cropRectangleUniform = m_shaderProgram.uniformLocation("cropRectangle");
-	m_textureRotationMatrixUniform = m_shaderProgram.uniformLocation("textureRotationMatrix");
 
-	m_modelviewMatrixUniform = m_shaderProgram.uniformLocation("modelviewMatrix");
-	m_modelviewprojMatrixUniform = m_shaderProgram.uniformLocation("modelviewprojMatrix");
-	m_vertexPositionAttrib = m_shaderProgram.attributeLocation("vertexPosition");
-	m_vertexNormalAttrib = m_shaderProgram.attributeLocation("vertexNormal");
-	m_vertexTexcoordsAttrib = m_shaderProgram.attributeLocation("vertexTexcoords");
+void VideoMaterial::setTextureFormat(unsigned int const p_index, TexturePool::TextureFormat const &p_format)
+{
+	assert(p_index < MaxNumTextures);
+	assert(m_texturePool != nullptr);
 
-	// Instruct the shader to fetch texels from texture unit #0. This is
-	// where the video material texture will be bound to.
-	m_shaderProgram.setUniformValue("videoTexture", GLint(0));
+	if (m_textureFormats[p_index] == p_format)
+		return;
 
-	m_shaderProgram.release();
+	m_texturePool->releaseTexture(m_textureFormats[p_index], m_textureIds[p_index]);
+	m_textureIds[p_index] = m_texturePool->acquireTexture(p_format);
+	m_textureFormats[p_index] = p_format;
 }
 
 
-void VideoMaterialProvider::unbindTexture()
+TexturePool::TextureFormat const & VideoMaterial::getTextureFormat(unsigned int const p_index) const
 {
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, 0);
+	assert(p_index < MaxNumTextures);
+	return m_textureFormats[p_index];
 }
 
 
-VideoMaterial VideoMaterialProvider::createVideoMaterial()
+guint64 VideoMaterial::getContentSerial() const
+{
+	return m_contentSerial;
+}
+
+
+VideoShaderProgram & VideoMaterial::getShaderProgram()
+{
+	assert(m_shaderProgram != nullptr);
+	return *m_shaderProgram;
+}
+
+
+void VideoMaterial::setShaderProgram(VideoShaderProgram &p_shaderProgram)
 {
-	return VideoMaterial(*this, m_glcontext);
+	m_shaderProgram = &p_shaderProgram;
 }
 
 
-QOpenGLShaderProgram& VideoMaterialProvider::getShaderProgram()
+QMatrix3x3 const & VideoMaterial::getColorMatrix() const
 {
-	return m_shaderProgram;
+	return m_colorMatrix;
+}
+
+
+QVector3D const & VideoMaterial::getColorOffset() const
+{
+	return m_colorOffset;
+}
+
+
+void VideoMaterial::setPrivData(VideoMaterialPrivDataUPtr p_privData)
+{
+	m_privData = std::move(p_privData);
+}
+
+
+VideoMaterialPrivData * VideoMaterial::getPrivData()
+{
+	return m_privData.get();
+}
+
+
+
+
+VideoMaterialProvider::VideoMaterialProvider(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, SupportedVideoFormats p_formats)
+	: m_glcontext(p_glcontext)
+	, m_texturePool(&p_texturePool)
+	, m_formats(std::move(p_formats))
+{
+}
+
+
+VideoMaterialProvider::~VideoMaterialProvider()
+{
+	for (GstContext *context : m_gstreamerContexts)
+		gst_context_unref(context);
+}
+
+
+VideoShaderProgram & VideoMaterialProvider::getShaderProgram(GstVideoFormat const p_format)
+{
+	return getShaderProgramForVariant(getShaderVariant(p_format));
+}
+
+
+void VideoMaterialProvider::unbindMaterial(VideoMaterial &p_videoMaterial)
+{
+	// Unbind in reverse order, to end up with texture unit #0 being active.
+	for (unsigned int i = p_videoMaterial.getShaderProgram().getNumTextures(); i > 0; --i)
+	{
+		m_glcontext->functions()->glActiveTexture(GL_TEXTURE0 + i - 1);
+		m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+
+VideoMaterial VideoMaterialProvider::createVideoMaterial()
+{
+	return VideoMaterial(*this, m_glcontext, *m_texturePool);
 }
 
 
@@ -408,86 +1098,261 @@ VideoMaterialProvider::SupportedVideoFormats const & VideoMaterialProvider::getS
 }
 
 
-int VideoMaterialProvider::getModelviewMatrixUniform() const
+char const * VideoMaterialProvider::getSinkCapsFeature() const
 {
-	return m_modelviewMatrixUniform;
+	return nullptr;
 }
 
 
-int VideoMaterialProvider::getModelviewprojMatrixUniform() const
+VideoMaterialProvider::GStreamerContexts const & VideoMaterialProvider::getGStreamerContexts() const
 {
-	return m_modelviewprojMatrixUniform;
+	return m_gstreamerContexts;
 }
 
 
-int VideoMaterialProvider::getVertexPositionAttrib() const
+bool VideoMaterialProvider::prefersDmaBufMemory() const
 {
-	return m_vertexPositionAttrib;
+	return false;
 }
 
 
-int VideoMaterialProvider::getVertexNormalAttrib() const
+bool VideoMaterialProvider::supportsThreadedUploads() const
 {
-	return m_vertexNormalAttrib;
+	return false;
 }
 
 
-int VideoMaterialProvider::getVertexTexcoordsAttrib() const
+GstBufferPool* VideoMaterialProvider::createUpstreamBufferPool()
 {
-	return m_vertexTexcoordsAttrib;
+	return nullptr;
 }
 
 
-void VideoMaterialProvider::bindMaterial(VideoMaterial &p_videoMaterial)
+void VideoMaterialProvider::serviceUpstreamBufferPools()
 {
-	m_glcontext->functions()->glActiveTexture(GL_TEXTURE0);
-	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, p_videoMaterial.getTextureId());
 }
 
 
-void VideoMaterialProvider::setVideoInfoChangedFlag(bool const)
+bool VideoMaterialProvider::supportsInstancedDrawing() const
 {
+	return false;
 }
 
 
-void VideoMaterialProvider::setShaderUniformValues(VideoMaterial &p_videoMaterial)
+VideoShaderProgram * VideoMaterialProvider::getInstancedShaderProgram(VideoShaderProgram &p_shaderProgram)
 {
-	// Calculate crop rectangle values for the shader based on the specified
-	// crop rectangle and the ratio between frame and total sizes.
-	//
-	// We need to skip the padding frame pixels and also make sure only
-	// the pixels in the crop rectangle are used. To that end, the crop
-	// rectangle's coordinates have to be transformed from the 0-100 to
-	// the 0.0-1.0 scale. Then it has to be shrunk by the frame/total
-	// size ratio, because the crop rectangle is specified in a coordinate
-	// space that does not include the padding pixels, but the texture
-	// coordinates are in a space that does include them.
+	if (!supportsInstancedDrawing())
+		return nullptr;
+
+	// Look up the variant of the given program. External textures
+	// cannot be copied into texture arrays, so the ExternalOES
+	// variant has no instanced counterpart.
+	auto variantIter = std::find_if(m_shaderPrograms.begin(), m_shaderPrograms.end(), [&](ShaderProgramMap::value_type const &p_entry) { return p_entry.second.get() == &p_shaderProgram; });
+	if ((variantIter == m_shaderPrograms.end()) || (variantIter->first == VideoShaderVariant::ExternalOES))
+		return nullptr;
+
+	VideoShaderVariant variant = variantIter->first;
+
+	// Like the regular programs, the instanced ones are created on
+	// demand. The binary cache exists already, since it was created
+	// together with the regular program.
+	ShaderProgramMap::iterator iter = m_instancedShaderPrograms.find(variant);
+	if (iter == m_instancedShaderPrograms.end())
+	{
+		qCDebug(lcQtGLVidDemo) << "Creating instanced shader program for variant" << int(variant);
+		VideoShaderProgramUPtr program(new VideoShaderProgram(getInstancedVertexShaderSource(), getInstancedFragmentShaderSource(variant), getNumTextures(variant), m_shaderProgramBinaryCache.get()));
+		iter = m_instancedShaderPrograms.emplace(variant, std::move(program)).first;
+	}
+
+	// If the driver failed to build the program, the
+	// materials have to be drawn one by one instead.
+	return iter->second->getProgram().isLinked() ? iter->second.get() : nullptr;
+}
+
+
+GstMapFlags VideoMaterialProvider::getFrameMapFlags() const
+{
+	return GST_MAP_READ;
+}
 
-	QRect const & cropRectangle = p_videoMaterial.getCropRectangle();
 
-	// Figure out the frame/total width/height ratio. These values are always
-	// less than or equal to 1.0.
-	float scaleW = float(p_videoMaterial.getFrameWidth()) / float(p_videoMaterial.getTotalWidth());
-	float scaleH = float(p_videoMaterial.getFrameHeight()) / float(p_videoMaterial.getTotalHeight());
+void VideoMaterialProvider::bindMaterial(VideoMaterial &p_videoMaterial)
+{
+	// Bind texture #N to texture unit #N. Bind in reverse order,
+	// to end up with texture unit #0 being active.
+	for (unsigned int i = p_videoMaterial.getShaderProgram().getNumTextures(); i > 0; --i)
+	{
+		m_glcontext->functions()->glActiveTexture(GL_TEXTURE0 + i - 1);
+		m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, p_videoMaterial.getTextureId(i - 1));
+	}
+}
 
-	// Transform the rectangle coordinates from the 0-100 to the 0.0-1.0 range.
-	float cw = std::min(cropRectangle.width() / 100.0f, 1.0f - cropRectangle.x() / 100.0f);
-	float ch = std::min(cropRectangle.height() / 100.0f, 1.0f - cropRectangle.y() / 100.0f);
-
-	// Calculate scaled rectangle coordinates to exclude padding pixels.
-	float x = (cropRectangle.x() / 100.0f) * scaleW;
-	float y = (cropRectangle.y() / 100.0f) * scaleW;
-	float w = cw * scaleW;
-	float h = ch * scaleH;
-
-	// Pass on the scaled coordinates to the crop rectangle shader uniform.
-	m_shaderProgram.setUniformValue(
-		m_cropRectangleUniform,
-		x, y, w, h
-	);
+
+void VideoMaterialProvider::setShaderUniformValues(VideoMaterial &p_videoMaterial)
+{
+	VideoShaderProgram &shaderProgram = p_videoMaterial.getShaderProgram();
+
+	// Pass on the crop rectangle in texture coordinates
+	// to the crop rectangle shader uniform.
+	shaderProgram.getProgram().setUniformValue(shaderProgram.getCropRectangleUniform(), p_videoMaterial.getShaderCropRectangle());
 
 	// Pass on the texture rotation matrix to the rotation uniform.
-	m_shaderProgram.setUniformValue(m_textureRotationMatrixUniform, p_videoMaterial.getTextureRotationMatrix());
+	shaderProgram.getProgram().setUniformValue(shaderProgram.getTextureRotationMatrixUniform(), p_videoMaterial.getTextureRotationMatrix());
+
+	// Pass on the YUV->RGB conversion coefficients. RGB shader variants
+	// do not have these uniforms; their IDs are -1 then, and Qt ignores
+	// setUniformValue() calls with such IDs.
+	shaderProgram.getProgram().setUniformValue(shaderProgram.getColorMatrixUniform(), p_videoMaterial.getColorMatrix());
+	shaderProgram.getProgram().setUniformValue(shaderProgram.getColorOffsetUniform(), p_videoMaterial.getColorOffset());
+}
+
+
+bool VideoMaterialProvider::uploadsCropRegionOnly() const
+{
+	return false;
+}
+
+
+VideoShaderVariant VideoMaterialProvider::getShaderVariant(GstVideoFormat const p_format) const
+{
+	switch (p_format)
+	{
+		case GST_VIDEO_FORMAT_I420:
+		case GST_VIDEO_FORMAT_YV12:
+		case GST_VIDEO_FORMAT_I420_10LE:
+			return VideoShaderVariant::ThreePlaneYUV;
+		case GST_VIDEO_FORMAT_NV12:
+		case GST_VIDEO_FORMAT_P010_10LE:
+			return VideoShaderVariant::TwoPlaneYUV;
+		case GST_VIDEO_FORMAT_NV21:
+			return VideoShaderVariant::TwoPlaneYVU;
+		case GST_VIDEO_FORMAT_YUY2:
+			return VideoShaderVariant::PackedYUY2;
+		case GST_VIDEO_FORMAT_UYVY:
+			return VideoShaderVariant::PackedUYVY;
+		case GST_VIDEO_FORMAT_BGRA:
+		case GST_VIDEO_FORMAT_BGRx:
+			return VideoShaderVariant::BGRA;
+		default:
+			return VideoShaderVariant::RGBA;
+	}
+}
+
+
+VideoShaderProgram & VideoMaterialProvider::getShaderProgramForVariant(VideoShaderVariant const p_variant)
+{
+	// Shader programs are created on demand, since usually,
+	// only a few of the variants are actually used.
+	ShaderProgramMap::iterator iter = m_shaderPrograms.find(p_variant);
+	if (iter == m_shaderPrograms.end())
+	{
+		if (!m_shaderProgramBinaryCache)
+			m_shaderProgramBinaryCache.reset(new ShaderProgramBinaryCache(m_glcontext));
+
+		qCDebug(lcQtGLVidDemo) << "Creating shader program for variant" << int(p_variant);
+		VideoShaderProgramUPtr program(new VideoShaderProgram(defaultVertexShaderSource, getFragmentShaderSource(p_variant), getNumTextures(p_variant), m_shaderProgramBinaryCache.get()));
+		iter = m_shaderPrograms.emplace(p_variant, std::move(program)).first;
+	}
+
+	return *(iter->second);
+}
+
+
+QString VideoMaterialProvider::getFragmentShaderSource(VideoShaderVariant const p_variant) const
+{
+	QString source;
+
+	// The extension directive must come before any non-preprocessor tokens.
+	if (p_variant == VideoShaderVariant::ExternalOES)
+	{
+		source += "#extension GL_OES_EGL_image_external : require\n";
+		source += "#define VIDEO_TEXTURE0_SAMPLER samplerExternalOES\n";
+	}
+	else
+		source += "#define VIDEO_TEXTURE0_SAMPLER sampler2D\n";
+
+	source += usesRGTextures() ? "#define SECOND_CHANNEL g\n" : "#define SECOND_CHANNEL a\n";
+	source += fragmentShaderDeclarationsSource;
+	source += "\n";
+
+	switch (p_variant)
+	{
+		case VideoShaderVariant::RGBA:
+		case VideoShaderVariant::ExternalOES:   source += fetchRGBASource; break;
+		case VideoShaderVariant::BGRA:          source += fetchBGRASource; break;
+		case VideoShaderVariant::ThreePlaneYUV: source += fetchThreePlaneYUVSource; break;
+		case VideoShaderVariant::TwoPlaneYUV:   source += fetchTwoPlaneYUVSource; break;
+		case VideoShaderVariant::TwoPlaneYVU:   source += fetchTwoPlaneYVUSource; break;
+		case VideoShaderVariant::PackedYUY2:    source += fetchPackedYUY2Source; break;
+		case VideoShaderVariant::PackedUYVY:    source += fetchPackedUYVYSource; break;
+	}
+
+	source += "\n";
+	source += fragmentShaderMainSource;
+
+	return source;
+}
+
+
+QString VideoMaterialProvider::getInstancedVertexShaderSource() const
+{
+	QString source = m_glcontext->isOpenGLES() ? "#version 300 es\n" : "#version 330\n";
+	source += instancedVertexShaderSource;
+	return source;
+}
+
+
+QString VideoMaterialProvider::getInstancedFragmentShaderSource(VideoShaderVariant const p_variant) const
+{
+	QString source = m_glcontext->isOpenGLES() ? "#version 300 es\n" : "#version 330\n";
+
+	// OpenGL ES fragment shaders have no default float precision.
+	source += "#ifdef GL_ES\n";
+	source += "precision highp float;\n";
+	source += "#endif\n";
+
+	// Let the fetchRGB() sources sample from the instance's layer.
+	source += "#define texture2D(s, uv) texture(s, vec3(uv, layerVariant))\n";
+	source += usesRGTextures() ? "#define SECOND_CHANNEL g\n" : "#define SECOND_CHANNEL a\n";
+	source += instancedFragmentShaderDeclarationsSource;
+	source += "\n";
+
+	switch (p_variant)
+	{
+		case VideoShaderVariant::RGBA:
+		case VideoShaderVariant::ExternalOES:   source += fetchRGBASource; break;
+		case VideoShaderVariant::BGRA:          source += fetchBGRASource; break;
+		case VideoShaderVariant::ThreePlaneYUV: source += fetchThreePlaneYUVSource; break;
+		case VideoShaderVariant::TwoPlaneYUV:   source += fetchTwoPlaneYUVSource; break;
+		case VideoShaderVariant::TwoPlaneYVU:   source += fetchTwoPlaneYVUSource; break;
+		case VideoShaderVariant::PackedYUY2:    source += fetchPackedYUY2Source; break;
+		case VideoShaderVariant::PackedUYVY:    source += fetchPackedUYVYSource; break;
+	}
+
+	source += "\n";
+	source += instancedFragmentShaderMainSource;
+
+	return source;
+}
+
+
+bool VideoMaterialProvider::usesRGTextures() const
+{
+	return false;
+}
+
+
+unsigned int VideoMaterialProvider::getNumTextures(VideoShaderVariant const p_variant)
+{
+	switch (p_variant)
+	{
+		case VideoShaderVariant::ThreePlaneYUV: return 3;
+		case VideoShaderVariant::TwoPlaneYUV:
+		case VideoShaderVariant::TwoPlaneYVU:
+		case VideoShaderVariant::PackedYUY2:
+		case VideoShaderVariant::PackedUYVY:    return 2;
+		default:                                return 1;
+	}
 }
 
 
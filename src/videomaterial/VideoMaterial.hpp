@@ -20,6 +20,8 @@
 #ifndef QTGLVIDDEMO_VIDEO_MATERIAL_HPP
 #define QTGLVIDDEMO_VIDEO_MATERIAL_HPP
 
+#include <map>
+#include <memory>
 #include <vector>
 #include <gst/gst.h>
 #include <gst/video/video.h>
@@ -27,6 +29,10 @@
 #include <QOpenGLShaderProgram>
 #include <QRectF>
 #include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include "ShaderProgramBinaryCache.hpp"
+#include "TexturePool.hpp"
 
 
 namespace qtglviddemo
@@ -36,16 +42,161 @@ namespace qtglviddemo
 class VideoMaterial;
 
 
+/**
+ * Shader variants for rendering video materials.
+ *
+ * The variants differ in how the fragment shader fetches texels from the
+ * video material textures and how these are turned into RGB values. Frames
+ * with YUV pixel formats are converted to RGB in the fragment shader.
+ */
+enum class VideoShaderVariant
+{
+	/// One RGBA texture.
+	RGBA,
+	/// One RGBA texture with the red and blue channels swapped (BGRA, BGRx).
+	BGRA,
+	/// Three single-channel textures (Y, U, V), for example I420 and YV12.
+	ThreePlaneYUV,
+	/// One single-channel Y texture plus one two-channel UV texture (NV12).
+	TwoPlaneYUV,
+	/// One single-channel Y texture plus one two-channel VU texture (NV21).
+	TwoPlaneYVU,
+	/// Packed 4:2:2 YUV, with Y in the first byte of each pixel (YUY2).
+	PackedYUY2,
+	/// Packed 4:2:2 YUV, with Y in the second byte of each pixel (UYVY).
+	PackedUYVY,
+	/**
+	 * One external texture (GL_TEXTURE_EXTERNAL_OES), typically backed by
+	 * an EGLImage. The driver takes care of any YUV->RGB conversion.
+	 * Requires the GL_OES_EGL_image_external extension.
+	 */
+	ExternalOES
+};
+
+
+/**
+ * OpenGL shader program used for rendering video materials.
+ *
+ * This contains the QOpenGLShaderProgram and the IDs of the uniforms and
+ * vertex attributes the renderer and the video material provider need. There
+ * is one instance per shader variant. Instances are created on demand by the
+ * VideoMaterialProvider.
+ */
+class VideoShaderProgram
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * Compiles and links the program. If a binary cache is given, and it
+	 * contains a binary of the program, that binary is loaded instead.
+	 * Otherwise, the newly linked program's binary is stored in the cache.
+	 * The OpenGL context must be valid when this is called.
+	 *
+	 * @param p_vertexShaderSource GLSL source of the vertex shader.
+	 * @param p_fragmentShaderSource GLSL source of the fragment shader.
+	 * @param p_numTextures Number of textures the fragment shader samples from.
+	 * @param p_binaryCache Program binary cache to use. Can be null.
+	 */
+	explicit VideoShaderProgram(QString const &p_vertexShaderSource, QString const &p_fragmentShaderSource, unsigned int const p_numTextures, ShaderProgramBinaryCache *p_binaryCache = nullptr);
+
+	/// Returns the underlying Qt shader program.
+	QOpenGLShaderProgram& getProgram();
+	/// Returns the number of textures the fragment shader samples from.
+	unsigned int getNumTextures() const;
+
+	// Shader uniform IDs for material uniforms.
+	int getCropRectangleUniform() const;
+	int getTextureRotationMatrixUniform() const;
+	int getColorMatrixUniform() const;
+	int getColorOffsetUniform() const;
+
+	// Shader uniform IDs for matrix uniforms.
+	int getModelviewMatrixUniform() const;
+	int getModelviewprojMatrixUniform() const;
+
+	// Shader uniform ID for the opacity the output is multiplied with.
+	int getOpacityUniform() const;
+
+	// IDs for vertex attributes.
+	int getVertexPositionAttrib() const;
+	int getVertexNormalAttrib() const;
+	int getVertexTexcoordsAttrib() const;
+
+	// IDs for per-instance vertex attributes. Only programs for
+	// instanced drawing have these (see
+	// VideoMaterialProvider::getInstancedShaderProgram()).
+	// In other programs, the IDs are -1.
+	int getInstanceModelviewprojMatrixAttrib() const;
+	int getInstanceNormalMatrixAttrib() const;
+	int getInstanceCropRectangleAttrib() const;
+	int getInstanceTextureRotationAttrib() const;
+	int getInstanceClipRectangleAttrib() const;
+	int getInstanceDepthRangeAttrib() const;
+	int getInstanceLayerAttrib() const;
+
+	/// VideoShaderProgram is neither copyable nor movable.
+	VideoShaderProgram(VideoShaderProgram const &) = delete;
+	VideoShaderProgram& operator = (VideoShaderProgram const &) = delete;
+
+
+private:
+	QOpenGLShaderProgram m_program;
+	unsigned int m_numTextures;
+
+	int m_cropRectangleUniform;
+	int m_textureRotationMatrixUniform;
+	int m_colorMatrixUniform;
+	int m_colorOffsetUniform;
+
+	int m_modelviewMatrixUniform;
+	int m_modelviewprojMatrixUniform;
+	int m_opacityUniform;
+	int m_vertexPositionAttrib;
+	int m_vertexNormalAttrib;
+	int m_vertexTexcoordsAttrib;
+
+	int m_instanceModelviewprojMatrixAttrib;
+	int m_instanceNormalMatrixAttrib;
+	int m_instanceCropRectangleAttrib;
+	int m_instanceTextureRotationAttrib;
+	int m_instanceClipRectangleAttrib;
+	int m_instanceDepthRangeAttrib;
+	int m_instanceLayerAttrib;
+};
+
+typedef std::unique_ptr < VideoShaderProgram > VideoShaderProgramUPtr;
+
+
+/**
+ * Base class for provider specific per-material data.
+ *
+ * Providers that need to keep state for each video material (for example,
+ * additional OpenGL objects) subclass this, and attach instances to video
+ * materials in their createVideoMaterial() implementation. The data is
+ * destroyed together with the video material, so the OpenGL context must
+ * be valid at that point.
+ */
+struct VideoMaterialPrivData
+{
+	virtual ~VideoMaterialPrivData();
+};
+
+typedef std::unique_ptr < VideoMaterialPrivData > VideoMaterialPrivDataUPtr;
+
+
 // Private interface between video material and video material provider.
 struct VideoMaterialPrivIFace
 {
 public:
 	virtual ~VideoMaterialPrivIFace();
+	virtual VideoShaderProgram & getShaderProgram(GstVideoFormat const p_format) = 0;
+	virtual GstMapFlags getFrameMapFlags() const = 0;
 	virtual void bindMaterial(VideoMaterial &p_videoMaterial) = 0;
-	virtual void unbindTexture() = 0;
-	virtual void setVideoInfoChangedFlag(bool const p_flag) = 0;
+	virtual void unbindMaterial(VideoMaterial &p_videoMaterial) = 0;
 	virtual void setShaderUniformValues(VideoMaterial &p_videoMaterial) = 0;
 	virtual void uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe) = 0;
+	virtual bool uploadsCropRegionOnly() const = 0;
 };
 
 
@@ -89,6 +240,13 @@ public:
  * Default crop rectangle is x 0 y 0 width 100 height 100. Default texture rotation
  * angle is 0.
  *
+ * Frames can consist of multiple planes (for example, I420 frames have one Y, one U,
+ * and one V plane). For this reason, the video material has up to MaxNumTextures
+ * textures. How many of these are actually used depends on the shader variant the
+ * provider picks for the pixel format from the GstVideoInfo. If the format is a YUV
+ * format, the YUV->RGB conversion is done in the fragment shader, using a color
+ * matrix that is derived from the colorimetry in the GstVideoInfo.
+ *
  * The video material has "frame" width/height and "total" width/height. The difference
  * is that the latter include padding colums/rows, the former doesn't. Padding rows
  * and columsn are typically added to video frames when video codecs require width
@@ -108,6 +266,9 @@ public:
 class VideoMaterial
 {
 public:
+	/// Maximum number of textures (one per plane) a video material can use.
+	static constexpr unsigned int MaxNumTextures = 3;
+
 	/**
 	 * Default constructor.
 	 *
@@ -128,8 +289,10 @@ public:
 	 *
 	 * @param p_privIFace Interface to a video material provider.
 	 * @param p_glcontext Qt OpenGL context object pointer. Must not be null.
+	 * @param p_texturePool Pool to acquire textures from and release
+	 *        textures to. Must outlive the video material.
 	 */
-	explicit VideoMaterial(VideoMaterialPrivIFace &p_privIFace, QOpenGLContext *p_glcontext);
+	explicit VideoMaterial(VideoMaterialPrivIFace &p_privIFace, QOpenGLContext *p_glcontext, TexturePool &p_texturePool);
 	/// Move constructor.
 	VideoMaterial(VideoMaterial && p_other);
 	/**
@@ -169,13 +332,30 @@ public:
 	 * The provider's OpenGL context must be valid when this is called.
 	 */
 	void unbind();
+	/**
+	 * Uploads the current frame again if necessary.
+	 *
+	 * If the provider only uploads the cropped region of the frames, and
+	 * the crop rectangle changed since the current frame was uploaded,
+	 * the textures do not contain the pixels that are now visible. This
+	 * function uploads the frame again in that case. bind() calls this.
+	 * Callers that use the textures without binding the material (for
+	 * example, to copy their contents) have to call it themselves.
+	 *
+	 * The provider's OpenGL context must be valid when this is called.
+	 */
+	void updateTextures();
 
 	/**
 	 * Defines the format of the video material's texture.
 	 *
 	 * The given GStreamer GstVideoInfo structure contains the width, height,
 	 * row stride, plane offsets, and pixel format the texture must use. The
-	 * Other GstVideoInfo fields are ignored.
+	 * colorimetry is used for picking the YUV->RGB conversion matrix. The
+	 * other GstVideoInfo fields are ignored.
+	 *
+	 * This also selects the shader program variant that is suitable for
+	 * the pixel format.
 	 *
 	 * Note that the values in the video info might be overridden if a
 	 * GstBuffer passed to setVideoGstbuffer() contains GstVideoMeta metadata.
@@ -187,6 +367,8 @@ public:
 	 * @param p_videoInfo GstVideoInfo containing the format information.
 	 */
 	void setVideoInfo(GstVideoInfo p_videoInfo);
+	/// Returns the video info that was set by setVideoInfo().
+	GstVideoInfo const & getVideoInfo() const;
 
 	/**
 	 * Set the GstBuffer containing the video frame to be rendered.
@@ -197,7 +379,8 @@ public:
 	 * You must call setVideoInfo() prior to calling this, otherwise there
 	 * won't be an allocated texture to fill pixels into (or associate with).
 	 * This also means that the provider's OpenGL context must be valid
-	 * when this is called.
+	 * when this is called. (If the provider supports threaded uploads,
+	 * a context that shares resources with it suffices.)
 	 *
 	 * @param p_buffer Pointer to the GstBuffer. Must not be null.
 	 */
@@ -216,12 +399,42 @@ public:
 	 * by the setShaderUniformValues() call. The valid range of the
 	 * integer coordinates is 0-100.
 	 *
+	 * If the provider only uploads the cropped region of the frames, and
+	 * no upload crop rectangle is set, the current frame is uploaded again
+	 * by the next bind() call, since the textures do not contain the
+	 * pixels of the new crop region yet.
+	 *
 	 * @param p_cropRectangle Crop rectangle to use.
 	 */
 	void setCropRectangle(QRect p_cropRectangle);
 	/// Returns the currently used crop rectangle.
 	QRect const & getCropRectangle() const;
 
+	/**
+	 * Sets the crop rectangle that determines which region gets uploaded.
+	 *
+	 * This is only relevant if the provider only uploads the cropped
+	 * region of the frames. By default, this is a null rectangle, and
+	 * the region inside the crop rectangle is uploaded. Materials that
+	 * are drawn with several crop rectangles set this to a rectangle
+	 * which contains all of them. Then, changing the crop rectangle
+	 * does not require uploading the frame again, as long as the new
+	 * one is inside the upload crop rectangle.
+	 *
+	 * If the upload crop rectangle changes, the current frame is
+	 * uploaded again by the next bind() call.
+	 *
+	 * @param p_uploadCropRectangle Upload crop rectangle to use,
+	 *        in the same 0-100 range as the crop rectangle.
+	 */
+	void setUploadCropRectangle(QRect p_uploadCropRectangle);
+	/**
+	 * Returns the crop rectangle that determines which region gets uploaded.
+	 *
+	 * This is the crop rectangle if no upload crop rectangle is set.
+	 */
+	QRect const & getUploadCropRectangle() const;
+
 	/**
 	 * Sets the texture rotation angle.
 	 *
@@ -240,6 +453,15 @@ public:
 	 * Default value is the identity matrix.
 	 */
 	QMatrix2x2 const & getTextureRotationMatrix() const;
+	/**
+	 * Returns the crop rectangle in texture coordinates.
+	 *
+	 * The crop rectangle is transformed into the 0.0-1.0 texture coordinate
+	 * space of the region the textures contain (see setUploadRectangle()).
+	 * x and y are the top left corner, z and w are the width and height.
+	 * This is the value of the crop rectangle shader uniform.
+	 */
+	QVector4D getShaderCropRectangle() const;
 
 	/**
 	 * Returns the current frame width.
@@ -270,15 +492,107 @@ public:
 	 * GstVideoMeta metadata, by setVideoGstbuffer().
 	 */
 	guint getTotalHeight() const;
+	/**
+	 * Overrides the total sizes calculated by setVideoGstbuffer().
+	 *
+	 * Only providers call this from their uploadGstFrame() implementation,
+	 * for example if the frame is not uploaded into textures whose sizes
+	 * include the padding pixels.
+	 */
+	void setTotalSizes(guint const p_totalWidth, guint const p_totalHeight);
 
 	/**
-	 * Get the ID (or "name" in OpenGL jargon) of the allocated OpenGL
-	 * texture.
+	 * Sets the region of the frame that the textures contain.
+	 *
+	 * Only providers call this from their uploadGstFrame() implementation
+	 * if they upload just a part of the frame. The rectangle is given in
+	 * pixel coordinates of the first component (the Y component in YUV
+	 * formats). The textures are expected to contain exactly this region,
+	 * without any padding pixels. A null rectangle means that the textures
+	 * contain the whole frame including padding pixels, that is, the
+	 * region is 0,0 - getTotalWidth(),getTotalHeight(). This is the default.
+	 */
+	void setUploadRectangle(QRect p_uploadRectangle);
+	/// Returns the region of the frame that the textures contain.
+	QRect const & getUploadRectangle() const;
+
+	/**
+	 * Get the ID (or "name" in OpenGL jargon) of one of the allocated
+	 * OpenGL textures.
 	 *
 	 * This ID is 0 if the video material was created by the default
 	 * constructor, nonzero otherwise.
+	 *
+	 * @param p_index Index of the texture. Must be less than MaxNumTextures.
 	 */
-	GLuint getTextureId() const;
+	GLuint getTextureId(unsigned int const p_index = 0) const;
+	/**
+	 * Makes sure one of the textures has the given size and format.
+	 *
+	 * Only providers call this from their uploadGstFrame() implementation.
+	 * If the texture's current format differs, the texture is released to
+	 * the texture pool, and a texture with the given format is acquired
+	 * from it. Its ID is then returned by getTextureId(). The contents of
+	 * the texture are undefined afterwards. If the format does not differ,
+	 * this does nothing. Passing a default constructed format releases the
+	 * texture's storage.
+	 *
+	 * Initially, all textures have no storage.
+	 *
+	 * @param p_index Index of the texture. Must be less than MaxNumTextures.
+	 * @param p_format New size and format of the texture.
+	 */
+	void setTextureFormat(unsigned int const p_index, TexturePool::TextureFormat const &p_format);
+	/// Returns the size and format of one of the textures.
+	TexturePool::TextureFormat const & getTextureFormat(unsigned int const p_index = 0) const;
+	/**
+	 * Returns a number that identifies the current contents of the textures.
+	 *
+	 * Every upload assigns a new serial that is unique among all video
+	 * materials. Callers that keep copies of the texture contents can
+	 * compare serials to check if their copies are still up to date.
+	 * The serial is 0 if nothing has been uploaded yet.
+	 */
+	guint64 getContentSerial() const;
+
+	/**
+	 * Returns the shader program to use for rendering this video material.
+	 *
+	 * Which program is returned depends on the pixel format of the video
+	 * info that was passed to setVideoInfo().
+	 */
+	VideoShaderProgram & getShaderProgram();
+	/**
+	 * Overrides the shader program selected by setVideoInfo().
+	 *
+	 * Only providers call this, for example if they render frames with
+	 * different shader variants depending on the frame's memory type.
+	 */
+	void setShaderProgram(VideoShaderProgram &p_shaderProgram);
+
+	/**
+	 * Returns the YUV->RGB color matrix.
+	 *
+	 * The shader computes RGB values out of YUV ones with:
+	 *
+	 *   rgb = colorMatrix * (yuv - colorOffset)
+	 *
+	 * This matrix is calculated in setVideoInfo(). For RGB formats, it
+	 * is not used.
+	 */
+	QMatrix3x3 const & getColorMatrix() const;
+	/// Returns the YUV offset vector (see getColorMatrix()).
+	QVector3D const & getColorOffset() const;
+
+	/**
+	 * Attaches provider specific data to this video material.
+	 *
+	 * Any previously attached data is destroyed first. Only providers
+	 * call this (see VideoMaterialPrivData).
+	 */
+	void setPrivData(VideoMaterialPrivDataUPtr p_privData);
+	/// Returns the attached provider specific data, or null if there is none.
+	VideoMaterialPrivData * getPrivData();
 
 
 	/// VideoMaterial is movable but not copyable.
@@ -287,20 +601,34 @@ public:
 
 
 private:
+	void uploadCurrentBuffer();
+
 	VideoMaterialPrivIFace *m_privIFace;
 	QOpenGLContext *m_glcontext;
+	TexturePool *m_texturePool;
+	VideoShaderProgram *m_shaderProgram;
 
-	GLuint m_textureId;
+	GLuint m_textureIds[MaxNumTextures];
+	TexturePool::TextureFormat m_textureFormats[MaxNumTextures];
 	GstBuffer *m_curBuffer;
 
 	GstVideoInfo m_videoInfo;
 	guint m_frameWidth, m_frameHeight;
 	guint m_totalWidth, m_totalHeight;
+	QRect m_uploadRectangle;
+	bool m_reuploadNeeded;
+	guint64 m_contentSerial;
 
 	QRect m_cropRectangle;
+	QRect m_uploadCropRectangle;
 	int m_textureRotation;
 
 	QMatrix2x2 m_textureRotationMatrix;
+
+	QMatrix3x3 m_colorMatrix;
+	QVector3D m_colorOffset;
+
+	VideoMaterialPrivDataUPtr m_privData;
 };
 
 
@@ -308,8 +636,10 @@ private:
  * Class for providing video material instances and accompanying shaders and states.
  *
  * This is the class to use for creating video material instances. It also contains
- * the OpenGL shaders that are used for rendering, and provides shader uniform IDs
- * for setting shader uniform values.
+ * the OpenGL shaders that are used for rendering. There is one shader program per
+ * shader variant; these are created on demand, the first time a video material
+ * with a pixel format that requires the variant is set up. The shader programs
+ * provide the shader uniform IDs for setting shader uniform values.
  *
  * Only one instance of the video material provider is necessary per OpenGL context.
  * To support different video streams rendered as OpenGL texture, call
@@ -323,15 +653,29 @@ class VideoMaterialProvider
 {
 public:
 	typedef std::vector < GstVideoFormat > SupportedVideoFormats;
+	typedef std::vector < GstContext* > GStreamerContexts;
+
+	virtual ~VideoMaterialProvider();
 
 	/**
-	 * Unbinds the texture currently bound to the OpenGL context.
+	 * Returns the shader program to use for frames of the given format.
 	 *
-	 * Don't call this directly. Use VideoMaterial::bind() instead.
+	 * Don't call this directly. Use VideoMaterial::getShaderProgram() instead.
 	 *
-	 * Default implementation calls glBindTexture() with texture ID 0.
+	 * If the program for the corresponding shader variant does not exist
+	 * yet, it is created. The provider's OpenGL context must be valid when
+	 * this is called.
 	 */
-	virtual void unbindTexture() override;
+	virtual VideoShaderProgram & getShaderProgram(GstVideoFormat const p_format) override;
+	/**
+	 * Unbinds the textures of the given material from the OpenGL context.
+	 *
+	 * Don't call this directly. Use VideoMaterial::unbind() instead.
+	 *
+	 * Default implementation calls glBindTexture() with texture ID 0 for
+	 * each texture unit the material's shader program uses.
+	 */
+	virtual void unbindMaterial(VideoMaterial &p_videoMaterial) override;
 	/**
 	 * Creates a video material instance, associated with this provider.
 	 *
@@ -341,11 +685,6 @@ public:
 	 */
 	virtual VideoMaterial createVideoMaterial();
 
-	/**
-	 * Returns the OpenGL shader program to use for rendering with
-	 * video materials associated with this provider.
-	 */
-	QOpenGLShaderProgram& getShaderProgram();
 	/**
 	 * Returns a list of GStreamer video formats that can be used
 	 * for uploading to video material textures.
@@ -358,36 +697,170 @@ public:
 	 * This list must not be empty.
 	 */
 	SupportedVideoFormats const & getSupportedVideoFormats() const;
-
-	// Shader uniform IDs for matrix uniforms.
-	int getModelviewMatrixUniform() const;
-	int getModelviewprojMatrixUniform() const;
-
-	// IDs for vertex attributes.
-	int getVertexPositionAttrib() const;
-	int getVertexNormalAttrib() const;
-	int getVertexTexcoordsAttrib() const;
+	/**
+	 * Returns the caps feature the frames passed to the video material's
+	 * setVideoGstbuffer() call must have.
+	 *
+	 * This is used together with getSupportedVideoFormats() for setting
+	 * up format restrictions in media players. The default implementation
+	 * returns null, meaning that frames must be in system memory.
+	 */
+	virtual char const * getSinkCapsFeature() const;
+	/**
+	 * Returns GStreamer contexts that have to be set on the elements
+	 * which produce the frames for this provider.
+	 *
+	 * Some providers need to share resources such as the OpenGL context
+	 * with the player's pipeline. They do this through GstContext objects.
+	 * The default implementation returns an empty list. This function does
+	 * not transfer ownership over the contexts to the caller.
+	 */
+	virtual GStreamerContexts const & getGStreamerContexts() const;
+	/**
+	 * Returns true if frames should preferably be stored in DMA-BUF memory.
+	 *
+	 * Players can use this to configure sources and decoders to export
+	 * DMA-BUFs instead of copying frames into system memory. Unlike the
+	 * caps feature, this is just a preference; frames in system memory
+	 * must still be supported. The default implementation returns false.
+	 */
+	virtual bool prefersDmaBufMemory() const;
+	/**
+	 * Returns true if frames can be uploaded into video materials by a
+	 * thread other than the render thread.
+	 *
+	 * If this returns true, setVideoGstbuffer() may be called in a thread
+	 * whose current OpenGL context shares resources with the provider's
+	 * context, as long as no other call is made on the same video material
+	 * at the same time. All other video material functions still have to
+	 * be called with the provider's context. See FrameUploadThread. The
+	 * default implementation returns false.
+	 */
+	virtual bool supportsThreadedUploads() const;
+	/**
+	 * Creates a buffer pool that players shall propose to upstream elements.
+	 *
+	 * Providers that can upload frames faster if these are in specific
+	 * memory (for example, mapped pixel buffer objects) create pools that
+	 * allocate such memory. This is called from GStreamer streaming threads.
+	 * The default implementation returns null, meaning that no pool is
+	 * proposed.
+	 *
+	 * @return New buffer pool, or null. The caller owns the reference.
+	 */
+	virtual GstBufferPool* createUpstreamBufferPool();
+	/**
+	 * Does work for the pools from createUpstreamBufferPool() that
+	 * requires the provider's OpenGL context.
+	 *
+	 * This must be called regularly in the render thread, with the
+	 * provider's context being current. The default implementation
+	 * does nothing.
+	 */
+	virtual void serviceUpstreamBufferPools();
+	/**
+	 * Returns true if video materials of this provider can be drawn
+	 * with instanced draw calls.
+	 *
+	 * Instanced drawing samples from texture arrays the caller fills
+	 * with copies of the material textures (see VideoTextureArray),
+	 * so the textures must be regular 2D textures that are owned by
+	 * the material. Also, OpenGL ES 3.0 or OpenGL 3.3 is required.
+	 * The default implementation returns false.
+	 */
+	virtual bool supportsInstancedDrawing() const;
+	/**
+	 * Returns the shader program for drawing video materials that use
+	 * p_shaderProgram with one instanced draw call.
+	 *
+	 * The program samples from GL_TEXTURE_2D_ARRAY textures, one per
+	 * plane, with one layer per material. Everything that differs between
+	 * the materials and the objects they are drawn on is passed through
+	 * the per-instance vertex attributes (see VideoShaderProgram). The
+	 * color matrix and offset uniforms are shared by all instances.
+	 *
+	 * If the program does not exist yet, it is created. The provider's
+	 * OpenGL context must be valid when this is called.
+	 *
+	 * @return The instanced program, or null if instanced drawing is not
+	 *         supported, or not possible with the shader variant of
+	 *         p_shaderProgram (for example, with external textures).
+	 */
+	VideoShaderProgram * getInstancedShaderProgram(VideoShaderProgram &p_shaderProgram);
 
 
 protected:
-	VideoMaterialProvider(QOpenGLContext *p_glcontext, SupportedVideoFormats p_formats, QString const &p_vertexShaderSource = "", QString const &p_fragmentShaderSource = "");
+	VideoMaterialProvider(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, SupportedVideoFormats p_formats);
 
+	/**
+	 * Returns the flags to use for mapping frames prior to the
+	 * uploadGstFrame() call. The default implementation returns
+	 * GST_MAP_READ.
+	 */
+	virtual GstMapFlags getFrameMapFlags() const override;
 	virtual void bindMaterial(VideoMaterial &p_videoMaterial) override;
-	virtual void setVideoInfoChangedFlag(bool const p_flag) override;
 	virtual void setShaderUniformValues(VideoMaterial &p_videoMaterial) override;
+	/**
+	 * Returns true if uploadGstFrame() only uploads the part of the frame
+	 * that is inside the crop rectangle. Video materials then upload their
+	 * current frame again if the crop rectangle changes. The default
+	 * implementation returns false.
+	 */
+	virtual bool uploadsCropRegionOnly() const override;
 
-	QOpenGLContext *m_glcontext;
-	QOpenGLShaderProgram m_shaderProgram;
-	SupportedVideoFormats m_formats;
+	/**
+	 * Returns the shader variant to use for frames of the given format.
+	 *
+	 * The default implementation picks the variant that converts the
+	 * format to RGB in the fragment shader. GST_VIDEO_FORMAT_UNKNOWN
+	 * and RGB formats map to VideoShaderVariant::RGBA. Subclasses that
+	 * let the GPU convert the pixels by other means can override this.
+	 */
+	virtual VideoShaderVariant getShaderVariant(GstVideoFormat const p_format) const;
+	/**
+	 * Returns the shader program for the given shader variant.
+	 *
+	 * If the program does not exist yet, it is created. The provider's
+	 * OpenGL context must be valid when this is called.
+	 */
+	VideoShaderProgram & getShaderProgramForVariant(VideoShaderVariant const p_variant);
+	/**
+	 * Returns the GLSL source of the fragment shader for the given variant.
+	 *
+	 * The default implementation produces sources that sample from
+	 * regular 2D textures. Two-channel textures are expected to have
+	 * their second channel in the alpha component (GL_LUMINANCE_ALPHA)
+	 * unless p_useRGTextures is true, in which case the second channel
+	 * is expected in the green component (GL_RG).
+	 */
+	virtual QString getFragmentShaderSource(VideoShaderVariant const p_variant) const;
+	/**
+	 * Returns the GLSL sources of the vertex and fragment shaders that
+	 * draw the given variant with instancing. These are GLSL ES 3.00
+	 * or GLSL 3.30 sources, depending on the OpenGL context.
+	 */
+	QString getInstancedVertexShaderSource() const;
+	QString getInstancedFragmentShaderSource(VideoShaderVariant const p_variant) const;
+	/**
+	 * Returns true if two-channel textures are GL_RG textures instead
+	 * of GL_LUMINANCE_ALPHA ones. Default implementation returns false.
+	 */
+	virtual bool usesRGTextures() const;
 
-	int m_cropRectangleUniform;
-	int m_textureRotationMatrixUniform;
+	/// Returns the number of textures that the given shader variant samples from.
+	static unsigned int getNumTextures(VideoShaderVariant const p_variant);
 
-	int m_modelviewMatrixUniform;
-	int m_modelviewprojMatrixUniform;
-	int m_vertexPositionAttrib;
-	int m_vertexNormalAttrib;
-	int m_vertexTexcoordsAttrib;
+	QOpenGLContext *m_glcontext;
+	TexturePool *m_texturePool;
+	SupportedVideoFormats m_formats;
+	GStreamerContexts m_gstreamerContexts;
+
+	typedef std::map < VideoShaderVariant, VideoShaderProgramUPtr > ShaderProgramMap;
+	ShaderProgramMap m_shaderPrograms;
+	ShaderProgramMap m_instancedShaderPrograms;
+	// Created along with the first shader program, since
+	// it needs a current OpenGL context.
+	std::unique_ptr < ShaderProgramBinaryCache > m_shaderProgramBinaryCache;
 };
 
 
@@ -0,0 +1,459 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <gst/allocators/gstdmabuf.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "VideoMaterialProviderDmaBuf.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// Use our own definitions to make sure they are available
+// no matter how old the EGL and GL headers are.
+
+#ifndef EGL_LINUX_DMA_BUF_EXT
+#define EGL_LINUX_DMA_BUF_EXT          0x3270
+#define EGL_LINUX_DRM_FOURCC_EXT       0x3271
+#define EGL_DMA_BUF_PLANE0_FD_EXT      0x3272
+#define EGL_DMA_BUF_PLANE0_OFFSET_EXT  0x3273
+#define EGL_DMA_BUF_PLANE0_PITCH_EXT   0x3274
+#define EGL_DMA_BUF_PLANE1_FD_EXT      0x3275
+#define EGL_DMA_BUF_PLANE1_OFFSET_EXT  0x3276
+#define EGL_DMA_BUF_PLANE1_PITCH_EXT   0x3277
+#define EGL_DMA_BUF_PLANE2_FD_EXT      0x3278
+#define EGL_DMA_BUF_PLANE2_OFFSET_EXT  0x3279
+#define EGL_DMA_BUF_PLANE2_PITCH_EXT   0x327A
+#define EGL_YUV_COLOR_SPACE_HINT_EXT   0x327B
+#define EGL_SAMPLE_RANGE_HINT_EXT      0x327C
+#define EGL_ITU_REC601_EXT             0x327F
+#define EGL_ITU_REC709_EXT             0x3280
+#define EGL_ITU_REC2020_EXT            0x3281
+#define EGL_YUV_FULL_RANGE_EXT         0x3282
+#define EGL_YUV_NARROW_RANGE_EXT       0x3283
+#endif
+
+#ifndef GL_TEXTURE_EXTERNAL_OES
+#define GL_TEXTURE_EXTERNAL_OES        0x8D65
+#endif
+
+
+// DRM fourcc codes, as defined in the Linux drm_fourcc.h header.
+// Defined here to avoid a dependency on the libdrm headers.
+
+#define QTGLVIDDEMO_FOURCC(a, b, c, d) (EGLint(a) | (EGLint(b) << 8) | (EGLint(c) << 16) | (EGLint(d) << 24))
+
+#define DRM_FORMAT_YUV420   QTGLVIDDEMO_FOURCC('Y', 'U', '1', '2')
+#define DRM_FORMAT_YVU420   QTGLVIDDEMO_FOURCC('Y', 'V', '1', '2')
+#define DRM_FORMAT_NV12     QTGLVIDDEMO_FOURCC('N', 'V', '1', '2')
+#define DRM_FORMAT_NV21     QTGLVIDDEMO_FOURCC('N', 'V', '2', '1')
+#define DRM_FORMAT_YUYV     QTGLVIDDEMO_FOURCC('Y', 'U', 'Y', 'V')
+#define DRM_FORMAT_UYVY     QTGLVIDDEMO_FOURCC('U', 'Y', 'V', 'Y')
+#define DRM_FORMAT_ABGR8888 QTGLVIDDEMO_FOURCC('A', 'B', '2', '4')
+#define DRM_FORMAT_XBGR8888 QTGLVIDDEMO_FOURCC('X', 'B', '2', '4')
+#define DRM_FORMAT_ARGB8888 QTGLVIDDEMO_FOURCC('A', 'R', '2', '4')
+#define DRM_FORMAT_XRGB8888 QTGLVIDDEMO_FOURCC('X', 'R', '2', '4')
+
+
+typedef void (KHRONOS_APIENTRY *PFNQTGLVIDDEMOEGLIMAGETARGETTEXTURE2DOESPROC) (GLenum target, void *image);
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * EGL and OpenGL extension functions needed for DMA-BUF import.
+ */
+struct DmaBufImportFuncs
+{
+	EGLDisplay m_eglDisplay;
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
+	PFNQTGLVIDDEMOEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
+};
+
+
+namespace
+{
+
+
+// Maximum number of EGLImages to cache per video material.
+// Buffer pools usually contain far fewer buffers than this.
+// If the limit is exceeded, frames are probably not coming
+// from a pool, and caching is pointless; the cache is then
+// cleared to avoid accumulating EGLImages indefinitely.
+constexpr std::size_t MaxNumCachedImages = 32;
+
+
+EGLint toDrmFourcc(GstVideoFormat const p_format)
+{
+	switch (p_format)
+	{
+		case GST_VIDEO_FORMAT_I420: return DRM_FORMAT_YUV420;
+		case GST_VIDEO_FORMAT_YV12: return DRM_FORMAT_YVU420;
+		case GST_VIDEO_FORMAT_NV12: return DRM_FORMAT_NV12;
+		case GST_VIDEO_FORMAT_NV21: return DRM_FORMAT_NV21;
+		case GST_VIDEO_FORMAT_YUY2: return DRM_FORMAT_YUYV;
+		case GST_VIDEO_FORMAT_UYVY: return DRM_FORMAT_UYVY;
+		case GST_VIDEO_FORMAT_RGBA: return DRM_FORMAT_ABGR8888;
+		case GST_VIDEO_FORMAT_RGBx: return DRM_FORMAT_XBGR8888;
+		case GST_VIDEO_FORMAT_BGRA: return DRM_FORMAT_ARGB8888;
+		case GST_VIDEO_FORMAT_BGRx: return DRM_FORMAT_XRGB8888;
+		default: return 0;
+	}
+}
+
+
+// An EGLImage created out of a DMA-BUF, and the
+// external texture the EGLImage is bound to.
+struct DmaBufImage
+{
+	// Inode of the DMA-BUF. File descriptor numbers can be
+	// reused after a DMA-BUF is closed, so the inode is used
+	// for detecting stale cache entries.
+	ino_t m_inode;
+	EGLImageKHR m_eglImage;
+	GLuint m_textureId;
+};
+
+
+// Per-material data.
+struct DmaBufMaterialData
+	: public VideoMaterialPrivData
+{
+	DmaBufMaterialData(QOpenGLContext *p_glcontext, DmaBufImportFuncs const &p_importFuncs)
+		: m_glcontext(p_glcontext)
+		, m_importFuncs(p_importFuncs)
+		, m_currentTextureId(0)
+		, m_importFailed(false)
+	{
+		gst_video_info_init(&m_videoInfo);
+	}
+
+	~DmaBufMaterialData()
+	{
+		clearImages();
+	}
+
+	void clearImages()
+	{
+		for (auto const & entry : m_images)
+		{
+			m_glcontext->functions()->glDeleteTextures(1, &(entry.second.m_textureId));
+			m_importFuncs.eglDestroyImageKHR(m_importFuncs.m_eglDisplay, entry.second.m_eglImage);
+		}
+		m_images.clear();
+		m_currentTextureId = 0;
+	}
+
+	QOpenGLContext *m_glcontext;
+	DmaBufImportFuncs const &m_importFuncs;
+
+	// Cached images, keyed by the file descriptor of the
+	// DMA-BUF containing the first plane.
+	std::map < int, DmaBufImage > m_images;
+	// The video info the cached images were created for.
+	GstVideoInfo m_videoInfo;
+	// External texture to use for rendering, or 0 if the
+	// current frame was uploaded into the regular textures.
+	GLuint m_currentTextureId;
+	// Set to true if creating an EGLImage failed. Used for
+	// logging the fallback only once instead of per frame.
+	bool m_importFailed;
+};
+
+
+} // unnamed namespace end
+
+
+bool isDmaBufImportSupported(QOpenGLContext *p_context)
+{
+	assert(p_context != nullptr);
+
+	EGLDisplay eglDisplay = eglGetCurrentDisplay();
+	if (eglDisplay == EGL_NO_DISPLAY)
+	{
+		qCDebug(lcQtGLVidDemo) << "Qt OpenGL context is not EGL based; DMA-BUF import not supported";
+		return false;
+	}
+
+	char const *eglExtensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	if ((eglExtensions == nullptr) || (std::strstr(eglExtensions, "EGL_EXT_image_dma_buf_import") == nullptr))
+	{
+		qCDebug(lcQtGLVidDemo) << "EGL_EXT_image_dma_buf_import not supported";
+		return false;
+	}
+
+	if (!p_context->hasExtension(QByteArray("GL_OES_EGL_image")) || !p_context->hasExtension(QByteArray("GL_OES_EGL_image_external")))
+	{
+		qCDebug(lcQtGLVidDemo) << "GL_OES_EGL_image and/or GL_OES_EGL_image_external not supported";
+		return false;
+	}
+
+	qCDebug(lcQtGLVidDemo) << "DMA-BUF import supported";
+	return true;
+}
+
+
+VideoMaterialProviderDmaBuf::VideoMaterialProviderDmaBuf(QOpenGLContext *p_glcontext, TexturePool &p_texturePool)
+	: VideoMaterialProviderGeneric(p_glcontext, p_texturePool, Settings::UploadMode::Direct)
+	, m_importFuncs(new DmaBufImportFuncs)
+{
+	m_importFuncs->m_eglDisplay = eglGetCurrentDisplay();
+	m_importFuncs->eglCreateImageKHR = reinterpret_cast < PFNEGLCREATEIMAGEKHRPROC > (eglGetProcAddress("eglCreateImageKHR"));
+	m_importFuncs->eglDestroyImageKHR = reinterpret_cast < PFNEGLDESTROYIMAGEKHRPROC > (eglGetProcAddress("eglDestroyImageKHR"));
+	m_importFuncs->glEGLImageTargetTexture2DOES = reinterpret_cast < PFNQTGLVIDDEMOEGLIMAGETARGETTEXTURE2DOESPROC > (p_glcontext->getProcAddress("glEGLImageTargetTexture2DOES"));
+}
+
+
+VideoMaterialProviderDmaBuf::~VideoMaterialProviderDmaBuf()
+{
+	delete m_importFuncs;
+}
+
+
+VideoMaterial VideoMaterialProviderDmaBuf::createVideoMaterial()
+{
+	VideoMaterial videoMaterial = VideoMaterialProviderGeneric::createVideoMaterial();
+	videoMaterial.setPrivData(VideoMaterialPrivDataUPtr(new DmaBufMaterialData(m_glcontext, *m_importFuncs)));
+	return videoMaterial;
+}
+
+
+bool VideoMaterialProviderDmaBuf::prefersDmaBufMemory() const
+{
+	return true;
+}
+
+
+bool VideoMaterialProviderDmaBuf::supportsThreadedUploads() const
+{
+	// The EGLImages are imported, and their external textures are
+	// created, bound, and deleted, through the provider's m_glcontext
+	// (the glEGLImageTargetTexture2DOES pointer was also resolved for
+	// that context). Importing in an upload thread's shared context,
+	// where m_glcontext is not current, is not supported.
+	return false;
+}
+
+
+void VideoMaterialProviderDmaBuf::bindMaterial(VideoMaterial &p_videoMaterial)
+{
+	DmaBufMaterialData *data = static_cast < DmaBufMaterialData* > (p_videoMaterial.getPrivData());
+
+	if (data->m_currentTextureId != 0)
+	{
+		m_glcontext->functions()->glActiveTexture(GL_TEXTURE0);
+		m_glcontext->functions()->glBindTexture(GL_TEXTURE_EXTERNAL_OES, data->m_currentTextureId);
+	}
+	else
+		VideoMaterialProviderGeneric::bindMaterial(p_videoMaterial);
+}
+
+
+void VideoMaterialProviderDmaBuf::unbindMaterial(VideoMaterial &p_videoMaterial)
+{
+	DmaBufMaterialData *data = static_cast < DmaBufMaterialData* > (p_videoMaterial.getPrivData());
+
+	if (data->m_currentTextureId != 0)
+	{
+		m_glcontext->functions()->glActiveTexture(GL_TEXTURE0);
+		m_glcontext->functions()->glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+	}
+	else
+		VideoMaterialProviderGeneric::unbindMaterial(p_videoMaterial);
+}
+
+
+void VideoMaterialProviderDmaBuf::uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe)
+{
+	DmaBufMaterialData *data = static_cast < DmaBufMaterialData* > (p_videoMaterial.getPrivData());
+	GstVideoInfo const &info = p_vframe.info;
+	GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&info);
+	EGLint drmFourcc = toDrmFourcc(format);
+
+	// Images that were created for a different video info
+	// cannot be used anymore, so clear the cache.
+	if (!gst_video_info_is_equal(&info, &(data->m_videoInfo)))
+	{
+		qCDebug(lcQtGLVidDemo) << "Video info changed; clearing DMA-BUF EGLImage cache";
+		data->clearImages();
+		data->m_videoInfo = info;
+		data->m_importFailed = false;
+	}
+
+	data->m_currentTextureId = 0;
+
+	// Find out if all planes are stored in DMA-BUF memory, and
+	// get their file descriptors and offsets.
+	unsigned int numPlanes = GST_VIDEO_INFO_N_PLANES(&info);
+	int planeFds[GST_VIDEO_MAX_PLANES];
+	gsize planeOffsets[GST_VIDEO_MAX_PLANES];
+	bool isDmaBuf = (drmFourcc != 0);
+
+	for (unsigned int plane = 0; isDmaBuf && (plane < numPlanes); ++plane)
+	{
+		guint memIndex, numMemories;
+		gsize skip;
+
+		if (!gst_buffer_find_memory(p_vframe.buffer, GST_VIDEO_INFO_PLANE_OFFSET(&info, plane), 1, &memIndex, &numMemories, &skip))
+		{
+			isDmaBuf = false;
+			break;
+		}
+
+		GstMemory *memory = gst_buffer_peek_memory(p_vframe.buffer, memIndex);
+		if (!gst_is_dmabuf_memory(memory))
+		{
+			isDmaBuf = false;
+			break;
+		}
+
+		planeFds[plane] = gst_dmabuf_memory_get_fd(memory);
+		planeOffsets[plane] = memory->offset + skip;
+	}
+
+	// Look up the EGLImage in the cache, and create one if necessary.
+	DmaBufImage *image = nullptr;
+	if (isDmaBuf && !data->m_importFailed)
+	{
+		struct stat fdStat;
+		ino_t inode = (fstat(planeFds[0], &fdStat) == 0) ? fdStat.st_ino : 0;
+
+		auto iter = data->m_images.find(planeFds[0]);
+		if ((iter != data->m_images.end()) && (iter->second.m_inode != inode))
+		{
+			// The file descriptor was reused for a different DMA-BUF.
+			m_glcontext->functions()->glDeleteTextures(1, &(iter->second.m_textureId));
+			m_importFuncs->eglDestroyImageKHR(m_importFuncs->m_eglDisplay, iter->second.m_eglImage);
+			data->m_images.erase(iter);
+			iter = data->m_images.end();
+		}
+
+		if (iter != data->m_images.end())
+			image = &(iter->second);
+		else
+		{
+			if (data->m_images.size() >= MaxNumCachedImages)
+			{
+				qCDebug(lcQtGLVidDemo) << "Too many cached DMA-BUF EGLImages; clearing cache";
+				data->clearImages();
+			}
+
+			std::vector < EGLint > attribs = {
+				EGL_WIDTH, EGLint(GST_VIDEO_INFO_WIDTH(&info)),
+				EGL_HEIGHT, EGLint(GST_VIDEO_INFO_HEIGHT(&info)),
+				EGL_LINUX_DRM_FOURCC_EXT, drmFourcc
+			};
+
+			static EGLint const planeAttribs[3][3] = {
+				{ EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT },
+				{ EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT },
+				{ EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT }
+			};
+
+			for (unsigned int plane = 0; plane < numPlanes; ++plane)
+			{
+				attribs.insert(attribs.end(), {
+					planeAttribs[plane][0], planeFds[plane],
+					planeAttribs[plane][1], EGLint(planeOffsets[plane]),
+					planeAttribs[plane][2], EGLint(GST_VIDEO_INFO_PLANE_STRIDE(&info, plane))
+				});
+			}
+
+			// Pass on the colorimetry, so the driver uses the
+			// correct matrix for converting YUV to RGB.
+			if (GST_VIDEO_INFO_IS_YUV(&info))
+			{
+				EGLint colorSpace;
+				switch (info.colorimetry.matrix)
+				{
+					case GST_VIDEO_COLOR_MATRIX_BT709: colorSpace = EGL_ITU_REC709_EXT; break;
+					case GST_VIDEO_COLOR_MATRIX_BT2020: colorSpace = EGL_ITU_REC2020_EXT; break;
+					default: colorSpace = EGL_ITU_REC601_EXT;
+				}
+
+				attribs.insert(attribs.end(), {
+					EGL_YUV_COLOR_SPACE_HINT_EXT, colorSpace,
+					EGL_SAMPLE_RANGE_HINT_EXT, (info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255) ? EGL_YUV_FULL_RANGE_EXT : EGL_YUV_NARROW_RANGE_EXT
+				});
+			}
+
+			attribs.push_back(EGL_NONE);
+
+			EGLImageKHR eglImage = m_importFuncs->eglCreateImageKHR(m_importFuncs->m_eglDisplay, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, &(attribs[0]));
+			if (eglImage == EGL_NO_IMAGE_KHR)
+			{
+				qCWarning(lcQtGLVidDemo) << "Could not create EGLImage out of DMA-BUF (EGL error" << eglGetError() << "); uploading frames instead";
+				data->m_importFailed = true;
+			}
+			else
+			{
+				DmaBufImage newImage;
+				newImage.m_inode = inode;
+				newImage.m_eglImage = eglImage;
+
+				QOpenGLFunctions *glfuncs = m_glcontext->functions();
+				glfuncs->glGenTextures(1, &(newImage.m_textureId));
+				glfuncs->glBindTexture(GL_TEXTURE_EXTERNAL_OES, newImage.m_textureId);
+				glfuncs->glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glfuncs->glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				// External textures only support GL_CLAMP_TO_EDGE.
+				glfuncs->glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glfuncs->glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				m_importFuncs->glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, eglImage);
+				glfuncs->glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+
+				qCDebug(lcQtGLVidDemo) << "Created EGLImage for DMA-BUF with FD" << planeFds[0];
+
+				image = &(data->m_images.emplace(planeFds[0], newImage).first->second);
+			}
+		}
+	}
+
+	if (image != nullptr)
+	{
+		// The EGLImage covers only the actual frame pixels, so there
+		// are no padding pixels to skip with the texture coordinates.
+		p_videoMaterial.setTotalSizes(GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info));
+		p_videoMaterial.setUploadRectangle(QRect());
+		data->m_currentTextureId = image->m_textureId;
+		p_videoMaterial.setShaderProgram(getShaderProgramForVariant(VideoShaderVariant::ExternalOES));
+	}
+	else
+	{
+		// Fall back to uploading the pixels.
+		p_videoMaterial.setShaderProgram(getShaderProgram(format));
+		VideoMaterialProviderGeneric::uploadGstFrame(p_videoMaterial, p_vframe);
+	}
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,93 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_DMABUF_HPP
+#define QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_DMABUF_HPP
+
+#include "VideoMaterialProviderGeneric.hpp"
+
+
+namespace qtglviddemo
+{
+
+
+struct DmaBufImportFuncs;
+
+
+/**
+ * Checks if DMA-BUF import is supported.
+ *
+ * This returns true if the EGL_EXT_image_dma_buf_import, GL_OES_EGL_image,
+ * and GL_OES_EGL_image_external extensions are supported, false otherwise.
+ *
+ * The specified OpenGL context must be current when this function is called.
+ *
+ * @param p_context OpenGL context to use for checking. Must not be null.
+ */
+bool isDmaBufImportSupported(QOpenGLContext *p_context);
+
+
+/**
+ * Video material provider subclass which imports DMA-BUF frames as EGLImages.
+ *
+ * This provider can only be used if isDmaBufImportSupported() returns true.
+ *
+ * If a frame's memory is a GstDmaBufMemory (for example because it was
+ * produced by a V4L2 capture device or a hardware decoder that exports
+ * DMA-BUFs), an EGLImage is created out of the DMA-BUF file descriptors,
+ * and bound to an external texture (GL_TEXTURE_EXTERNAL_OES). The GPU
+ * then samples directly from the DMA-BUF, so no pixels are copied by the
+ * CPU, and the driver takes care of YUV->RGB conversion. Since buffers
+ * typically come from a pool and are reused, the EGLImages are cached per
+ * DMA-BUF file descriptor. The cache is cleared when the video info changes.
+ *
+ * If a frame's memory is not a DMA-BUF, or if its format cannot be imported,
+ * the frame is uploaded the same way VideoMaterialProviderGeneric does it,
+ * with direct uploads (the PBO upload mode is not used by this provider).
+ * This decision is made per frame. Only materials with such uploaded frames
+ * can be drawn with instanced draw calls, since external textures cannot be
+ * copied into texture arrays (see getInstancedShaderProgram()).
+ *
+ * Players should configure their sources and decoders to export DMA-BUFs.
+ * See GStreamerPlayer::setPreferDmaBufMemory().
+ */
+class VideoMaterialProviderDmaBuf
+	: public VideoMaterialProviderGeneric
+{
+public:
+	explicit VideoMaterialProviderDmaBuf(QOpenGLContext *p_glcontext, TexturePool &p_texturePool);
+	~VideoMaterialProviderDmaBuf();
+
+	virtual VideoMaterial createVideoMaterial() override;
+	virtual bool prefersDmaBufMemory() const override;
+	virtual bool supportsThreadedUploads() const override;
+
+private:
+	virtual void bindMaterial(VideoMaterial &p_videoMaterial) override;
+	virtual void unbindMaterial(VideoMaterial &p_videoMaterial) override;
+	virtual void uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe) override;
+
+	DmaBufImportFuncs *m_importFuncs;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include "VideoMaterialProviderGLMemory.hpp"
+
+#include <gst/gl/gl.h>
+#if GST_GL_HAVE_PLATFORM_EGL
+#include <gst/gl/egl/gstgldisplay_egl.h>
+#include <EGL/egl.h>
+#endif
+#if GST_GL_HAVE_PLATFORM_GLX
+// Include GLX last, since the X11 headers define
+// macros that can clash with other headers.
+#include <gst/gl/x11/gstgldisplay_x11.h>
+#include <GL/glx.h>
+#endif
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+namespace qtglviddemo
+{
+
+
+namespace
+{
+
+
+// Per-material data. Contains the ID of the texture
+// of the GstGLMemory in the material's current frame.
+struct GLMemoryTexture
+	: public VideoMaterialPrivData
+{
+	GLuint m_textureId = 0;
+};
+
+
+} // unnamed namespace end
+
+
+GstGLContext* createWrappedGstGLContext(QOpenGLContext *p_glcontext)
+{
+	assert(p_glcontext != nullptr);
+	assert(QOpenGLContext::currentContext() == p_glcontext);
+
+	GstGLDisplay *display = nullptr;
+	GstGLPlatform platform = GST_GL_PLATFORM_NONE;
+	guintptr contextHandle = 0;
+
+	// Find out what platform the Qt context uses by checking what
+	// platform has a current context, and get the corresponding
+	// native display. The GstGLDisplay must use the same native
+	// display, otherwise the contexts cannot share resources.
+
+#if GST_GL_HAVE_PLATFORM_EGL
+	contextHandle = gst_gl_context_get_current_gl_context(GST_GL_PLATFORM_EGL);
+	if (contextHandle != 0)
+	{
+		platform = GST_GL_PLATFORM_EGL;
+		display = GST_GL_DISPLAY_CAST(gst_gl_display_egl_new_with_egl_display(eglGetCurrentDisplay()));
+	}
+#endif
+
+#if GST_GL_HAVE_PLATFORM_GLX
+	if (contextHandle == 0)
+	{
+		contextHandle = gst_gl_context_get_current_gl_context(GST_GL_PLATFORM_GLX);
+		if (contextHandle != 0)
+		{
+			platform = GST_GL_PLATFORM_GLX;
+			display = GST_GL_DISPLAY_CAST(gst_gl_display_x11_new_with_display(glXGetCurrentDisplay()));
+		}
+	}
+#endif
+
+	if ((contextHandle == 0) || (display == nullptr))
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not determine the platform of the Qt OpenGL context; cannot wrap it in a GstGLContext";
+		if (display != nullptr)
+			gst_object_unref(GST_OBJECT(display));
+		return nullptr;
+	}
+
+	guint glMajor, glMinor;
+	GstGLAPI glapi = gst_gl_context_get_current_gl_api(platform, &glMajor, &glMinor);
+
+	qCDebug(lcQtGLVidDemo) << "Wrapping Qt OpenGL context: platform:" << gst_gl_platform_to_string(platform) << "OpenGL API:" << gst_gl_api_to_string(glapi) << "version:" << glMajor << "." << glMinor;
+
+	GstGLContext *gstglContext = gst_gl_context_new_wrapped(display, contextHandle, platform, glapi);
+	// The wrapped context holds its own reference to the display.
+	gst_object_unref(GST_OBJECT(display));
+
+	if (gstglContext == nullptr)
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not wrap Qt OpenGL context in a GstGLContext";
+		return nullptr;
+	}
+
+	// Activate the wrapped context in this thread and let GStreamer
+	// fill in its internal information (function pointers etc.).
+	gst_gl_context_activate(gstglContext, TRUE);
+
+	GError *error = nullptr;
+	if (!gst_gl_context_fill_info(gstglContext, &error))
+	{
+		qCWarning(lcQtGLVidDemo) << "Could not fill GstGLContext info:" << error->message;
+		g_error_free(error);
+		gst_gl_context_activate(gstglContext, FALSE);
+		gst_object_unref(GST_OBJECT(gstglContext));
+		return nullptr;
+	}
+
+	return gstglContext;
+}
+
+
+VideoMaterialProviderGLMemory::VideoMaterialProviderGLMemory(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, GstGLContext *p_gstglContext)
+	: VideoMaterialProvider(p_glcontext, p_texturePool, { GST_VIDEO_FORMAT_RGBA })
+	, m_gstglContext(p_gstglContext)
+{
+	assert(m_gstglContext != nullptr);
+
+	// Set up the contexts for the player pipeline. The display context
+	// makes sure the GStreamer OpenGL elements use the same display as
+	// Qt. The application context makes these elements create their
+	// OpenGL contexts as contexts that share resources with Qt's.
+
+	GstGLDisplay *display = gst_gl_context_get_display(m_gstglContext);
+	GstContext *displayContext = gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
+	gst_context_set_gl_display(displayContext, display);
+	gst_object_unref(GST_OBJECT(display));
+
+	GstContext *appContext = gst_context_new("gst.gl.app_context", TRUE);
+	gst_structure_set(gst_context_writable_structure(appContext), "context", GST_TYPE_GL_CONTEXT, m_gstglContext, nullptr);
+
+	m_gstreamerContexts = { displayContext, appContext };
+}
+
+
+VideoMaterialProviderGLMemory::~VideoMaterialProviderGLMemory()
+{
+	gst_gl_context_activate(m_gstglContext, FALSE);
+	gst_object_unref(GST_OBJECT(m_gstglContext));
+}
+
+
+VideoMaterial VideoMaterialProviderGLMemory::createVideoMaterial()
+{
+	VideoMaterial videoMaterial = VideoMaterialProvider::createVideoMaterial();
+	videoMaterial.setPrivData(VideoMaterialPrivDataUPtr(new GLMemoryTexture));
+	return videoMaterial;
+}
+
+
+char const * VideoMaterialProviderGLMemory::getSinkCapsFeature() const
+{
+	return GST_CAPS_FEATURE_MEMORY_GL_MEMORY;
+}
+
+
+GstMapFlags VideoMaterialProviderGLMemory::getFrameMapFlags() const
+{
+	// With GST_MAP_GL, the plane data pointers of the mapped
+	// frame point to the texture IDs instead of to pixels.
+	return GstMapFlags(GST_MAP_READ | GST_MAP_GL);
+}
+
+
+void VideoMaterialProviderGLMemory::bindMaterial(VideoMaterial &p_videoMaterial)
+{
+	// Bind the GstGLMemory texture instead of the material's own one.
+	GLMemoryTexture *glmemTexture = static_cast < GLMemoryTexture* > (p_videoMaterial.getPrivData());
+	m_glcontext->functions()->glActiveTexture(GL_TEXTURE0);
+	m_glcontext->functions()->glBindTexture(GL_TEXTURE_2D, glmemTexture->m_textureId);
+}
+
+
+void VideoMaterialProviderGLMemory::uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe)
+{
+	GLMemoryTexture *glmemTexture = static_cast < GLMemoryTexture* > (p_videoMaterial.getPrivData());
+
+	GstMemory *memory = gst_buffer_peek_memory(p_vframe.buffer, 0);
+	if (!gst_is_gl_memory(memory))
+	{
+		qCWarning(lcQtGLVidDemo) << "Frame is not stored in GL memory; cannot use it";
+		glmemTexture->m_textureId = 0;
+		return;
+	}
+
+	// Make sure the GStreamer OpenGL context finished writing
+	// to the texture before the Qt context samples from it.
+	GstGLSyncMeta *syncMeta = gst_buffer_get_gl_sync_meta(p_vframe.buffer);
+	if (syncMeta != nullptr)
+		gst_gl_sync_meta_wait(syncMeta, m_gstglContext);
+
+	// There is no need to copy anything. The video material keeps
+	// a reference to the frame's GstBuffer until the next frame
+	// is set, so the texture stays valid until then.
+	glmemTexture->m_textureId = *reinterpret_cast < guint* > (GST_VIDEO_FRAME_PLANE_DATA(&p_vframe, 0));
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,105 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_GLMEMORY_HPP
+#define QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_GLMEMORY_HPP
+
+#include "VideoMaterial.hpp"
+
+
+typedef struct _GstGLContext GstGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Creates a GstGLContext that wraps the given Qt OpenGL context.
+ *
+ * This allows for sharing the Qt OpenGL context with GStreamer OpenGL
+ * elements. EGL and GLX based contexts are supported (depending on what
+ * platforms the GStreamer OpenGL library was built for).
+ *
+ * The specified OpenGL context must be current in the calling thread.
+ * The wrapped context is activated in the calling thread, so this
+ * must be called in the thread that renders with the Qt context.
+ *
+ * @param p_glcontext Qt OpenGL context to wrap. Must not be null.
+ * @return The wrapped context, or null if the context could not be
+ *         wrapped. The caller owns the returned context.
+ */
+GstGLContext* createWrappedGstGLContext(QOpenGLContext *p_glcontext);
+
+
+/**
+ * Video material provider subclass which uses frames stored in GstGLMemory.
+ *
+ * This provider shares the Qt OpenGL context with the player's pipeline,
+ * by wrapping the context in a GstGLContext (see createWrappedGstGLContext())
+ * and passing it and its GstGLDisplay on as GStreamer contexts (see
+ * getGStreamerContexts()). The pipeline uploads and converts frames with
+ * the glupload and glcolorconvert elements, which create their own OpenGL
+ * context that shares resources with the Qt one. Frames then arrive with
+ * the "memory:GLMemory" caps feature, meaning that their pixels are already
+ * in an RGBA OpenGL texture. This provider does not copy any pixels; it
+ * simply binds that texture when rendering. If the frames were decoded
+ * into GL memory, or into memory glupload can import without copying,
+ * no CPU copies are done at all.
+ *
+ * glcolorconvert attaches a GstGLSyncMeta to the frames (the player
+ * requests this through the allocation query). This provider waits on
+ * the sync point before using the texture, to make sure that the
+ * GStreamer OpenGL context has finished writing to it.
+ *
+ * This provider only depends on core OpenGL (ES) functionality, so it
+ * also works with software rasterizers such as Mesa's llvmpipe.
+ */
+class VideoMaterialProviderGLMemory
+	: public VideoMaterialProvider
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param p_glcontext Qt OpenGL context to use. Must not be null.
+	 * @param p_texturePool Texture pool for the video materials.
+	 * @param p_gstglContext Wrapped version of p_glcontext, created
+	 *        by createWrappedGstGLContext(). Must not be null. The
+	 *        provider takes ownership over this context.
+	 */
+	explicit VideoMaterialProviderGLMemory(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, GstGLContext *p_gstglContext);
+	~VideoMaterialProviderGLMemory();
+
+	virtual VideoMaterial createVideoMaterial() override;
+	virtual char const * getSinkCapsFeature() const override;
+
+private:
+	virtual GstMapFlags getFrameMapFlags() const override;
+	virtual void bindMaterial(VideoMaterial &p_videoMaterial) override;
+	virtual void uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe) override;
+
+	GstGLContext *m_gstglContext;
+};
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -17,61 +17,731 @@
  */
 
 
+#include <assert.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <QDebug>
+#include <QLoggingCategory>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include "VideoMaterialProviderGeneric.hpp"
 
 
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// These are not defined in OpenGL ES 2 headers, but
+// are available with OpenGL ES 3 and desktop OpenGL 3.
+
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+
+#ifndef GL_RG8
+#define GL_RG8 0x822B
+#endif
+
+// These are available with desktop OpenGL 3 and (as GL_R16_EXT and
+// GL_RG16_EXT) with OpenGL ES 3 and GL_EXT_texture_norm16.
+
+#ifndef GL_R16
+#define GL_R16 0x822A
+#endif
+
+#ifndef GL_RG16
+#define GL_RG16 0x822C
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+
+// These are not defined in OpenGL ES 2 headers, but are available
+// with OpenGL ES 3, desktop OpenGL, and GL_EXT_unpack_subimage.
+
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
+
+#ifndef GL_UNPACK_SKIP_PIXELS
+#define GL_UNPACK_SKIP_PIXELS 0x0CF4
+#endif
+
+
 namespace qtglviddemo
 {
 
 
-VideoMaterialProviderGeneric::VideoMaterialProviderGeneric(QOpenGLContext *p_glcontext)
-	: VideoMaterialProvider(p_glcontext, { GST_VIDEO_FORMAT_RGBx })
-	, m_videoInfoChanged(true)
+namespace
+{
+
+
+// Describes what part of a video frame is uploaded into
+// which video material texture, and how.
+struct TextureUploadDesc
+{
+	// Index of the component whose plane is uploaded into the texture.
+	// The component also defines the number of rows in the plane
+	// (relevant for subsampled chroma planes).
+	unsigned int m_component;
+	// Number of channels per texel (1, 2, or 4).
+	unsigned int m_numChannels;
+	// Number of bytes per channel (1, or 2 for formats with
+	// more than 8 bits per component).
+	unsigned int m_bytesPerChannel;
+};
+
+
+// Fills p_descs with the upload descriptions for the given format.
+// Returns the number of filled descriptions (= number of textures).
+// The order of the textures must match what the fragment shader
+// variant that corresponds to the format expects.
+unsigned int getTextureUploadDescs(GstVideoFormat const p_format, TextureUploadDesc p_descs[VideoMaterial::MaxNumTextures])
 {
+	switch (p_format)
+	{
+		case GST_VIDEO_FORMAT_I420:
+		case GST_VIDEO_FORMAT_YV12:
+			// Textures are ordered by component (Y, U, V). I420
+			// and YV12 only differ in the order of the U and V
+			// planes, which is taken care of by the format info's
+			// component->plane mapping.
+			p_descs[0] = { 0, 1, 1 };
+			p_descs[1] = { 1, 1, 1 };
+			p_descs[2] = { 2, 1, 1 };
+			return 3;
+
+		case GST_VIDEO_FORMAT_NV12:
+		case GST_VIDEO_FORMAT_NV21:
+			p_descs[0] = { 0, 1, 1 };
+			p_descs[1] = { 1, 2, 1 };
+			return 2;
+
+		// The 10-bit formats store each component in 16 bits, and
+		// are uploaded into 16-bit textures. I420_10LE has the value
+		// in the lower 10 bits, P010_10LE in the upper 10 bits. The
+		// shaders are the same as for 8 bits; the color matrix takes
+		// care of the different value ranges (see VideoMaterial).
+		case GST_VIDEO_FORMAT_I420_10LE:
+			p_descs[0] = { 0, 1, 2 };
+			p_descs[1] = { 1, 1, 2 };
+			p_descs[2] = { 2, 1, 2 };
+			return 3;
+
+		case GST_VIDEO_FORMAT_P010_10LE:
+			p_descs[0] = { 0, 1, 2 };
+			p_descs[1] = { 1, 2, 2 };
+			return 2;
+
+		case GST_VIDEO_FORMAT_YUY2:
+		case GST_VIDEO_FORMAT_UYVY:
+			p_descs[0] = { 0, 2, 1 };
+			p_descs[1] = { 0, 4, 1 };
+			return 2;
+
+		default:
+			p_descs[0] = { 0, 4, 1 };
+			return 1;
+	}
 }
 
 
-void VideoMaterialProviderGeneric::setVideoInfoChangedFlag(bool const p_flag)
+// Number of pixels to add around each side of the crop region when
+// uploading it. Without these, linear filtering at the edges of the
+// crop region would blend in pixels from the opposite side of the
+// texture (because of GL_REPEAT) instead of the actual neighbours.
+constexpr int CropRegionMargin = 2;
+
+
+// Calculates the region of the frame that needs to be uploaded to
+// display the given crop rectangle (which is in the 0-100 range).
+// The region is given in pixel coordinates of the first component.
+// It is aligned to the chroma subsampling, so that the region's
+// edges coincide with pixel edges in all planes.
+QRect calculateUploadRectangle(QRect const &p_cropRectangle, GstVideoFrame const &p_vframe)
 {
-	m_videoInfoChanged = p_flag;
+	GstVideoFormatInfo const *finfo = p_vframe.info.finfo;
+	int frameWidth = GST_VIDEO_FRAME_WIDTH(&p_vframe);
+	int frameHeight = GST_VIDEO_FRAME_HEIGHT(&p_vframe);
+
+	int alignX = 1, alignY = 1;
+	for (unsigned int comp = 0; comp < GST_VIDEO_FRAME_N_COMPONENTS(&p_vframe); ++comp)
+	{
+		alignX = std::max(alignX, 1 << GST_VIDEO_FORMAT_INFO_W_SUB(finfo, comp));
+		alignY = std::max(alignY, 1 << GST_VIDEO_FORMAT_INFO_H_SUB(finfo, comp));
+	}
+
+	// Transform the crop rectangle from the 0-100 range to pixels.
+	// Round outwards, so that partially covered pixels are included.
+	int x0 = p_cropRectangle.x() * frameWidth / 100 - CropRegionMargin;
+	int y0 = p_cropRectangle.y() * frameHeight / 100 - CropRegionMargin;
+	int x1 = ((p_cropRectangle.x() + p_cropRectangle.width()) * frameWidth + 99) / 100 + CropRegionMargin;
+	int y1 = ((p_cropRectangle.y() + p_cropRectangle.height()) * frameHeight + 99) / 100 + CropRegionMargin;
+
+	// Align the edges and clamp them to the frame boundaries.
+	// The right and bottom edges are not aligned if they are at
+	// the frame boundaries, since the frame sizes may be odd.
+	x0 = std::max(x0, 0) / alignX * alignX;
+	y0 = std::max(y0, 0) / alignY * alignY;
+	x1 = std::min((x1 + alignX - 1) / alignX * alignX, frameWidth);
+	y1 = std::min((y1 + alignY - 1) / alignY * alignY, frameHeight);
+
+	// Upload the whole frame if the crop rectangle is degenerate.
+	if ((x1 <= x0) || (y1 <= y0))
+		return QRect(0, 0, frameWidth, frameHeight);
+
+	return QRect(x0, y0, x1 - x0, y1 - y0);
 }
 
 
-void VideoMaterialProviderGeneric::uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe)
+// Ring of pixel buffer objects (PBOs) for asynchronous uploads.
+//
+// Each frame is copied into the next PBO in the ring, and the
+// glTexSubImage2D() calls then source their pixels from that PBO.
+// These calls return immediately; the GPU performs the actual
+// transfer into the texture asynchronously. Since the ring has
+// several PBOs, the CPU copy of a frame can take place while the
+// GPU is still transferring and sampling from the previous frames,
+// without the driver having to stall until they are done.
+class PixelBufferRing
+	: public VideoMaterialPrivData
+{
+public:
+	explicit PixelBufferRing(QOpenGLContext *p_glcontext)
+		: m_glcontext(p_glcontext)
+		, m_nextBuffer(0)
+	{
+		m_glcontext->functions()->glGenBuffers(NumBuffers, m_bufferIds);
+		for (auto & size : m_bufferSizes)
+			size = 0;
+	}
+
+	~PixelBufferRing()
+	{
+		// The ring may be destroyed in an upload thread.
+		QOpenGLContext::currentContext()->functions()->glDeleteBuffers(NumBuffers, m_bufferIds);
+	}
+
+	// Copies rows of the frame's planes into the next PBO in the ring and
+	// leaves that PBO bound to GL_PIXEL_UNPACK_BUFFER. Only the rows in the
+	// range specified by p_planeFirstRows and p_planeNumRows are copied.
+	// p_planeSources is filled with the offsets of the first copied row of
+	// each plane within the PBO, which are then to be passed to
+	// glTexSubImage2D() instead of pointers. Returns false if the PBO
+	// could not be mapped; nothing is bound then.
+	bool stageFrame(GstVideoFrame &p_vframe, guint const p_planeFirstRows[GST_VIDEO_MAX_PLANES], guint const p_planeNumRows[GST_VIDEO_MAX_PLANES], guint8 const * p_planeSources[GST_VIDEO_MAX_PLANES])
+	{
+		QOpenGLExtraFunctions *glextrafuncs = QOpenGLContext::currentContext()->extraFunctions();
+		unsigned int numPlanes = GST_VIDEO_FRAME_N_PLANES(&p_vframe);
+
+		// Determine the size of each plane's row range and their offsets in the PBO.
+		gsize planeSizes[GST_VIDEO_MAX_PLANES];
+		gsize planeOffsets[GST_VIDEO_MAX_PLANES];
+		gsize totalSize = 0;
+		for (unsigned int plane = 0; plane < numPlanes; ++plane)
+		{
+			planeSizes[plane] = gsize(GST_VIDEO_FRAME_PLANE_STRIDE(&p_vframe, plane)) * p_planeNumRows[plane];
+			planeOffsets[plane] = totalSize;
+			totalSize += planeSizes[plane];
+		}
+
+		GLuint bufferIndex = m_nextBuffer;
+		m_nextBuffer = (m_nextBuffer + 1) % NumBuffers;
+
+		glextrafuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_bufferIds[bufferIndex]);
+
+		// (Re)allocate the PBO storage if the frame size changed.
+		if (m_bufferSizes[bufferIndex] != totalSize)
+		{
+			glextrafuncs->glBufferData(GL_PIXEL_UNPACK_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+			m_bufferSizes[bufferIndex] = totalSize;
+		}
+
+		// Invalidate the previous contents while mapping. This tells the
+		// driver that it does not have to wait until the GPU is done with
+		// the old contents; it can hand out fresh memory instead.
+		void *mappedData = glextrafuncs->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mappedData == nullptr)
+		{
+			qCWarning(lcQtGLVidDemo) << "Could not map pixel buffer object; uploading frame directly";
+			glextrafuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return false;
+		}
+
+		for (unsigned int plane = 0; plane < numPlanes; ++plane)
+		{
+			guint8 const *planeRows = reinterpret_cast < guint8 const * > (GST_VIDEO_FRAME_PLANE_DATA(&p_vframe, plane)) + gsize(GST_VIDEO_FRAME_PLANE_STRIDE(&p_vframe, plane)) * p_planeFirstRows[plane];
+			std::memcpy(reinterpret_cast < guint8* > (mappedData) + planeOffsets[plane], planeRows, planeSizes[plane]);
+			p_planeSources[plane] = reinterpret_cast < guint8 const * > (std::uintptr_t(planeOffsets[plane]));
+		}
+
+		glextrafuncs->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		return true;
+	}
+
+	void unbind()
+	{
+		QOpenGLContext::currentContext()->functions()->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+
+private:
+	// Three buffers are enough to ensure that the buffer that is
+	// about to be filled is not in use by the GPU anymore.
+	static constexpr unsigned int NumBuffers = 3;
+
+	QOpenGLContext *m_glcontext;
+	GLuint m_bufferIds[NumBuffers];
+	gsize m_bufferSizes[NumBuffers];
+	unsigned int m_nextBuffer;
+};
+
+
+// Keeps the last frame that was uploaded from its mapped PBO alive
+// until the GPU is done transferring the pixels into the textures.
+//
+// The video material only holds a reference to its current frame.
+// Once the next frame is set, the previous frame goes back to its
+// pool, and upstream may overwrite its PBO, even though the GPU
+// might still be reading from it. The fence tells when it is safe
+// to let go of the frame.
+class InFlightPixelBuffer
+	: public VideoMaterialPrivData
 {
-	// Call glTexImage2D() if the video info changed or if this the
-	// first upload call. Otherwise, call glTexSubImage2D(); which
-	// is faster because it does not have to reallocate the texture.
+public:
+	InFlightPixelBuffer()
+		: m_buffer(nullptr)
+		, m_fence(nullptr)
+	{
+	}
 
-	if (m_videoInfoChanged)
+	~InFlightPixelBuffer()
 	{
-		m_glcontext->functions()->glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RGBA,
-			p_videoMaterial.getTotalWidth(), p_videoMaterial.getTotalHeight(),
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			p_vframe.data[0]
-		);
+		release();
+	}
 
-		m_videoInfoChanged = false;
+	// Waits until the GPU is done with the frame's PBO,
+	// then unrefs the frame.
+	void release()
+	{
+		// The material may be used by an upload thread.
+		QOpenGLExtraFunctions *glextrafuncs = QOpenGLContext::currentContext()->extraFunctions();
+
+		if (m_fence != nullptr)
+		{
+			// A whole frame has passed since the fence was inserted,
+			// so this normally does not block. The timeout is just
+			// a safeguard against broken drivers.
+			GLenum waitResult = glextrafuncs->glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, FenceTimeout);
+			if ((waitResult == GL_TIMEOUT_EXPIRED) || (waitResult == GL_WAIT_FAILED))
+				qCWarning(lcQtGLVidDemo) << "Waiting for pixel buffer transfer failed; frame pixels may be overwritten while being transferred";
+
+			glextrafuncs->glDeleteSync(m_fence);
+			m_fence = nullptr;
+		}
+
+		if (m_buffer != nullptr)
+		{
+			gst_buffer_unref(m_buffer);
+			m_buffer = nullptr;
+		}
 	}
+
+	// Holds on to the frame until the next release() call. Inserts
+	// a fence right after the commands that transfer its pixels.
+	void hold(GstBuffer *p_buffer)
+	{
+		assert(m_buffer == nullptr);
+		m_buffer = gst_buffer_ref(p_buffer);
+		m_fence = QOpenGLContext::currentContext()->extraFunctions()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+
+private:
+	// 100 ms, in nanoseconds.
+	static constexpr GLuint64 FenceTimeout = 100000000;
+
+	GstBuffer *m_buffer;
+	GLsync m_fence;
+};
+
+
+} // unnamed namespace end
+
+
+VideoMaterialProviderGeneric::VideoMaterialProviderGeneric(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, Settings::UploadMode const p_uploadMode)
+	: VideoMaterialProvider(p_glcontext, p_texturePool, {
+		GST_VIDEO_FORMAT_I420,
+		GST_VIDEO_FORMAT_YV12,
+		GST_VIDEO_FORMAT_NV12,
+		GST_VIDEO_FORMAT_NV21,
+		GST_VIDEO_FORMAT_YUY2,
+		GST_VIDEO_FORMAT_UYVY,
+		GST_VIDEO_FORMAT_RGBx,
+		GST_VIDEO_FORMAT_RGBA,
+		GST_VIDEO_FORMAT_BGRx,
+		GST_VIDEO_FORMAT_BGRA
+	})
+{
+	// GL_LUMINANCE and GL_LUMINANCE_ALPHA are not available in
+	// core profiles, so prefer GL_R8 and GL_RG8 if possible.
+	m_useRGTextures = (p_glcontext->format().majorVersion() >= 3);
+
+	// Formats with more than 8 bits per component are uploaded into
+	// 16-bit normalized textures. These are available in desktop
+	// OpenGL 3, but OpenGL ES needs GL_EXT_texture_norm16. The
+	// textures use the host byte order, so the little endian formats
+	// can only be uploaded as-is on little endian hosts. Without 16-bit
+	// textures, these formats are not listed as supported, and the
+	// player converts the frames to one of the 8-bit formats instead.
+	if (p_glcontext->isOpenGLES())
+		m_use16BitTextures = (p_glcontext->format().majorVersion() >= 3) && p_glcontext->hasExtension(QByteArray("GL_EXT_texture_norm16"));
 	else
+		m_use16BitTextures = (p_glcontext->format().majorVersion() >= 3);
+	m_use16BitTextures = m_use16BitTextures && (G_BYTE_ORDER == G_LITTLE_ENDIAN);
+
+	if (m_use16BitTextures)
+	{
+		m_formats.push_back(GST_VIDEO_FORMAT_P010_10LE);
+		m_formats.push_back(GST_VIDEO_FORMAT_I420_10LE);
+	}
+
+	// Pixel buffer objects as well as glMapBufferRange() require
+	// OpenGL ES 3 or desktop OpenGL 3.
+	m_usePixelBufferObjects = (p_uploadMode == Settings::UploadMode::PixelBufferObjects);
+
+	// Persistently mapped PBOs require OpenGL 4.4, OpenGL ES 3.1,
+	// or an extension. Fall back to the PBO ring if they are
+	// not available.
+	if (p_uploadMode == Settings::UploadMode::PersistentPixelBuffers)
+	{
+		if (MappedPixelBufferAllocator::isSupported(p_glcontext))
+			m_mappedPixelBufferAllocator = std::make_shared < MappedPixelBufferAllocator > (p_glcontext);
+		else
+		{
+			qCWarning(lcQtGLVidDemo) << "Persistently mapped pixel buffer objects are not supported; using pixel buffer object ring";
+			m_usePixelBufferObjects = true;
+		}
+	}
+
+	if (m_usePixelBufferObjects && (p_glcontext->format().majorVersion() < 3))
+	{
+		qCWarning(lcQtGLVidDemo) << "Pixel buffer object uploads require OpenGL (ES) 3.0 or newer; using direct uploads";
+		m_usePixelBufferObjects = false;
+	}
+
+	// GL_UNPACK_ROW_LENGTH and GL_UNPACK_SKIP_PIXELS make it possible to
+	// upload a subregion of a plane with one call. OpenGL ES 2 only has
+	// them if GL_EXT_unpack_subimage is supported.
+	m_useUnpackRowLength = !p_glcontext->isOpenGLES() || (p_glcontext->format().majorVersion() >= 3) || p_glcontext->hasExtension(QByteArray("GL_EXT_unpack_subimage"));
+
+	// Instanced drawing needs glDrawElementsInstanced(),
+	// glVertexAttribDivisor(), texture arrays, and GLSL ES 3.00
+	// or GLSL 3.30.
+	if (p_glcontext->isOpenGLES())
+		m_useInstancedDrawing = (p_glcontext->format().majorVersion() >= 3);
+	else
+		m_useInstancedDrawing = (p_glcontext->format().version() >= qMakePair(3, 3));
+
+	qCDebug(lcQtGLVidDemo) << "Generic video material provider upload mode:" << (m_mappedPixelBufferAllocator ? "persistently mapped pixel buffer objects" : m_usePixelBufferObjects ? "pixel buffer objects" : "direct");
+	qCDebug(lcQtGLVidDemo) << "Generic video material provider uses GL_UNPACK_ROW_LENGTH:" << m_useUnpackRowLength;
+	qCDebug(lcQtGLVidDemo) << "Generic video material provider supports 10-bit formats:" << m_use16BitTextures;
+	qCDebug(lcQtGLVidDemo) << "Generic video material provider supports instanced drawing:" << m_useInstancedDrawing;
+}
+
+
+VideoMaterialProviderGeneric::~VideoMaterialProviderGeneric()
+{
+	// Pools and their buffers may still exist at this point, and
+	// keep the allocator alive, so explicitely delete the PBOs
+	// while the OpenGL context is still there.
+	if (m_mappedPixelBufferAllocator)
+		m_mappedPixelBufferAllocator->shutdown();
+}
+
+
+VideoMaterial VideoMaterialProviderGeneric::createVideoMaterial()
+{
+	VideoMaterial videoMaterial = VideoMaterialProvider::createVideoMaterial();
+	if (m_usePixelBufferObjects)
+		videoMaterial.setPrivData(VideoMaterialPrivDataUPtr(new PixelBufferRing(m_glcontext)));
+	else if (m_mappedPixelBufferAllocator)
+		videoMaterial.setPrivData(VideoMaterialPrivDataUPtr(new InFlightPixelBuffer()));
+	return videoMaterial;
+}
+
+
+void VideoMaterialProviderGeneric::uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe)
+{
+	// This may be called by an upload thread, so use
+	// its context instead of m_glcontext.
+	QOpenGLFunctions *glfuncs = QOpenGLContext::currentContext()->functions();
+	GstVideoFormatInfo const *finfo = p_vframe.info.finfo;
+
+	TextureUploadDesc descs[VideoMaterial::MaxNumTextures];
+	unsigned int numTextures = getTextureUploadDescs(GST_VIDEO_INFO_FORMAT(&(p_vframe.info)), descs);
+
+	// Only upload the region of the frame that is visible through the
+	// crop rectangle (or the upload crop rectangle, if the material is
+	// drawn with several crop rectangles). Padding rows and columns are
+	// never uploaded. The textures are exactly as large as this region.
+	QRect uploadRectangle = calculateUploadRectangle(p_videoMaterial.getUploadCropRectangle(), p_vframe);
+	p_videoMaterial.setUploadRectangle(uploadRectangle);
+
+	int x0 = uploadRectangle.x(), x1 = uploadRectangle.x() + uploadRectangle.width();
+	int y0 = uploadRectangle.y(), y1 = uploadRectangle.y() + uploadRectangle.height();
+
+	// Determine which rows of each plane are inside the upload region.
+	guint planeFirstRows[GST_VIDEO_MAX_PLANES] = { 0 };
+	guint planeNumRows[GST_VIDEO_MAX_PLANES] = { 0 };
+	for (unsigned int comp = 0; comp < GST_VIDEO_FRAME_N_COMPONENTS(&p_vframe); ++comp)
 	{
-		m_glcontext->functions()->glTexSubImage2D(
-			GL_TEXTURE_2D,
-			0,
-			0, 0,
-			p_videoMaterial.getTotalWidth(), p_videoMaterial.getTotalHeight(),
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			p_vframe.data[0]
-		);
+		unsigned int plane = GST_VIDEO_FRAME_COMP_PLANE(&p_vframe, comp);
+		planeFirstRows[plane] = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp, y0);
+		planeNumRows[plane] = GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp, y1) - planeFirstRows[plane];
 	}
+
+	// Get the sources of the first row to upload from each plane. In
+	// direct mode, these point into the mapped frame's planes. In PBO
+	// mode, the rows are first copied into a PBO, and the sources are
+	// offsets inside the PBO. If the frame itself is in a mapped PBO,
+	// the sources are offsets inside that PBO, and nothing is copied.
+	guint8 const *planeSources[GST_VIDEO_MAX_PLANES];
+	// Subclasses may attach their own private data to materials, so
+	// only look for a PBO ring or an in-flight frame if the upload
+	// mode uses them.
+	PixelBufferRing *pixelBufferRing = m_usePixelBufferObjects ? static_cast < PixelBufferRing* > (p_videoMaterial.getPrivData()) : nullptr;
+	InFlightPixelBuffer *inFlightPixelBuffer = m_mappedPixelBufferAllocator ? static_cast < InFlightPixelBuffer* > (p_videoMaterial.getPrivData()) : nullptr;
+	MappedPixelBuffer const *mappedPixelBuffer = nullptr;
+	if (inFlightPixelBuffer != nullptr)
+	{
+		// Let go of the frame that was uploaded previously. If
+		// this is a reupload of the same frame (because the crop
+		// rectangle changed), the material still holds it.
+		inFlightPixelBuffer->release();
+
+		if (gst_buffer_n_memory(p_vframe.buffer) == 1)
+			mappedPixelBuffer = getMappedPixelBuffer(gst_buffer_peek_memory(p_vframe.buffer, 0));
+	}
+
+	if (mappedPixelBuffer != nullptr)
+	{
+		// The mapped frame's plane pointers point into the
+		// PBO's mapping, so they can be turned into offsets.
+		glfuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mappedPixelBuffer->m_bufferId);
+		for (unsigned int plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&p_vframe); ++plane)
+		{
+			gsize offset = (reinterpret_cast < guint8 const * > (GST_VIDEO_FRAME_PLANE_DATA(&p_vframe, plane)) - mappedPixelBuffer->m_mappedData) + gsize(GST_VIDEO_FRAME_PLANE_STRIDE(&p_vframe, plane)) * planeFirstRows[plane];
+			planeSources[plane] = reinterpret_cast < guint8 const * > (std::uintptr_t(offset));
+		}
+	}
+	else if ((pixelBufferRing == nullptr) || !pixelBufferRing->stageFrame(p_vframe, planeFirstRows, planeNumRows, planeSources))
+	{
+		pixelBufferRing = nullptr;
+		for (unsigned int plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&p_vframe); ++plane)
+			planeSources[plane] = reinterpret_cast < guint8 const * > (GST_VIDEO_FRAME_PLANE_DATA(&p_vframe, plane)) + gsize(GST_VIDEO_FRAME_PLANE_STRIDE(&p_vframe, plane)) * planeFirstRows[plane];
+	}
+
+	// Rows of the upload region do not necessarily
+	// start at 4-byte boundaries.
+	glfuncs->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (unsigned int i = 0; i < numTextures; ++i)
+	{
+		TextureUploadDesc const &desc = descs[i];
+
+		unsigned int plane = GST_VIDEO_FORMAT_INFO_PLANE(finfo, desc.m_component);
+		gint planeStride = GST_VIDEO_FRAME_PLANE_STRIDE(&p_vframe, plane);
+		gint pixelStride = GST_VIDEO_FRAME_COMP_PSTRIDE(&p_vframe, desc.m_component);
+
+		// Determine the byte range of the upload region within each row
+		// of the plane, and convert it to texels. With packed 4:2:2 formats,
+		// the RGBA texture has one texel per macropixel, so the end has to
+		// be rounded up in case the frame width is odd.
+		guint texelSize = desc.m_numChannels * desc.m_bytesPerChannel;
+		guint firstByte = GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, desc.m_component, x0) * pixelStride;
+		guint endByte = GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, desc.m_component, x1) * pixelStride;
+		GLint firstTexel = firstByte / texelSize;
+		GLsizei textureWidth = (endByte + texelSize - 1) / texelSize - firstTexel;
+		GLsizei textureHeight = planeNumRows[plane];
+		GLint rowLength = planeStride / texelSize;
+
+		GLint internalFormat;
+		GLenum format;
+		GLenum type = GL_UNSIGNED_BYTE;
+		if (desc.m_bytesPerChannel == 2)
+		{
+			// 16-bit textures are only used if m_use16BitTextures
+			// is true, which implies that GL_RED and GL_RG exist.
+			assert(m_use16BitTextures);
+			assert(desc.m_numChannels <= 2);
+			internalFormat = (desc.m_numChannels == 1) ? GL_R16 : GL_RG16;
+			format = (desc.m_numChannels == 1) ? GL_RED : GL_RG;
+			type = GL_UNSIGNED_SHORT;
+		}
+		else
+		{
+			switch (desc.m_numChannels)
+			{
+				case 1:
+					internalFormat = m_useRGTextures ? GL_R8 : GL_LUMINANCE;
+					format = m_useRGTextures ? GL_RED : GL_LUMINANCE;
+					break;
+				case 2:
+					internalFormat = m_useRGTextures ? GL_RG8 : GL_LUMINANCE_ALPHA;
+					format = m_useRGTextures ? GL_RG : GL_LUMINANCE_ALPHA;
+					break;
+				default:
+					assert(desc.m_numChannels == 4);
+					internalFormat = GL_RGBA;
+					format = GL_RGBA;
+			}
+		}
+
+		// Make sure the texture has the right size and format. If the
+		// video info or the upload region changed (or if this is the
+		// first upload), this swaps the texture with a suitable one
+		// from the texture pool. The pool only allocates storage if it
+		// has no such texture. Since the format is tracked per video
+		// material, other materials are unaffected by this.
+		p_videoMaterial.setTextureFormat(i, TexturePool::TextureFormat(textureWidth, textureHeight, internalFormat, format, type));
+
+		glfuncs->glBindTexture(GL_TEXTURE_2D, p_videoMaterial.getTextureId(i));
+
+		if (m_useUnpackRowLength)
+		{
+			// The row length lets OpenGL skip the rest of each row
+			// (including padding columns), and the skip pixels value
+			// lets it skip the columns left of the upload region.
+			glfuncs->glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+			glfuncs->glPixelStorei(GL_UNPACK_SKIP_PIXELS, firstTexel);
+
+			glfuncs->glTexSubImage2D(
+				GL_TEXTURE_2D,
+				0,
+				0, 0,
+				textureWidth, textureHeight,
+				format,
+				type,
+				planeSources[plane]
+			);
+		}
+		else if (textureWidth == rowLength)
+		{
+			// The upload region covers entire rows, and there are
+			// no padding columns, so the rows are contiguous and
+			// can be uploaded with one call.
+			glfuncs->glTexSubImage2D(
+				GL_TEXTURE_2D,
+				0,
+				0, 0,
+				textureWidth, textureHeight,
+				format,
+				type,
+				planeSources[plane]
+			);
+		}
+		else
+		{
+			// Without GL_UNPACK_ROW_LENGTH, the upload region's rows
+			// are not contiguous in memory, so upload them one by one.
+			for (GLsizei row = 0; row < textureHeight; ++row)
+			{
+				glfuncs->glTexSubImage2D(
+					GL_TEXTURE_2D,
+					0,
+					0, row,
+					textureWidth, 1,
+					format,
+					type,
+					planeSources[plane] + gsize(planeStride) * row + firstByte
+				);
+			}
+		}
+	}
+
+	// Give the storage of textures that this format does
+	// not use back to the pool so others can use it.
+	for (unsigned int i = numTextures; i < VideoMaterial::MaxNumTextures; ++i)
+		p_videoMaterial.setTextureFormat(i, TexturePool::TextureFormat());
+
+	if (pixelBufferRing != nullptr)
+		pixelBufferRing->unbind();
+
+	if (mappedPixelBuffer != nullptr)
+	{
+		glfuncs->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		inFlightPixelBuffer->hold(p_vframe.buffer);
+	}
+
+	// Restore the default unpack states and the texture
+	// binding that VideoMaterial::setVideoGstbuffer() expects.
+	if (m_useUnpackRowLength)
+	{
+		glfuncs->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glfuncs->glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	}
+	glfuncs->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glfuncs->glBindTexture(GL_TEXTURE_2D, p_videoMaterial.getTextureId(0));
+}
+
+
+bool VideoMaterialProviderGeneric::supportsThreadedUploads() const
+{
+	// Uploads only access the material, its private data, and the
+	// texture pool, which is thread safe. The provider's states are
+	// only read.
+	return true;
+}
+
+
+GstBufferPool* VideoMaterialProviderGeneric::createUpstreamBufferPool()
+{
+	return m_mappedPixelBufferAllocator ? m_mappedPixelBufferAllocator->createBufferPool() : nullptr;
+}
+
+
+void VideoMaterialProviderGeneric::serviceUpstreamBufferPools()
+{
+	if (m_mappedPixelBufferAllocator)
+		m_mappedPixelBufferAllocator->processRequests();
+}
+
+
+bool VideoMaterialProviderGeneric::supportsInstancedDrawing() const
+{
+	return m_useInstancedDrawing;
+}
+
+
+bool VideoMaterialProviderGeneric::uploadsCropRegionOnly() const
+{
+	return true;
+}
+
+
+bool VideoMaterialProviderGeneric::usesRGTextures() const
+{
+	return m_useRGTextures;
 }
 
 
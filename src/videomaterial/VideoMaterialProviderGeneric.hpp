@@ -20,6 +20,8 @@
 #ifndef QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_GENERIC_HPP
 #define QTGLVIDDEMO_VIDEO_MATERIAL_PROVIDER_GENERIC_HPP
 
+#include "base/Settings.hpp"
+#include "MappedPixelBufferPool.hpp"
 #include "VideoMaterial.hpp"
 
 
@@ -33,24 +35,82 @@ namespace qtglviddemo
  * This is considered a "generic" provider because all OpenGL implementations support
  * the glTexImage2D() and glTexSubImage2D() functions. So, if the implementation has
  * no specialized video frame upload functions, this can be used as a fallback.
- * However, specialized providers should always be preferred, since (a) glTexImage2D()
- * and glTexSubImage2D() only support RGB formats, forcing pixel format conversions
- * prior to uploading, and (b) they copy the video frame pixels, which requires CPU work.
+ * However, specialized providers should always be preferred, since these functions
+ * copy the video frame pixels, which requires CPU work.
  *
- * Since, as said, these functions only support RGB(A) data, the list of supported
- * formats contains only one entry, GST_VIDEO_FORMAT_RGBx .
+ * glTexImage2D() and glTexSubImage2D() do not support YUV formats. To avoid costly
+ * pixel format conversions on the CPU, each plane of a YUV frame is uploaded into
+ * its own single- or two-channel texture, and the fragment shader converts the YUV
+ * values to RGB. Packed 4:2:2 formats (YUY2, UYVY) are uploaded twice, once as a
+ * two-channel texture with one texel per pixel (for the Y values), once as an RGBA
+ * texture with one texel per macropixel (for the U and V values). On OpenGL (ES)
+ * 3.0 and newer, two-channel textures use GL_RG8, otherwise GL_LUMINANCE_ALPHA.
+ *
+ * The 10-bit formats P010_10LE and I420_10LE are uploaded the same way, but into
+ * 16-bit GL_R16 and GL_RG16 textures, so the fragment shader gets the full
+ * precision, and the CPU does not have to convert the frames to 8 bits. The
+ * different value ranges are accounted for in the color matrix. 16-bit textures
+ * require desktop OpenGL 3.0, or OpenGL ES 3.0 with GL_EXT_texture_norm16. If
+ * these are not available, the 10-bit formats are not listed as supported, so
+ * the player converts such frames to an 8-bit format.
+ *
+ * With the Settings::UploadMode::PixelBufferObjects upload mode, each video material
+ * gets a ring of pixel buffer objects. Frames are copied into the next PBO in the
+ * ring, and the texture upload is then sourced from that PBO, allowing the GPU to
+ * transfer the pixels asynchronously instead of stalling the render thread. This
+ * mode requires OpenGL (ES) 3.0; with older versions, direct uploads are used.
+ *
+ * With the Settings::UploadMode::PersistentPixelBuffers upload mode, the provider
+ * creates buffer pools backed by persistently mapped PBOs (see
+ * MappedPixelBufferAllocator), which players propose to upstream elements. Frames
+ * from these pools are already in a PBO, so they are not copied by the CPU at
+ * all; glTexSubImage2D() sources the pixels from the frame's PBO directly. Each
+ * video material keeps its last such frame alive until a fence signals that the
+ * GPU is done with the transfer. Frames that are not in such a PBO (for example,
+ * because upstream did not use the pool) are uploaded directly. If persistent
+ * mapping is not supported, the PBO ring is used instead (or direct uploads with
+ * OpenGL (ES) 2).
+ *
+ * Only the region of the frame that is visible through the material's crop rectangle
+ * is uploaded (plus a small margin for texture filtering), and padding rows/columns
+ * are skipped. Rows are uploaded with GL_UNPACK_ROW_LENGTH and GL_UNPACK_SKIP_PIXELS
+ * if available. On OpenGL ES 2 without GL_EXT_unpack_subimage, subregions are
+ * uploaded row by row instead.
+ *
+ * Texture storage is taken from the video material's texture pool. The size and
+ * format of each texture is tracked per video material, so a format change in one
+ * stream only swaps the textures of that stream's material.
+ *
+ * Since the textures are regular 2D textures owned by the materials, materials of
+ * this provider can be drawn with instanced draw calls on OpenGL ES 3.0 and desktop
+ * OpenGL 3.3 (see supportsInstancedDrawing()).
  */
 class VideoMaterialProviderGeneric
 	: public VideoMaterialProvider
 {
 public:
-	explicit VideoMaterialProviderGeneric(QOpenGLContext *p_glcontext);
+	explicit VideoMaterialProviderGeneric(QOpenGLContext *p_glcontext, TexturePool &p_texturePool, Settings::UploadMode const p_uploadMode = Settings::UploadMode::Direct);
+	~VideoMaterialProviderGeneric();
 
-private:
-	virtual void setVideoInfoChangedFlag(bool const p_flag) override;
+	virtual VideoMaterial createVideoMaterial() override;
+	virtual bool supportsThreadedUploads() const override;
+	virtual GstBufferPool* createUpstreamBufferPool() override;
+	virtual void serviceUpstreamBufferPools() override;
+	virtual bool supportsInstancedDrawing() const override;
+
+protected:
 	virtual void uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe) override;
+	virtual bool uploadsCropRegionOnly() const override;
+	virtual bool usesRGTextures() const override;
 
-	bool m_videoInfoChanged;
+private:
+	bool m_useRGTextures;
+	bool m_use16BitTextures;
+	bool m_usePixelBufferObjects;
+	bool m_useUnpackRowLength;
+	bool m_useInstancedDrawing;
+	// Only set in the PersistentPixelBuffers upload mode.
+	MappedPixelBufferAllocatorSPtr m_mappedPixelBufferAllocator;
 };
 
 
@@ -55,8 +55,8 @@ GLenum toVivPixelFormat(GstVideoFormat p_gstformat)
 } // unnamed namespace end
 
 
-VideoMaterialProviderVivante::VideoMaterialProviderVivante(QOpenGLContext *p_glcontext)
-	: VideoMaterialProvider(p_glcontext, {
+VideoMaterialProviderVivante::VideoMaterialProviderVivante(QOpenGLContext *p_glcontext, TexturePool &p_texturePool)
+	: VideoMaterialProvider(p_glcontext, p_texturePool, {
 		GST_VIDEO_FORMAT_I420,
 		GST_VIDEO_FORMAT_YV12,
 		GST_VIDEO_FORMAT_NV12,
@@ -103,4 +103,12 @@ void VideoMaterialProviderVivante::uploadGstFrame(VideoMaterial &p_videoMaterial
 }
 
 
+VideoShaderVariant VideoMaterialProviderVivante::getShaderVariant(GstVideoFormat const) const
+{
+	// Direct textures convert YUV to RGB (and BGR to RGB) transparently,
+	// so the texels are always fetched as RGBA in the shader.
+	return VideoShaderVariant::RGBA;
+}
+
+
 } // namespace qtglviddemo end
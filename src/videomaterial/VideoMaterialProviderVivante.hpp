@@ -54,10 +54,11 @@ class VideoMaterialProviderVivante
 	: public VideoMaterialProvider
 {
 public:
-	explicit VideoMaterialProviderVivante(QOpenGLContext *p_glcontext);
+	explicit VideoMaterialProviderVivante(QOpenGLContext *p_glcontext, TexturePool &p_texturePool);
 
 private:
 	virtual void uploadGstFrame(VideoMaterial &p_videoMaterial, GstVideoFrame &p_vframe) override;
+	virtual VideoShaderVariant getShaderVariant(GstVideoFormat const p_format) const override;
 
 	VivDirectTextureFuncs *m_vivFuncs;
 };
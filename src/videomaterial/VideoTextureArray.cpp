@@ -0,0 +1,227 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <assert.h>
+#include <algorithm>
+#include <iterator>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions>
+#include "VideoTextureArray.hpp"
+
+
+Q_DECLARE_LOGGING_CATEGORY(lcQtGLVidDemo)
+
+
+// These are not defined in OpenGL ES 2 headers, but
+// are available with OpenGL ES 3 and desktop OpenGL 3.
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+
+#ifndef GL_READ_FRAMEBUFFER_BINDING
+#define GL_READ_FRAMEBUFFER_BINDING 0x8CAA
+#endif
+
+
+namespace qtglviddemo
+{
+
+
+VideoTextureArray::VideoTextureArray(QOpenGLContext *p_glcontext)
+	: m_glcontext(p_glcontext)
+	, m_textureIds{0, 0, 0}
+	, m_numTextures(0)
+	, m_numLayers(0)
+	, m_framebuffer(0)
+{
+	assert(m_glcontext != nullptr);
+}
+
+
+VideoTextureArray::~VideoTextureArray()
+{
+	release();
+
+	if (m_framebuffer != 0)
+		m_glcontext->functions()->glDeleteFramebuffers(1, &m_framebuffer);
+}
+
+
+bool VideoTextureArray::areCompatible(VideoMaterial &p_first, VideoMaterial &p_second)
+{
+	VideoShaderProgram &shaderProgram = p_first.getShaderProgram();
+	if (&shaderProgram != &(p_second.getShaderProgram()))
+		return false;
+
+	for (unsigned int i = 0; i < shaderProgram.getNumTextures(); ++i)
+	{
+		TexturePool::TextureFormat const &format = p_first.getTextureFormat(i);
+		if ((format.m_internalFormat == 0) || (format != p_second.getTextureFormat(i)))
+			return false;
+	}
+
+	return (p_first.getColorMatrix() == p_second.getColorMatrix()) && (p_first.getColorOffset() == p_second.getColorOffset());
+}
+
+
+void VideoTextureArray::setup(VideoMaterial &p_videoMaterial, unsigned int const p_numLayers)
+{
+	assert(p_numLayers >= 1);
+
+	unsigned int numTextures = p_videoMaterial.getShaderProgram().getNumTextures();
+
+	bool formatsMatch = (numTextures == m_numTextures) && (p_numLayers == m_numLayers);
+	for (unsigned int i = 0; formatsMatch && (i < numTextures); ++i)
+		formatsMatch = (m_textureFormats[i] == p_videoMaterial.getTextureFormat(i));
+	if (formatsMatch)
+		return;
+
+	release();
+
+	QOpenGLFunctions *glfuncs = m_glcontext->functions();
+	QOpenGLExtraFunctions *glextrafuncs = m_glcontext->extraFunctions();
+
+	glfuncs->glActiveTexture(GL_TEXTURE0);
+
+	for (unsigned int i = 0; i < numTextures; ++i)
+	{
+		TexturePool::TextureFormat const &format = p_videoMaterial.getTextureFormat(i);
+
+		glfuncs->glGenTextures(1, &(m_textureIds[i]));
+		glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureIds[i]);
+
+		// Use the same filter and wrap modes as the pool textures
+		// the material textures come from (see TexturePool).
+		glfuncs->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glfuncs->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glfuncs->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glfuncs->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		glextrafuncs->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format.m_internalFormat, format.m_width, format.m_height, p_numLayers, 0, format.m_format, format.m_type, nullptr);
+
+		m_textureFormats[i] = format;
+	}
+
+	glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	m_numTextures = numTextures;
+	m_numLayers = p_numLayers;
+	m_layerContentSerials.assign(p_numLayers, 0);
+
+	qCDebug(lcQtGLVidDemo).nospace() << "Allocated " << numTextures << " texture array(s) with " << p_numLayers << " " << m_textureFormats[0].m_width << "x" << m_textureFormats[0].m_height << " layer(s)";
+}
+
+
+bool VideoTextureArray::copyIntoLayer(VideoMaterial &p_videoMaterial, unsigned int const p_layer)
+{
+	assert(p_layer < m_numLayers);
+
+	guint64 contentSerial = p_videoMaterial.getContentSerial();
+	if ((contentSerial != 0) && (m_layerContentSerials[p_layer] == contentSerial))
+		return true;
+
+	QOpenGLFunctions *glfuncs = m_glcontext->functions();
+	QOpenGLExtraFunctions *glextrafuncs = m_glcontext->extraFunctions();
+
+	if (m_framebuffer == 0)
+		glfuncs->glGenFramebuffers(1, &m_framebuffer);
+
+	// Only the read framebuffer binding is changed, so the
+	// current render target stays bound for drawing.
+	GLint previousReadFramebuffer;
+	glfuncs->glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousReadFramebuffer);
+	glfuncs->glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glfuncs->glActiveTexture(GL_TEXTURE0);
+
+	bool copied = true;
+
+	for (unsigned int i = 0; i < m_numTextures; ++i)
+	{
+		TexturePool::TextureFormat const &format = m_textureFormats[i];
+
+		glfuncs->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, p_videoMaterial.getTextureId(i), 0);
+		if (glfuncs->glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			qCDebug(lcQtGLVidDemo) << "Cannot copy textures with internal format" << format.m_internalFormat << "into texture array";
+			copied = false;
+			break;
+		}
+
+		glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureIds[i]);
+		glextrafuncs->glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, p_layer, 0, 0, format.m_width, format.m_height);
+	}
+
+	// Detach the material texture, since it belongs to the texture
+	// pool, and may be given to another material or be deleted.
+	glfuncs->glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+	glfuncs->glBindFramebuffer(GL_READ_FRAMEBUFFER, GLuint(previousReadFramebuffer));
+	glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	m_layerContentSerials[p_layer] = copied ? contentSerial : 0;
+
+	return copied;
+}
+
+
+void VideoTextureArray::bind()
+{
+	// Bind in reverse order, to end up with
+	// texture unit #0 being active.
+	QOpenGLFunctions *glfuncs = m_glcontext->functions();
+	for (unsigned int i = m_numTextures; i > 0; --i)
+	{
+		glfuncs->glActiveTexture(GL_TEXTURE0 + i - 1);
+		glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureIds[i - 1]);
+	}
+}
+
+
+void VideoTextureArray::unbind()
+{
+	QOpenGLFunctions *glfuncs = m_glcontext->functions();
+	for (unsigned int i = m_numTextures; i > 0; --i)
+	{
+		glfuncs->glActiveTexture(GL_TEXTURE0 + i - 1);
+		glfuncs->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+}
+
+
+void VideoTextureArray::release()
+{
+	if (m_numTextures > 0)
+		m_glcontext->functions()->glDeleteTextures(m_numTextures, m_textureIds);
+
+	std::fill(std::begin(m_textureIds), std::end(m_textureIds), 0);
+	std::fill(std::begin(m_textureFormats), std::end(m_textureFormats), TexturePool::TextureFormat());
+	m_numTextures = 0;
+	m_numLayers = 0;
+	m_layerContentSerials.clear();
+}
+
+
+} // namespace qtglviddemo end
@@ -0,0 +1,152 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef QTGLVIDDEMO_VIDEO_TEXTURE_ARRAY_HPP
+#define QTGLVIDDEMO_VIDEO_TEXTURE_ARRAY_HPP
+
+#include <memory>
+#include <vector>
+#include <qopengl.h>
+#include "TexturePool.hpp"
+#include "VideoMaterial.hpp"
+
+
+class QOpenGLContext;
+
+
+namespace qtglviddemo
+{
+
+
+/**
+ * Texture arrays holding copies of the textures of several video materials.
+ *
+ * An instanced draw call can only sample from the textures that are bound
+ * while it is issued, so materials with their own textures cannot be drawn
+ * together with one such call. This class copies the textures of several
+ * materials into the layers of GL_TEXTURE_2D_ARRAY textures (one array per
+ * plane, one layer per material), which the instanced shader programs of
+ * the video material provider then sample from (see
+ * VideoMaterialProvider::getInstancedShaderProgram()).
+ *
+ * The copies are made on the GPU with glCopyTexSubImage3D(), reading from a
+ * framebuffer object the material textures are attached to. Each layer
+ * remembers the content serial of the material that was copied into it,
+ * so unchanged frames are not copied again.
+ *
+ * All materials in an array must be compatible (see areCompatible()); in
+ * particular, their textures must have the same sizes and formats. Texture
+ * arrays require OpenGL ES 3.0 or OpenGL 3.0. All functions must be called
+ * with the OpenGL context that was passed to the constructor being current.
+ */
+class VideoTextureArray
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * This does not allocate any textures yet; see setup().
+	 *
+	 * @param p_glcontext Qt OpenGL context object pointer. Must not be null.
+	 */
+	explicit VideoTextureArray(QOpenGLContext *p_glcontext);
+	/**
+	 * Destructor.
+	 *
+	 * Deletes the texture arrays and the framebuffer object.
+	 */
+	~VideoTextureArray();
+
+	/**
+	 * Returns true if the two video materials can be drawn together out
+	 * of one texture array with one instanced draw call.
+	 *
+	 * This is the case if they use the same shader program, if their
+	 * textures have storage and the same sizes and formats, and if they
+	 * use the same YUV->RGB conversion coefficients (these are passed to
+	 * the shader through uniforms that all instances share).
+	 */
+	static bool areCompatible(VideoMaterial &p_first, VideoMaterial &p_second);
+
+	/**
+	 * Allocates the texture arrays for the textures of the given material.
+	 *
+	 * If the arrays already have the sizes and formats of the material's
+	 * textures, and the given number of layers, this does nothing.
+	 * Otherwise, they are reallocated, and their contents are undefined.
+	 *
+	 * @param p_videoMaterial Material whose texture formats to use.
+	 * @param p_numLayers Number of layers to allocate. Must be at least 1.
+	 */
+	void setup(VideoMaterial &p_videoMaterial, unsigned int const p_numLayers);
+	/**
+	 * Copies the textures of a video material into one of the layers.
+	 *
+	 * If the layer already contains a copy of the material's current
+	 * texture contents, nothing is copied. The material must be compatible
+	 * with the one that was passed to setup().
+	 *
+	 * @param p_videoMaterial Material whose textures to copy.
+	 * @param p_layer Layer to copy the textures into.
+	 * @return true if the layer contains a copy of the textures,
+	 *         false if the copy failed (for example because the
+	 *         texture format cannot be attached to a framebuffer).
+	 */
+	bool copyIntoLayer(VideoMaterial &p_videoMaterial, unsigned int const p_layer);
+
+	/**
+	 * Binds texture array #N to texture unit #N.
+	 *
+	 * Texture unit #0 is active afterwards.
+	 */
+	void bind();
+	/// Undoes the bind() call.
+	void unbind();
+
+	/// VideoTextureArray is neither copyable nor movable.
+	VideoTextureArray(VideoTextureArray const &) = delete;
+	VideoTextureArray& operator = (VideoTextureArray const &) = delete;
+
+
+private:
+	void release();
+
+	QOpenGLContext *m_glcontext;
+
+	GLuint m_textureIds[VideoMaterial::MaxNumTextures];
+	TexturePool::TextureFormat m_textureFormats[VideoMaterial::MaxNumTextures];
+	unsigned int m_numTextures;
+	unsigned int m_numLayers;
+
+	// Framebuffer the material textures are attached to for copying.
+	GLuint m_framebuffer;
+
+	// Content serials of the materials that were copied into the
+	// layers (see VideoMaterial::getContentSerial()). 0 means that
+	// the layer contents are undefined.
+	std::vector < guint64 > m_layerContentSerials;
+};
+
+typedef std::unique_ptr < VideoTextureArray > VideoTextureArrayUPtr;
+
+
+} // namespace qtglviddemo end
+
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * Qt5 OpenGL video demo application
+ * Copyright (C) 2018 Carlos Rafael Giani < dv AT pseudoterminal DOT org >
+ *
+ * qtglviddemo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "base/TripleBuffer.hpp"
+
+
+/*
+ * Stress test for the TripleBuffer class.
+ *
+ * A synthetic producer thread publishes frames at 240 fps, and a slower
+ * consumer thread takes them at 60 fps, like the appsink streaming thread
+ * and the render thread do with the video renderer's sample triple buffer.
+ * The payloads are handled the same way GStreamerVideoRenderer handles
+ * samples: The producer releases payloads that were replaced before the
+ * consumer took them, and the consumer releases the payloads it took.
+ *
+ * The test checks that consumed values only ever increase, that no value
+ * is torn or consumed twice, that the newest value is always consumed in
+ * the end, and that every payload is released exactly once.
+ */
+
+
+namespace
+{
+
+
+typedef std::chrono::steady_clock Clock;
+
+unsigned int const ProducerFrameRate = 240;
+unsigned int const ConsumerFrameRate = 60;
+unsigned int const TestDurationInSeconds = 3;
+std::uint64_t const NumFrames = ProducerFrameRate * TestDurationInSeconds;
+
+
+// Stand-in for a GstSample. The payloads are allocated up front
+// and never freed during the test, so that their reference counts
+// can still be checked after they were released.
+struct Payload
+{
+	Payload()
+		: m_refcount(0)
+		, m_numTimesConsumed(0)
+	{
+	}
+
+	std::atomic < int > m_refcount;
+	std::atomic < int > m_numTimesConsumed;
+};
+
+
+struct Slot
+{
+	Slot()
+		: m_payload(nullptr)
+		, m_value(0)
+		, m_checkValue(0)
+	{
+	}
+
+	Payload *m_payload;
+	// These are written with plain stores by the producer. m_checkValue
+	// is always the inverse of m_value, so if the consumer sees a slot
+	// that is only partially written, the two do not match.
+	std::uint64_t m_value;
+	std::uint64_t m_checkValue;
+};
+
+
+struct TestState
+{
+	TestState()
+		: m_payloads(NumFrames)
+		, m_producerFinished(false)
+		, m_numFailures(0)
+		, m_numDropped(0)
+		, m_numConsumed(0)
+		, m_lastConsumedValue(0)
+	{
+	}
+
+	qtglviddemo::TripleBuffer < Slot > m_buffer;
+	std::vector < Payload > m_payloads;
+	std::atomic < bool > m_producerFinished;
+	std::atomic < unsigned int > m_numFailures;
+	// Only accessed by the producer while the test runs.
+	std::uint64_t m_numDropped;
+	// Only accessed by the consumer while the test runs.
+	std::uint64_t m_numConsumed;
+	std::uint64_t m_lastConsumedValue;
+};
+
+
+void check(TestState &p_state, bool const p_condition, char const *p_description)
+{
+	if (p_condition)
+		return;
+
+	std::cerr << "FAILED: " << p_description << std::endl;
+	++(p_state.m_numFailures);
+}
+
+
+void releasePayload(TestState &p_state, Payload *p_payload)
+{
+	int previousRefcount = p_payload->m_refcount.fetch_sub(1);
+	check(p_state, previousRefcount == 1, "payload was released more than once");
+}
+
+
+void runProducer(TestState &p_state)
+{
+	Clock::duration const frameDuration = std::chrono::duration_cast < Clock::duration > (std::chrono::seconds(1)) / ProducerFrameRate;
+	Clock::time_point nextFrameTime = Clock::now();
+
+	for (std::uint64_t value = 1; value <= NumFrames; ++value)
+	{
+		Payload *payload = &(p_state.m_payloads[value - 1]);
+		payload->m_refcount = 1;
+
+		// Payloads in the back slot are released right after publishing,
+		// and the consumer clears the slots it took the payload from,
+		// so the back slot must always be empty here.
+		Slot &backSlot = p_state.m_buffer.getBackSlot();
+		check(p_state, backSlot.m_payload == nullptr, "back slot still holds a payload");
+		backSlot.m_payload = payload;
+		backSlot.m_value = value;
+		backSlot.m_checkValue = ~value;
+
+		if (p_state.m_buffer.publish())
+		{
+			Slot &droppedSlot = p_state.m_buffer.getBackSlot();
+			check(p_state, droppedSlot.m_payload != nullptr, "replaced slot holds no payload");
+			if (droppedSlot.m_payload != nullptr)
+			{
+				releasePayload(p_state, droppedSlot.m_payload);
+				droppedSlot.m_payload = nullptr;
+				++(p_state.m_numDropped);
+			}
+		}
+
+		nextFrameTime += frameDuration;
+		std::this_thread::sleep_until(nextFrameTime);
+	}
+
+	p_state.m_producerFinished = true;
+}
+
+
+void consumeValue(TestState &p_state)
+{
+	if (!p_state.m_buffer.consume())
+		return;
+
+	Slot &frontSlot = p_state.m_buffer.getFrontSlot();
+	std::uint64_t value = frontSlot.m_value;
+
+	check(p_state, frontSlot.m_checkValue == ~value, "consumed a torn value");
+	check(p_state, value > p_state.m_lastConsumedValue, "consumed values do not increase");
+	check(p_state, (value >= 1) && (value <= NumFrames) && (frontSlot.m_payload == &(p_state.m_payloads[value - 1])), "consumed value does not match its payload");
+
+	if (frontSlot.m_payload != nullptr)
+	{
+		check(p_state, frontSlot.m_payload->m_numTimesConsumed.fetch_add(1) == 0, "payload was consumed more than once");
+		releasePayload(p_state, frontSlot.m_payload);
+		frontSlot.m_payload = nullptr;
+	}
+
+	p_state.m_lastConsumedValue = value;
+	++(p_state.m_numConsumed);
+}
+
+
+void runConsumer(TestState &p_state)
+{
+	Clock::duration const frameDuration = std::chrono::duration_cast < Clock::duration > (std::chrono::seconds(1)) / ConsumerFrameRate;
+
+	while (!p_state.m_producerFinished)
+	{
+		consumeValue(p_state);
+		std::this_thread::sleep_for(frameDuration);
+	}
+
+	// Pick up the value that was published last.
+	consumeValue(p_state);
+}
+
+
+} // unnamed namespace end
+
+
+int main()
+{
+	TestState state;
+
+	std::thread consumerThread(runConsumer, std::ref(state));
+	std::thread producerThread(runProducer, std::ref(state));
+	producerThread.join();
+	consumerThread.join();
+
+	check(state, state.m_lastConsumedValue == NumFrames, "the newest value was not consumed");
+	check(state, (state.m_numConsumed + state.m_numDropped) == NumFrames, "values went missing");
+	check(state, state.m_numDropped > 0, "no values were replaced, so the consumer was not slower than the producer");
+	check(state, !state.m_buffer.consume(), "a value was published after the last one");
+
+	std::uint64_t numLeaked = 0;
+	for (Payload const &payload : state.m_payloads)
+	{
+		if (payload.m_refcount != 0)
+			++numLeaked;
+	}
+	check(state, numLeaked == 0, "payloads were not released");
+
+	std::cout << "produced " << NumFrames << " values at " << ProducerFrameRate << " fps, consumed " << state.m_numConsumed << " at " << ConsumerFrameRate << " fps, " << state.m_numDropped << " were replaced" << std::endl;
+
+	if (state.m_numFailures != 0)
+	{
+		std::cerr << state.m_numFailures << " check(s) failed" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
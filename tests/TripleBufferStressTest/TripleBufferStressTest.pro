@@ -0,0 +1,16 @@
+# Standalone stress test for src/base/TripleBuffer.hpp. It does not
+# depend on Qt or GStreamer. Build and run it with:
+#
+#   qmake tests/TripleBufferStressTest && make check
+
+TEMPLATE = app
+CONFIG += console c++11 thread testcase
+CONFIG -= qt app_bundle
+
+TARGET = TripleBufferStressTest
+
+SOURCES += TripleBufferStressTest.cpp
+
+INCLUDEPATH += ../../src
+
+QMAKE_CXXFLAGS += -Wextra -Wall -std=c++11 -pedantic